@@ -0,0 +1,148 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/**
+ * Microbenchmark for CircularBuffer<float>
+ *
+ * - ns/op: single thread enqueue followed by dequeue of one batch
+ * - transfer: producer and consumer threads moving a fixed number of
+ *   elements through the ring, pinned to different cores when possible
+ */
+
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "circular_buffer.hh"
+
+namespace {
+
+constexpr std::size_t RING_CAPACITY = 16384U;
+constexpr std::size_t TRANSFER_ELEMENTS = std::size_t(1) << 26;
+
+using Clock = std::chrono::steady_clock;
+
+void pin_to_cpu([[maybe_unused]] unsigned int cpu) {
+#if defined(__linux__)
+  auto n_cpu = std::thread::hardware_concurrency();
+  if (n_cpu > 1) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu % n_cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  }
+#endif
+}
+
+double bench_ns_per_op(std::size_t batch) {
+  CircularBuffer<float> ring(RING_CAPACITY);
+  std::vector<float> src(batch, 1.0F);
+  std::vector<float> dst(batch, 0.0F);
+  const std::size_t iterations = (TRANSFER_ELEMENTS / batch) / 4U;
+
+  auto begin = Clock::now();
+  for (std::size_t i = 0; i < iterations; ++i) {
+    ring.enqueue(src.data(), batch);
+    ring.dequeue(dst.data(), batch);
+  }
+  auto end = Clock::now();
+
+  // Keep the compiler from discarding the copies
+  volatile float sink = dst[batch - 1];
+  static_cast<void>(sink);
+
+  auto ns = std::chrono::duration<double, std::nano>(end - begin).count();
+  return ns / static_cast<double>(iterations * 2U);
+}
+
+double bench_transfer(std::size_t batch) {
+  CircularBuffer<float> ring(RING_CAPACITY);
+  std::atomic<bool> go{false};
+
+  std::thread producer([&]() {
+    pin_to_cpu(1);
+    std::vector<float> src(batch, 1.0F);
+    std::size_t sent = 0;
+
+    while (!go.load(std::memory_order_acquire)) {
+    }
+
+    while (sent < TRANSFER_ELEMENTS) {
+      auto n = std::min(batch, TRANSFER_ELEMENTS - sent);
+      auto written = ring.enqueue(src.data(), n);
+      sent += written;
+
+      // Don't starve the consumer when both threads share a core
+      if (written == 0) {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  pin_to_cpu(0);
+  std::vector<float> dst(batch, 0.0F);
+  std::size_t received = 0;
+
+  auto begin = Clock::now();
+  go.store(true, std::memory_order_release);
+  while (received < TRANSFER_ELEMENTS) {
+    auto read = ring.dequeue(dst.data(), batch);
+    received += read;
+
+    if (read == 0) {
+      std::this_thread::yield();
+    }
+  }
+  auto end = Clock::now();
+  producer.join();
+
+  auto sec = std::chrono::duration<double>(end - begin).count();
+  return static_cast<double>(TRANSFER_ELEMENTS) / sec;
+}
+
+}  // namespace
+
+int main() {
+  std::cout << "CircularBuffer<float> capacity " << RING_CAPACITY
+            << ", cores " << std::thread::hardware_concurrency() << "\n"
+            << std::setw(8) << "batch" << std::setw(14) << "ns/op"
+            << std::setw(14) << "ns/elem" << std::setw(16) << "Melem/s"
+            << std::setw(14) << "MB/s" << "\n";
+
+  for (std::size_t batch = 64U; batch <= 4096U; batch *= 2U) {
+    auto ns_op = bench_ns_per_op(batch);
+    auto rate = bench_transfer(batch);
+
+    std::cout << std::fixed << std::setprecision(2) << std::setw(8) << batch
+              << std::setw(14) << ns_op << std::setw(14)
+              << ns_op / static_cast<double>(batch) << std::setw(16)
+              << rate / 1e6 << std::setw(14)
+              << rate * sizeof(float) / 1e6 << "\n";
+  }
+
+  return EXIT_SUCCESS;
+}
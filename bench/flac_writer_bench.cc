@@ -0,0 +1,240 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/**
+ * Throughput of the parallel FLAC writer against the number of workers
+ *
+ * Writes the same multichannel capture, as pcm16 and as pcm24, with 1, 2
+ * and 4 worker threads, then doubling up to the number of cores. Reports
+ * how many times faster than real time each run was and its speedup over
+ * one worker. Runs with more workers than cores are marked, they can only
+ * show the cost of the extra threads.
+ *
+ * Every file is read back through libsndfile and checked to hold the
+ * written samples bit for bit. The capture is long enough for the seek
+ * table to be thinned out, and ends in a partial FLAC frame. A few seeks
+ * check that the seek table leads to the right samples.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "flac_file_writer.hh"
+#include "sndfile.hh"
+
+namespace {
+
+constexpr int CHANNELS = 8;
+constexpr int SAMPLE_RATE = 48000;
+constexpr std::size_t BATCH_FRAMES = 2048U;
+
+//! 60 s and a bit, the last FLAC frame is a partial one
+constexpr std::size_t CAPTURE_FRAMES = 60U * SAMPLE_RATE + 1000U;
+
+static_assert(CAPTURE_FRAMES % FlacFileWriter::BLOCK_SIZE != 0U);
+static_assert(CAPTURE_FRAMES > FlacFileWriter::SEEK_POINTS *
+                                   FlacFileWriter::BLOCK_SIZE);
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * @brief Quiet noise plus a tone per channel, left justified 24-bit
+ */
+std::vector<int> make_capture(std::size_t frames) {
+  std::vector<int> pcm(frames * CHANNELS);
+  std::mt19937 rng{1};
+  std::normal_distribution<double> noise{0.0, 0.001};
+
+  for (std::size_t i = 0; i < frames; ++i) {
+    for (int c = 0; c < CHANNELS; ++c) {
+      auto w = 0.002 * static_cast<double>(c + 1);
+      auto v = 0.25 * std::sin(w * static_cast<double>(i)) + noise(rng);
+      pcm[i * CHANNELS + c] = static_cast<int>(std::lrint(v * 8388607.0)) *
+                              256;
+    }
+  }
+
+  return pcm;
+}
+
+/**
+ * @brief Write the capture with a number of workers
+ * @return double Speed in multiples of real time
+ */
+double bench(std::vector<int> const &pcm, int subformat,
+             unsigned int threads, std::filesystem::path const &path) {
+  WriterConfig config{};
+  config.sync.mode = SyncPolicy::Mode::NONE;
+  config.encoder_threads = threads;
+
+  auto frames = pcm.size() / CHANNELS;
+  auto begin = Clock::now();
+
+  {
+    FlacFileWriter file{path.string(), SF_FORMAT_FLAC | subformat, CHANNELS,
+                        SAMPLE_RATE, config};
+
+    for (std::size_t pos = 0; pos < frames; pos += BATCH_FRAMES) {
+      auto n = std::min(BATCH_FRAMES, frames - pos);
+      file.writef(pcm.data() + pos * CHANNELS, static_cast<sf_count_t>(n));
+    }
+
+    file.close();
+  }
+
+  auto seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+  return static_cast<double>(frames) / SAMPLE_RATE / seconds;
+}
+
+/**
+ * @brief Compare frames read from a file with the capture
+ * @param pcm Capture, left justified 24-bit
+ * @param shift Bits the file drops at the bottom of each sample
+ * @param pos First frame to compare
+ * @param got Frames read from the file, left justified
+ * @return bool True if every sample matches
+ */
+bool same_samples(std::vector<int> const &pcm, unsigned int shift,
+                  std::size_t pos, std::vector<int> const &got) {
+  auto const *expected = pcm.data() + pos * CHANNELS;
+
+  for (std::size_t i = 0; i < got.size(); ++i) {
+    if (got[i] != (expected[i] >> shift) * (1 << shift)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/**
+ * @brief Read a file back through libsndfile and check it against the
+ *  capture
+ * @return std::string Empty if the file holds the capture, what is wrong
+ *  otherwise
+ */
+std::string verify(std::vector<int> const &pcm, int subformat,
+                   std::filesystem::path const &path) {
+  auto file = SndfileHandle(path.string(), SFM_READ);
+  auto frames = pcm.size() / CHANNELS;
+  auto shift = (subformat == SF_FORMAT_PCM_24) ? 8U : 16U;
+
+  if (file.error() != SF_ERR_NO_ERROR) {
+    return std::string{"can not open: "} + file.strError();
+  }
+
+  if ((file.channels() != CHANNELS) ||
+      (file.frames() != static_cast<sf_count_t>(frames))) {
+    return "read " + std::to_string(file.channels()) + " channel(s) of " +
+           std::to_string(file.frames()) + " frame(s), wrote " +
+           std::to_string(CHANNELS) + " of " + std::to_string(frames);
+  }
+
+  std::vector<int> got(BATCH_FRAMES * CHANNELS);
+
+  for (std::size_t pos = 0; pos < frames; pos += BATCH_FRAMES) {
+    auto n = std::min(BATCH_FRAMES, frames - pos);
+    got.resize(n * CHANNELS);
+
+    if ((file.readf(got.data(), static_cast<sf_count_t>(n)) !=
+         static_cast<sf_count_t>(n)) ||
+        !same_samples(pcm, shift, pos, got)) {
+      return "samples differ from frame " + std::to_string(pos);
+    }
+  }
+
+  // Seeks go through the seek table, including into the partial frame
+  std::mt19937 rng{2};
+  std::uniform_int_distribution<std::size_t> any_frame{0, frames - 1U};
+
+  for (int i = 0; i < 32; ++i) {
+    auto pos = (i == 0) ? frames - 1U : any_frame(rng);
+    auto n = std::min(BATCH_FRAMES, frames - pos);
+    got.resize(n * CHANNELS);
+
+    if ((file.seek(static_cast<sf_count_t>(pos), SEEK_SET) !=
+         static_cast<sf_count_t>(pos)) ||
+        (file.readf(got.data(), static_cast<sf_count_t>(n)) !=
+         static_cast<sf_count_t>(n)) ||
+        !same_samples(pcm, shift, pos, got)) {
+      return "seek to frame " + std::to_string(pos) + " failed";
+    }
+  }
+
+  return {};
+}
+
+}  // namespace
+
+int main() {
+  auto path = std::filesystem::temp_directory_path() / "flac_bench.flac";
+  auto pcm = make_capture(CAPTURE_FRAMES);
+  auto cores = std::max(std::thread::hardware_concurrency(), 1U);
+
+  // Always cover 1, 2 and 4 workers, so scaling shows on small machines
+  auto max_threads = std::max(cores, 4U);
+  auto result = EXIT_SUCCESS;
+
+  std::cout << CHANNELS << " channel(s), " << SAMPLE_RATE << " Hz, "
+            << CAPTURE_FRAMES << " frame(s), " << cores << " core(s)\n";
+
+  for (auto [name, subformat] : {std::pair{"pcm16", SF_FORMAT_PCM_16},
+                                 std::pair{"pcm24", SF_FORMAT_PCM_24}}) {
+    std::cout << name << "\n"
+              << std::setw(10) << "threads" << std::setw(14) << "x realtime"
+              << std::setw(10) << "speedup" << "\n";
+
+    double single = 0.0;
+
+    for (unsigned int threads = 1; threads <= max_threads; threads *= 2U) {
+      auto speed = bench(pcm, subformat, threads, path);
+
+      if (threads == 1U) {
+        single = speed;
+      }
+
+      std::cout << std::setw(10) << threads << std::fixed
+                << std::setprecision(1) << std::setw(14) << speed
+                << std::setprecision(2) << std::setw(10) << (speed / single)
+                << ((threads > cores) ? "  (more threads than cores)" : "")
+                << "\n";
+
+      auto error = verify(pcm, subformat, path);
+      if (!error.empty()) {
+        std::cerr << name << ", " << threads << " thread(s): " << error
+                  << std::endl;
+        result = EXIT_FAILURE;
+      }
+    }
+  }
+
+  std::filesystem::remove(path);
+  return result;
+}
@@ -0,0 +1,131 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/**
+ * Microbenchmark for the float to integer quantizer
+ *
+ * Compares quantize() with and without dither against a scalar reference
+ * modelled on libsndfile's float to int conversion, which scales, clips
+ * and rounds one sample at a time with lrintf().
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "sample_convert.hh"
+
+namespace {
+
+constexpr std::size_t BLOCK_SAMPLES = 4096U;
+constexpr std::size_t TOTAL_SAMPLES = std::size_t(1) << 26;
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * @brief Scalar float to int conversion, as done by libsndfile
+ */
+template <typename IntType, int Bits>
+void reference_convert(std::span<float const> in, std::span<IntType> out) {
+  constexpr int shift = int(sizeof(IntType) * 8) - Bits;
+  constexpr double scale = double(std::uint64_t(1) << (Bits - 1));
+
+  for (std::size_t i = 0; i < in.size(); ++i) {
+    auto v = static_cast<double>(in[i]) * scale;
+
+    if (v >= (scale - 1.0)) {
+      v = scale - 1.0;
+    } else if (v <= -scale) {
+      v = -scale;
+    }
+
+    auto q = static_cast<std::int32_t>(std::lrint(v));
+    out[i] = static_cast<IntType>(static_cast<std::uint32_t>(q) << shift);
+  }
+}
+
+/**
+ * @brief Time a converter over TOTAL_SAMPLES samples
+ * @return double Nanoseconds per sample
+ */
+template <typename IntType, typename Convert>
+double bench(Convert convert) {
+  std::vector<float> src(BLOCK_SAMPLES);
+  std::vector<IntType> dst(BLOCK_SAMPLES);
+
+  for (std::size_t i = 0; i < src.size(); ++i) {
+    src[i] = 0.9F * std::sin(0.01F * static_cast<float>(i));
+  }
+
+  const std::size_t iterations = TOTAL_SAMPLES / BLOCK_SAMPLES;
+
+  auto begin = Clock::now();
+  for (std::size_t i = 0; i < iterations; ++i) {
+    convert(std::span<float const>(src), std::span<IntType>(dst));
+  }
+  auto end = Clock::now();
+
+  // Keep the compiler from discarding the conversion
+  volatile IntType sink = dst[BLOCK_SAMPLES - 1];
+  static_cast<void>(sink);
+
+  auto ns = std::chrono::duration<double, std::nano>(end - begin).count();
+  return ns / static_cast<double>(TOTAL_SAMPLES);
+}
+
+void print_row(std::string const &name, double ns) {
+  std::cout << std::setw(24) << name << std::fixed << std::setprecision(3)
+            << std::setw(12) << ns << std::setw(14) << std::setprecision(1)
+            << 1e3 / ns << "\n";
+}
+
+template <typename IntType, int Bits>
+void bench_format(std::string const &name) {
+  TpdfDither dither{};
+
+  print_row(name + " reference", bench<IntType>([](auto in, auto out) {
+              reference_convert<IntType, Bits>(in, out);
+            }));
+  print_row(name + " quantize", bench<IntType>([](auto in, auto out) {
+              quantize<IntType, Bits>(in, out, nullptr);
+            }));
+  print_row(name + " quantize+tpdf", bench<IntType>([&](auto in, auto out) {
+              quantize<IntType, Bits>(in, out, &dither);
+            }));
+}
+
+}  // namespace
+
+int main() {
+  std::cout << "Block " << BLOCK_SAMPLES << " samples\n"
+            << std::setw(24) << "converter" << std::setw(12) << "ns/sample"
+            << std::setw(14) << "Msample/s" << "\n";
+
+  bench_format<short, 16>("pcm16");
+  bench_format<int, 24>("pcm24");
+  bench_format<int, 32>("pcm32");
+
+  return EXIT_SUCCESS;
+}
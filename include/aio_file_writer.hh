@@ -0,0 +1,150 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef RTUTIL_AIO_FILE_WRITER_HH_
+#define RTUTIL_AIO_FILE_WRITER_HH_
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <aio.h>
+#endif
+
+#include "audio_file_writer.hh"
+
+/**
+ * @brief RAW and WAV writer keeping several large buffers in flight with
+ *  POSIX AIO
+ *
+ * Samples are encoded into aligned buffers, and a full buffer is queued
+ * with aio_write() while the next one fills, so the recorder only waits
+ * on the disk when every buffer is in flight. With O_DIRECT every write
+ * is a multiple of ALIGNMENT at an aligned offset; WAV files then get a
+ * JUNK chunk that pushes the sample data to ALIGNMENT. The WAV header
+ * is written with unknown sizes up front and patched on close.
+ */
+class AioFileWriter : public AudioFileWriter {
+ public:
+  // Divisible by every sample size (1, 2, 3, 4 and 8) and by ALIGNMENT
+  static constexpr std::size_t BUFFER_BYTES = std::size_t(3) << 19U;
+  static constexpr std::size_t BUFFER_COUNT = 4U;
+  static constexpr std::size_t ALIGNMENT = 4096U;
+
+  /**
+   * @brief Create a file
+   * @throw std::runtime_error if the file can not be created
+   * @param filename Path of the file
+   * @param format libsndfile major format and subformat, see supports()
+   * @param channels Number of channels
+   * @param samplerate Sample rate
+   * @param config Writer configuration
+   */
+  AioFileWriter(std::string const &filename, int format, int channels,
+                int samplerate, WriterConfig const &config);
+
+  ~AioFileWriter() override;
+
+  /**
+   * @brief Check whether a format can be written by this backend
+   * @param format libsndfile major format and subformat
+   * @return true for little endian RAW or WAV, with 16, 24 or 32-bit
+   *  integer, float or double samples
+   */
+  static bool supports(int format);
+
+  sf_count_t writef(short const *ptr, sf_count_t frames) override;
+  sf_count_t writef(int const *ptr, sf_count_t frames) override;
+  sf_count_t writef(float const *ptr, sf_count_t frames) override;
+  sf_count_t writef(double const *ptr, sf_count_t frames) override;
+  bool flush() override;
+  bool close() override;
+
+ private:
+#if defined(__linux__)
+  struct Buffer {
+    unsigned char *data{nullptr};
+    std::size_t used{};
+    bool in_flight{false};
+    aiocb cb{};
+  };
+
+  template <typename SampleType>
+  sf_count_t write_frames(SampleType const *ptr, sf_count_t frames);
+
+  /**
+   * @brief Copy encoded bytes into the buffers, queueing full ones
+   * @return false on error
+   */
+  bool put_bytes(unsigned char const *src, std::size_t size);
+
+  /**
+   * @brief Queue the first size bytes of the current buffer, and carry
+   *  the rest over to the next buffer
+   * @return false on error
+   */
+  bool submit_current(std::size_t size);
+
+  /**
+   * @brief Wait for a buffer to be written
+   * @return false on error
+   */
+  bool wait(Buffer &buffer);
+
+  /**
+   * @brief Write the WAV header
+   * @param data_bytes Size of the sample data, or unknown if empty
+   * @return false on error
+   */
+  bool write_header(std::optional<std::uint64_t> data_bytes);
+
+  /**
+   * @brief Close the file without finishing it, and free the buffers
+   */
+  void release();
+
+  /**
+   * @brief Report an error once, and remember that the writer failed
+   * @return false
+   */
+  bool fail(char const *what);
+
+ private:
+  int fd_{-1};
+  bool direct_io_{false};
+  bool is_wav_{false};
+  int subformat_{};
+  std::size_t sample_bytes_{};
+  std::size_t header_bytes_{};
+  std::uint64_t write_offset_{};
+  std::uint64_t data_bytes_{};
+  std::array<Buffer, BUFFER_COUNT> buffers_{};
+  std::size_t current_{};
+  std::vector<unsigned char> staging_{};
+  aiocb sync_cb_{};
+  bool sync_in_flight_{false};
+  SyncSchedule schedule_;
+  bool failed_{false};
+  bool closed_{false};
+#endif
+};
+
+#endif /* RTUTIL_AIO_FILE_WRITER_HH_ */
@@ -0,0 +1,66 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef RTUTIL_AUDIO_DEVICE_HH_
+#define RTUTIL_AUDIO_DEVICE_HH_
+
+#include <cstdint>
+#include <string>
+
+#include "RtAudio.h"
+
+/**
+ * @brief Print the audio APIs compiled into RtAudio
+ */
+void list_audio_api();
+
+/**
+ * @brief Print the devices of an audio API
+ * @param api Audio API
+ */
+void list_audio_device(RtAudio::Api api);
+
+/**
+ * @brief Format an RtAudio sample format mask
+ * @param mask Mask of RtAudioFormat flags
+ * @return std::string Comma separated format names
+ */
+std::string rt_sample_formats_str(std::uint32_t mask);
+
+/**
+ * @brief Pick the device sample rate closest to the requested one
+ * @param info Device info
+ * @param rate Requested sample rate
+ * @return unsigned int rate itself if supported, or if the device does
+ *  not report its rates, otherwise the nearest supported rate
+ */
+unsigned int nearest_sample_rate(RtAudio::DeviceInfo const &info,
+                                 unsigned int rate);
+
+/**
+ * @brief Get the sample rate the device prefers to run at
+ * @param info Device info
+ * @param rate Rate to fall back on when the device has no preference
+ * @return unsigned int Preferred rate, or the supported rate nearest to
+ *  rate
+ */
+unsigned int preferred_sample_rate(RtAudio::DeviceInfo const &info,
+                                   unsigned int rate);
+
+#endif /* RTUTIL_AUDIO_DEVICE_HH_ */
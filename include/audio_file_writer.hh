@@ -0,0 +1,193 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef RTUTIL_AUDIO_FILE_WRITER_HH_
+#define RTUTIL_AUDIO_FILE_WRITER_HH_
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "sndfile.hh"
+#include "sync_policy.hh"
+
+/**
+ * @brief Backend used to write recorded files
+ */
+enum class WriterBackend {
+  SNDFILE,  //!< libsndfile, any format
+  AIO,      //!< POSIX AIO with large aligned buffers, RAW and WAV only
+  FLAC,     //!< FLAC encoded on a pool of worker threads
+};
+
+/**
+ * @brief Parse a writer backend name
+ * @param name One of "sndfile", "aio" or "flac"
+ * @return std::optional<WriterBackend> Backend, empty if unknown
+ */
+std::optional<WriterBackend> parse_writer_backend(std::string_view name);
+
+/**
+ * @brief File writer configuration
+ */
+struct WriterConfig {
+  WriterBackend backend{WriterBackend::SNDFILE};  //!< Preferred backend
+  bool direct_io{false};  //!< Bypass the page cache with O_DIRECT
+  SyncPolicy sync{};      //!< When to flush to stable storage
+
+  //! Depth of the encoder queue for compressed formats, 0 to encode on
+  //! the file IO thread
+  unsigned int encoder_queue_ms{2000};
+
+  //! libsndfile compression level from 0 to 1, negative for the default
+  double compression{-1.0};
+
+  //! Worker threads of the flac writer, 0 for one per core
+  unsigned int encoder_threads{0};
+};
+
+/**
+ * @brief Sink for recorded frames
+ *
+ * Mirrors the part of SndfileHandle used by the recorder, so that the
+ * recorder does not care which backend does the writing.
+ */
+class AudioFileWriter {
+ public:
+  AudioFileWriter(int format, int channels, int samplerate)
+      : format_(format), channels_(channels), samplerate_(samplerate) {}
+
+  AudioFileWriter(AudioFileWriter const &) = delete;
+  AudioFileWriter &operator=(AudioFileWriter const &) = delete;
+
+  virtual ~AudioFileWriter() = default;
+
+  int format() const { return format_; }
+  int channels() const { return channels_; }
+  int samplerate() const { return samplerate_; }
+
+  /**
+   * @brief Write interleaved frames
+   * @return sf_count_t Frames written, less than frames on error
+   */
+  virtual sf_count_t writef(short const *ptr, sf_count_t frames) = 0;
+  virtual sf_count_t writef(int const *ptr, sf_count_t frames) = 0;
+  virtual sf_count_t writef(float const *ptr, sf_count_t frames) = 0;
+  virtual sf_count_t writef(double const *ptr, sf_count_t frames) = 0;
+
+  /**
+   * @brief Called after every batch of writes, syncs to stable storage
+   *  when the sync policy says so
+   * @return false on error
+   */
+  virtual bool flush() = 0;
+
+  /**
+   * @brief Finish the file, writing out anything still buffered
+   * @return false on error
+   */
+  virtual bool close() = 0;
+
+  /**
+   * @brief Get a short backend status for the status line
+   * @return std::string Status text, empty if there is nothing to report
+   */
+  virtual std::string status_str() const { return {}; }
+
+  /**
+   * @brief Print backend statistics once the file is closed
+   */
+  virtual void print_summary() const {}
+
+ private:
+  int format_{};
+  int channels_{};
+  int samplerate_{};
+};
+
+/**
+ * @brief Writer backed by libsndfile
+ */
+class SndfileWriter : public AudioFileWriter {
+ public:
+  /**
+   * @brief Create a file
+   * @throw std::runtime_error if libsndfile can not create the file
+   * @param filename Path of the file
+   * @param format libsndfile major format and subformat
+   * @param channels Number of channels
+   * @param samplerate Sample rate
+   * @param config Writer configuration
+   */
+  SndfileWriter(std::string const &filename, int format, int channels,
+                int samplerate, WriterConfig const &config);
+
+  ~SndfileWriter() override { SndfileWriter::close(); }
+
+  sf_count_t writef(short const *ptr, sf_count_t frames) override;
+  sf_count_t writef(int const *ptr, sf_count_t frames) override;
+  sf_count_t writef(float const *ptr, sf_count_t frames) override;
+  sf_count_t writef(double const *ptr, sf_count_t frames) override;
+  bool flush() override;
+  bool close() override;
+
+ private:
+  template <typename SampleType>
+  sf_count_t write_frames(SampleType const *ptr, sf_count_t frames);
+
+ private:
+  SndfileHandle file_{};
+  SyncSchedule schedule_;
+  bool closed_{false};
+};
+
+/**
+ * @brief Check whether a format is compressed, and so expensive to encode
+ * @param format libsndfile major format and subformat
+ * @return true for FLAC and Ogg
+ */
+bool is_compressed_format(int format);
+
+/**
+ * @brief Get the major format of a file from its extension
+ * @param filename Path of the file
+ * @return int libsndfile major format, SF_FORMAT_RAW if the extension is
+ *  not known, or SF_FORMAT_WAV for stdout or a named pipe
+ */
+int file_format_from_name(std::string const &filename);
+
+/**
+ * @brief Create a writer for a file, falling back to libsndfile when the
+ *  preferred backend does not support the format. Compressed formats are
+ *  encoded on a dedicated thread unless config.encoder_queue_ms is 0, and
+ *  "-" or a named pipe is streamed by a PipeWriter
+ * @throw std::runtime_error if the file can not be created
+ * @param filename Path of the file
+ * @param format libsndfile major format and subformat
+ * @param channels Number of channels
+ * @param samplerate Sample rate
+ * @param config Writer configuration
+ * @return std::unique_ptr<AudioFileWriter> Writer
+ */
+std::unique_ptr<AudioFileWriter> make_audio_file_writer(
+    std::string const &filename, int format, int channels, int samplerate,
+    WriterConfig const &config);
+
+#endif /* RTUTIL_AUDIO_FILE_WRITER_HH_ */
@@ -0,0 +1,112 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef RTUTIL_AUDIO_STREAM_HH_
+#define RTUTIL_AUDIO_STREAM_HH_
+
+#include <memory>
+#include <string>
+
+#include "RtAudio.h"
+
+struct StreamConfig;
+
+/**
+ * @brief Audio device stream, the part of RtAudio that playback and
+ *  recording use, so that they can run on a device that is not RtAudio's
+ *
+ * Devices are described and the stream opened with RtAudio's own types,
+ * and the callback follows RtAudio's contract: returning 1 stops the
+ * stream after the buffers have played out, 2 stops it right away.
+ */
+class AudioStream {
+ public:
+  virtual ~AudioStream() = default;
+
+  /**
+   * @brief Get the name of the backend, for display
+   */
+  virtual std::string api_name() = 0;
+
+  virtual unsigned int default_output_device() = 0;
+  virtual unsigned int default_input_device() = 0;
+  virtual RtAudio::DeviceInfo device_info(unsigned int device) = 0;
+
+  /**
+   * @brief Open the stream, see RtAudio::openStream()
+   * @throw std::exception if the stream can not be opened
+   */
+  virtual void open(RtAudio::StreamParameters *output,
+                    RtAudio::StreamParameters *input, RtAudioFormat format,
+                    unsigned int sample_rate, unsigned int *frames,
+                    RtAudioCallback callback, void *user_data,
+                    RtAudio::StreamOptions *options) = 0;
+
+  virtual void start() = 0;
+
+  /**
+   * @brief Stop and close the stream, the callback is not called again
+   */
+  virtual void close() = 0;
+
+  /**
+   * @brief Get the latency of the open stream in frames, as reported
+   */
+  virtual long latency() = 0;
+};
+
+/**
+ * @brief Stream on an RtAudio device
+ */
+class RtAudioStream : public AudioStream {
+ public:
+  /**
+   * @brief Construct a new RtAudio stream
+   * @param api RtAudio API, UNSPECIFIED for the default
+   */
+  explicit RtAudioStream(RtAudio::Api api) : rt_audio_(api) {}
+
+  std::string api_name() override;
+  unsigned int default_output_device() override;
+  unsigned int default_input_device() override;
+  RtAudio::DeviceInfo device_info(unsigned int device) override;
+  void open(RtAudio::StreamParameters *output,
+            RtAudio::StreamParameters *input, RtAudioFormat format,
+            unsigned int sample_rate, unsigned int *frames,
+            RtAudioCallback callback, void *user_data,
+            RtAudio::StreamOptions *options) override;
+  void start() override;
+  void close() override;
+  long latency() override;
+
+ private:
+  RtAudio rt_audio_;
+};
+
+/**
+ * @brief Create the stream selected by the configuration, the virtual
+ *  device when it is enabled, RtAudio otherwise
+ * @param api_id RtAudio API, less than zero for the default
+ * @param config Stream configuration
+ * @return std::unique_ptr<AudioStream> Stream, not open yet
+ */
+std::unique_ptr<AudioStream> make_audio_stream(int api_id,
+                                               StreamConfig const &config);
+
+#endif /* RTUTIL_AUDIO_STREAM_HH_ */
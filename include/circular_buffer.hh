@@ -20,12 +20,16 @@
 #ifndef RTUTIL_LOCKFREE_CIRCULARBUFFER_HH_
 #define RTUTIL_LOCKFREE_CIRCULARBUFFER_HH_
 
+#include <algorithm>
 #include <atomic>
 #include <bit>
 #include <cassert>
 #include <limits>
+#include <span>
 #include <vector>
 
+#include "ring_storage.hh"
+
 #ifdef _MSC_VER
 #include <intrin.h>
 #endif
@@ -57,8 +61,37 @@ constexpr std::size_t next_pow2(std::size_t z) {
 }
 
 /**
- * @brief An implementation of a naiive lock-free single producer
- *  and single consumer circular buffer
+ * @brief Region of ring storage, split in two when it wraps around
+ * @tparam DataType Data type of the circular buffer element
+ */
+template <typename DataType>
+struct RingSegments {
+  std::span<DataType> first{};   //!< Segment starting at the head
+  std::span<DataType> second{};  //!< Wrapped segment at the storage start
+
+  /**
+   * @brief Get total number of elements in both segments
+   * @return std::size_t Number of elements
+   */
+  std::size_t size() const { return first.size() + second.size(); }
+};
+
+/**
+ * @brief Assumed size of a cache line, used to keep the producer and
+ *  consumer state from sharing a line
+ */
+constexpr std::size_t CACHE_LINE_SIZE = 64U;
+
+/**
+ * @brief An implementation of a lock-free single producer and single
+ *  consumer circular buffer
+ *
+ * The read and write heads are free running counters, and only get masked
+ * when indexing into the storage. Each head lives on its own cache line
+ * together with the owner's cached copy of the peer's head, so the peer
+ * index is only reloaded when the ring appears full (producer) or empty
+ * (consumer).
+ *
  * @tparam DataType Data type of the circular buffer element
  */
 template <typename DataType>
@@ -73,8 +106,7 @@ class CircularBuffer {
    * @brief Construct a new circular buffer object
    * @param capacity Capacity of circular buffer
    */
-  CircularBuffer(std::size_t capacity)
-      : buffer_(next_pow2(capacity)), read_head_{0}, write_head_{0} {}
+  CircularBuffer(std::size_t capacity) : buffer_(next_pow2(capacity)) {}
 
   /**
    * @brief Get circular buffer capacity
@@ -83,19 +115,39 @@ class CircularBuffer {
   std::size_t capacity() const { return buffer_.size(); }
 
   /**
-   * @brief Resize circular buffer
+   * @brief Check whether every region of the ring is one contiguous span
+   * @return true when the storage is mirrored in virtual memory, in
+   *  which case RingSegments::second is always empty
+   */
+  bool is_contiguous() const { return buffer_.is_mirrored(); }
+
+  /**
+   * @brief Resize circular buffer, this discards any queued data
    * @note This method is not thread safe
    * @param new_size New circular buffer size
    */
-  void resize(std::size_t new_size) { buffer_.resize(next_pow2(new_size)); }
+  void resize(std::size_t new_size) {
+    buffer_.allocate(next_pow2(new_size));
+    write_head_.store(0, std::memory_order_relaxed);
+    read_head_.store(0, std::memory_order_relaxed);
+    read_head_cache_ = 0;
+    write_head_cache_ = 0;
+  }
+
+  /**
+   * @brief Fault in the ring storage ahead of real-time use
+   * @note This method is not thread safe
+   */
+  void prefault() { buffer_.prefault(); }
 
   /**
    * @brief Get the read space available
    * @return std::size_t Number of elements available
    */
   std::size_t get_read_available() const {
-    return compute_read_available(read_head_.load(), write_head_.load(),
-                                  capacity());
+    auto read_head = read_head_.load(std::memory_order_acquire);
+    auto write_head = write_head_.load(std::memory_order_acquire);
+    return write_head - read_head;
   }
 
   /**
@@ -103,132 +155,140 @@ class CircularBuffer {
    * @return std::size_t Number of elements available
    */
   std::size_t get_write_available() const {
-    return compute_write_available(read_head_.load(), write_head_.load(),
-                                   capacity());
+    return capacity() - get_read_available();
+  }
+
+  /**
+   * @brief Get a view of up to size elements ready to be read, the view
+   *  stays valid until consume() is called
+   * @note Must only be called from the consumer thread
+   * @param size Elements requested
+   * @return RingSegments<DataType> Readable region of the ring
+   */
+  RingSegments<DataType> peek_read(std::size_t size) noexcept {
+    auto read_head = read_head_.load(std::memory_order_relaxed);
+    auto read_available = write_head_cache_ - read_head;
+
+    // Only touch the producer's cache line when the ring looks short
+    if (read_available < size) {
+      write_head_cache_ = write_head_.load(std::memory_order_acquire);
+      read_available = write_head_cache_ - read_head;
+    }
+
+    return make_segments(read_head, std::min(size, read_available));
+  }
+
+  /**
+   * @brief Release elements previously returned by peek_read()
+   * @note Must only be called from the consumer thread
+   * @param size Number of elements consumed
+   */
+  void consume(std::size_t size) noexcept {
+    auto read_head = read_head_.load(std::memory_order_relaxed);
+    read_head_.store(read_head + size, std::memory_order_release);
+  }
+
+  /**
+   * @brief Get a view of up to size elements of free space, the view is
+   *  published to the consumer by commit_write()
+   * @note Must only be called from the producer thread
+   * @param size Elements requested
+   * @return RingSegments<DataType> Writable region of the ring
+   */
+  RingSegments<DataType> prepare_write(std::size_t size) noexcept {
+    auto write_head = write_head_.load(std::memory_order_relaxed);
+    auto write_available = capacity() - (write_head - read_head_cache_);
+
+    // Only touch the consumer's cache line when the ring looks full
+    if (write_available < size) {
+      read_head_cache_ = read_head_.load(std::memory_order_acquire);
+      write_available = capacity() - (write_head - read_head_cache_);
+    }
+
+    return make_segments(write_head, std::min(size, write_available));
+  }
+
+  /**
+   * @brief Publish elements previously returned by prepare_write()
+   * @note Must only be called from the producer thread
+   * @param size Number of elements written
+   */
+  void commit_write(std::size_t size) noexcept {
+    auto write_head = write_head_.load(std::memory_order_relaxed);
+    write_head_.store(write_head + size, std::memory_order_release);
   }
 
   /**
    * @brief Read from the circular buffer
+   * @note Must only be called from the consumer thread
    * @param[out] dst Pointer to the destination buffer
    * @param size Elements requested
    * @return std::size_t Number of elements read
    */
   std::size_t dequeue(DataType *dst, std::size_t size) noexcept {
-    auto read_start = read_head_.load();
-    auto write_start = write_head_.load();
-    auto ring_size = capacity();
-    auto ring_mask = ring_size - 1;
-
-    auto read_available =
-        compute_read_available(read_start, write_start, ring_size);
-    auto read_size = std::min(size, read_available);
-    auto read_end = read_start + read_size;
-
-    // Compute the segment sizes
-    auto cnt_hi = ring_size - read_start;
-    auto cnt_lo = read_end & ring_mask;
-    auto buf_begin = buffer_.begin();
-    auto buf_end = buffer_.end();
-
-    if (read_end > ring_size) {
-      std::copy(buf_begin + read_start, buf_end, dst);  // Copy high segment
-      std::copy(buf_begin, buf_begin + cnt_lo,
-                dst + cnt_hi);  // Copy low segment
-    } else {
-      auto start = buf_begin + read_start;
-      auto stop = start + read_size;
-      std::copy(start, stop, dst);
-    }
-
-    // Store the updated read offset
-    auto read_head = cnt_lo;
-    read_head_.store(read_head);
-    return read_size;
+    auto segments = peek_read(size);
+    auto dst_end = std::copy(segments.first.begin(), segments.first.end(),
+                             dst);  // Copy high segment
+    std::copy(segments.second.begin(), segments.second.end(),
+              dst_end);  // Copy low segment
+    consume(segments.size());
+    return segments.size();
   }
 
   /**
    * @brief Write to the circular buffer
+   * @note Must only be called from the producer thread
    * @param[in] src Pointer to the source buffer
    * @param size Elements need to be written
    * @return std::size_t Number of elements written
    */
   std::size_t enqueue(DataType const *src, std::size_t size) noexcept {
-    auto read_start = read_head_.load();
-    auto write_start = write_head_.load();
-    auto ring_size = capacity();
-    auto ring_mask = ring_size - 1;
-
-    auto write_available =
-        compute_write_available(read_start, write_start, ring_size);
-    auto write_size = std::min(size, write_available);
-    auto write_end = write_start + write_size;
-
-    // Compute the segment sizes
-    auto cnt_hi = ring_size - write_start;
-    auto cnt_lo = write_end & ring_mask;
-    auto buf_begin = buffer_.begin();
-
-    if (write_end > ring_size) {
-      std::copy(src, src + cnt_hi,
-                buf_begin + write_start);  // Copy high segment
-      std::copy(src + cnt_hi, src + write_size,
-                buf_begin);  // Copy low segment
-    } else {
-      std::copy(src, src + write_size, buf_begin + write_start);
-    }
-
-    // Store the updated write offset
-    auto write_head = cnt_lo;
-    write_head_.store(write_head);
-    return write_size;
+    auto segments = prepare_write(size);
+    auto src_mid = src + segments.first.size();
+    std::copy(src, src_mid, segments.first.begin());  // Copy high segment
+    std::copy(src_mid, src + segments.size(),
+              segments.second.begin());  // Copy low segment
+    commit_write(segments.size());
+    return segments.size();
   }
 
  private:
   /**
-   * @brief Helper function to compute amount of read data availbale
-   * @param read_head Current read head position
-   * @param write_head Current write head position
-   * @param capacity Ring buffer capacity
-   * @return std::size_t Amount of elements available for reading
-   */
-  static std::size_t compute_read_available(std::size_t read_head,
-                                            std::size_t write_head,
-                                            std::size_t capacity) {
-    assert(is_pow2(capacity) == true);
-
-    // Singe ring buffer capacity is always a power of two, the modulo
-    // operation can be replaced by a bit-mask
-    auto mask = capacity - 1U;
-    std::size_t read_available = 0U;
-
-    if (write_head > read_head) {
-      read_available = write_head - read_head;
-    } else {
-      read_available = (capacity - write_head + read_head) & mask;
+   * @brief Split a region of the ring at the wrap-around point
+   * @param head Free running position of the first element
+   * @param size Number of elements in the region
+   * @return RingSegments<DataType> High and low segments
+   */
+  RingSegments<DataType> make_segments(std::size_t head,
+                                       std::size_t size) noexcept {
+    auto ring_size = capacity();
+    auto offset = head & (ring_size - 1U);
+    auto *data = buffer_.data();
+
+    // The mirror mapping makes data + offset valid for size elements
+    if (buffer_.is_mirrored()) {
+      return {.first = std::span<DataType>(data + offset, size),
+              .second = {}};
     }
 
-    assert(read_available < capacity);
-    return read_available;
-  }
+    auto cnt_hi = std::min(size, ring_size - offset);
 
-  /**
-   * @brief Helper function to compute amount of write data availbale
-   * @param read_head Current read head position
-   * @param write_head Current write head position
-   * @param capacity Ring buffer capacity
-   * @return std::size_t Amount of elements available for writing
-   */
-  static std::size_t compute_write_available(std::size_t read_head,
-                                             std::size_t write_head,
-                                             std::size_t capacity) {
-    return capacity - compute_read_available(read_head, write_head, capacity) -
-           1U;
+    return {.first = std::span<DataType>(data + offset, cnt_hi),
+            .second = std::span<DataType>(data, size - cnt_hi)};
   }
 
  private:
-  std::vector<DataType> buffer_{};
-  std::atomic<std::size_t> read_head_{0};
-  std::atomic<std::size_t> write_head_{0};
+  RingStorage<DataType> buffer_{};
+
+  // Producer cache line: the write head and the producer's last seen
+  // read head
+  alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> write_head_{0};
+  std::size_t read_head_cache_{0};
+
+  // Consumer cache line: the read head and the consumer's last seen
+  // write head
+  alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> read_head_{0};
+  std::size_t write_head_cache_{0};
 };
 
 #endif /* RTUTIL_LOCKFREE_CIRCULARBUFFER_HH_ */
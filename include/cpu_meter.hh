@@ -0,0 +1,76 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef RTUTIL_CPU_METER_HH_
+#define RTUTIL_CPU_METER_HH_
+
+#include <chrono>
+#include <ctime>
+
+/**
+ * @brief Measure CPU time used by the calling thread against wall time
+ * @note Falls back to process CPU time where per-thread clocks are not
+ *  available
+ */
+class ThreadCpuMeter {
+ public:
+  ThreadCpuMeter() : cpu_start_(cpu_now()), wall_start_(Clock::now()) {}
+
+  /**
+   * @brief Get CPU time used by this thread since construction
+   * @return double CPU time in seconds
+   */
+  double cpu_seconds() const { return cpu_now() - cpu_start_; }
+
+  /**
+   * @brief Get wall time elapsed since construction
+   * @return double Wall time in seconds
+   */
+  double wall_seconds() const {
+    return std::chrono::duration<double>(Clock::now() - wall_start_).count();
+  }
+
+  /**
+   * @brief Get CPU usage of this thread since construction
+   * @return double CPU usage in percent of one core
+   */
+  double percent() const {
+    auto wall = wall_seconds();
+    return (wall > 0.0) ? (100.0 * cpu_seconds() / wall) : 0.0;
+  }
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  static double cpu_now() {
+#if defined(CLOCK_THREAD_CPUTIME_ID)
+    timespec ts{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<double>(ts.tv_sec) +
+           1e-9 * static_cast<double>(ts.tv_nsec);
+#else
+    return static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+#endif
+  }
+
+  double cpu_start_{};
+  Clock::time_point wall_start_{};
+};
+
+#endif /* RTUTIL_CPU_METER_HH_ */
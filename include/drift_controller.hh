@@ -0,0 +1,98 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef RTUTIL_DRIFT_CONTROLLER_HH_
+#define RTUTIL_DRIFT_CONTROLLER_HH_
+
+/**
+ * @brief Steer a resampling ratio so that a queue between two clocks
+ *  holds a target fill level
+ *
+ * Two crystals that are nominally at the same rate drift apart by tens
+ * of ppm, so the queue between them slowly fills or drains. The fill
+ * error is low-pass filtered, to remove the jitter of period sized
+ * transfers, and drives a PI loop. The proportional term pulls the fill
+ * back to the target. The integral term learns the drift itself, so at
+ * steady state it is the drift estimate in ppm. The correction is
+ * clamped, and the integral is held while it is, so a glitch can not
+ * wind the loop up.
+ */
+class DriftController {
+ public:
+  /**
+   * @brief Construct a new drift controller
+   * @param sample_rate Sample rate of the queue
+   * @param target_frames Fill level to hold
+   * @param max_ppm Largest correction, either way
+   * @param time_constant Seconds for the loop to pull back a fill error,
+   *  longer is smoother
+   */
+  DriftController(int sample_rate, double target_frames,
+                  double max_ppm = 500.0, double time_constant = 5.0);
+
+  /**
+   * @brief Feed a fill level measurement
+   * @param fill_frames Frames in the queue
+   * @param dt Seconds since the last measurement
+   * @return double Factor to scale the output/input resampling ratio by,
+   *  below 1 when the queue fills up
+   */
+  double update(double fill_frames, double dt);
+
+  /**
+   * @brief Forget the error history, e.g. after the queue was realigned
+   */
+  void reset();
+
+  /**
+   * @brief Get the correction applied by the last update()
+   * @return double Correction in ppm, positive when the queue fills up
+   */
+  double correction_ppm() const { return correction_ppm_; }
+
+  /**
+   * @brief Get the learned clock drift
+   * @return double Drift in ppm, positive when the queue's input clock is
+   *  faster than its output clock
+   */
+  double drift_ppm() const { return integral_ppm_; }
+
+  /**
+   * @brief Get the low-pass filtered fill error
+   * @return double Fill above the target in frames
+   */
+  double error_frames() const { return error_frames_; }
+
+  /**
+   * @brief Get the fill level the controller holds
+   */
+  double target_frames() const { return target_frames_; }
+
+ private:
+  double sample_rate_{};
+  double target_frames_{};
+  double max_ppm_{};
+  double time_constant_{};
+  double error_frames_{};
+  double integral_ppm_{};
+  double correction_ppm_{};
+  bool primed_{false};
+};
+
+#endif /* RTUTIL_DRIFT_CONTROLLER_HH_ */
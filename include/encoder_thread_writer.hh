@@ -0,0 +1,158 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef RTUTIL_ENCODER_THREAD_WRITER_HH_
+#define RTUTIL_ENCODER_THREAD_WRITER_HH_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "audio_file_writer.hh"
+
+/**
+ * @brief Writer that hands frames to another writer on a thread of its own
+ *
+ * Frames are copied into a fixed pool of large blocks. A full block goes
+ * on a bounded queue, and the encoder thread writes it out through the
+ * wrapped writer, so expensive encoding (FLAC, Vorbis) never runs on the
+ * thread draining the audio ring. When every block is queued the caller
+ * waits for the encoder, which is counted, so a recorder that can not
+ * keep up shows up in the statistics long before the ring overruns.
+ */
+class EncoderThreadWriter : public AudioFileWriter {
+ public:
+  static constexpr std::size_t BLOCK_MS = 100U;
+
+  /**
+   * @brief Queue statistics
+   */
+  struct Stats {
+    std::size_t blocks_written{};  //!< Blocks written by the encoder
+    std::size_t queue_depth{};     //!< Blocks queued right now
+    std::size_t high_water{};      //!< Most blocks ever queued at once
+    std::size_t producer_waits{};  //!< Times the caller found no free block
+    double wait_seconds{};         //!< Total time spent waiting
+    double max_wait_seconds{};     //!< Longest single wait
+  };
+
+  /**
+   * @brief Start the encoder thread
+   * @param file Writer that does the encoding
+   * @param block_frames Frames per block
+   * @param block_count Number of blocks, at least 2
+   */
+  EncoderThreadWriter(std::unique_ptr<AudioFileWriter> file,
+                      std::size_t block_frames, std::size_t block_count);
+
+  ~EncoderThreadWriter() override { EncoderThreadWriter::close(); }
+
+  sf_count_t writef(short const *ptr, sf_count_t frames) override;
+  sf_count_t writef(int const *ptr, sf_count_t frames) override;
+  sf_count_t writef(float const *ptr, sf_count_t frames) override;
+  sf_count_t writef(double const *ptr, sf_count_t frames) override;
+
+  /**
+   * @brief Report encoder errors, the wrapped writer is flushed by the
+   *  encoder thread after every block
+   * @return false once the encoder has failed
+   */
+  bool flush() override;
+
+  /**
+   * @brief Queue the last partial block, wait for the encoder to finish
+   *  and close the wrapped writer
+   * @return false on error
+   */
+  bool close() override;
+
+  std::string status_str() const override;
+  void print_summary() const override;
+
+  /**
+   * @brief Get a copy of the queue statistics
+   * @return Stats Statistics
+   */
+  Stats stats() const;
+
+ private:
+  enum class SampleKind { SHORT, INT, FLOAT, DOUBLE };
+
+  struct Block {
+    std::vector<std::byte> data{};
+    SampleKind kind{SampleKind::SHORT};
+    std::size_t frames{};
+  };
+
+  template <typename SampleType>
+  static constexpr SampleKind kind_of();
+
+  template <typename SampleType>
+  sf_count_t write_frames(SampleType const *ptr, sf_count_t frames);
+
+  /**
+   * @brief Take a free block, waiting for the encoder when there is none
+   * @return Block* Free block
+   */
+  Block *acquire_block();
+
+  /**
+   * @brief Queue the block being filled, if it holds anything
+   */
+  void submit_current();
+
+  /**
+   * @brief Encoder thread body
+   */
+  void encode_loop();
+
+  /**
+   * @brief Write a block through the wrapped writer
+   * @return false on error
+   */
+  bool encode_block(Block const &block);
+
+ private:
+  std::unique_ptr<AudioFileWriter> file_{};
+  std::size_t block_frames_{};
+  std::vector<Block> blocks_{};
+  Block *current_{nullptr};
+
+  mutable std::mutex mutex_{};
+  std::condition_variable queued_{};
+  std::condition_variable freed_{};
+  std::deque<Block *> queue_{};
+  std::vector<Block *> free_{};
+  bool done_{false};
+  Stats stats_{};
+  double encoder_cpu_seconds_{};
+  double encoder_wall_seconds_{};
+
+  std::atomic<bool> failed_{false};
+  bool closed_{false};
+  std::thread encoder_{};
+};
+
+#endif /* RTUTIL_ENCODER_THREAD_WRITER_HH_ */
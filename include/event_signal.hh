@@ -0,0 +1,182 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef RTUTIL_EVENT_SIGNAL_HH_
+#define RTUTIL_EVENT_SIGNAL_HH_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <optional>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#else
+#include <thread>
+#endif
+
+/**
+ * @brief Wakeup signal from a real-time thread to a single waiter
+ *
+ * The notifier bumps a sequence counter and only issues a wake when the
+ * waiter is asleep and the reported level has reached the waiter's
+ * threshold. The notifier never takes a lock and never blocks, and the
+ * waiter re-checks its predicate against the sequence counter before
+ * sleeping, so no wakeup can be lost.
+ *
+ * On Linux the waiter sleeps on a private futex on the sequence counter,
+ * which also gives wait_for() its timeout. Elsewhere std::atomic wait
+ * and notify are used, and wait_for() polls.
+ */
+class EventSignal {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  /**
+   * @brief Signal that the level (data or space available) has changed
+   * @note Real-time safe, may be called from the audio callback
+   * @param level Current level as seen by the notifier
+   */
+  void notify(std::size_t level) noexcept {
+    sequence_.fetch_add(1U, std::memory_order_seq_cst);
+
+    if (level >= threshold_.load(std::memory_order_seq_cst)) {
+      wake_waiter();
+    }
+  }
+
+  /**
+   * @brief Wake the waiter regardless of its threshold, e.g. on stop
+   * @note Real-time safe, may be called from the audio callback
+   */
+  void wake() noexcept {
+    sequence_.fetch_add(1U, std::memory_order_seq_cst);
+
+    if (threshold_.load(std::memory_order_seq_cst) != NO_WAITER) {
+      wake_waiter();
+    }
+  }
+
+  /**
+   * @brief Sleep until the predicate is satisfied
+   * @param threshold Level at which the notifier should wake this thread
+   * @param ready Predicate, checked before every sleep
+   */
+  template <typename Predicate>
+  void wait(std::size_t threshold, Predicate ready) {
+    wait_until(threshold, std::nullopt, ready);
+  }
+
+  /**
+   * @brief Sleep until the predicate is satisfied or a timeout expires
+   * @param threshold Level at which the notifier should wake this thread
+   * @param timeout Longest time to wait
+   * @param ready Predicate, checked before every sleep
+   * @return bool Result of the last check of the predicate
+   */
+  template <typename Predicate>
+  bool wait_for(std::size_t threshold, Clock::duration timeout,
+                Predicate ready) {
+    return wait_until(threshold, Clock::now() + timeout, ready);
+  }
+
+ private:
+  static constexpr std::size_t NO_WAITER =
+      std::numeric_limits<std::size_t>::max();
+
+  template <typename Predicate>
+  bool wait_until(std::size_t threshold,
+                  std::optional<Clock::time_point> deadline,
+                  Predicate ready) {
+    for (;;) {
+      auto sequence = sequence_.load(std::memory_order_seq_cst);
+
+      if (ready()) {
+        return true;
+      }
+
+      std::optional<Clock::duration> timeout{};
+      if (deadline) {
+        timeout = *deadline - Clock::now();
+        if (*timeout <= Clock::duration::zero()) {
+          return false;
+        }
+      }
+
+      // Publish the threshold before the final check, so a notifier
+      // either sees it or has already bumped the sequence
+      threshold_.store(threshold, std::memory_order_seq_cst);
+
+      if (!ready()) {
+        sleep_while(sequence, timeout);
+      }
+
+      threshold_.store(NO_WAITER, std::memory_order_seq_cst);
+    }
+  }
+
+  /**
+   * @brief Sleep while the sequence counter still holds a value, woken
+   *  by wake_waiter(), a timeout or spuriously
+   */
+  void sleep_while(std::uint32_t sequence,
+                   std::optional<Clock::duration> timeout) noexcept {
+#if defined(__linux__)
+    timespec ts{};
+    if (timeout) {
+      auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(*timeout)
+                    .count();
+      ts.tv_sec = static_cast<time_t>(ns / 1000000000);
+      ts.tv_nsec = static_cast<long>(ns % 1000000000);
+    }
+    syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&sequence_),
+            FUTEX_WAIT_PRIVATE, sequence, timeout ? &ts : nullptr, nullptr,
+            0);
+#else
+    if (timeout) {
+      std::this_thread::sleep_for(
+          std::min<Clock::duration>(*timeout, std::chrono::milliseconds(1)));
+    } else {
+      sequence_.wait(sequence, std::memory_order_seq_cst);
+    }
+#endif
+  }
+
+  void wake_waiter() noexcept {
+#if defined(__linux__)
+    syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&sequence_),
+            FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#else
+    sequence_.notify_one();
+#endif
+  }
+
+  // 32-bit so that waiting maps directly on a futex on Linux
+  std::atomic<std::uint32_t> sequence_{0};
+  std::atomic<std::size_t> threshold_{NO_WAITER};
+
+  static_assert(sizeof(sequence_) == sizeof(std::uint32_t));
+};
+
+#endif /* RTUTIL_EVENT_SIGNAL_HH_ */
@@ -0,0 +1,133 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef RTUTIL_FLAC_ENCODER_HH_
+#define RTUTIL_FLAC_ENCODER_HH_
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+/**
+ * @brief Contents of a FLAC STREAMINFO metadata block
+ */
+struct FlacStreamInfo {
+  std::uint32_t min_block_size{};   //!< Smallest block, but the last
+  std::uint32_t max_block_size{};   //!< Largest block
+  std::uint32_t min_frame_bytes{};  //!< Smallest frame, 0 if unknown
+  std::uint32_t max_frame_bytes{};  //!< Largest frame, 0 if unknown
+  std::uint32_t sample_rate{};      //!< Sample rate in Hz
+  std::uint32_t channels{};         //!< Number of channels, 1 to 8
+  std::uint32_t bits{};             //!< Bits per sample
+  std::uint64_t total_frames{};     //!< Frames in the stream, 0 if unknown
+};
+
+/**
+ * @brief Entry of a FLAC SEEKTABLE metadata block
+ */
+struct FlacSeekPoint {
+  std::uint64_t frame{};   //!< First sample frame of the target frame
+  std::uint64_t offset{};  //!< Byte offset from the first frame header
+  std::uint32_t frames{};  //!< Sample frames in the target frame
+};
+
+/**
+ * @brief Build the start of a FLAC file: the "fLaC" marker, STREAMINFO
+ *  and a SEEKTABLE with a fixed number of slots
+ *
+ * The size only depends on seek_slots, so the header can be written with
+ * what is known up front and rewritten in place once the stream is done.
+ *
+ * @param info Stream information
+ * @param points Seek points in ascending order, at most seek_slots
+ * @param seek_slots Number of seek table entries, unused ones are written
+ *  as placeholders
+ * @return std::vector<std::uint8_t> Header bytes
+ */
+std::vector<std::uint8_t> flac_stream_header(
+    FlacStreamInfo const &info, std::span<FlacSeekPoint const> points,
+    std::size_t seek_slots);
+
+class FlacBitWriter;
+
+/**
+ * @brief Encoder for single FLAC frames
+ *
+ * Every frame is independent of the others, so frames can be encoded on
+ * any number of threads, one encoder per thread, and written in order
+ * afterwards. Channels are coded independently with the best of the
+ * constant, verbatim and fixed polynomial predictors, and the residual
+ * with partitioned Rice codes.
+ */
+class FlacFrameEncoder {
+ public:
+  static constexpr unsigned int MAX_FIXED_ORDER = 4U;
+  static constexpr unsigned int MAX_PARTITION_ORDER = 8U;
+
+  /**
+   * @brief Construct a new encoder
+   * @param channels Number of channels, 1 to 8
+   * @param bits Bits per sample, 16 or 24
+   * @param max_block_size Largest number of frames per FLAC frame
+   */
+  FlacFrameEncoder(unsigned int channels, unsigned int bits,
+                   std::size_t max_block_size);
+
+  /**
+   * @brief Encode one FLAC frame
+   * @param samples Interleaved, right justified samples, whole frames and
+   *  at most max_block_size of them
+   * @param frame_number Index of this frame in the stream
+   * @param out Encoded frame is appended here
+   * @return std::size_t Size of the encoded frame in bytes
+   */
+  std::size_t encode(std::span<std::int32_t const> samples,
+                     std::uint64_t frame_number,
+                     std::vector<std::uint8_t> &out);
+
+ private:
+  /**
+   * @brief Encode one channel of the frame
+   * @param bits Bit writer positioned at the subframe
+   * @param x Samples of the channel
+   */
+  void encode_subframe(FlacBitWriter &bits, std::span<std::int32_t const> x);
+
+  /**
+   * @brief Find the cheapest Rice partitioning of residual_
+   * @param n Block size
+   * @param order Predictor order, residual_ holds n - order values
+   * @return std::uint64_t Estimated size of the residual in bits,
+   *  rice_params_ holds the chosen parameters
+   */
+  std::uint64_t choose_partitions(std::size_t n, unsigned int order);
+
+ private:
+  unsigned int channels_{};
+  unsigned int bits_{};
+  std::size_t max_block_size_{};
+  std::vector<std::int32_t> channel_{};
+  std::vector<std::uint32_t> residual_{};
+  std::vector<std::uint64_t> partition_sums_{};
+  std::vector<std::uint8_t> rice_params_{};
+  unsigned int partition_order_{};
+};
+
+#endif /* RTUTIL_FLAC_ENCODER_HH_ */
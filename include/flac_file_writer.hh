@@ -0,0 +1,181 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef RTUTIL_FLAC_FILE_WRITER_HH_
+#define RTUTIL_FLAC_FILE_WRITER_HH_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "audio_file_writer.hh"
+#include "flac_encoder.hh"
+
+/**
+ * @brief FLAC writer compressing on a pool of worker threads
+ *
+ * Incoming frames are cut into jobs of FRAMES_PER_JOB FLAC frames. FLAC
+ * frames do not depend on each other, so any idle worker takes the next
+ * job and encodes it. Whichever worker finishes the oldest outstanding
+ * job writes out every finished job in submission order. STREAMINFO and
+ * the SEEKTABLE are written up front with what is known and patched in
+ * place on close.
+ */
+class FlacFileWriter : public AudioFileWriter {
+ public:
+  static constexpr std::size_t BLOCK_SIZE = 4096U;
+  static constexpr std::size_t FRAMES_PER_JOB = 8U;
+  static constexpr std::size_t SEEK_POINTS = 512U;
+  static constexpr int MAX_CHANNELS = 8;
+
+  /**
+   * @brief Create a file and start the workers
+   * @throw std::runtime_error if the file can not be created, or the
+   *  format is not supported
+   * @param filename Path of the file
+   * @param format libsndfile major format and subformat, see supports()
+   * @param channels Number of channels, at most MAX_CHANNELS
+   * @param samplerate Sample rate
+   * @param config Writer configuration
+   */
+  FlacFileWriter(std::string const &filename, int format, int channels,
+                 int samplerate, WriterConfig const &config);
+
+  ~FlacFileWriter() override;
+
+  /**
+   * @brief Check whether a file can be written by this backend
+   * @param format libsndfile major format and subformat
+   * @param channels Number of channels
+   * @return true for FLAC with 16 or 24-bit samples and at most
+   *  MAX_CHANNELS channels
+   */
+  static bool supports(int format, int channels);
+
+  sf_count_t writef(short const *ptr, sf_count_t frames) override;
+  sf_count_t writef(int const *ptr, sf_count_t frames) override;
+  sf_count_t writef(float const *ptr, sf_count_t frames) override;
+  sf_count_t writef(double const *ptr, sf_count_t frames) override;
+
+  /**
+   * @brief Report worker errors, files are written and synced by the
+   *  workers as jobs complete
+   * @return false once writing has failed
+   */
+  bool flush() override;
+
+  /**
+   * @brief Encode and write the last partial job, stop the workers and
+   *  patch the header
+   * @return false on error
+   */
+  bool close() override;
+
+  std::string status_str() const override;
+  void print_summary() const override;
+
+ private:
+  struct Job {
+    std::vector<std::int32_t> pcm{};
+    std::vector<std::uint8_t> encoded{};
+    std::vector<std::uint32_t> frame_bytes{};
+    std::size_t frames{};
+    std::uint64_t first_frame{};
+    bool done{false};
+  };
+
+  template <typename SampleType>
+  sf_count_t write_frames(SampleType const *ptr, sf_count_t frames);
+
+  /**
+   * @brief Take a free job, waiting for the workers when there is none
+   * @return Job* Free job
+   */
+  Job *acquire_job();
+
+  /**
+   * @brief Queue the job being filled, if it holds anything
+   */
+  void submit_current();
+
+  /**
+   * @brief Worker thread body
+   */
+  void worker_loop();
+
+  /**
+   * @brief Write out finished jobs in order, unless another worker is
+   *  already at it
+   * @param lock Lock on mutex_, released while writing
+   */
+  void write_finished(std::unique_lock<std::mutex> &lock);
+
+  /**
+   * @brief Write an encoded job to file, only one thread at a time
+   * @return false on error
+   */
+  bool write_job(Job const &job);
+
+  /**
+   * @brief Flush stdio buffers and sync the file to stable storage
+   * @return false on error
+   */
+  bool sync_file();
+
+ private:
+  std::FILE *file_{nullptr};
+  unsigned int bits_{};
+  std::vector<Job> jobs_{};
+  Job *current_{nullptr};
+  std::uint64_t next_frame_{};
+
+  // Shared between the caller and the workers
+  mutable std::mutex mutex_{};
+  std::condition_variable queued_{};
+  std::condition_variable freed_{};
+  std::deque<Job *> pending_{};
+  std::deque<Job *> in_flight_{};
+  std::vector<Job *> free_{};
+  bool writing_{false};
+  bool done_{false};
+  std::size_t high_water_{};
+  std::size_t producer_waits_{};
+  double wait_seconds_{};
+  double max_wait_seconds_{};
+  double worker_cpu_seconds_{};
+
+  // Only touched by the thread writing finished jobs
+  FlacStreamInfo info_{};
+  std::uint64_t stream_bytes_{};
+  std::vector<FlacSeekPoint> seek_points_{};
+  std::uint64_t seek_spacing_{1};
+  SyncSchedule schedule_;
+
+  std::atomic<bool> failed_{false};
+  bool closed_{false};
+  std::vector<std::thread> workers_{};
+};
+
+#endif /* RTUTIL_FLAC_FILE_WRITER_HH_ */
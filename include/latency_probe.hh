@@ -0,0 +1,71 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef RTUTIL_LATENCY_PROBE_HH_
+#define RTUTIL_LATENCY_PROBE_HH_
+
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Test signal played to measure round-trip latency
+ */
+enum class ProbeSignal {
+  MLS,    //!< Maximum length sequence, flat spectrum and sharp peak
+  CHIRP,  //!< Logarithmic sine sweep, gentler on speakers
+};
+
+/**
+ * @brief Parse a probe signal name
+ * @param name One of "mls" or "chirp"
+ * @return std::optional<ProbeSignal> Signal, empty if unknown
+ */
+std::optional<ProbeSignal> parse_probe_signal(std::string_view name);
+
+/**
+ * @brief Generate a probe signal of half a second to a second
+ * @param signal Signal type
+ * @param sample_rate Sample rate of the stream
+ * @return std::vector<float> Mono samples at half full scale
+ */
+std::vector<float> make_probe_signal(ProbeSignal signal, int sample_rate);
+
+/**
+ * @brief Offset of a probe in a capture
+ */
+struct LatencyEstimate {
+  std::size_t frames{};  //!< Capture frame where the probe starts
+  double peak_ratio{};   //!< Correlation peak over its RMS, > 10 is good
+};
+
+/**
+ * @brief Find the probe in a capture by cross-correlation
+ * @param probe Probe signal as played
+ * @param captured Captured signal, starting at the frame the probe was
+ *  played at
+ * @return std::optional<LatencyEstimate> Estimate, empty if the capture
+ *  is silent
+ */
+std::optional<LatencyEstimate> estimate_latency(
+    std::span<float const> probe, std::span<float const> captured);
+
+#endif /* RTUTIL_LATENCY_PROBE_HH_ */
@@ -0,0 +1,241 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef RTUTIL_LOOP_READER_HH_
+#define RTUTIL_LOOP_READER_HH_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <numbers>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "sndfile.hh"
+
+/**
+ * @brief Read a region of a file a number of times over, as one
+ *  continuous stream of frames
+ *
+ * At the end of every pass but the last, the reader seeks back to the
+ * start of the region in the same readf() call, so the frame after the
+ * region's last is its first, with no gap. With a crossfade, the last
+ * frames of a pass are mixed with the first frames of the region, read
+ * once up front, and the next pass carries on right after them.
+ *
+ * @tparam SampleType Sample type to read
+ */
+template <typename SampleType>
+class LoopReader {
+ public:
+  /**
+   * @brief Seek to the start of the region
+   * @throw std::runtime_error if the region is empty, or the file can
+   *  not be seeked to its start
+   * @param file File to read, must outlive the reader
+   * @param start First frame of the region
+   * @param end Frame after the last frame of the region
+   * @param passes Number of passes, 0 for forever
+   * @param crossfade Frames to crossfade at the loop point, at most half
+   *  the region
+   */
+  LoopReader(SndfileHandle &file, std::size_t start, std::size_t end,
+             unsigned int passes, std::size_t crossfade)
+      : file_(file),
+        channels_(static_cast<std::size_t>(file.channels())),
+        start_(start),
+        end_(end),
+        passes_(passes),
+        crossfade_(std::min(crossfade, (end - start) / 2U)) {
+    if (end <= start) {
+      throw std::runtime_error("Nothing to play between start and end");
+    }
+
+    if (!more_passes()) {
+      crossfade_ = 0;
+    }
+
+    // The head of the region is mixed into the tail of every pass
+    if (crossfade_ > 0) {
+      head_.resize(crossfade_ * channels_);
+      seek_to(start_);
+      auto frames = static_cast<sf_count_t>(crossfade_);
+
+      if (file_.readf(head_.data(), frames) < frames) {
+        throw std::runtime_error("Error reading the start of the loop");
+      }
+    }
+
+    seek_to(start_);
+    position_ = start_;
+  }
+
+  int channels() const { return file_.channels(); }
+
+  /**
+   * @brief Read frames, wrapping around at the end of the region
+   * @param ptr Interleaved frames
+   * @param frames Number of frames to read
+   * @return sf_count_t Frames read, less than frames only after the
+   *  last pass
+   */
+  sf_count_t readf(SampleType *ptr, sf_count_t frames) {
+    auto channels = channels_;
+    auto wanted = static_cast<std::size_t>(frames);
+    std::size_t count = 0;
+
+    while (count < wanted) {
+      auto looping = more_passes();
+
+      if (position_ >= end_) {
+        if (!looping || !wrap()) {
+          break;
+        }
+        continue;
+      }
+
+      // Read up to where the crossfade starts, or to the end
+      auto fade = looping ? crossfade_ : 0U;
+      auto fade_start = end_ - fade;
+      auto boundary = (position_ < fade_start) ? fade_start : end_;
+      auto chunk = std::min(wanted - count, boundary - position_);
+      auto *dst = ptr + count * channels;
+      auto got = static_cast<std::size_t>(
+          file_.readf(dst, static_cast<sf_count_t>(chunk)));
+
+      if ((fade > 0) && (position_ >= fade_start)) {
+        mix_head(dst, position_ - fade_start, got);
+      }
+
+      position_ += got;
+      count += got;
+
+      if (got < chunk) {
+        // The file is shorter than it claimed, loop what there is
+        if ((got == 0) && (position_ == loop_start())) {
+          break;
+        }
+        end_ = position_;
+        crossfade_ = 0;
+      }
+    }
+
+    return static_cast<sf_count_t>(count);
+  }
+
+  /**
+   * @brief Get the number of the pass being read, from 0
+   */
+  unsigned int pass() const { return pass_; }
+
+  /**
+   * @brief Get the number of passes, 0 for forever
+   */
+  unsigned int passes() const { return passes_; }
+
+  /**
+   * @brief Get the frame the next read starts at
+   */
+  std::size_t position() const { return position_; }
+
+  /**
+   * @brief Get how far into the region the reader is
+   * @return double Fraction of the region, 0 to 1
+   */
+  double progress() const {
+    return static_cast<double>(position_ - start_) /
+           static_cast<double>(end_ - start_);
+  }
+
+ private:
+  bool more_passes() const {
+    return (passes_ == 0U) || ((pass_ + 1U) < passes_);
+  }
+
+  /**
+   * @brief Where later passes start, the head has been mixed in already
+   */
+  std::size_t loop_start() const { return start_ + crossfade_; }
+
+  void seek_to(std::size_t frame) {
+    if (file_.seek(static_cast<sf_count_t>(frame), SEEK_SET) < 0) {
+      throw std::runtime_error("Error seeking to frame " +
+                               std::to_string(frame));
+    }
+  }
+
+  /**
+   * @brief Go back to the start of the region for the next pass
+   * @return false if the file can not be seeked
+   */
+  bool wrap() {
+    if (file_.seek(static_cast<sf_count_t>(loop_start()), SEEK_SET) < 0) {
+      return false;
+    }
+
+    position_ = loop_start();
+    ++pass_;
+    return true;
+  }
+
+  /**
+   * @brief Crossfade the head of the region into frames of the tail,
+   *  with raised cosine gains that always sum to one
+   * @param tail Interleaved tail frames, mixed in place
+   * @param offset Index of the first frame into the crossfade
+   * @param frames Number of frames
+   */
+  void mix_head(SampleType *tail, std::size_t offset, std::size_t frames) {
+    auto channels = channels_;
+    auto length = static_cast<double>(crossfade_);
+
+    for (std::size_t i = 0; i < frames; ++i) {
+      auto t = (static_cast<double>(offset + i) + 0.5) / length;
+      auto gain_in = 0.5 - 0.5 * std::cos(std::numbers::pi * t);
+      auto const *head = head_.data() + (offset + i) * channels;
+      auto *out = tail + i * channels;
+
+      for (std::size_t c = 0; c < channels; ++c) {
+        auto mixed = static_cast<double>(out[c]) * (1.0 - gain_in) +
+                     static_cast<double>(head[c]) * gain_in;
+
+        if constexpr (std::is_floating_point_v<SampleType>) {
+          out[c] = static_cast<SampleType>(mixed);
+        } else {
+          out[c] = static_cast<SampleType>(std::lround(mixed));
+        }
+      }
+    }
+  }
+
+ private:
+  SndfileHandle &file_;
+  std::size_t channels_{};
+  std::size_t start_{};
+  std::size_t end_{};
+  unsigned int passes_{};
+  unsigned int pass_{0};
+  std::size_t crossfade_{};
+  std::size_t position_{};
+  std::vector<SampleType> head_{};
+};
+
+#endif /* RTUTIL_LOOP_READER_HH_ */
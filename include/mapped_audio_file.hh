@@ -0,0 +1,263 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef RTUTIL_MAPPED_AUDIO_FILE_HH_
+#define RTUTIL_MAPPED_AUDIO_FILE_HH_
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+/**
+ * @brief Encoding of samples in an uncompressed file
+ */
+enum class SampleEncoding {
+  S8,       //!< 8-bit signed integer
+  U8,       //!< 8-bit unsigned integer, WAV
+  PCM16,    //!< 16-bit signed integer
+  PCM24,    //!< 24-bit signed integer, packed
+  PCM32,    //!< 32-bit signed integer
+  FLOAT32,  //!< IEEE 754 single
+  FLOAT64,  //!< IEEE 754 double
+};
+
+/**
+ * @brief Uncompressed WAV or AIFF file mapped into memory
+ *
+ * The header is parsed here rather than by libsndfile, so that samples
+ * can be decoded straight from the page cache, without a read() copy
+ * and without a file IO ring. Only the decoding is done on the audio
+ * thread, keeping the pages resident ahead of it is up to the caller.
+ */
+class MappedAudioFile {
+ public:
+  /**
+   * @brief Map a file
+   * @throw std::runtime_error if the file can not be mapped, or is not
+   *  an uncompressed WAV or AIFF file
+   * @param filename Path of the file
+   */
+  explicit MappedAudioFile(std::string const &filename);
+
+  MappedAudioFile(MappedAudioFile const &) = delete;
+  MappedAudioFile &operator=(MappedAudioFile const &) = delete;
+
+  ~MappedAudioFile();
+
+  int channels() const { return channels_; }
+  int samplerate() const { return samplerate_; }
+  std::size_t frames() const { return frames_; }
+
+  /**
+   * @brief Get the equivalent libsndfile subformat, e.g. to pick a stream
+   *  format with native_stream_format()
+   * @return int libsndfile subformat
+   */
+  int sf_subformat() const;
+
+  /**
+   * @brief Ask the kernel to start reading frames in ahead of time
+   * @param frame First frame
+   * @param frames Number of frames
+   */
+  void will_need(std::size_t frame, std::size_t frames) const;
+
+  /**
+   * @brief Touch every page of a range of frames, so that decoding them
+   *  later does not page fault
+   * @param frame First frame
+   * @param frames Number of frames
+   */
+  void prefault(std::size_t frame, std::size_t frames) const;
+
+  /**
+   * @brief Let go of frames that have been played, if they were locked
+   *  into memory on fault
+   * @param frame First frame
+   * @param frames Number of frames
+   */
+  void release(std::size_t frame, std::size_t frames) const;
+
+  /**
+   * @brief Decode interleaved frames into the stream sample type
+   *
+   * Integers are left justified when converted to wider integers and
+   * truncated to narrower ones, floats are clipped to integers. Real-time
+   * safe as long as the frames have been faulted in.
+   *
+   * @tparam SampleType short, int, float or double
+   * @param frame First frame
+   * @param frames Number of frames
+   * @param out Interleaved output, frames * channels() samples
+   */
+  template <typename SampleType>
+  void decode(std::size_t frame, std::size_t frames,
+              SampleType *out) const noexcept {
+    auto const *src = data_ + frame * frame_bytes_;
+    auto n = frames * static_cast<std::size_t>(channels_);
+
+    switch (encoding_) {
+      case SampleEncoding::S8:
+        decode_loop<SampleEncoding::S8, false>(src, n, out);
+        break;
+      case SampleEncoding::U8:
+        decode_loop<SampleEncoding::U8, false>(src, n, out);
+        break;
+      case SampleEncoding::PCM16:
+        dispatch<SampleEncoding::PCM16>(src, n, out);
+        break;
+      case SampleEncoding::PCM24:
+        dispatch<SampleEncoding::PCM24>(src, n, out);
+        break;
+      case SampleEncoding::PCM32:
+        dispatch<SampleEncoding::PCM32>(src, n, out);
+        break;
+      case SampleEncoding::FLOAT32:
+        dispatch<SampleEncoding::FLOAT32>(src, n, out);
+        break;
+      case SampleEncoding::FLOAT64:
+        dispatch<SampleEncoding::FLOAT64>(src, n, out);
+        break;
+    }
+  }
+
+ private:
+  /**
+   * @brief Size of a sample in bytes
+   */
+  static constexpr std::size_t sample_bytes(SampleEncoding encoding) {
+    switch (encoding) {
+      case SampleEncoding::S8:
+      case SampleEncoding::U8:
+        return 1;
+      case SampleEncoding::PCM16:
+        return 2;
+      case SampleEncoding::PCM24:
+        return 3;
+      case SampleEncoding::PCM32:
+      case SampleEncoding::FLOAT32:
+        return 4;
+      case SampleEncoding::FLOAT64:
+      default:
+        return 8;
+    }
+  }
+
+  /**
+   * @brief Load an unsigned integer of N bytes
+   */
+  template <std::size_t N, bool BigEndian>
+  static std::uint64_t load(unsigned char const *p) noexcept {
+    std::uint64_t v = 0;
+    for (std::size_t i = 0; i < N; ++i) {
+      auto shift = 8U * (BigEndian ? (N - 1U - i) : i);
+      v |= static_cast<std::uint64_t>(p[i]) << shift;
+    }
+    return v;
+  }
+
+  /**
+   * @brief Convert a left justified 32-bit integer to the sample type
+   */
+  template <typename SampleType>
+  static SampleType from_int32(std::int32_t v) noexcept {
+    if constexpr (std::is_same_v<SampleType, short>) {
+      return static_cast<short>(v >> 16);
+    } else if constexpr (std::is_same_v<SampleType, int>) {
+      return v;
+    } else {
+      return static_cast<SampleType>(v) * SampleType(1.0 / 2147483648.0);
+    }
+  }
+
+  /**
+   * @brief Convert a normalized float to the sample type
+   */
+  template <typename SampleType>
+  static SampleType from_double(double v) noexcept {
+    if constexpr (std::is_floating_point_v<SampleType>) {
+      return static_cast<SampleType>(v);
+    } else {
+      constexpr auto bits = int(sizeof(SampleType) * 8);
+      constexpr auto scale = double(std::uint64_t(1) << (bits - 1));
+      auto q = std::clamp(v * scale, -scale, scale - 1.0);
+      return static_cast<SampleType>(q + ((q >= 0.0) ? 0.5 : -0.5));
+    }
+  }
+
+  template <SampleEncoding Encoding, bool BigEndian, typename SampleType>
+  static void decode_loop(unsigned char const *src, std::size_t n,
+                          SampleType *out) noexcept {
+    constexpr auto size = sample_bytes(Encoding);
+
+    for (std::size_t i = 0; i < n; ++i, src += size) {
+      auto v = load<size, BigEndian>(src);
+
+      if constexpr (Encoding == SampleEncoding::FLOAT32) {
+        auto f = std::bit_cast<float>(static_cast<std::uint32_t>(v));
+        out[i] = from_double<SampleType>(f);
+      } else if constexpr (Encoding == SampleEncoding::FLOAT64) {
+        out[i] = from_double<SampleType>(std::bit_cast<double>(v));
+      } else if constexpr (Encoding == SampleEncoding::U8) {
+        auto s = static_cast<std::uint32_t>(v ^ 0x80U) << 24U;
+        out[i] = from_int32<SampleType>(static_cast<std::int32_t>(s));
+      } else {
+        auto s = static_cast<std::uint32_t>(v) << (32U - 8U * size);
+        out[i] = from_int32<SampleType>(static_cast<std::int32_t>(s));
+      }
+    }
+  }
+
+  template <SampleEncoding Encoding, typename SampleType>
+  void dispatch(unsigned char const *src, std::size_t n,
+                SampleType *out) const noexcept {
+    if (big_endian_) {
+      decode_loop<Encoding, true>(src, n, out);
+    } else {
+      decode_loop<Encoding, false>(src, n, out);
+    }
+  }
+
+  void parse_wav();
+  void parse_aiff();
+
+  /**
+   * @brief Byte range of a range of frames, rounded out to pages
+   */
+  std::pair<unsigned char *, std::size_t> page_range(
+      std::size_t frame, std::size_t frames) const;
+
+ private:
+  unsigned char *map_{nullptr};
+  std::size_t map_size_{};
+  unsigned char const *data_{nullptr};
+  std::size_t data_size_{};
+  std::size_t frame_bytes_{};
+  std::size_t frames_{};
+  int channels_{};
+  int samplerate_{};
+  SampleEncoding encoding_{SampleEncoding::PCM16};
+  bool big_endian_{false};
+};
+
+#endif /* RTUTIL_MAPPED_AUDIO_FILE_HH_ */
@@ -0,0 +1,45 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef RTUTIL_MULTI_RECORD_HH_
+#define RTUTIL_MULTI_RECORD_HH_
+
+#include <optional>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief One device of a multi-device recording
+ */
+struct CaptureDevice {
+  unsigned int id{};  //!< Device ID
+  int channels{};     //!< Number of channels, 0 for the --channels count
+};
+
+/**
+ * @brief Parse a device list
+ * @param spec Comma separated "<id>" or "<id>:<channels>", the first
+ *  device is the clock the others are locked to
+ * @return std::optional<std::vector<CaptureDevice>> Devices, empty if the
+ *  list is malformed
+ */
+std::optional<std::vector<CaptureDevice>> parse_capture_devices(
+    std::string_view spec);
+
+#endif /* RTUTIL_MULTI_RECORD_HH_ */
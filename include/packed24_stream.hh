@@ -0,0 +1,122 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef RTUTIL_PACKED24_STREAM_HH_
+#define RTUTIL_PACKED24_STREAM_HH_
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "RtAudio.h"
+
+/**
+ * @brief Serve an RTAUDIO_SINT24 stream with a callback that works in
+ *  left justified int32
+ *
+ * Devices that only speak packed 24-bit samples would otherwise have
+ * RtAudio convert every buffer. Here the samples are unpacked on their
+ * way in and packed on their way out, around the wrapped callback, in
+ * the stream's own byte order.
+ */
+class Packed24Stream {
+ public:
+  /**
+   * @brief Construct a new packed 24-bit stream adapter
+   * @param callback Callback working in int32
+   * @param user_data User data of the callback
+   * @param channels Channels of the stream
+   */
+  Packed24Stream(RtAudioCallback callback, void *user_data,
+                 std::size_t channels)
+      : callback_(callback), user_data_(user_data), channels_(channels) {}
+
+  /**
+   * @brief Size the int32 buffer for the periods the device granted
+   * @note Call after the stream is opened and before it is started
+   * @param frame_size Frames per callback
+   */
+  void set_frame_size(unsigned int frame_size) {
+    scratch_.resize(std::size_t{frame_size} * channels_);
+  }
+
+  static int audio_callback(void *output_buffer, void *input_buffer,
+                            unsigned int n_frame, double stream_time,
+                            RtAudioStreamStatus status, void *user_data) {
+    auto *self = static_cast<Packed24Stream *>(user_data);
+    auto channels = self->channels_;
+    auto frames =
+        std::min<std::size_t>(n_frame, self->scratch_.size() / channels);
+    auto samples = frames * channels;
+    auto *scratch = self->scratch_.data();
+
+    if (input_buffer != nullptr) {
+      unpack(static_cast<unsigned char const *>(input_buffer), scratch,
+             samples);
+    }
+
+    auto result = self->callback_(
+        (output_buffer != nullptr) ? scratch : nullptr,
+        (input_buffer != nullptr) ? scratch : nullptr,
+        static_cast<unsigned int>(frames), stream_time, status,
+        self->user_data_);
+
+    if (output_buffer != nullptr) {
+      auto *out = static_cast<unsigned char *>(output_buffer);
+      pack(scratch, out, samples);
+      std::fill(out + 3U * samples, out + 3U * n_frame * channels, 0U);
+    }
+
+    return result;
+  }
+
+ private:
+  // Packed samples are in the host's byte order
+  static constexpr bool LITTLE = (std::endian::native == std::endian::little);
+
+  static void unpack(unsigned char const *in, std::int32_t *out,
+                     std::size_t samples) noexcept {
+    for (std::size_t i = 0; i < samples; ++i, in += 3) {
+      auto lo = LITTLE ? in[0] : in[2];
+      auto hi = LITTLE ? in[2] : in[0];
+      out[i] = static_cast<std::int32_t>(
+          (std::uint32_t{hi} << 24U) | (std::uint32_t{in[1]} << 16U) |
+          (std::uint32_t{lo} << 8U));
+    }
+  }
+
+  static void pack(std::int32_t const *in, unsigned char *out,
+                   std::size_t samples) noexcept {
+    for (std::size_t i = 0; i < samples; ++i, out += 3) {
+      auto v = static_cast<std::uint32_t>(in[i]);
+      out[LITTLE ? 0 : 2] = static_cast<unsigned char>(v >> 8U);
+      out[1] = static_cast<unsigned char>(v >> 16U);
+      out[LITTLE ? 2 : 0] = static_cast<unsigned char>(v >> 24U);
+    }
+  }
+
+  RtAudioCallback callback_{};
+  void *user_data_{};
+  std::size_t channels_{};
+  std::vector<std::int32_t> scratch_{};
+};
+
+#endif /* RTUTIL_PACKED24_STREAM_HH_ */
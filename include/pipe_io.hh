@@ -0,0 +1,225 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef RTUTIL_PIPE_IO_HH_
+#define RTUTIL_PIPE_IO_HH_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <thread>
+
+#include "audio_file_writer.hh"
+#include "circular_buffer.hh"
+#include "event_signal.hh"
+#include "sample_format.hh"
+#include "sndfile.hh"
+
+/**
+ * @brief Check whether a path names a stream rather than a file
+ * @param path "-" for stdin or stdout, or the path of a named pipe
+ * @return true if the path can not be seeked
+ */
+bool is_pipe_path(std::string const &path);
+
+/**
+ * @brief Read audio from stdin or a named pipe
+ *
+ * A thread of its own drains the pipe into a deep byte ring as fast as
+ * the producer writes, polling a non-blocking descriptor so that it also
+ * notices a stop, and the file IO thread decodes from the ring through
+ * libsndfile's virtual IO. A bursty producer is never held up by the
+ * playback queue being full, and the playback queue is never held up by
+ * a read from the pipe.
+ *
+ * A pipe can not be seeked, so a WAV header is parsed here and the data
+ * that follows is handed to libsndfile as RAW, and anything else must be
+ * header-less PCM in a known layout.
+ */
+class PipeReader {
+ public:
+  // About 20 s of stereo pcm16 at 48 kHz, 64 times a Linux pipe
+  static constexpr std::size_t BUFFER_BYTES = std::size_t(4) << 20U;
+
+  // How often the reader thread checks for a stop while the pipe is idle
+  static constexpr int POLL_MS = 100;
+
+  /**
+   * @brief Open the pipe and start draining it
+   * @throw std::runtime_error if the pipe can not be opened
+   * @param path "-" for stdin, or the path of a named pipe
+   */
+  explicit PipeReader(std::string const &path);
+
+  PipeReader(PipeReader const &) = delete;
+  PipeReader &operator=(PipeReader const &) = delete;
+
+  ~PipeReader();
+
+  /**
+   * @brief Open the stream for decoding, reading its WAV header first
+   *  unless it is header-less
+   * @throw std::runtime_error if the header is not a PCM or float WAV,
+   *  or the stream ends before its data
+   * @param raw Layout of header-less PCM, empty to expect a WAV header
+   * @return SndfileHandle Handle reading from this pipe, which must
+   *  outlive it, reporting an unknown (very large) length
+   */
+  SndfileHandle open(std::optional<RawFormat> const &raw);
+
+  /**
+   * @brief Print how much was read, and how full the ring ever got
+   */
+  void print_summary() const;
+
+ private:
+  /**
+   * @brief Reader thread body
+   */
+  void drain();
+
+  /**
+   * @brief Take bytes from the ring, waiting for the producer
+   * @return std::size_t Bytes read, less than size only at the end of
+   *  the stream or on a stop
+   */
+  std::size_t read(void *dst, std::size_t size);
+
+  /**
+   * @brief Read bytes that must be there, e.g. a header
+   * @throw std::runtime_error if the stream ends first
+   */
+  void read_exact(void *dst, std::size_t size);
+
+  /**
+   * @brief Read a WAV header up to the start of the sample data
+   * @throw std::runtime_error if it is not a PCM or float WAV
+   * @return SF_INFO Layout of the sample data, as RAW
+   */
+  SF_INFO read_wav_header();
+
+  static sf_count_t vio_get_filelen(void *user_data);
+  static sf_count_t vio_seek(sf_count_t offset, int whence, void *user_data);
+  static sf_count_t vio_read(void *ptr, sf_count_t count, void *user_data);
+  static sf_count_t vio_write(void const *ptr, sf_count_t count,
+                              void *user_data);
+  static sf_count_t vio_tell(void *user_data);
+
+ private:
+  std::string path_{};
+  int fd_{-1};
+  int saved_flags_{-1};
+  CircularBuffer<unsigned char> ring_{};
+  EventSignal data_ready_{};
+  EventSignal space_ready_{};
+  std::atomic<bool> eof_{false};
+  std::atomic<bool> failed_{false};
+  std::atomic<bool> closing_{false};
+  std::atomic<std::size_t> peak_bytes_{0};
+  std::atomic<std::uint64_t> total_bytes_{0};
+  std::thread thread_{};
+
+  // Consumer side, owned by the file IO thread
+  SF_VIRTUAL_IO vio_{};
+  std::uint64_t position_{};
+  std::optional<std::uint64_t> data_bytes_{};
+};
+
+/**
+ * @brief Write a recording to stdout or a named pipe
+ *
+ * libsndfile only writes RAW to something it can not seek, so it encodes
+ * the samples as RAW through virtual IO, and a WAV stream gets its header
+ * written up front with unknown sizes, as other streaming tools do. For
+ * stdout, the original descriptor is kept for the audio and stdout is
+ * pointed at stderr, so that status output does not end up in the
+ * stream.
+ */
+class PipeWriter : public AudioFileWriter {
+ public:
+  /**
+   * @brief Open the pipe
+   * @throw std::runtime_error if the pipe can not be opened, or the
+   *  format is not supported
+   * @param path "-" for stdout, or the path of a named pipe
+   * @param format libsndfile major format and subformat, see supports()
+   * @param channels Number of channels
+   * @param samplerate Sample rate
+   */
+  PipeWriter(std::string const &path, int format, int channels,
+             int samplerate);
+
+  ~PipeWriter() override;
+
+  /**
+   * @brief Check whether a format can be streamed by this writer
+   * @param format libsndfile major format and subformat
+   * @return true for RAW or WAV with 16, 24 or 32-bit integer, float or
+   *  double samples
+   */
+  static bool supports(int format);
+
+  sf_count_t writef(short const *ptr, sf_count_t frames) override;
+  sf_count_t writef(int const *ptr, sf_count_t frames) override;
+  sf_count_t writef(float const *ptr, sf_count_t frames) override;
+  sf_count_t writef(double const *ptr, sf_count_t frames) override;
+
+  /**
+   * @brief Report write errors, a pipe has nothing to sync
+   * @return false once a write has failed, e.g. the reader went away
+   */
+  bool flush() override { return !failed_; }
+
+  bool close() override;
+
+ private:
+  template <typename SampleType>
+  sf_count_t write_frames(SampleType const *ptr, sf_count_t frames);
+
+  /**
+   * @brief Write bytes to the pipe, waiting for the reader as needed
+   * @return false on error
+   */
+  bool write_bytes(void const *src, std::size_t size);
+
+  /**
+   * @brief Write a WAV header with unknown sizes
+   * @return false on error
+   */
+  bool write_wav_header();
+
+  static sf_count_t vio_get_filelen(void *user_data);
+  static sf_count_t vio_seek(sf_count_t offset, int whence, void *user_data);
+  static sf_count_t vio_read(void *ptr, sf_count_t count, void *user_data);
+  static sf_count_t vio_write(void const *ptr, sf_count_t count,
+                              void *user_data);
+  static sf_count_t vio_tell(void *user_data);
+
+ private:
+  int fd_{-1};
+  SF_VIRTUAL_IO vio_{};
+  std::uint64_t position_{};
+  SndfileHandle file_{};
+  bool failed_{false};
+  bool closed_{false};
+};
+
+#endif /* RTUTIL_PIPE_IO_HH_ */
@@ -0,0 +1,66 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef RTUTIL_PLAY_REGION_HH_
+#define RTUTIL_PLAY_REGION_HH_
+
+#include <cstddef>
+#include <optional>
+#include <string_view>
+
+/**
+ * @brief Position in a file, in seconds or in sample frames
+ */
+struct TimePosition {
+  double value{};       //!< Seconds, or frames when in_frames is set
+  bool in_frames{false};
+
+  /**
+   * @brief Convert to sample frames
+   * @param sample_rate Sample rate of the file
+   * @return std::size_t Frame index, rounded to the nearest frame
+   */
+  std::size_t to_frames(int sample_rate) const;
+};
+
+/**
+ * @brief Parse a position
+ * @param spec Seconds as "<n>" or "<n>s", milliseconds as "<n>ms", or
+ *  sample frames as "<n>f"
+ * @return std::optional<TimePosition> Position, empty if malformed or
+ *  negative
+ */
+std::optional<TimePosition> parse_time_position(std::string_view spec);
+
+/**
+ * @brief Part of a file to play, and how often
+ */
+struct PlayRegion {
+  std::optional<TimePosition> start{};  //!< First frame, file start if empty
+  std::optional<TimePosition> end{};    //!< Frame after the last, file end
+  unsigned int passes{1};               //!< Times to play, 0 for forever
+  unsigned int crossfade_ms{0};         //!< Crossfade at the loop point
+
+  /**
+   * @brief Check whether anything but the whole file, once, is asked for
+   */
+  bool is_set() const { return start || end || (passes != 1U); }
+};
+
+#endif /* RTUTIL_PLAY_REGION_HH_ */
@@ -0,0 +1,445 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef RTUTIL_PLAYBACK_PROCESS_HH_
+#define RTUTIL_PLAYBACK_PROCESS_HH_
+
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "RtAudio.h"
+#include "circular_buffer.hh"
+#include "drift_controller.hh"
+#include "event_signal.hh"
+#include "loop_reader.hh"
+#include "realtime.hh"
+#include "resampler.hh"
+#include "sndfile.hh"
+#include "sndfile_ring_io.hh"
+#include "stop_signal.hh"
+#include "stream_config.hh"
+#include "stream_stats.hh"
+
+/**
+ * @brief Play a file, or a region of it any number of times, through the
+ *  ring to the audio callback
+ *
+ * The file is read through a LoopReader, which seeks back to the start
+ * of the region in the middle of a block, so the IO thread appends the
+ * next pass right behind the last one and the ring never holds audio
+ * that has to be discarded.
+ *
+ * With a drift lock, the source is taken to run on a clock of its own,
+ * e.g. a live feed through a pipe. The converter's ratio is then steered
+ * by a DriftController, within 500 ppm of nominal, to hold the ring at
+ * the target latency. While the ring is full, the source is being read
+ * at the device's pace rather than its own, so the nominal ratio is used
+ * and the controller is held.
+ *
+ * @tparam SampleType Sample type of the stream, anything but float plays
+ *  the file's samples as they are, without resampling
+ */
+template <typename SampleType>
+class PlaybackProcess {
+ public:
+  static constexpr std::size_t BUFFER_FACTOR = 4U;
+
+  // Headroom for the converter's rounding and delay line flush
+  static constexpr std::size_t RESAMPLE_SLACK_FRAMES = 64U;
+
+  // Drift lock loop time constant in seconds. The fill is only seen once
+  // a block, so it steps by up to a block, and 30 s keeps steps of a few
+  // blocks within 500 ppm of correction
+  static constexpr double DRIFT_TIME_CONSTANT = 30.0;
+
+  /**
+   * @brief Construct a new playback process
+   * @throw std::runtime_error if the resampler can not be created,
+   *  resampling or a drift lock is asked of a non-float stream, or the
+   *  region is empty or can not be seeked to
+   * @param file File to play
+   * @param config Stream configuration
+   * @param stream_rate Sample rate of the audio stream, the file is
+   *  resampled when it differs from the file sample rate
+   * @param is_pipe The file is read from a pipe, its length is not known
+   */
+  PlaybackProcess(SndfileHandle &&file, StreamConfig const &config,
+                  int stream_rate, bool is_pipe = false)
+      : file_(std::move(file)),
+        channels_(static_cast<std::size_t>(file_.channels())),
+        stream_rate_(stream_rate),
+        is_pipe_(is_pipe),
+        frame_scratch_(channels_, SampleType{}),
+        callback_pin_(config.callback_cpu) {
+    auto queue_size = queue_frames(config, stream_rate);
+    auto io_frames = std::max<std::size_t>(
+        1U, std::min(BUFFER_FACTOR * config.frames, queue_size / 4U));
+
+    circ_buffer_.resize(queue_size * channels_);
+    io_block_len_ = io_frames * channels_;
+    block_space_ = io_block_len_;
+
+    // The whole file once, unless a region is asked for
+    auto file_rate = file_.samplerate();
+    auto file_frames = static_cast<std::size_t>(file_.frames());
+    auto const &region = config.region;
+    auto start = region.start ? region.start->to_frames(file_rate) : 0U;
+    auto end = region.end ? std::min(region.end->to_frames(file_rate),
+                                     file_frames)
+                          : file_frames;
+    auto crossfade = static_cast<std::size_t>(region.crossfade_ms) *
+                     static_cast<std::size_t>(file_rate) / 1000U;
+
+    reader_.emplace(file_, start, end, region.passes, crossfade);
+
+    if ((stream_rate != file_.samplerate()) || (config.drift_lock_ms > 0)) {
+      if constexpr (!std::is_same_v<SampleType, float>) {
+        throw std::runtime_error("Resampling needs a float32 stream");
+      }
+
+      auto ratio = static_cast<double>(stream_rate) / file_.samplerate();
+      auto in_frames = std::max<std::size_t>(
+          1U, static_cast<std::size_t>(static_cast<double>(io_frames) / ratio));
+
+      resampler_ = std::make_unique<Resampler>(config.resample_quality,
+                                               file_.channels(), ratio);
+      resample_in_.resize(in_frames * channels_);
+      resample_out_.resize((io_frames + RESAMPLE_SLACK_FRAMES) * channels_);
+      block_space_ = resample_out_.size();
+      nominal_ratio_ = ratio;
+    }
+
+    // Leave room above the target for the source to run ahead
+    if (config.drift_lock_ms > 0) {
+      auto target = std::min(static_cast<std::size_t>(config.drift_lock_ms) *
+                                 static_cast<std::size_t>(stream_rate) /
+                                 1000U,
+                             queue_size - block_space_ / channels_);
+      drift_.emplace(stream_rate, static_cast<double>(target), 500.0,
+                     DRIFT_TIME_CONSTANT);
+    }
+  }
+
+  /**
+   * @brief Grow the ring to hold the periods the device granted, which
+   *  can be longer than the ones asked for
+   * @note Call after the stream is opened, before anything is queued
+   * @param frame_size Frames per callback of the opened stream
+   */
+  void set_frame_size(unsigned int frame_size) {
+    auto queue_size = min_queue_frames(frame_size) * channels_;
+    if (circ_buffer_.capacity() < queue_size) {
+      circ_buffer_.resize(queue_size);
+    }
+  }
+
+  /**
+   * @brief Fault in the buffers used by the audio callback
+   */
+  void prefault() { circ_buffer_.prefault(); }
+
+  /**
+   * @brief Report how the audio callback thread was set up
+   */
+  void report_callback_thread() const { callback_pin_.report("Callback"); }
+
+  /**
+   * @brief Fill the ring before the stream starts, so that the first
+   *  callbacks do not run dry, only up to the target with a drift lock
+   */
+  void prefill() {
+    auto limit = drift_ ? static_cast<std::size_t>(drift_->target_frames())
+                        : circ_buffer_.capacity();
+
+    while (!eof_.load(std::memory_order_relaxed) &&
+           (circ_buffer_.get_write_available() >= block_space_) &&
+           (frames_queued() < limit)) {
+      fill_block();
+    }
+  }
+
+  /**
+   * @brief Get the number of frames queued for the audio process
+   */
+  std::size_t frames_queued() const {
+    return circ_buffer_.get_read_available() / channels_;
+  }
+
+  /**
+   * @brief Check whether everything has been read and queued
+   */
+  bool finished() const { return eof_.load(std::memory_order_relaxed); }
+
+  void start() {
+    auto block_space = block_space_;
+    auto passes = reader_->passes();
+    std::size_t animation_counter = 0U;
+
+    while (!eof_.load(std::memory_order_relaxed)) {
+      // A file on disk only sets the pace while it does not have to wait
+      // for room in the ring. A pipe is steered even while the ring is
+      // full, so that a burst that backs up into the pipe buffer is
+      // played off at the largest correction, back down to the target
+      steer_ = is_pipe_ ||
+               (circ_buffer_.get_write_available() >= block_space);
+
+      // Sleep until the audio process has made room for a whole block
+      request_data_.wait(block_space, [&]() {
+        return (circ_buffer_.get_write_available() >= block_space) ||
+               stop_requested();
+      });
+
+      if (stop_requested()) {
+        return;
+      }
+
+      fill_block();
+      ++animation_counter;
+
+      // Display timeline info, a pipe has no end to count towards
+      std::cout << "[ " << ("\\|/-"[animation_counter % 4]) << " Playing ";
+
+      if (is_pipe_) {
+        std::cout << reader_->position() /
+                         static_cast<std::size_t>(file_.samplerate())
+                  << " s, ";
+      } else {
+        std::cout << static_cast<int>(reader_->progress() * 100.0) << "%, ";
+      }
+
+      if (passes != 1U) {
+        std::cout << "pass " << (reader_->pass() + 1U) << "/";
+        if (passes == 0U) {
+          std::cout << "inf, ";
+        } else {
+          std::cout << passes << ", ";
+        }
+      }
+
+      if (drift_) {
+        std::cout << "drift " << std::showpos << std::fixed
+                  << std::setprecision(1) << drift_->drift_ppm()
+                  << std::noshowpos << " ppm, queue "
+                  << frames_queued() * 1000U /
+                         static_cast<std::size_t>(stream_rate_)
+                  << " ms, ";
+      }
+
+      std::cout << stats_status_str(stats_.snapshot()) << " ]\r"
+                << std::flush;
+    }
+
+    // Let the audio process play out whatever is still queued
+    auto capacity = circ_buffer_.capacity();
+    request_data_.wait(capacity, [&]() {
+      return (circ_buffer_.get_write_available() >= capacity) ||
+             stop_requested();
+    });
+  }
+
+  /**
+   * @brief Print xrun counters, and the drift lock's estimate
+   */
+  void print_summary() const {
+    if (drift_) {
+      std::cout << "Drift lock: " << std::showpos << std::fixed
+                << std::setprecision(1) << drift_->drift_ppm()
+                << " ppm, correction " << min_ppm_ << " to " << max_ppm_
+                << " ppm" << std::noshowpos << ", target "
+                << drift_->target_frames() << " frame(s)" << std::endl;
+    }
+
+    print_stats_summary(stats_.snapshot(), stream_rate_);
+  }
+
+  void read_frames(SampleType *output, std::size_t frames,
+                   RtAudioStreamStatus status) {
+    auto channels = channels_;
+    auto data_needed = frames * channels;
+    auto data_read = circ_buffer_.dequeue(output, data_needed);
+    auto data_missing = data_needed - data_read;
+
+    // Fill the rest of the output buffer with zeros to prevent
+    // "raspberry" sound when queue runs short
+    auto out = std::span(output + data_read, data_missing);
+    std::fill(std::begin(out), std::end(out), SampleType{});
+
+    // Running dry after the end of file is not an underrun
+    stats_.on_device_status(status);
+    if ((data_missing > 0) && !eof_.load(std::memory_order_relaxed)) {
+      stats_.on_ring_underrun(data_missing, data_missing / channels);
+    } else {
+      stats_.on_ring_ok();
+    }
+
+    // Wake up the file IO thread once there is room for a block, or
+    // right away when asked to stop
+    if (stop_requested()) {
+      request_data_.wake();
+    } else {
+      request_data_.notify(circ_buffer_.get_write_available());
+    }
+  }
+
+  static int audio_callback(void *output_buffer, void * /* input_buffer */,
+                            unsigned int n_frame, double /* stream_time */,
+                            RtAudioStreamStatus status, void *user_data) {
+    auto *output = static_cast<SampleType *>(output_buffer);
+    auto *proc = static_cast<PlaybackProcess *>(user_data);
+    proc->callback_pin_.apply();
+    proc->read_frames(output, n_frame, status);
+    return 0;
+  }
+
+ private:
+  /**
+   * @brief Produce one block into the ring, the caller makes sure there
+   *  are at least block_space_ samples free
+   */
+  void fill_block() {
+    if constexpr (std::is_same_v<SampleType, float>) {
+      if (resampler_) {
+        fill_block_resampled();
+        return;
+      }
+    }
+
+    fill_block_direct();
+  }
+
+  /**
+   * @brief Decode one block straight into the ring storage
+   */
+  void fill_block_direct() {
+    auto channels = static_cast<sf_count_t>(channels_);
+    auto frames = static_cast<sf_count_t>(io_block_len_) / channels;
+
+    auto segments = circ_buffer_.prepare_write(io_block_len_);
+    auto read_frames =
+        readf_segments(*reader_, segments, std::span(frame_scratch_));
+    circ_buffer_.commit_write(
+        static_cast<std::size_t>(read_frames * channels));
+
+    if (read_frames < frames) {
+      eof_.store(true, std::memory_order_relaxed);
+    }
+  }
+
+  /**
+   * @brief Decode and resample one block, input the converter could not
+   *  take is carried over to the next block
+   */
+  void fill_block_resampled() {
+    auto channels = channels_;
+    auto in_capacity = resample_in_.size() / channels;
+
+    // Top up the input block from the file
+    if (!file_eof_ && (resample_in_frames_ < in_capacity)) {
+      auto wanted = static_cast<sf_count_t>(in_capacity - resample_in_frames_);
+      auto *dst = resample_in_.data() + resample_in_frames_ * channels;
+      auto read_frames = reader_->readf(dst, wanted);
+      resample_in_frames_ += static_cast<std::size_t>(read_frames);
+      file_eof_ = (read_frames < wanted);
+    }
+
+    if (drift_) {
+      steer();
+    }
+
+    auto input = std::span<float const>(resample_in_.data(),
+                                        resample_in_frames_ * channels);
+    auto result = resampler_->process(input, resample_out_, file_eof_);
+    block_frames_ = result.frames_generated;
+
+    // Keep unconsumed input at the front of the block
+    auto used = result.frames_used * channels;
+    std::copy(resample_in_.begin() + static_cast<std::ptrdiff_t>(used),
+              resample_in_.begin() +
+                  static_cast<std::ptrdiff_t>(input.size()),
+              resample_in_.begin());
+    resample_in_frames_ -= result.frames_used;
+
+    circ_buffer_.enqueue(resample_out_.data(),
+                         result.frames_generated * channels);
+
+    // The converter is flushed once it stops producing at end of file
+    if (file_eof_ && (resample_in_frames_ == 0) &&
+        (result.frames_generated == 0)) {
+      eof_.store(true, std::memory_order_relaxed);
+    }
+  }
+
+  /**
+   * @brief Set the converter ratio for the next block from the ring fill
+   */
+  void steer() {
+    if (!steer_) {
+      resampler_->set_ratio(nominal_ratio_);
+      return;
+    }
+
+    // The last block stands for the time since the last measurement, and
+    // input waiting in front of the converter counts as queued too
+    auto dt = static_cast<double>(block_frames_) / stream_rate_;
+    auto queued = static_cast<double>(frames_queued()) +
+                  static_cast<double>(resample_in_frames_) * nominal_ratio_;
+    auto factor = drift_->update(queued, dt);
+    auto ppm = drift_->correction_ppm();
+
+    min_ppm_ = std::min(min_ppm_, ppm);
+    max_ppm_ = std::max(max_ppm_, ppm);
+    resampler_->set_ratio(nominal_ratio_ * factor);
+  }
+
+ private:
+  SndfileHandle file_{};
+  std::optional<LoopReader<SampleType>> reader_{};
+  std::size_t channels_{};
+  int stream_rate_{};
+  bool is_pipe_{false};
+  CircularBuffer<SampleType> circ_buffer_{};
+  std::size_t io_block_len_{};
+  std::size_t block_space_{};
+  std::vector<SampleType> frame_scratch_{};
+  std::unique_ptr<Resampler> resampler_{};
+  std::vector<float> resample_in_{};
+  std::vector<float> resample_out_{};
+  std::size_t resample_in_frames_{};
+  bool file_eof_{false};
+  double nominal_ratio_{1.0};
+  std::optional<DriftController> drift_{};
+  std::size_t block_frames_{0};
+  bool steer_{false};
+  double min_ppm_{0.0};
+  double max_ppm_{0.0};
+  EventSignal request_data_{};
+  CallbackThreadPin callback_pin_{};
+  StreamStats stats_{};
+  std::atomic<bool> eof_{false};
+};
+
+#endif /* RTUTIL_PLAYBACK_PROCESS_HH_ */
@@ -0,0 +1,40 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef RTUTIL_PLAYLIST_HH_
+#define RTUTIL_PLAYLIST_HH_
+
+#include <optional>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Read the file names of an M3U or extended M3U playlist
+ *
+ * Blank lines and lines starting with '#' are skipped, and relative
+ * paths are taken relative to the playlist's directory.
+ *
+ * @param filename Path of the playlist
+ * @return std::optional<std::vector<std::string>> File names, empty if
+ *  the playlist can not be read
+ */
+std::optional<std::vector<std::string>> read_m3u_playlist(
+    std::string const &filename);
+
+#endif /* RTUTIL_PLAYLIST_HH_ */
@@ -0,0 +1,106 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef RTUTIL_REALTIME_HH_
+#define RTUTIL_REALTIME_HH_
+
+#include <atomic>
+#include <string_view>
+
+#include "stream_config.hh"
+
+/**
+ * @brief Lock current and future process memory in RAM
+ * @param on_fault Lock pages only once they are touched, so that large
+ *  file mappings are not read in and pinned as a whole
+ * @return true on success, otherwise the reason is reported on stderr
+ */
+bool lock_process_memory(bool on_fault = false);
+
+/**
+ * @brief Switch the calling thread to SCHED_FIFO
+ * @param priority Real-time priority
+ * @return true on success, otherwise the reason is reported on stderr
+ */
+bool set_thread_realtime(int priority);
+
+/**
+ * @brief Pin the calling thread to a single CPU
+ * @note Does not report, so that it can be used from the audio callback
+ * @param cpu CPU index
+ * @return true on success, false also for a CPU index out of range
+ */
+bool pin_thread_to_cpu(int cpu) noexcept;
+
+/**
+ * @brief Touch a region of the calling thread's stack so that it is
+ *  resident before real-time work starts
+ */
+void prefault_stack();
+
+/**
+ * @brief Apply the real-time settings of the configuration to the
+ *  calling (file IO) thread, reporting what could not be applied
+ * @param config Stream configuration
+ * @param lock_on_fault Passed on to lock_process_memory()
+ */
+void setup_io_thread(StreamConfig const &config, bool lock_on_fault = false);
+
+/**
+ * @brief One-shot CPU pinning of the audio callback thread, which is
+ *  owned by RtAudio and only reachable from within the callback
+ */
+class CallbackThreadPin {
+ public:
+  CallbackThreadPin() = default;
+
+  /**
+   * @brief Construct a new callback pin
+   * @param cpu CPU index, negative to leave the thread unpinned
+   */
+  explicit CallbackThreadPin(int cpu) : cpu_(cpu) {}
+
+  /**
+   * @brief Pin the calling thread on first call
+   * @note Called from the audio callback, only the first call makes a
+   *  system call
+   */
+  void apply() noexcept {
+    if ((cpu_ >= 0) && (status_.load(std::memory_order_relaxed) == PENDING)) {
+      auto ok = pin_thread_to_cpu(cpu_);
+      status_.store(ok ? PINNED : FAILED, std::memory_order_relaxed);
+    }
+  }
+
+  /**
+   * @brief Report the outcome of the pinning on stdout/stderr
+   * @param name Name of the pinned thread
+   */
+  void report(std::string_view name) const;
+
+ private:
+  static constexpr int PENDING = 0;
+  static constexpr int PINNED = 1;
+  static constexpr int FAILED = -1;
+
+  int cpu_{-1};
+  std::atomic<int> status_{PENDING};
+};
+
+#endif /* RTUTIL_REALTIME_HH_ */
@@ -0,0 +1,530 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef RTUTIL_RECORD_PROCESS_HH_
+#define RTUTIL_RECORD_PROCESS_HH_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "RtAudio.h"
+#include "audio_file_writer.hh"
+#include "circular_buffer.hh"
+#include "cpu_meter.hh"
+#include "event_signal.hh"
+#include "realtime.hh"
+#include "resampler.hh"
+#include "sample_convert.hh"
+#include "sndfile_ring_io.hh"
+#include "stop_signal.hh"
+#include "stream_config.hh"
+#include "stream_stats.hh"
+
+/**
+ * @brief Record audio to file
+ * @tparam SampleType Sample type of the stream, anything but float is
+ *  written to file as it is, without resampling or dither
+ */
+template <typename SampleType>
+class RecordProcess {
+ public:
+  static constexpr std::size_t BUFFER_FACTOR = 4U;
+
+  // Headroom for the converter's rounding and delay line flush
+  static constexpr std::size_t RESAMPLE_SLACK_FRAMES = 64U;
+
+  // Longest wait for the audio callback to close the input after a stop
+  // request, in case the stream has stopped calling it
+  static constexpr auto INPUT_CLOSE_TIMEOUT = std::chrono::milliseconds(500);
+
+  /**
+   * @brief Construct a new record process
+   * @throw std::runtime_error if the resampler can not be created, or
+   *  resampling is asked of a non-float stream
+   * @param file File to record to
+   * @param config Stream configuration
+   * @param stream_rate Sample rate of the audio stream, the audio is
+   *  resampled when it differs from the file sample rate
+   */
+  RecordProcess(std::unique_ptr<AudioFileWriter> file,
+                StreamConfig const &config, int stream_rate)
+      : file_{std::move(file)},
+        channels_(static_cast<std::size_t>(file_->channels())),
+        stream_rate_(stream_rate),
+        frame_scratch_(channels_, SampleType{}),
+        callback_pin_(config.callback_cpu) {
+    auto queue_size = queue_frames(config, stream_rate);
+    auto io_frames = std::max<std::size_t>(
+        1U, std::min(BUFFER_FACTOR * config.frames, queue_size / 4U));
+
+    circ_buffer_.resize(queue_size * channels_);
+    drain_watermark_ = io_frames * channels_;
+
+    // Integer files are quantized here rather than by libsndfile, float
+    // carries 24 bits so 32-bit output gains nothing from dither
+    subformat_ = file_->format() & SF_FORMAT_SUBMASK;
+    convert_len_ = drain_watermark_;
+
+    if constexpr (std::is_same_v<SampleType, float>) {
+      if (subformat_ == SF_FORMAT_PCM_16) {
+        convert16_.resize(convert_len_);
+      } else if ((subformat_ == SF_FORMAT_PCM_24) ||
+                 (subformat_ == SF_FORMAT_PCM_32)) {
+        convert32_.resize(convert_len_);
+      }
+    }
+
+    dither_enabled_ = config.dither && (subformat_ != SF_FORMAT_PCM_32);
+
+    if (stream_rate != file_->samplerate()) {
+      if constexpr (!std::is_same_v<SampleType, float>) {
+        throw std::runtime_error("Resampling needs a float32 stream");
+      }
+
+      auto ratio = static_cast<double>(file_->samplerate()) / stream_rate;
+      auto out_frames = static_cast<std::size_t>(
+          std::ceil(static_cast<double>(io_frames) * ratio));
+
+      resampler_ = std::make_unique<Resampler>(config.resample_quality,
+                                               file_->channels(), ratio);
+      resample_out_.resize((out_frames + RESAMPLE_SLACK_FRAMES) * channels_);
+    }
+  }
+
+  /**
+   * @brief Grow the ring to hold the periods the device granted, which
+   *  can be longer than the ones asked for
+   * @note Call after the stream is opened, before anything is queued
+   * @param frame_size Frames per callback of the opened stream
+   */
+  void set_frame_size(unsigned int frame_size) {
+    auto queue_size = min_queue_frames(frame_size) * channels_;
+    if (circ_buffer_.capacity() < queue_size) {
+      circ_buffer_.resize(queue_size);
+    }
+  }
+
+  /**
+   * @brief Fault in the buffers used by the audio callback
+   */
+  void prefault() { circ_buffer_.prefault(); }
+
+  /**
+   * @brief Turn the status line off, when another process prints its own
+   *  on the same terminal
+   * @param show True to print the status line
+   */
+  void show_status(bool show) { show_status_ = show; }
+
+  /**
+   * @brief Start file io thread, returns after a stop has been requested
+   *  and everything queued has been written
+   */
+  void start() {
+    auto watermark = drain_watermark_;
+    auto sample_rate = file_->samplerate();
+    bool stopping = false;
+    cpu_meter_ = ThreadCpuMeter{};
+
+    while (!stopping) {
+      // Sleep until the audio process has queued a watermark worth of
+      // data, or until asked to stop
+      data_ready_.wait(watermark, [&]() {
+        return (circ_buffer_.get_read_available() >= watermark) ||
+               stop_requested();
+      });
+
+      // Audio queued before the stop request still gets written, once
+      // the callback has queued its last frames
+      stopping = stop_requested();
+
+      if (stopping) {
+        wait_input_closed();
+      }
+
+      if (!write_queued(stopping)) {
+        break;
+      }
+
+      if (!show_status_) {
+        continue;
+      }
+
+      // Display recording info info
+      auto writer_status = file_->status_str();
+      std::cout << "[ Recording " << (write_counter_ / sample_rate)
+                << " second(s), io cpu " << std::fixed
+                << std::setprecision(1) << cpu_meter_.percent() << "%, "
+                << (writer_status.empty() ? "" : writer_status + ", ")
+                << stats_status_str(stats_.snapshot()) << " ]\r"
+                << std::flush;
+    }
+
+    close();
+  }
+
+  /**
+   * @brief Write what the audio process has queued, on the calling thread
+   * @param end_of_input True once nothing more will be queued, to flush
+   *  the converter's delay line
+   * @return false on write error, reported on stderr
+   */
+  bool write_queued(bool end_of_input) {
+    if (!drain()) {
+      std::cerr << "\nFailed to write data..." << std::endl;
+      return false;
+    }
+
+    // Push out the converter's delay line once everything is in
+    if (end_of_input && !flush_resampler()) {
+      std::cerr << "\nFailed to write data..." << std::endl;
+      return false;
+    }
+
+    return true;
+  }
+
+  /**
+   * @brief Write out whatever the backend still buffers and finish the
+   *  header
+   */
+  void close() {
+    if (!file_->close()) {
+      std::cerr << "\nFailed to finish file..." << std::endl;
+    }
+  }
+
+  /**
+   * @brief Get the number of frames written to file
+   */
+  std::size_t frames_written() const { return write_counter_; }
+
+  /**
+   * @brief Print a summary of the recording
+   */
+  void print_summary() const {
+    auto sample_rate = static_cast<double>(file_->samplerate());
+    std::cout << "Recorded " << write_counter_ << " frame(s), "
+              << std::setprecision(3)
+              << static_cast<double>(write_counter_) / sample_rate
+              << " second(s)" << std::endl
+              << "IO thread cpu: " << cpu_meter_.cpu_seconds() << " s over "
+              << cpu_meter_.wall_seconds() << " s ("
+              << std::setprecision(2) << cpu_meter_.percent() << "%)"
+              << std::endl;
+    file_->print_summary();
+    callback_pin_.report("Callback");
+    print_stats_summary(stats_.snapshot(), stream_rate_);
+  }
+
+  void write_frames(SampleType const *input, std::size_t frames,
+                    RtAudioStreamStatus status) {
+    // Nothing is queued after the final drain has started
+    if (input_closed_.load(std::memory_order_relaxed)) {
+      return;
+    }
+
+    auto channels = channels_;
+    auto data_len = frames * channels;
+    auto data_written = circ_buffer_.enqueue(input, data_len);
+    auto data_dropped = data_len - data_written;
+
+    stats_.on_device_status(status);
+    if (data_dropped > 0) {
+      stats_.on_ring_overrun(data_dropped, data_dropped / channels);
+    } else {
+      stats_.on_ring_ok();
+    }
+
+    // Wake up the file IO thread once the watermark is reached, or right
+    // away to drain the ring when stopping
+    if (stop_requested()) {
+      data_ready_.wake();
+    } else {
+      data_ready_.notify(circ_buffer_.get_read_available());
+    }
+  }
+
+  static int audio_callback(void * /*output_buffer*/, void *input_buffer,
+                            unsigned int n_frame, double /* stream_time */,
+                            RtAudioStreamStatus status, void *user_data) {
+    auto *input = static_cast<SampleType *>(input_buffer);
+    auto *proc = static_cast<RecordProcess *>(user_data);
+    proc->callback_pin_.apply();
+    proc->write_frames(input, n_frame, status);
+
+    // Returning 1 stops the stream
+    if (stop_requested()) {
+      proc->close_input();
+      return 1;
+    }
+
+    return 0;
+  }
+
+  /**
+   * @brief Stop queueing input after a stop request, so that start()
+   *  writes everything queued and then flushes the file
+   * @note Real-time safe, called from the audio callback once it has
+   *  queued its last frames
+   */
+  void close_input() noexcept {
+    input_closed_.store(true, std::memory_order_release);
+    data_ready_.wake();
+  }
+
+ private:
+  /**
+   * @brief Wait for the audio callback to close the input, or for a
+   *  stream that has stopped calling it to time out
+   */
+  void wait_input_closed() {
+    // Only close_input() and the callback's wake() matter here, no level
+    // the notifier reports can be enough
+    data_ready_.wait_for(
+        std::numeric_limits<std::size_t>::max() - 1U, INPUT_CLOSE_TIMEOUT,
+        [&]() { return input_closed_.load(std::memory_order_acquire); });
+  }
+
+  /**
+   * @brief Write everything queued in the ring to file in one batch
+   * @return false on write error
+   */
+  bool drain() {
+    auto channels = channels_;
+    auto available = circ_buffer_.get_read_available();
+    auto batch_len = available - (available % channels);
+
+    if (batch_len == 0) {
+      return true;
+    }
+
+    auto segments = circ_buffer_.peek_read(batch_len);
+
+    if constexpr (std::is_same_v<SampleType, float>) {
+      if (resampler_ || is_quantized()) {
+        // The batch goes through the converter and/or the quantizer in
+        // whole frames, writing as it goes
+        auto ok = for_each_frame_span(segments, [this](auto samples) {
+          return resampler_ ? resample_and_write(samples, false)
+                            : write_samples(samples);
+        });
+        circ_buffer_.consume(batch_len);
+        return file_->flush() && ok;
+      }
+    }
+
+    // Encode straight from the ring storage
+    auto write_frames =
+        writef_segments(*file_, segments, std::span(frame_scratch_));
+    auto write_len = static_cast<std::size_t>(write_frames) * channels;
+    circ_buffer_.consume(write_len);
+    write_counter_ += static_cast<std::size_t>(write_frames);
+
+    return file_->flush() && (write_len == batch_len);
+  }
+
+  /**
+   * @brief Flush the converter's delay line, if there is a converter
+   * @return false on write error
+   */
+  bool flush_resampler() {
+    if constexpr (std::is_same_v<SampleType, float>) {
+      if (resampler_) {
+        return resample_and_write({}, true);
+      }
+    }
+
+    return true;
+  }
+
+  /**
+   * @brief Hand ring segments to a writer as spans of whole frames, a
+   *  frame split by the wrap-around point goes through frame_scratch_
+   * @param segments Readable region of the ring, whole frames
+   * @param write Writer, returns false on error
+   * @return false on write error
+   */
+  template <typename Writer>
+  bool for_each_frame_span(RingSegments<SampleType> segments, Writer write) {
+    auto channels = channels_;
+    auto split = segments.first.size() % channels;
+    auto first = segments.first.first(segments.first.size() - split);
+
+    if (!write(std::span<SampleType const>(first))) {
+      return false;
+    }
+
+    std::size_t lo_offset = 0;
+
+    if (split > 0) {
+      lo_offset = channels - split;
+      auto hi_tail = segments.first.last(split);
+      auto lo_head = segments.second.first(lo_offset);
+      auto scratch_mid =
+          std::copy(hi_tail.begin(), hi_tail.end(), frame_scratch_.begin());
+      std::copy(lo_head.begin(), lo_head.end(), scratch_mid);
+
+      if (!write(std::span<SampleType const>(frame_scratch_))) {
+        return false;
+      }
+    }
+
+    auto second = segments.second.subspan(lo_offset);
+    return write(std::span<SampleType const>(second));
+  }
+
+  /**
+   * @brief Run input through the converter and write its output
+   * @param input Interleaved input samples, whole frames
+   * @param end_of_input True to flush the converter's delay line
+   * @return false on write error
+   */
+  bool resample_and_write(std::span<float const> input, bool end_of_input) {
+    auto channels = channels_;
+
+    for (;;) {
+      auto result = resampler_->process(input, resample_out_, end_of_input);
+      auto frames = result.frames_generated;
+      input = input.subspan(result.frames_used * channels);
+
+      if (!write_samples(std::span<float const>(resample_out_.data(),
+                                                frames * channels))) {
+        return false;
+      }
+
+      // Flushing is done once the converter has nothing left to give
+      if (input.empty() && (!end_of_input || (frames == 0))) {
+        return true;
+      }
+    }
+  }
+
+  /**
+   * @brief Check whether samples are quantized before writing
+   * @return true if the file has an integer sample format
+   */
+  bool is_quantized() const {
+    return !convert16_.empty() || !convert32_.empty();
+  }
+
+  /**
+   * @brief Write interleaved samples in the file's sample format
+   * @param samples Interleaved samples, whole frames
+   * @return false on write error
+   */
+  bool write_samples(std::span<float const> samples) {
+    if (!is_quantized()) {
+      auto frames = static_cast<sf_count_t>(samples.size() / channels_);
+
+      if (file_->writef(samples.data(), frames) < frames) {
+        return false;
+      }
+
+      write_counter_ += static_cast<std::size_t>(frames);
+      return true;
+    }
+
+    // Quantize in chunks of whole frames that fit the conversion buffer
+    auto chunk_len = convert_len_ - (convert_len_ % channels_);
+
+    while (!samples.empty()) {
+      auto chunk = samples.first(std::min(samples.size(), chunk_len));
+      samples = samples.subspan(chunk.size());
+
+      auto ok = true;
+      switch (subformat_) {
+        case SF_FORMAT_PCM_16:
+          ok = write_quantized<short, 16>(chunk, convert16_);
+          break;
+        case SF_FORMAT_PCM_24:
+          ok = write_quantized<int, 24>(chunk, convert32_);
+          break;
+        default:
+          ok = write_quantized<int, 32>(chunk, convert32_);
+          break;
+      }
+
+      if (!ok) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  /**
+   * @brief Quantize samples and write them to file
+   * @tparam IntType Sample type handed to libsndfile
+   * @tparam Bits Significant bits of the file format
+   * @param samples Interleaved samples, whole frames
+   * @param buffer Conversion buffer, at least samples.size() elements
+   * @return false on write error
+   */
+  template <typename IntType, int Bits>
+  bool write_quantized(std::span<float const> samples,
+                       std::vector<IntType> &buffer) {
+    auto *dither = dither_enabled_ ? &dither_ : nullptr;
+    quantize<IntType, Bits>(samples, buffer, dither);
+
+    auto frames = static_cast<sf_count_t>(samples.size() / channels_);
+
+    if (file_->writef(buffer.data(), frames) < frames) {
+      return false;
+    }
+
+    write_counter_ += static_cast<std::size_t>(frames);
+    return true;
+  }
+
+ private:
+  std::unique_ptr<AudioFileWriter> file_{};
+  std::size_t channels_{};
+  int stream_rate_{};
+  CircularBuffer<SampleType> circ_buffer_{};
+  std::size_t drain_watermark_{};
+  std::vector<SampleType> frame_scratch_{};
+  std::unique_ptr<Resampler> resampler_{};
+  std::vector<float> resample_out_{};
+  int subformat_{};
+  std::size_t convert_len_{};
+  std::vector<short> convert16_{};
+  std::vector<int> convert32_{};
+  TpdfDither dither_{};
+  bool dither_enabled_{false};
+  EventSignal data_ready_{};
+  std::atomic<bool> input_closed_{false};
+  std::size_t write_counter_{};
+  ThreadCpuMeter cpu_meter_{};
+  CallbackThreadPin callback_pin_{};
+  StreamStats stats_{};
+  bool show_status_{true};
+};
+
+#endif /* RTUTIL_RECORD_PROCESS_HH_ */
@@ -0,0 +1,115 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef RTUTIL_RESAMPLER_HH_
+#define RTUTIL_RESAMPLER_HH_
+
+#include <optional>
+#include <span>
+#include <string_view>
+
+typedef struct SRC_STATE_tag SRC_STATE;
+
+/**
+ * @brief Sample rate converter quality, from libsamplerate
+ */
+enum class ResampleQuality {
+  BEST,     //!< Band limited sinc, best quality
+  MEDIUM,   //!< Band limited sinc, medium quality
+  FASTEST,  //!< Band limited sinc, fastest
+  LINEAR,   //!< Linear interpolation, not band limited
+};
+
+/**
+ * @brief Parse a resampler quality name
+ * @param name One of "best", "medium", "fastest" or "linear"
+ * @return std::optional<ResampleQuality> Quality, empty if unknown
+ */
+std::optional<ResampleQuality> parse_resample_quality(std::string_view name);
+
+/**
+ * @brief Streaming sample rate converter for interleaved float frames
+ */
+class Resampler {
+ public:
+  /**
+   * @brief Result of one process() call
+   */
+  struct Result {
+    std::size_t frames_used{};       //!< Input frames consumed
+    std::size_t frames_generated{};  //!< Output frames produced
+  };
+
+  /**
+   * @brief Construct a new resampler
+   * @throw std::runtime_error if libsamplerate rejects the parameters
+   * @param quality Converter quality
+   * @param channels Number of interleaved channels
+   * @param ratio Output rate divided by input rate
+   */
+  Resampler(ResampleQuality quality, int channels, double ratio);
+
+  Resampler(Resampler const &) = delete;
+  Resampler &operator=(Resampler const &) = delete;
+
+  ~Resampler();
+
+  /**
+   * @brief Convert as much of the input as fits in the output
+   * @throw std::runtime_error on conversion error
+   * @param input Interleaved input samples
+   * @param output Interleaved output samples
+   * @param end_of_input True once the input is exhausted, to flush the
+   *  converter's delay line
+   * @return Result Frames consumed and produced
+   */
+  Result process(std::span<float const> input, std::span<float> output,
+                 bool end_of_input);
+
+  /**
+   * @brief Change the conversion ratio, the converter glides to it
+   *  over the next process() call
+   * @param ratio Output rate divided by input rate
+   */
+  void set_ratio(double ratio) { ratio_ = ratio; }
+
+  /**
+   * @brief Get the conversion ratio
+   * @return double Output rate divided by input rate
+   */
+  double ratio() const { return ratio_; }
+
+  /**
+   * @brief Get number of interleaved channels
+   * @return int Number of channels
+   */
+  int channels() const { return channels_; }
+
+  /**
+   * @brief Clear the converter state, e.g. after a seek
+   */
+  void reset();
+
+ private:
+  SRC_STATE *state_{nullptr};
+  int channels_{};
+  double ratio_{1.0};
+};
+
+#endif /* RTUTIL_RESAMPLER_HH_ */
@@ -0,0 +1,187 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef RTUTIL_RING_STORAGE_HH_
+#define RTUTIL_RING_STORAGE_HH_
+
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @brief Backing storage for a circular buffer
+ *
+ * On Linux the storage is mapped twice back to back in virtual memory, so
+ * element i and element i + size() alias the same physical memory. Any
+ * region of up to size() elements starting anywhere in the first mapping
+ * is then one contiguous pointer. When the size is not a multiple of the
+ * page size, or mapping fails, a plain std::vector is used instead.
+ *
+ * @tparam DataType Data type of the storage element
+ */
+template <typename DataType>
+class RingStorage {
+ public:
+  /**
+   * @brief Construct an empty storage
+   */
+  RingStorage() = default;
+
+  /**
+   * @brief Construct a new storage
+   * @param size Number of elements
+   */
+  RingStorage(std::size_t size) { allocate(size); }
+
+  RingStorage(RingStorage const &) = delete;
+  RingStorage &operator=(RingStorage const &) = delete;
+
+  ~RingStorage() { release(); }
+
+  /**
+   * @brief Reallocate the storage, this discards the previous contents
+   * @param size Number of elements
+   */
+  void allocate(std::size_t size) {
+    release();
+
+    if (!map_mirrored(size)) {
+      fallback_.resize(size);
+    }
+
+    size_ = size;
+  }
+
+  /**
+   * @brief Get pointer to the first element
+   * @return DataType* Storage pointer
+   */
+  DataType *data() { return is_mirrored() ? mirror_ : fallback_.data(); }
+
+  /**
+   * @brief Get number of elements
+   * @return std::size_t Number of elements
+   */
+  std::size_t size() const { return size_; }
+
+  /**
+   * @brief Touch every page of the storage, including the mirror, so
+   *  that later accesses do not page fault
+   */
+  void prefault() {
+    auto *bytes = reinterpret_cast<volatile unsigned char *>(data());
+    auto n_bytes = size_ * sizeof(DataType) * (is_mirrored() ? 2U : 1U);
+
+    for (std::size_t i = 0; i < n_bytes; i += PREFAULT_STRIDE) {
+      bytes[i] = bytes[i];
+    }
+  }
+
+  /**
+   * @brief Check whether the storage wraps around in virtual memory
+   * @return true data() is valid for 2 * size() elements
+   */
+  bool is_mirrored() const { return mirror_ != nullptr; }
+
+ private:
+  // Smallest page size in use, touching every one of them is enough
+  static constexpr std::size_t PREFAULT_STRIDE = 4096U;
+
+  /**
+   * @brief Map the same memory twice, back to back
+   * @param size Number of elements
+   * @return true on success
+   */
+  bool map_mirrored([[maybe_unused]] std::size_t size) {
+#if defined(__linux__)
+    if constexpr (!std::is_trivially_copyable_v<DataType>) {
+      return false;
+    }
+
+    auto page_size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    auto bytes = size * sizeof(DataType);
+
+    if ((bytes == 0) || ((bytes % page_size) != 0)) {
+      return false;
+    }
+
+    int fd = memfd_create("rtutil-ring", MFD_CLOEXEC);
+    if (fd < 0) {
+      return false;
+    }
+
+    if (ftruncate(fd, static_cast<off_t>(bytes)) != 0) {
+      close(fd);
+      return false;
+    }
+
+    // Reserve the address range, then map the file over both halves
+    auto *base = static_cast<std::byte *>(mmap(
+        nullptr, 2 * bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+
+    if (base == MAP_FAILED) {
+      close(fd);
+      return false;
+    }
+
+    auto *lo = mmap(base, bytes, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_FIXED, fd, 0);
+    auto *hi = mmap(base + bytes, bytes, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_FIXED, fd, 0);
+    close(fd);
+
+    if ((lo == MAP_FAILED) || (hi == MAP_FAILED)) {
+      munmap(base, 2 * bytes);
+      return false;
+    }
+
+    mirror_ = reinterpret_cast<DataType *>(base);
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  /**
+   * @brief Release the mapping or vector storage
+   */
+  void release() {
+#if defined(__linux__)
+    if (mirror_ != nullptr) {
+      munmap(mirror_, 2 * size_ * sizeof(DataType));
+      mirror_ = nullptr;
+    }
+#endif
+    fallback_.clear();
+    fallback_.shrink_to_fit();
+    size_ = 0;
+  }
+
+ private:
+  std::vector<DataType> fallback_{};
+  DataType *mirror_{nullptr};
+  std::size_t size_{0};
+};
+
+#endif /* RTUTIL_RING_STORAGE_HH_ */
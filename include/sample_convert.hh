@@ -0,0 +1,135 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef RTUTIL_SAMPLE_CONVERT_HH_
+#define RTUTIL_SAMPLE_CONVERT_HH_
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <span>
+
+/**
+ * @brief Triangular PDF dither generator
+ *
+ * Runs LANES independent xorshift32 generators side by side, so that
+ * generating a block of noise has no serial dependency and vectorizes.
+ */
+class TpdfDither {
+ public:
+  static constexpr std::size_t LANES = 8U;
+
+  /**
+   * @brief Construct a new dither generator
+   * @param seed Seed
+   */
+  explicit TpdfDither(std::uint32_t seed = 0x9E3779B9U) {
+    for (std::size_t i = 0; i < LANES; ++i) {
+      auto lane = static_cast<std::uint32_t>(i + 1U);
+      state_a_[i] = (seed * lane) | 1U;
+      state_b_[i] = (~seed * lane * 0x632BE5ABU) | 1U;
+    }
+  }
+
+  /**
+   * @brief Fill a block with dither in (-1, 1) LSB, triangular PDF
+   * @param[out] out Dither values, size a multiple of LANES
+   */
+  void fill(std::span<float> out) noexcept {
+    // Difference of two uniform 24-bit values, scaled to +/- 1
+    constexpr float scale = 1.0F / 16777216.0F;
+
+    for (std::size_t i = 0; i < out.size(); i += LANES) {
+      for (std::size_t j = 0; j < LANES; ++j) {
+        state_a_[j] = step(state_a_[j]);
+        state_b_[j] = step(state_b_[j]);
+        auto a = static_cast<std::int32_t>(state_a_[j] >> 8U);
+        auto b = static_cast<std::int32_t>(state_b_[j] >> 8U);
+        out[i + j] = static_cast<float>(a - b) * scale;
+      }
+    }
+  }
+
+ private:
+  static std::uint32_t step(std::uint32_t x) noexcept {
+    x ^= x << 13U;
+    x ^= x >> 17U;
+    x ^= x << 5U;
+    return x;
+  }
+
+  std::array<std::uint32_t, LANES> state_a_{};
+  std::array<std::uint32_t, LANES> state_b_{};
+};
+
+/**
+ * @brief Quantize normalized float samples to integers
+ *
+ * Samples are scaled to Bits wide integers, optionally dithered, clipped
+ * and rounded, then shifted left so that the result is left justified in
+ * IntType, which is how libsndfile expects e.g. 24-bit samples in int.
+ * Rounding is half away from zero, by truncating after a signed bias.
+ * Noise is generated a block at a time so the conversion loop is branch
+ * free and vectorizes.
+ *
+ * @tparam IntType Output integer type
+ * @tparam Bits Number of significant bits
+ * @param in Normalized samples in [-1, 1)
+ * @param out Output samples, at least in.size() elements
+ * @param dither Dither generator, nullptr to disable dithering
+ */
+template <typename IntType, int Bits>
+void quantize(std::span<float const> in, std::span<IntType> out,
+              TpdfDither *dither) noexcept {
+  static_assert(Bits <= 32 && Bits <= int(sizeof(IntType) * 8));
+  constexpr std::size_t block = 16U * TpdfDither::LANES;
+  constexpr int shift = int(sizeof(IntType) * 8) - Bits;
+  constexpr float scale = float(std::uint64_t(1) << (Bits - 1));
+
+  // Largest float that still fits, 2^31 - 1 is not representable
+  constexpr float max_val = (Bits < 25) ? (scale - 1.0F) : 2147483520.0F;
+  constexpr float min_val = -scale;
+
+  alignas(64) std::array<float, block> noise{};
+  auto const *src = in.data();
+  auto *dst = out.data();
+  auto n = in.size();
+
+  for (std::size_t i = 0; i < n; i += block) {
+    auto len = std::min(block, n - i);
+
+    if (dither != nullptr) {
+      dither->fill(noise);
+    }
+
+    // Rounding happens before clipping, as nothing may follow the clip
+    // selects for the compiler to if-convert and vectorize the loop
+    for (std::size_t k = 0; k < len; ++k) {
+      auto v = src[i + k] * scale + noise[k];
+      v += std::copysign(0.5F, v);
+      v = (v > max_val) ? max_val : v;
+      v = (v < min_val) ? min_val : v;
+      auto q = static_cast<std::uint32_t>(static_cast<std::int32_t>(v));
+      dst[i + k] = static_cast<IntType>(q << shift);
+    }
+  }
+}
+
+#endif /* RTUTIL_SAMPLE_CONVERT_HH_ */
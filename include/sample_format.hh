@@ -0,0 +1,160 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef RTUTIL_SAMPLE_FORMAT_HH_
+#define RTUTIL_SAMPLE_FORMAT_HH_
+
+#include <optional>
+#include <string_view>
+#include <type_traits>
+
+#include "RtAudio.h"
+
+/**
+ * @brief On-disk sample format of recorded files
+ */
+enum class SampleFormat {
+  PCM16,   //!< 16-bit signed integer
+  PCM24,   //!< 24-bit signed integer
+  PCM32,   //!< 32-bit signed integer
+  FLOAT,   //!< 32-bit float, written without conversion
+  DOUBLE,  //!< 64-bit float
+};
+
+/**
+ * @brief Parse a sample format name
+ * @param name One of "pcm16", "pcm24", "pcm32", "float" or "double"
+ * @return std::optional<SampleFormat> Format, empty if unknown
+ */
+std::optional<SampleFormat> parse_sample_format(std::string_view name);
+
+/**
+ * @brief Layout of header-less PCM, e.g. piped from another process
+ */
+struct RawFormat {
+  int sample_rate{};  //!< Frames per second
+  int channels{};     //!< Interleaved channels
+
+  //! Sample format, always little endian
+  SampleFormat sample_format{SampleFormat::PCM16};
+};
+
+/**
+ * @brief Parse a header-less PCM layout
+ * @param spec "<rate>:<channels>:<format>", any field may be left empty
+ *  to take it from defaults, e.g. "48000::float"
+ * @param defaults Layout of the fields left empty
+ * @return std::optional<RawFormat> Layout, empty if malformed
+ */
+std::optional<RawFormat> parse_raw_format(std::string_view spec,
+                                          RawFormat const &defaults);
+
+/**
+ * @brief Get the libsndfile format of header-less PCM
+ * @param raw Layout
+ * @return int SF_FORMAT_RAW with the subformat, little endian
+ */
+int sf_raw_format(RawFormat const &raw);
+
+/**
+ * @brief Get the libsndfile subformat for a container
+ *
+ * Compressed containers have their own subformat, e.g. Ogg is always
+ * written as Vorbis whatever sample format is asked for.
+ *
+ * @param format Sample format
+ * @param major_format libsndfile major format, e.g. SF_FORMAT_WAV
+ * @return int libsndfile subformat
+ */
+int sf_subformat(SampleFormat format, int major_format);
+
+/**
+ * @brief Pick the stream format that moves a file's samples to and from
+ *  the device without conversion
+ *
+ * The file subformat maps to int16, int32 (left justified, also used for
+ * 24-bit files), float32 or float64. A 24-bit file gets packed 24-bit
+ * samples on a device that speaks those but not int32, see
+ * Packed24Stream. If the device does not natively
+ * speak that format, or the file has no matching sample type, float32
+ * is used and RtAudio / libsndfile convert as before.
+ *
+ * @param sf_format libsndfile format of the file
+ * @param native_formats RtAudio::DeviceInfo::nativeFormats of the device
+ * @return RtAudioFormat Stream format
+ */
+RtAudioFormat native_stream_format(int sf_format,
+                                   RtAudioFormat native_formats);
+
+/**
+ * @brief Get the libsndfile subformat that holds a stream's samples as
+ *  they are
+ * @param format RtAudio stream format, int16, int24, int32, float32 or
+ *  float64
+ * @return int libsndfile subformat
+ */
+int sf_subformat_of(RtAudioFormat format);
+
+/**
+ * @brief Get the RtAudio format of a sample type
+ * @tparam SampleType short, int, float or double
+ * @return RtAudioFormat Stream format
+ */
+template <typename SampleType>
+constexpr RtAudioFormat rt_format_of() {
+  if constexpr (std::is_same_v<SampleType, short>) {
+    return RTAUDIO_SINT16;
+  } else if constexpr (std::is_same_v<SampleType, int>) {
+    return RTAUDIO_SINT32;
+  } else if constexpr (std::is_same_v<SampleType, double>) {
+    return RTAUDIO_FLOAT64;
+  } else {
+    static_assert(std::is_same_v<SampleType, float>);
+    return RTAUDIO_FLOAT32;
+  }
+}
+
+/**
+ * @brief Call a function with the sample type of a stream format
+ * @note Packed 24-bit streams are handled as int32, the stream has to go
+ *  through a Packed24Stream
+ * @param format Stream format, from native_stream_format()
+ * @param function Called with std::type_identity<SampleType>
+ */
+template <typename Function>
+void visit_sample_type(RtAudioFormat format, Function function) {
+  switch (format) {
+    case RTAUDIO_SINT16:
+      function(std::type_identity<short>{});
+      break;
+    case RTAUDIO_SINT24:
+    case RTAUDIO_SINT32:
+      function(std::type_identity<int>{});
+      break;
+    case RTAUDIO_FLOAT64:
+      function(std::type_identity<double>{});
+      break;
+    case RTAUDIO_FLOAT32:
+    default:
+      function(std::type_identity<float>{});
+      break;
+  }
+}
+
+#endif /* RTUTIL_SAMPLE_FORMAT_HH_ */
@@ -0,0 +1,270 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef RTUTIL_SHARED_RING_HH_
+#define RTUTIL_SHARED_RING_HH_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+
+#include "RtAudio.h"
+#include "circular_buffer.hh"
+
+/**
+ * @brief Reader cursor in a shared ring
+ */
+struct alignas(CACHE_LINE_SIZE) SharedRingCursor {
+  std::atomic<std::uint64_t> read_head{0};  //!< Next frame to read
+  std::atomic<std::int32_t> pid{0};         //!< Owner, 0 when free
+  std::atomic<std::uint32_t> overruns{0};   //!< Times the writer lapped it
+};
+
+/**
+ * @brief Layout of the start of a shared ring segment
+ *
+ * The sample data follows at data_offset, a page boundary, and is
+ * capacity_frames interleaved frames of format. Heads count frames and
+ * run freely. The writer never waits for readers, so a reader more than
+ * capacity_frames behind has lost data and must skip ahead, and a
+ * reader checks write_claim after reading, as with a seqlock, to know
+ * that what it read was not overwritten meanwhile. Each reader owns a cursor,
+ * which the writer only reads, to report who is attached and how far
+ * behind they are. A reader that sleeps counts itself in waiters, and
+ * is woken with a shared futex on sequence.
+ */
+struct SharedRingHeader {
+  static constexpr std::uint32_t MAGIC = 0x52545552U;  // "RUTR"
+  static constexpr std::uint32_t VERSION = 1U;
+  static constexpr std::size_t MAX_READERS = 16U;
+
+  std::uint32_t magic{};          //!< MAGIC once the writer is set up
+  std::uint32_t version{};        //!< VERSION
+  std::uint32_t format{};         //!< RtAudioFormat of the samples
+  std::uint32_t sample_bytes{};   //!< Bytes per sample
+  std::uint32_t channels{};       //!< Interleaved channels
+  std::uint32_t sample_rate{};    //!< Frames per second
+  std::uint32_t period_frames{};  //!< Frames per write, as a hint
+  std::int32_t writer_pid{};      //!< Process writing the ring
+  std::uint64_t capacity_frames{};  //!< Ring size, a power of two
+  std::uint64_t data_offset{};      //!< Offset of the sample data
+
+  // Writer cache line. write_claim is moved ahead before frames are
+  // overwritten, and write_head once they are written
+  alignas(CACHE_LINE_SIZE) std::atomic<std::uint64_t> write_claim{0};
+  std::atomic<std::uint64_t> write_head{0};
+  std::atomic<std::uint32_t> sequence{0};  //!< Bumped on every write
+  std::atomic<std::uint32_t> waiters{0};   //!< Readers asleep on sequence
+  std::atomic<std::uint32_t> closed{0};    //!< Set when the writer stops
+
+  SharedRingCursor readers[MAX_READERS]{};
+};
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free,
+              "Shared ring heads must be lock-free to be shared");
+
+/**
+ * @brief Publish frames to a ring in POSIX shared memory
+ *
+ * The ring is named "/rtutil-<name>" and removed when the writer goes.
+ * The sample data is mapped twice back to back, as in RingStorage, so a
+ * write is always a single copy, and a reader always sees a contiguous
+ * region.
+ */
+class SharedRingWriter {
+ public:
+  /**
+   * @brief Create the ring
+   * @throw std::runtime_error if the ring can not be created, or another
+   *  writer is still publishing under the same name
+   * @param name Name of the ring
+   * @param format Sample format, int16, int32, float32 or float64
+   * @param channels Number of channels
+   * @param sample_rate Sample rate
+   * @param frames Minimum ring size in frames
+   */
+  SharedRingWriter(std::string const &name, RtAudioFormat format,
+                   int channels, int sample_rate, std::size_t frames);
+
+  SharedRingWriter(SharedRingWriter const &) = delete;
+  SharedRingWriter &operator=(SharedRingWriter const &) = delete;
+
+  /**
+   * @brief Mark the ring closed, wake readers and remove its name
+   */
+  ~SharedRingWriter();
+
+  /**
+   * @brief Get the ring size in frames
+   */
+  std::size_t capacity() const { return mask_ + 1U; }
+
+  /**
+   * @brief Set how many frames a write usually carries, as a latency
+   *  hint to readers
+   */
+  void set_period(unsigned int frames);
+
+  /**
+   * @brief Fault in the ring storage ahead of real-time use
+   */
+  void prefault();
+
+  /**
+   * @brief Append frames, overwriting the oldest ones
+   * @note Real-time safe, only makes a system call to wake a reader
+   *  that is asleep
+   * @param frames Interleaved frames in the ring's format
+   * @param count Number of frames
+   */
+  void write(void const *frames, std::size_t count) noexcept;
+
+  /**
+   * @brief Get the number of attached readers
+   */
+  std::size_t readers() const;
+
+  /**
+   * @brief Print the frames published and the readers still attached
+   */
+  void print_summary() const;
+
+ private:
+  std::string name_{};
+  SharedRingHeader *header_{nullptr};
+  std::size_t header_bytes_{};
+  unsigned char *data_{nullptr};
+  std::size_t data_bytes_{};
+  std::size_t frame_bytes_{};
+  std::uint64_t mask_{};
+};
+
+/**
+ * @brief Follow a ring in POSIX shared memory, reading its frames in
+ *  place
+ *
+ * The sample data is mapped read-only, only the reader's own cursor is
+ * written. A reader starts at the writer's head, i.e. with the next
+ * frames written.
+ */
+class SharedRingReader {
+ public:
+  /**
+   * @brief Attach to a ring and claim a cursor
+   * @throw std::runtime_error if there is no such ring, it is not
+   *  compatible, or every cursor is taken
+   * @param name Name of the ring
+   */
+  explicit SharedRingReader(std::string const &name);
+
+  SharedRingReader(SharedRingReader const &) = delete;
+  SharedRingReader &operator=(SharedRingReader const &) = delete;
+
+  /**
+   * @brief Release the cursor and detach
+   */
+  ~SharedRingReader();
+
+  RtAudioFormat format() const { return header_->format; }
+  int channels() const { return static_cast<int>(header_->channels); }
+  int sample_rate() const { return static_cast<int>(header_->sample_rate); }
+  std::size_t capacity() const { return header_->capacity_frames; }
+
+  /**
+   * @brief Get the writer's frames per write, 0 if not known yet
+   */
+  std::size_t period_frames() const { return header_->period_frames; }
+
+  /**
+   * @brief Check whether the writer has stopped
+   */
+  bool closed() const {
+    return header_->closed.load(std::memory_order_acquire) != 0U;
+  }
+
+  /**
+   * @brief Get the number of frames written but not read yet
+   * @note Real-time safe
+   * @return std::size_t Frames, more than capacity() once lapped
+   */
+  std::size_t available() const noexcept;
+
+  /**
+   * @brief Get frames ready to be read, in place
+   * @note Real-time safe. The frames are only known to be intact once
+   *  consume() says so
+   * @tparam SampleType Sample type of the ring's format
+   * @param frames Frames requested
+   * @return std::span<SampleType const> Up to frames interleaved frames
+   */
+  template <typename SampleType>
+  std::span<SampleType const> peek(std::size_t frames) const noexcept {
+    auto count = std::min(frames, std::min(available(), capacity()));
+    auto offset = (cursor_ & mask_) * header_->channels;
+    auto const *data = reinterpret_cast<SampleType const *>(data_);
+    return {data + offset, count * header_->channels};
+  }
+
+  /**
+   * @brief Release frames returned by peek()
+   * @note Real-time safe
+   * @param frames Number of frames read
+   * @return false if the writer overwrote them while they were read, so
+   *  they are not to be used
+   */
+  bool consume(std::size_t frames) noexcept;
+
+  /**
+   * @brief Move the cursor to a given distance behind the writer, e.g.
+   *  after falling behind
+   * @note Real-time safe
+   * @param lag Frames behind the writer's head, at most capacity()
+   */
+  void skip_to(std::size_t lag) noexcept;
+
+  /**
+   * @brief Sleep until frames are available or the writer stops
+   * @param frames Frames to wait for
+   * @param timeout_ms Longest wait
+   * @return true if the frames are available
+   */
+  bool wait(std::size_t frames, int timeout_ms);
+
+  /**
+   * @brief Get the times this reader was lapped by the writer
+   */
+  std::size_t overruns() const {
+    return cursor_slot_->overruns.load(std::memory_order_relaxed);
+  }
+
+ private:
+  std::string name_{};
+  SharedRingHeader *header_{nullptr};
+  std::size_t header_bytes_{};
+  unsigned char const *data_{nullptr};
+  std::size_t data_bytes_{};
+  std::uint64_t mask_{};
+  SharedRingCursor *cursor_slot_{nullptr};
+  std::uint64_t cursor_{};
+};
+
+#endif /* RTUTIL_SHARED_RING_HH_ */
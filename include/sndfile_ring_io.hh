@@ -0,0 +1,144 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef RTUTIL_SNDFILE_RING_IO_HH_
+#define RTUTIL_SNDFILE_RING_IO_HH_
+
+#include <algorithm>
+#include <span>
+
+#include "circular_buffer.hh"
+#include "sndfile.hh"
+
+/**
+ * @brief Read frames from a sound file straight into ring storage
+ *
+ * libsndfile only transfers whole frames, so when the wrap-around point
+ * splits a frame, that single frame is bounced through frame_scratch.
+ *
+ * @tparam File SndfileHandle, or anything with the same channels() and
+ *  readf()
+ * @tparam DataType Sample type of the ring
+ * @param file File to read from
+ * @param segments Writable region from CircularBuffer::prepare_write()
+ * @param frame_scratch Scratch space of at least one frame
+ * @return sf_count_t Number of frames read
+ */
+template <typename File, typename DataType>
+sf_count_t readf_segments(File &file,
+                          RingSegments<DataType> segments,
+                          std::span<DataType> frame_scratch) {
+  auto channels = static_cast<std::size_t>(file.channels());
+  auto first = segments.first;
+  auto second = segments.second;
+
+  auto hi_frames = static_cast<sf_count_t>(first.size() / channels);
+  auto frames = file.readf(first.data(), hi_frames);
+
+  // Mirrored storage hands out a single span, no split to handle
+  if ((frames < hi_frames) || second.empty()) {
+    return frames;
+  }
+
+  // Frame straddling the wrap-around point
+  auto split = first.size() % channels;
+  std::size_t lo_offset = 0;
+
+  if (split > 0) {
+    if (second.size() < (channels - split)) {
+      return frames;
+    }
+
+    if (file.readf(frame_scratch.data(), 1) < 1) {
+      return frames;
+    }
+
+    auto scratch_mid = frame_scratch.begin() + split;
+    std::copy(frame_scratch.begin(), scratch_mid,
+              first.end() - static_cast<std::ptrdiff_t>(split));
+    std::copy(scratch_mid, frame_scratch.begin() + channels, second.begin());
+    lo_offset = channels - split;
+    ++frames;
+  }
+
+  auto lo_frames =
+      static_cast<sf_count_t>((second.size() - lo_offset) / channels);
+  frames += file.readf(second.data() + lo_offset, lo_frames);
+  return frames;
+}
+
+/**
+ * @brief Write frames to a sound file straight from ring storage
+ *
+ * libsndfile only transfers whole frames, so when the wrap-around point
+ * splits a frame, that single frame is bounced through frame_scratch.
+ *
+ * @tparam File SndfileHandle, or anything with the same channels() and
+ *  writef()
+ * @tparam DataType Sample type of the ring
+ * @param file File to write to
+ * @param segments Readable region from CircularBuffer::peek_read()
+ * @param frame_scratch Scratch space of at least one frame
+ * @return sf_count_t Number of frames written
+ */
+template <typename File, typename DataType>
+sf_count_t writef_segments(File &file,
+                           RingSegments<DataType> segments,
+                           std::span<DataType> frame_scratch) {
+  auto channels = static_cast<std::size_t>(file.channels());
+  auto first = segments.first;
+  auto second = segments.second;
+
+  auto hi_frames = static_cast<sf_count_t>(first.size() / channels);
+  auto frames = file.writef(first.data(), hi_frames);
+
+  // Mirrored storage hands out a single span, no split to handle
+  if ((frames < hi_frames) || second.empty()) {
+    return frames;
+  }
+
+  // Frame straddling the wrap-around point
+  auto split = first.size() % channels;
+  std::size_t lo_offset = 0;
+
+  if (split > 0) {
+    if (second.size() < (channels - split)) {
+      return frames;
+    }
+
+    lo_offset = channels - split;
+    auto scratch_mid =
+        std::copy(first.end() - static_cast<std::ptrdiff_t>(split),
+                  first.end(), frame_scratch.begin());
+    std::copy(second.begin(), second.begin() + lo_offset, scratch_mid);
+
+    if (file.writef(frame_scratch.data(), 1) < 1) {
+      return frames;
+    }
+
+    ++frames;
+  }
+
+  auto lo_frames =
+      static_cast<sf_count_t>((second.size() - lo_offset) / channels);
+  frames += file.writef(second.data() + lo_offset, lo_frames);
+  return frames;
+}
+
+#endif /* RTUTIL_SNDFILE_RING_IO_HH_ */
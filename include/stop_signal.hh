@@ -0,0 +1,42 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef RTUTIL_STOP_SIGNAL_HH_
+#define RTUTIL_STOP_SIGNAL_HH_
+
+/**
+ * @brief Install SIGINT/SIGTERM handlers that request a clean stop, a
+ *  second signal terminates the process
+ */
+void install_stop_handler();
+
+/**
+ * @brief Request the running process to stop
+ * @note Async-signal and real-time safe
+ */
+void request_stop() noexcept;
+
+/**
+ * @brief Check whether a stop has been requested
+ * @note Async-signal and real-time safe
+ * @return true if a stop has been requested
+ */
+bool stop_requested() noexcept;
+
+#endif /* RTUTIL_STOP_SIGNAL_HH_ */
@@ -0,0 +1,120 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef RTUTIL_STREAM_CONFIG_HH_
+#define RTUTIL_STREAM_CONFIG_HH_
+
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "RtAudio.h"
+#include "audio_file_writer.hh"
+#include "play_region.hh"
+#include "resampler.hh"
+#include "sample_format.hh"
+#include "virtual_device.hh"
+
+/**
+ * @brief Named trade-offs between latency and robustness
+ */
+enum class LatencyProfile {
+  LOW,       //!< Small periods for live monitoring
+  BALANCED,  //!< Default
+  SAFE,      //!< Large periods and deep queue for bulk capture
+};
+
+/**
+ * @brief Stream timing and buffering configuration
+ */
+struct StreamConfig {
+  unsigned int frames{512};      //!< Frames per period (callback)
+  unsigned int periods{4};       //!< Device periods, 0 for API default
+  unsigned int queue_ms{1000};   //!< Depth of the file IO ring
+  bool minimize_latency{false};  //!< Request RTAUDIO_MINIMIZE_LATENCY
+  bool realtime{false};          //!< Real-time threads and locked memory
+  int rt_priority{70};           //!< SCHED_FIFO priority of the callback
+  int io_cpu{-1};                //!< CPU to pin file IO thread, -1 for any
+  int callback_cpu{-1};          //!< CPU to pin callback thread, -1 for any
+  unsigned int device_rate{0};   //!< Device sample rate, 0 to pick one
+
+  //! Quality of sample rate conversion between file and device
+  ResampleQuality resample_quality{ResampleQuality::MEDIUM};
+
+  //! Sample format of recorded files
+  SampleFormat sample_format{SampleFormat::PCM16};
+  bool dither{true};  //!< TPDF dither when recording to integer formats
+  bool mmap{false};   //!< Play uncompressed files from a file mapping
+
+  //! How recorded files are written and synced
+  WriterConfig writer{};
+
+  //! Part of the file to play, and how often
+  PlayRegion region{};
+
+  //! Playback latency to hold against a source on its own clock, 0 off
+  unsigned int drift_lock_ms{0};
+
+  //! Layout of header-less PCM to play or record, e.g. on a pipe
+  std::optional<RawFormat> raw{};
+
+  //! Name of a shared-memory ring to publish the capture to, empty off
+  std::string publish{};
+
+  //! Device without hardware, used instead of RtAudio when enabled
+  VirtualDeviceConfig virtual_device{};
+};
+
+/**
+ * @brief Parse a latency profile name
+ * @param name One of "low", "balanced" or "safe"
+ * @return std::optional<LatencyProfile> Profile, empty if unknown
+ */
+std::optional<LatencyProfile> parse_latency_profile(std::string_view name);
+
+/**
+ * @brief Get the stream configuration of a latency profile
+ * @param profile Latency profile
+ * @return StreamConfig Configuration
+ */
+StreamConfig make_stream_config(LatencyProfile profile);
+
+/**
+ * @brief Get RtAudio stream options for the configuration
+ * @param config Stream configuration
+ * @return RtAudio::StreamOptions Stream options
+ */
+RtAudio::StreamOptions make_stream_options(StreamConfig const &config);
+
+/**
+ * @brief Get the number of frames the file IO ring should hold
+ * @param config Stream configuration
+ * @param sample_rate Stream sample rate
+ * @return std::size_t Queue length in frames
+ */
+std::size_t queue_frames(StreamConfig const &config, int sample_rate);
+
+/**
+ * @brief Get the fewest frames the file IO ring may hold
+ * @param frame_size Frames per period
+ * @return std::size_t Queue length in frames
+ */
+std::size_t min_queue_frames(unsigned int frame_size);
+
+#endif /* RTUTIL_STREAM_CONFIG_HH_ */
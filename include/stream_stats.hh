@@ -0,0 +1,156 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef RTUTIL_STREAM_STATS_HH_
+#define RTUTIL_STREAM_STATS_HH_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "RtAudio.h"
+
+/**
+ * @brief Xrun counters, written by the audio callback and read by any
+ *  other thread
+ *
+ * Every counter has a single writer, so updates are plain relaxed
+ * load/store pairs rather than locked read-modify-writes.
+ */
+class StreamStats {
+ public:
+  /**
+   * @brief Consistent enough copy of the counters for reporting
+   */
+  struct Snapshot {
+    std::uint64_t device_underflows{};    //!< Output xruns reported by device
+    std::uint64_t device_overflows{};     //!< Input xruns reported by device
+    std::uint64_t ring_underruns{};       //!< Callbacks that found ring short
+    std::uint64_t ring_overruns{};        //!< Callbacks that found ring full
+    std::uint64_t samples_zero_filled{};  //!< Samples played as silence
+    std::uint64_t samples_dropped{};      //!< Samples that did not fit
+    std::uint64_t worst_gap_frames{};     //!< Longest run of lost frames
+
+    /**
+     * @brief Get total number of xruns of any kind
+     * @return std::uint64_t Number of xruns
+     */
+    std::uint64_t xruns() const {
+      return device_underflows + device_overflows + ring_underruns +
+             ring_overruns;
+    }
+  };
+
+  /**
+   * @brief Account the stream status passed to the audio callback
+   * @param status RtAudio stream status flags
+   */
+  void on_device_status(RtAudioStreamStatus status) noexcept {
+    if (status & RTAUDIO_OUTPUT_UNDERFLOW) {
+      bump(device_underflows_, 1U);
+    }
+
+    if (status & RTAUDIO_INPUT_OVERFLOW) {
+      bump(device_overflows_, 1U);
+    }
+  }
+
+  /**
+   * @brief Account a callback that had to zero-fill its output
+   * @param samples Number of samples zero-filled
+   * @param frames Number of frames zero-filled
+   */
+  void on_ring_underrun(std::size_t samples, std::size_t frames) noexcept {
+    bump(ring_underruns_, 1U);
+    bump(samples_zero_filled_, samples);
+    extend_gap(frames);
+  }
+
+  /**
+   * @brief Account a callback that could not queue all of its input
+   * @param samples Number of samples dropped
+   * @param frames Number of frames dropped
+   */
+  void on_ring_overrun(std::size_t samples, std::size_t frames) noexcept {
+    bump(ring_overruns_, 1U);
+    bump(samples_dropped_, samples);
+    extend_gap(frames);
+  }
+
+  /**
+   * @brief Account a callback that transferred all of its frames
+   */
+  void on_ring_ok() noexcept { current_gap_ = 0; }
+
+  /**
+   * @brief Copy the counters
+   * @return Snapshot Current counter values
+   */
+  Snapshot snapshot() const noexcept {
+    constexpr auto order = std::memory_order_relaxed;
+    return {.device_underflows = device_underflows_.load(order),
+            .device_overflows = device_overflows_.load(order),
+            .ring_underruns = ring_underruns_.load(order),
+            .ring_overruns = ring_overruns_.load(order),
+            .samples_zero_filled = samples_zero_filled_.load(order),
+            .samples_dropped = samples_dropped_.load(order),
+            .worst_gap_frames = worst_gap_frames_.load(order)};
+  }
+
+ private:
+  using Counter = std::atomic<std::uint64_t>;
+
+  static void bump(Counter &counter, std::uint64_t n) noexcept {
+    counter.store(counter.load(std::memory_order_relaxed) + n,
+                  std::memory_order_relaxed);
+  }
+
+  void extend_gap(std::size_t frames) noexcept {
+    current_gap_ += frames;
+
+    if (current_gap_ > worst_gap_frames_.load(std::memory_order_relaxed)) {
+      worst_gap_frames_.store(current_gap_, std::memory_order_relaxed);
+    }
+  }
+
+  Counter device_underflows_{0};
+  Counter device_overflows_{0};
+  Counter ring_underruns_{0};
+  Counter ring_overruns_{0};
+  Counter samples_zero_filled_{0};
+  Counter samples_dropped_{0};
+  Counter worst_gap_frames_{0};
+  std::uint64_t current_gap_{0};  // Only touched by the callback
+};
+
+/**
+ * @brief Format a short summary for the status line
+ * @param stats Counter snapshot
+ * @return std::string Status text
+ */
+std::string stats_status_str(StreamStats::Snapshot const &stats);
+
+/**
+ * @brief Print a full report of the counters
+ * @param stats Counter snapshot
+ * @param sample_rate Stream sample rate, to express the worst gap in ms
+ */
+void print_stats_summary(StreamStats::Snapshot const &stats, int sample_rate);
+
+#endif /* RTUTIL_STREAM_STATS_HH_ */
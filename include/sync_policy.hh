@@ -0,0 +1,108 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef RTUTIL_SYNC_POLICY_HH_
+#define RTUTIL_SYNC_POLICY_HH_
+
+#include <chrono>
+#include <cstddef>
+#include <optional>
+#include <string_view>
+
+/**
+ * @brief When recorded data is flushed to stable storage
+ */
+struct SyncPolicy {
+  enum class Mode {
+    NONE,      //!< Never, leave it to the OS
+    INTERVAL,  //!< Once interval_ms has passed since the last sync
+    BYTES,     //!< Once bytes have been written since the last sync
+    CLOSE,     //!< Once, when the file is closed
+  };
+
+  Mode mode{Mode::INTERVAL};
+  unsigned int interval_ms{1000};
+  std::size_t bytes{0};
+};
+
+/**
+ * @brief Parse a sync policy
+ * @param spec One of "none", "interval:<ms>", "bytes:<n>" or "close"
+ * @return std::optional<SyncPolicy> Policy, empty if malformed
+ */
+std::optional<SyncPolicy> parse_sync_policy(std::string_view spec);
+
+/**
+ * @brief Keeps track of when a writer is due to sync
+ */
+class SyncSchedule {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit SyncSchedule(SyncPolicy const &policy)
+      : policy_(policy), last_sync_(Clock::now()) {}
+
+  /**
+   * @brief Account for written data
+   * @param bytes Number of bytes written
+   */
+  void on_write(std::size_t bytes) { pending_bytes_ += bytes; }
+
+  /**
+   * @brief Check whether a sync is due now
+   * @return true if the writer should sync
+   */
+  bool due() const {
+    if (pending_bytes_ == 0) {
+      return false;
+    }
+
+    switch (policy_.mode) {
+      case SyncPolicy::Mode::INTERVAL:
+        return (Clock::now() - last_sync_) >=
+               std::chrono::milliseconds(policy_.interval_ms);
+      case SyncPolicy::Mode::BYTES:
+        return pending_bytes_ >= policy_.bytes;
+      case SyncPolicy::Mode::NONE:
+      case SyncPolicy::Mode::CLOSE:
+      default:
+        return false;
+    }
+  }
+
+  /**
+   * @brief Check whether the file should be synced when it is closed
+   */
+  bool sync_on_close() const { return policy_.mode != SyncPolicy::Mode::NONE; }
+
+  /**
+   * @brief Record that a sync has been issued
+   */
+  void on_sync() {
+    pending_bytes_ = 0;
+    last_sync_ = Clock::now();
+  }
+
+ private:
+  SyncPolicy policy_{};
+  Clock::time_point last_sync_{};
+  std::size_t pending_bytes_{};
+};
+
+#endif /* RTUTIL_SYNC_POLICY_HH_ */
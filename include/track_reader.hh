@@ -0,0 +1,114 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef RTUTIL_TRACK_READER_HH_
+#define RTUTIL_TRACK_READER_HH_
+
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "resampler.hh"
+#include "sndfile.hh"
+
+/**
+ * @brief Decode a file to float frames in a stream's channel layout and
+ *  sample rate
+ *
+ * Channels are mapped when the file has a different channel count than
+ * the stream: mono is copied to every channel, anything is averaged down
+ * to mono, and otherwise channels map one to one, with extra file
+ * channels dropped and missing ones silent. The sample rate is converted
+ * when it differs from the stream's.
+ */
+class TrackReader {
+ public:
+  static constexpr std::size_t BLOCK_FRAMES = 4096U;
+
+  /**
+   * @brief Open a file and decode its first block
+   * @throw std::runtime_error if the file can not be opened, or the
+   *  resampler can not be created
+   * @param filename Path of the file
+   * @param channels Number of stream channels
+   * @param sample_rate Stream sample rate
+   * @param quality Quality of sample rate conversion, if needed
+   */
+  TrackReader(std::string const &filename, int channels, int sample_rate,
+              ResampleQuality quality);
+
+  /**
+   * @brief Decode frames
+   * @param out Interleaved frames in the stream layout, whole frames
+   * @return std::size_t Frames decoded, less than asked for only at the
+   *  end of the track
+   */
+  std::size_t read(std::span<float> out);
+
+  /**
+   * @brief Check whether every frame of the track has been read
+   */
+  bool done() const { return done_ && (primed_frames_ == 0); }
+
+  std::string const &filename() const { return filename_; }
+  int file_channels() const { return file_.channels(); }
+  int file_rate() const { return file_.samplerate(); }
+
+  /**
+   * @brief Get the length of the track at the stream sample rate
+   * @return std::size_t Number of frames, approximate when resampled
+   */
+  std::size_t stream_frames() const { return stream_frames_; }
+
+ private:
+  /**
+   * @brief Decode and channel map file frames, without resampling
+   * @param out Interleaved frames in the stream layout
+   * @return std::size_t Frames decoded
+   */
+  std::size_t read_mapped(std::span<float> out);
+
+  /**
+   * @brief Decode, channel map and resample
+   * @param out Interleaved frames in the stream layout
+   * @return std::size_t Frames produced
+   */
+  std::size_t read_resampled(std::span<float> out);
+
+ private:
+  std::string filename_{};
+  SndfileHandle file_{};
+  std::size_t channels_{};
+  std::size_t stream_frames_{};
+  std::vector<float> decode_{};
+  std::unique_ptr<Resampler> resampler_{};
+  std::vector<float> resample_in_{};
+  std::size_t resample_in_frames_{};
+  bool file_eof_{false};
+  bool done_{false};
+
+  // First block, decoded when the track is opened
+  std::vector<float> primed_{};
+  std::size_t primed_frames_{};
+  std::size_t primed_offset_{};
+};
+
+#endif /* RTUTIL_TRACK_READER_HH_ */
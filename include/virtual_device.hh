@@ -0,0 +1,138 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef RTUTIL_VIRTUAL_DEVICE_HH_
+#define RTUTIL_VIRTUAL_DEVICE_HH_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "RtAudio.h"
+#include "audio_stream.hh"
+#include "sndfile.hh"
+
+/**
+ * @brief Virtual device configuration
+ */
+struct VirtualDeviceConfig {
+  bool enabled{false};  //!< Use the virtual device instead of RtAudio
+
+  //! Multiple of real time the device runs at, 0 for as fast as possible
+  double speed{1.0};
+
+  //! Input: silence, noise, sine:<hz>, loopback, or a file to loop
+  std::string source{"sine:440"};
+
+  //! WAV file that receives the output, empty to discard it
+  std::string sink{};
+};
+
+/**
+ * @brief A device without hardware
+ *
+ * A timer thread calls the stream callback once a period, paced at the
+ * sample rate times the configured speed, or back to back at speed 0.
+ * The input is generated, read from a file, or is the output looped
+ * back through the device's periods of buffering. The output is written
+ * to a WAV file or discarded. A timer that falls a whole period behind
+ * is reported to the callback as an xrun, like a real device would.
+ */
+class VirtualAudioStream : public AudioStream {
+ public:
+  static constexpr unsigned int MAX_CHANNELS = 32U;
+
+  /**
+   * @brief Construct a new virtual device
+   * @param config Virtual device configuration
+   */
+  explicit VirtualAudioStream(VirtualDeviceConfig config);
+
+  VirtualAudioStream(VirtualAudioStream const &) = delete;
+  VirtualAudioStream &operator=(VirtualAudioStream const &) = delete;
+
+  ~VirtualAudioStream() override;
+
+  std::string api_name() override;
+  unsigned int default_output_device() override { return 0U; }
+  unsigned int default_input_device() override { return 0U; }
+  RtAudio::DeviceInfo device_info(unsigned int device) override;
+
+  /**
+   * @brief Open the stream
+   * @throw std::runtime_error if a parameter is out of range, or the
+   *  source or sink can not be opened
+   */
+  void open(RtAudio::StreamParameters *output,
+            RtAudio::StreamParameters *input, RtAudioFormat format,
+            unsigned int sample_rate, unsigned int *frames,
+            RtAudioCallback callback, void *user_data,
+            RtAudio::StreamOptions *options) override;
+
+  void start() override;
+  void close() override;
+  long latency() override;
+
+ private:
+  /**
+   * @brief Input signal of the device
+   */
+  enum class Source { SILENCE, NOISE, SINE, LOOPBACK, FILE };
+
+  void run();
+  void make_input();
+  void write_output();
+
+ private:
+  VirtualDeviceConfig config_{};
+  Source source_{Source::SILENCE};
+  double sine_hz_{};
+  double sine_phase_{};
+  std::uint32_t noise_state_{0x9E3779B9U};
+  SndfileHandle source_file_{};
+  SndfileHandle sink_file_{};
+
+  RtAudioCallback callback_{};
+  void *user_data_{};
+  RtAudioFormat format_{};
+  std::size_t sample_size_{};
+  std::size_t out_channels_{};
+  std::size_t in_channels_{};
+  std::size_t frames_{};
+  std::size_t periods_{};
+  unsigned int sample_rate_{};
+  int rt_priority_{-1};
+
+  std::vector<std::byte> output_{};
+  std::vector<std::byte> input_{};
+  std::vector<float> input_float_{};
+  std::vector<float> file_scratch_{};
+
+  // Output periods on their way back to the input in loopback
+  std::vector<std::vector<std::byte>> loop_periods_{};
+  std::size_t loop_index_{};
+
+  std::thread thread_{};
+  std::atomic<bool> running_{false};
+};
+
+#endif /* RTUTIL_VIRTUAL_DEVICE_HH_ */
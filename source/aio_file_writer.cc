@@ -0,0 +1,535 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "aio_file_writer.hh"
+
+bool AioFileWriter::supports(int format) {
+  auto major = format & SF_FORMAT_TYPEMASK;
+  auto subformat = format & SF_FORMAT_SUBMASK;
+  auto endian = format & SF_FORMAT_ENDMASK;
+
+  // Samples are always written little endian
+  bool little = (endian == SF_ENDIAN_LITTLE) ||
+                (((endian == SF_ENDIAN_FILE) || (endian == SF_ENDIAN_CPU)) &&
+                 (std::endian::native == std::endian::little));
+
+  return ((major == SF_FORMAT_RAW) || (major == SF_FORMAT_WAV)) && little &&
+         ((subformat == SF_FORMAT_PCM_16) || (subformat == SF_FORMAT_PCM_24) ||
+          (subformat == SF_FORMAT_PCM_32) || (subformat == SF_FORMAT_FLOAT) ||
+          (subformat == SF_FORMAT_DOUBLE));
+}
+
+#if defined(__linux__)
+
+namespace {
+
+// Samples encoded per pass through the staging buffer
+constexpr std::size_t STAGING_SAMPLES = 8192U;
+
+/**
+ * @brief Convert a sample to a Bits wide integer, not left justified
+ */
+template <int Bits, typename SampleType>
+std::int32_t to_int(SampleType v) {
+  if constexpr (std::is_floating_point_v<SampleType>) {
+    constexpr auto scale = double(std::uint64_t(1) << (Bits - 1));
+    auto q = std::round(static_cast<double>(v) * scale);
+    return static_cast<std::int32_t>(std::clamp(q, -scale, scale - 1.0));
+  } else {
+    constexpr int bits = int(sizeof(SampleType) * 8);
+    if constexpr (bits >= Bits) {
+      return static_cast<std::int32_t>(v) >> (bits - Bits);
+    } else {
+      auto u = static_cast<std::uint32_t>(static_cast<std::int32_t>(v));
+      return static_cast<std::int32_t>(u << (Bits - bits));
+    }
+  }
+}
+
+/**
+ * @brief Convert a sample to a normalized floating point value
+ */
+template <typename SampleType>
+double to_double(SampleType v) {
+  if constexpr (std::is_floating_point_v<SampleType>) {
+    return static_cast<double>(v);
+  } else {
+    constexpr auto scale = double(std::uint64_t(1) << (sizeof(v) * 8 - 1));
+    return static_cast<double>(v) / scale;
+  }
+}
+
+template <typename Word>
+unsigned char *store_le(unsigned char *dst, Word word, std::size_t size) {
+  auto u = static_cast<std::uint64_t>(word);
+  for (std::size_t i = 0; i < size; ++i) {
+    dst[i] = static_cast<unsigned char>(u >> (8U * i));
+  }
+  return dst + size;
+}
+
+/**
+ * @brief Encode samples as little endian in the file's subformat
+ */
+template <typename SampleType>
+void encode(SampleType const *src, std::size_t n, int subformat,
+            unsigned char *dst) {
+  for (std::size_t i = 0; i < n; ++i) {
+    switch (subformat) {
+      case SF_FORMAT_PCM_16:
+        dst = store_le(dst, to_int<16>(src[i]), 2);
+        break;
+      case SF_FORMAT_PCM_24:
+        dst = store_le(dst, to_int<24>(src[i]), 3);
+        break;
+      case SF_FORMAT_PCM_32:
+        dst = store_le(dst, to_int<32>(src[i]), 4);
+        break;
+      case SF_FORMAT_FLOAT: {
+        auto f = static_cast<float>(to_double(src[i]));
+        dst = store_le(dst, std::bit_cast<std::uint32_t>(f), 4);
+        break;
+      }
+      case SF_FORMAT_DOUBLE:
+      default: {
+        auto d = to_double(src[i]);
+        dst = store_le(dst, std::bit_cast<std::uint64_t>(d), 8);
+        break;
+      }
+    }
+  }
+}
+
+std::size_t subformat_bytes(int subformat) {
+  switch (subformat) {
+    case SF_FORMAT_PCM_16:
+      return 2;
+    case SF_FORMAT_PCM_24:
+      return 3;
+    case SF_FORMAT_PCM_32:
+    case SF_FORMAT_FLOAT:
+      return 4;
+    case SF_FORMAT_DOUBLE:
+    default:
+      return 8;
+  }
+}
+
+std::size_t round_up(std::size_t size, std::size_t alignment) {
+  return ((size + alignment - 1) / alignment) * alignment;
+}
+
+}  // namespace
+
+AioFileWriter::AioFileWriter(std::string const &filename, int format,
+                             int channels, int samplerate,
+                             WriterConfig const &config)
+    : AudioFileWriter(format, channels, samplerate),
+      direct_io_(config.direct_io),
+      is_wav_((format & SF_FORMAT_TYPEMASK) == SF_FORMAT_WAV),
+      subformat_(format & SF_FORMAT_SUBMASK),
+      sample_bytes_(subformat_bytes(subformat_)),
+      schedule_(config.sync) {
+  if (!supports(format)) {
+    throw std::runtime_error("Unsupported format for the aio writer");
+  }
+
+  int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+  fd_ = ::open(filename.c_str(), flags | (direct_io_ ? O_DIRECT : 0), 0644);
+
+  // Not every file system does O_DIRECT, e.g. tmpfs
+  if ((fd_ < 0) && direct_io_ && (errno == EINVAL)) {
+    std::cerr << "Warning: O_DIRECT is not supported for \"" << filename
+              << "\", using buffered IO" << std::endl;
+    direct_io_ = false;
+    fd_ = ::open(filename.c_str(), flags, 0644);
+  }
+
+  if (fd_ < 0) {
+    throw std::runtime_error("Error opening file \"" + filename +
+                             "\" for writing: " + std::strerror(errno));
+  }
+
+  for (auto &buffer : buffers_) {
+    buffer.data = static_cast<unsigned char *>(
+        std::aligned_alloc(ALIGNMENT, BUFFER_BYTES));
+
+    if (buffer.data == nullptr) {
+      release();
+      throw std::bad_alloc();
+    }
+  }
+
+  staging_.resize(STAGING_SAMPLES * sample_bytes_);
+
+  // Sample data starts on a block boundary with O_DIRECT
+  header_bytes_ = is_wav_ ? (direct_io_ ? ALIGNMENT : 44U) : 0U;
+  write_offset_ = header_bytes_;
+
+  if (is_wav_ && !write_header(std::nullopt)) {
+    release();
+    throw std::runtime_error("Error writing header of \"" + filename + "\"");
+  }
+}
+
+AioFileWriter::~AioFileWriter() {
+  if (fd_ >= 0) {
+    close();
+  }
+
+  release();
+}
+
+void AioFileWriter::release() {
+  if (fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+
+  for (auto &buffer : buffers_) {
+    std::free(buffer.data);
+    buffer.data = nullptr;
+  }
+}
+
+template <typename SampleType>
+sf_count_t AioFileWriter::write_frames(SampleType const *ptr,
+                                       sf_count_t frames) {
+  if (failed_ || closed_) {
+    return 0;
+  }
+
+  auto n = static_cast<std::size_t>(frames) *
+           static_cast<std::size_t>(channels());
+
+  // Samples already in the file's encoding are copied as they are
+  constexpr bool little = (std::endian::native == std::endian::little);
+  bool same_encoding =
+      little &&
+      ((std::is_same_v<SampleType, short> && subformat_ == SF_FORMAT_PCM_16) ||
+       (std::is_same_v<SampleType, int> && subformat_ == SF_FORMAT_PCM_32) ||
+       (std::is_same_v<SampleType, float> && subformat_ == SF_FORMAT_FLOAT) ||
+       (std::is_same_v<SampleType, double> && subformat_ == SF_FORMAT_DOUBLE));
+
+  if (same_encoding) {
+    if (!put_bytes(reinterpret_cast<unsigned char const *>(ptr),
+                   n * sizeof(SampleType))) {
+      return 0;
+    }
+  } else {
+    for (std::size_t i = 0; i < n; i += STAGING_SAMPLES) {
+      auto chunk = std::min(STAGING_SAMPLES, n - i);
+      encode(ptr + i, chunk, subformat_, staging_.data());
+
+      if (!put_bytes(staging_.data(), chunk * sample_bytes_)) {
+        return 0;
+      }
+    }
+  }
+
+  auto bytes = n * sample_bytes_;
+  data_bytes_ += bytes;
+  schedule_.on_write(bytes);
+  return frames;
+}
+
+sf_count_t AioFileWriter::writef(short const *ptr, sf_count_t frames) {
+  return write_frames(ptr, frames);
+}
+
+sf_count_t AioFileWriter::writef(int const *ptr, sf_count_t frames) {
+  return write_frames(ptr, frames);
+}
+
+sf_count_t AioFileWriter::writef(float const *ptr, sf_count_t frames) {
+  return write_frames(ptr, frames);
+}
+
+sf_count_t AioFileWriter::writef(double const *ptr, sf_count_t frames) {
+  return write_frames(ptr, frames);
+}
+
+bool AioFileWriter::put_bytes(unsigned char const *src, std::size_t size) {
+  while (size > 0) {
+    auto &buffer = buffers_[current_];
+    auto n = std::min(size, BUFFER_BYTES - buffer.used);
+    std::memcpy(buffer.data + buffer.used, src, n);
+    buffer.used += n;
+    src += n;
+    size -= n;
+
+    if ((buffer.used == BUFFER_BYTES) && !submit_current(BUFFER_BYTES)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool AioFileWriter::submit_current(std::size_t size) {
+  if (size == 0) {
+    return true;
+  }
+
+  auto &buffer = buffers_[current_];
+  buffer.cb = aiocb{};
+  buffer.cb.aio_fildes = fd_;
+  buffer.cb.aio_buf = buffer.data;
+  buffer.cb.aio_nbytes = size;
+  buffer.cb.aio_offset = static_cast<off_t>(write_offset_);
+  buffer.cb.aio_sigevent.sigev_notify = SIGEV_NONE;
+
+  if (aio_write(&buffer.cb) != 0) {
+    return fail("aio_write");
+  }
+
+  buffer.in_flight = true;
+  write_offset_ += size;
+
+  // Only block on the disk when every buffer is in flight
+  auto next = (current_ + 1U) % BUFFER_COUNT;
+  auto &next_buffer = buffers_[next];
+
+  if (!wait(next_buffer)) {
+    return false;
+  }
+
+  auto carry = buffer.used - size;
+  std::memcpy(next_buffer.data, buffer.data + size, carry);
+  next_buffer.used = carry;
+  buffer.used = 0;
+  current_ = next;
+  return true;
+}
+
+bool AioFileWriter::wait(Buffer &buffer) {
+  if (!buffer.in_flight) {
+    return true;
+  }
+
+  aiocb const *list[] = {&buffer.cb};
+
+  while (aio_error(&buffer.cb) == EINPROGRESS) {
+    aio_suspend(list, 1, nullptr);
+  }
+
+  buffer.in_flight = false;
+  auto written = aio_return(&buffer.cb);
+
+  if ((written < 0) ||
+      (static_cast<std::size_t>(written) != buffer.cb.aio_nbytes)) {
+    return fail("aio write");
+  }
+
+  return true;
+}
+
+bool AioFileWriter::flush() {
+  if (failed_ || closed_) {
+    return !failed_;
+  }
+
+  if (!schedule_.due()) {
+    return true;
+  }
+
+  // Queue what has been buffered so far, the sync then covers it
+  auto used = buffers_[current_].used;
+  if (!submit_current(direct_io_ ? (used - (used % ALIGNMENT)) : used)) {
+    return false;
+  }
+
+  // A sync still running from last time is left to finish on its own
+  if (sync_in_flight_ && (aio_error(&sync_cb_) != EINPROGRESS)) {
+    sync_in_flight_ = false;
+    if (aio_return(&sync_cb_) != 0) {
+      return fail("aio_fsync");
+    }
+  }
+
+  if (!sync_in_flight_) {
+    sync_cb_ = aiocb{};
+    sync_cb_.aio_fildes = fd_;
+    sync_cb_.aio_sigevent.sigev_notify = SIGEV_NONE;
+
+    if (aio_fsync(O_DSYNC, &sync_cb_) != 0) {
+      return fail("aio_fsync");
+    }
+
+    sync_in_flight_ = true;
+  }
+
+  schedule_.on_sync();
+  return true;
+}
+
+bool AioFileWriter::close() {
+  if (closed_) {
+    return !failed_;
+  }
+
+  closed_ = true;
+
+  // O_DIRECT writes whole blocks, the padding is truncated below
+  auto &buffer = buffers_[current_];
+  auto size = buffer.used;
+
+  if (direct_io_) {
+    size = round_up(size, ALIGNMENT);
+    std::memset(buffer.data + buffer.used, 0, size - buffer.used);
+    buffer.used = size;
+  }
+
+  if (!failed_) {
+    submit_current(size);
+  }
+
+  for (auto &b : buffers_) {
+    wait(b);
+  }
+
+  if (sync_in_flight_) {
+    aiocb const *list[] = {&sync_cb_};
+    while (aio_error(&sync_cb_) == EINPROGRESS) {
+      aio_suspend(list, 1, nullptr);
+    }
+    aio_return(&sync_cb_);
+    sync_in_flight_ = false;
+  }
+
+  // RIFF chunks are padded to an even size
+  auto pad = (is_wav_ && (data_bytes_ & 1U)) ? 1U : 0U;
+  auto file_size = header_bytes_ + data_bytes_ + pad;
+
+  if (ftruncate(fd_, static_cast<off_t>(file_size)) != 0) {
+    fail("ftruncate");
+  }
+
+  if (is_wav_ && !failed_ && !write_header(data_bytes_)) {
+    fail("header");
+  }
+
+  if (schedule_.sync_on_close() && (fdatasync(fd_) != 0)) {
+    fail("fdatasync");
+  }
+
+  ::close(fd_);
+  fd_ = -1;
+  return !failed_;
+}
+
+bool AioFileWriter::write_header(std::optional<std::uint64_t> data_bytes) {
+  constexpr std::uint64_t max_size = std::numeric_limits<std::uint32_t>::max();
+  constexpr std::size_t fmt_end = 36U;
+
+  // Unknown sizes are left at the maximum, as for a stream
+  auto data_size = data_bytes ? std::min(*data_bytes, max_size) : max_size;
+  auto pad = data_size & 1U;
+  auto riff_size = max_size;
+
+  if (data_bytes) {
+    riff_size = std::min(header_bytes_ - 8U + data_size + pad, max_size);
+  }
+
+  auto channels = static_cast<std::uint32_t>(this->channels());
+  auto rate = static_cast<std::uint32_t>(samplerate());
+  auto block_align = channels * sample_bytes_;
+  bool is_float =
+      (subformat_ == SF_FORMAT_FLOAT) || (subformat_ == SF_FORMAT_DOUBLE);
+
+  auto *header = static_cast<unsigned char *>(
+      std::aligned_alloc(ALIGNMENT, round_up(header_bytes_, ALIGNMENT)));
+  if (header == nullptr) {
+    return false;
+  }
+
+  std::memset(header, 0, header_bytes_);
+  auto *p = header;
+  std::memcpy(p, "RIFF", 4);
+  p = store_le(p + 4, riff_size, 4);
+  std::memcpy(p, "WAVEfmt ", 8);
+  p = store_le(p + 8, 16U, 4);
+  p = store_le(p, is_float ? 3U : 1U, 2);
+  p = store_le(p, channels, 2);
+  p = store_le(p, rate, 4);
+  p = store_le(p, rate * block_align, 4);
+  p = store_le(p, block_align, 2);
+  p = store_le(p, sample_bytes_ * 8U, 2);
+
+  // Pad up to the aligned data offset with a chunk readers skip
+  if (header_bytes_ > (fmt_end + 8U)) {
+    std::memcpy(p, "JUNK", 4);
+    store_le(p + 4, header_bytes_ - fmt_end - 16U, 4);
+  }
+
+  p = header + header_bytes_ - 8U;
+  std::memcpy(p, "data", 4);
+  store_le(p + 4, data_size, 4);
+
+  auto written = pwrite(fd_, header, header_bytes_, 0);
+  std::free(header);
+  return written == static_cast<ssize_t>(header_bytes_);
+}
+
+bool AioFileWriter::fail(char const *what) {
+  if (!failed_) {
+    std::cerr << "\nError writing file: " << what << ": "
+              << std::strerror(errno) << std::endl;
+  }
+
+  failed_ = true;
+  return false;
+}
+
+#else
+
+AioFileWriter::AioFileWriter(std::string const & /* filename */, int format,
+                             int channels, int samplerate,
+                             WriterConfig const & /* config */)
+    : AudioFileWriter(format, channels, samplerate) {
+  throw std::runtime_error("The aio writer is not supported on this platform");
+}
+
+AioFileWriter::~AioFileWriter() = default;
+
+sf_count_t AioFileWriter::writef(short const *, sf_count_t) { return 0; }
+sf_count_t AioFileWriter::writef(int const *, sf_count_t) { return 0; }
+sf_count_t AioFileWriter::writef(float const *, sf_count_t) { return 0; }
+sf_count_t AioFileWriter::writef(double const *, sf_count_t) { return 0; }
+bool AioFileWriter::flush() { return false; }
+bool AioFileWriter::close() { return false; }
+
+#endif
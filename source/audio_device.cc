@@ -17,7 +17,9 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  **/
 
+#include <algorithm>
 #include <array>
+#include <cstdlib>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -27,6 +29,8 @@
 
 #include <tabulate/table.hpp>
 
+#include "audio_device.hh"
+
 void list_audio_api() {
   std::vector<RtAudio::Api> api;
   RtAudio::getCompiledApi(api);
@@ -84,6 +88,37 @@ std::string rt_sample_formats_str(std::uint32_t mask) {
   return out;
 }
 
+unsigned int nearest_sample_rate(RtAudio::DeviceInfo const &info,
+                                 unsigned int rate) {
+  auto const &rates = info.sampleRates;
+
+  if (rates.empty() ||
+      (std::find(rates.begin(), rates.end(), rate) != rates.end())) {
+    return rate;
+  }
+
+  // On a tie prefer the higher rate, so nothing gets band limited
+  auto distance = [rate](unsigned int r) {
+    return std::abs(static_cast<long>(r) - static_cast<long>(rate));
+  };
+
+  return *std::min_element(rates.begin(), rates.end(),
+                           [&](unsigned int a, unsigned int b) {
+                             auto da = distance(a);
+                             auto db = distance(b);
+                             return (da < db) || ((da == db) && (a > b));
+                           });
+}
+
+unsigned int preferred_sample_rate(RtAudio::DeviceInfo const &info,
+                                   unsigned int rate) {
+  if (info.preferredSampleRate > 0) {
+    return info.preferredSampleRate;
+  } else {
+    return nearest_sample_rate(info, rate);
+  }
+}
+
 void list_audio_device(RtAudio::Api api) {
   using namespace std::string_literals;
 
@@ -0,0 +1,192 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "aio_file_writer.hh"
+#include "audio_file_writer.hh"
+#include "encoder_thread_writer.hh"
+#include "flac_file_writer.hh"
+#include "pipe_io.hh"
+
+std::optional<WriterBackend> parse_writer_backend(std::string_view name) {
+  if (name == "sndfile") {
+    return WriterBackend::SNDFILE;
+  } else if (name == "aio") {
+    return WriterBackend::AIO;
+  } else if (name == "flac") {
+    return WriterBackend::FLAC;
+  } else {
+    return std::nullopt;
+  }
+}
+
+SndfileWriter::SndfileWriter(std::string const &filename, int format,
+                             int channels, int samplerate,
+                             WriterConfig const &config)
+    : AudioFileWriter(format, channels, samplerate),
+      file_(filename, SFM_WRITE, format, channels, samplerate),
+      schedule_(config.sync) {
+  if (file_.error() != 0) {
+    throw std::runtime_error("Error opening file \"" + filename +
+                             "\" for writing: " + file_.strError());
+  }
+
+  // Formats without a compression setting ignore it
+  if (config.compression >= 0.0) {
+    auto level = std::min(config.compression, 1.0);
+    file_.command(SFC_SET_COMPRESSION_LEVEL, &level, sizeof(level));
+  }
+}
+
+template <typename SampleType>
+sf_count_t SndfileWriter::write_frames(SampleType const *ptr,
+                                       sf_count_t frames) {
+  auto written = file_.writef(ptr, frames);
+  schedule_.on_write(static_cast<std::size_t>(written) *
+                     static_cast<std::size_t>(channels()) *
+                     sizeof(SampleType));
+  return written;
+}
+
+sf_count_t SndfileWriter::writef(short const *ptr, sf_count_t frames) {
+  return write_frames(ptr, frames);
+}
+
+sf_count_t SndfileWriter::writef(int const *ptr, sf_count_t frames) {
+  return write_frames(ptr, frames);
+}
+
+sf_count_t SndfileWriter::writef(float const *ptr, sf_count_t frames) {
+  return write_frames(ptr, frames);
+}
+
+sf_count_t SndfileWriter::writef(double const *ptr, sf_count_t frames) {
+  return write_frames(ptr, frames);
+}
+
+bool SndfileWriter::flush() {
+  if (schedule_.due()) {
+    file_.writeSync();
+    schedule_.on_sync();
+  }
+
+  return true;
+}
+
+bool SndfileWriter::close() {
+  if (closed_) {
+    return true;
+  }
+
+  if (schedule_.sync_on_close()) {
+    file_.writeSync();
+  }
+
+  // Dropping the handle finalizes the header
+  file_ = SndfileHandle{};
+  closed_ = true;
+  return true;
+}
+
+bool is_compressed_format(int format) {
+  auto major = format & SF_FORMAT_TYPEMASK;
+  return (major == SF_FORMAT_FLAC) || (major == SF_FORMAT_OGG);
+}
+
+int file_format_from_name(std::string const &filename) {
+  // This is a subset of formats supported by libsndfile
+  static const std::unordered_map<std::string, int> fmt{
+      {".wav", SF_FORMAT_WAV},   {".aiff", SF_FORMAT_AIFF},
+      {".au", SF_FORMAT_AU},     {".raw", SF_FORMAT_RAW},
+      {".flac", SF_FORMAT_FLAC}, {".ogg", SF_FORMAT_OGG},
+  };
+
+  namespace fs = std::filesystem;
+  auto ext = fs::path(filename).extension().string();
+
+  if (fmt.count(ext)) {
+    return fmt.at(ext);
+  } else if (is_pipe_path(filename)) {
+    // Streamed with a header, so the reader knows what it gets
+    return SF_FORMAT_WAV;
+  } else {
+    // Assume RAW file format
+    return SF_FORMAT_RAW;
+  }
+}
+
+std::unique_ptr<AudioFileWriter> make_audio_file_writer(
+    std::string const &filename, int format, int channels, int samplerate,
+    WriterConfig const &config) {
+  // Pipes are written as they are, there is no disk to optimize for
+  if (is_pipe_path(filename)) {
+    if (config.backend != WriterBackend::SNDFILE) {
+      std::cerr << "Writing to a pipe, --writer is ignored" << std::endl;
+    }
+
+    return std::make_unique<PipeWriter>(filename, format, channels,
+                                        samplerate);
+  }
+
+  if (config.backend == WriterBackend::AIO) {
+    if (AioFileWriter::supports(format)) {
+      return std::make_unique<AioFileWriter>(filename, format, channels,
+                                             samplerate, config);
+    }
+
+    std::cerr << "The aio writer only writes uncompressed RAW and WAV, "
+                 "using libsndfile"
+              << std::endl;
+  }
+
+  if (config.backend == WriterBackend::FLAC) {
+    if (FlacFileWriter::supports(format, channels)) {
+      return std::make_unique<FlacFileWriter>(filename, format, channels,
+                                              samplerate, config);
+    }
+
+    std::cerr << "The flac writer only writes .flac files with pcm16 or "
+                 "pcm24 and at most "
+              << FlacFileWriter::MAX_CHANNELS << " channels, using libsndfile"
+              << std::endl;
+  }
+
+  auto file = std::make_unique<SndfileWriter>(filename, format, channels,
+                                              samplerate, config);
+
+  if (!is_compressed_format(format) || (config.encoder_queue_ms == 0)) {
+    return file;
+  }
+
+  // Encode on a thread of its own, in blocks of BLOCK_MS
+  auto block_frames = std::max<std::size_t>(
+      1U, static_cast<std::size_t>(samplerate) *
+              EncoderThreadWriter::BLOCK_MS / 1000U);
+  auto block_count = std::max<std::size_t>(
+      2U, (config.encoder_queue_ms + EncoderThreadWriter::BLOCK_MS - 1U) /
+              EncoderThreadWriter::BLOCK_MS);
+
+  return std::make_unique<EncoderThreadWriter>(std::move(file), block_frames,
+                                               block_count);
+}
@@ -0,0 +1,65 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "audio_stream.hh"
+#include "stream_config.hh"
+#include "virtual_device.hh"
+
+std::string RtAudioStream::api_name() {
+  return RtAudio::getApiDisplayName(rt_audio_.getCurrentApi());
+}
+
+unsigned int RtAudioStream::default_output_device() {
+  return rt_audio_.getDefaultOutputDevice();
+}
+
+unsigned int RtAudioStream::default_input_device() {
+  return rt_audio_.getDefaultInputDevice();
+}
+
+RtAudio::DeviceInfo RtAudioStream::device_info(unsigned int device) {
+  return rt_audio_.getDeviceInfo(device);
+}
+
+void RtAudioStream::open(RtAudio::StreamParameters *output,
+                         RtAudio::StreamParameters *input,
+                         RtAudioFormat format, unsigned int sample_rate,
+                         unsigned int *frames, RtAudioCallback callback,
+                         void *user_data, RtAudio::StreamOptions *options) {
+  rt_audio_.openStream(output, input, format, sample_rate, frames, callback,
+                       user_data, options);
+}
+
+void RtAudioStream::start() { rt_audio_.startStream(); }
+
+void RtAudioStream::close() { rt_audio_.closeStream(); }
+
+long RtAudioStream::latency() { return rt_audio_.getStreamLatency(); }
+
+std::unique_ptr<AudioStream> make_audio_stream(int api_id,
+                                               StreamConfig const &config) {
+  if (config.virtual_device.enabled) {
+    return std::make_unique<VirtualAudioStream>(config.virtual_device);
+  }
+
+  // Use default API if api_id is less than zero
+  auto api = (api_id < 0) ? RtAudio::Api::UNSPECIFIED
+                          : static_cast<RtAudio::Api>(api_id);
+  return std::make_unique<RtAudioStream>(api);
+}
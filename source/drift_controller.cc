@@ -0,0 +1,76 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <algorithm>
+#include <cmath>
+
+#include "drift_controller.hh"
+
+namespace {
+
+// Error smoothing relative to the loop time constant
+constexpr double FILTER_FRACTION = 0.1;
+
+// Integral time relative to the loop time constant, 4 is critically
+// damped for a queue, which integrates the rate error
+constexpr double INTEGRAL_FACTOR = 4.0;
+
+}  // namespace
+
+DriftController::DriftController(int sample_rate, double target_frames,
+                                 double max_ppm, double time_constant)
+    : sample_rate_(static_cast<double>(sample_rate)),
+      target_frames_(target_frames),
+      max_ppm_(max_ppm),
+      time_constant_(time_constant) {}
+
+double DriftController::update(double fill_frames, double dt) {
+  auto error = fill_frames - target_frames_;
+
+  if (!primed_) {
+    error_frames_ = error;
+    primed_ = true;
+  } else {
+    auto alpha = 1.0 - std::exp(-dt / (FILTER_FRACTION * time_constant_));
+    error_frames_ += alpha * (error - error_frames_);
+  }
+
+  // Pull a fill error in seconds back at 1 / time_constant per second
+  auto error_seconds = error_frames_ / sample_rate_;
+  auto proportional = 1e6 * error_seconds / time_constant_;
+
+  // Hold the integral while the output is clamped, so it can not wind up
+  auto integral = integral_ppm_ +
+                  proportional * dt / (INTEGRAL_FACTOR * time_constant_);
+
+  if (std::abs(proportional + integral) < max_ppm_) {
+    integral_ppm_ = std::clamp(integral, -max_ppm_, max_ppm_);
+  }
+
+  correction_ppm_ =
+      std::clamp(proportional + integral_ppm_, -max_ppm_, max_ppm_);
+  return 1.0 / (1.0 + correction_ppm_ * 1e-6);
+}
+
+void DriftController::reset() {
+  error_frames_ = 0.0;
+  integral_ppm_ = 0.0;
+  correction_ppm_ = 0.0;
+  primed_ = false;
+}
@@ -0,0 +1,513 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/**
+ * Play and record through one full-duplex stream
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "RtAudio.h"
+#include "audio_device.hh"
+#include "audio_file_writer.hh"
+#include "audio_stream.hh"
+#include "event_signal.hh"
+#include "latency_probe.hh"
+#include "playback_process.hh"
+#include "realtime.hh"
+#include "record_process.hh"
+#include "sample_format.hh"
+#include "sndfile.hh"
+#include "stop_signal.hh"
+#include "stream_config.hh"
+#include "stream_stats.hh"
+
+/**
+ * @brief Play a file and record another from one callback
+ *
+ * The callback services the record ring and the playback ring of the
+ * same period, so frame n of the recording was captured while frame n
+ * of the file was handed to the device, and the two files line up to
+ * the sample, offset only by the device's round-trip latency.
+ */
+class DuplexProcess {
+ public:
+  // Keep recording after the file has played out, for the last of it to
+  // come back through the loop
+  static constexpr auto TAIL = std::chrono::milliseconds(500);
+
+  /**
+   * @brief Construct a new duplex process
+   * @param playback Playback of the file to play
+   * @param record Recording of the file to record
+   * @param config Stream configuration
+   */
+  DuplexProcess(std::unique_ptr<PlaybackProcess<float>> playback,
+                std::unique_ptr<RecordProcess<float>> record,
+                StreamConfig const &config)
+      : playback_(std::move(playback)),
+        record_(std::move(record)),
+        callback_pin_(config.callback_cpu) {
+    // The playback status line is the one that is shown
+    record_->show_status(false);
+  }
+
+  /**
+   * @brief Grow both rings to hold the periods the device granted
+   * @param frame_size Frames per callback of the opened stream
+   */
+  void set_frame_size(unsigned int frame_size) {
+    playback_->set_frame_size(frame_size);
+    record_->set_frame_size(frame_size);
+  }
+
+  /**
+   * @brief Fault in the buffers used by the audio callback
+   */
+  void prefault() {
+    playback_->prefault();
+    record_->prefault();
+  }
+
+  /**
+   * @brief Fill the playback ring before the stream starts
+   */
+  void prefill() { playback_->prefill(); }
+
+  /**
+   * @brief Run the file IO of both rings, returns once the file has been
+   *  played and everything recorded has been written
+   */
+  void start() {
+    // The writer inherits the IO thread's priority and affinity
+    std::thread writer([this]() { record_->start(); });
+
+    playback_->start();
+
+    if (!stop_requested()) {
+      std::this_thread::sleep_for(TAIL);
+    }
+
+    request_stop();
+    writer.join();
+  }
+
+  void print_summary() const {
+    std::cout << "Playback:" << std::endl;
+    playback_->print_summary();
+    std::cout << "Recording:" << std::endl;
+    record_->print_summary();
+  }
+
+  static int audio_callback(void *output_buffer, void *input_buffer,
+                            unsigned int n_frame, double /* stream_time */,
+                            RtAudioStreamStatus status, void *user_data) {
+    auto *proc = static_cast<DuplexProcess *>(user_data);
+    proc->callback_pin_.apply();
+    proc->record_->write_frames(static_cast<float const *>(input_buffer),
+                                n_frame, status);
+    proc->playback_->read_frames(static_cast<float *>(output_buffer),
+                                 n_frame, status);
+
+    // Returning 1 stops the stream
+    if (stop_requested()) {
+      proc->record_->close_input();
+      return 1;
+    }
+
+    return 0;
+  }
+
+ private:
+  std::unique_ptr<PlaybackProcess<float>> playback_{};
+  std::unique_ptr<RecordProcess<float>> record_{};
+  CallbackThreadPin callback_pin_{};
+};
+
+/**
+ * @brief Play a probe signal and capture it back through one callback
+ *
+ * The probe starts at a known frame of the stream, and the capture is
+ * kept from that same frame, so the offset of the probe in the capture
+ * is the round-trip latency in frames. Nothing is allocated or written
+ * while the stream runs.
+ */
+class LatencyProbeProcess {
+ public:
+  // Silence before the probe, so that the stream has settled
+  static constexpr double LEAD_SECONDS = 0.25;
+
+  // Longest round trip that can be measured
+  static constexpr double MAX_LATENCY_SECONDS = 1.0;
+
+  /**
+   * @brief Construct a new latency probe process
+   * @param probe Mono probe signal
+   * @param sample_rate Sample rate of the stream
+   * @param config Stream configuration
+   */
+  LatencyProbeProcess(std::vector<float> probe, int sample_rate,
+                      StreamConfig const &config)
+      : probe_(std::move(probe)),
+        lead_frames_(static_cast<std::size_t>(LEAD_SECONDS * sample_rate)),
+        callback_pin_(config.callback_cpu) {
+    auto tail = static_cast<std::size_t>(MAX_LATENCY_SECONDS * sample_rate);
+    captured_.resize(probe_.size() + tail);
+  }
+
+  void prefault() {
+    std::fill(captured_.begin(), captured_.end(), 0.0F);
+  }
+
+  /**
+   * @brief Wait for the capture to complete, or for a stop request
+   */
+  void start() {
+    auto length = captured_.size();
+    request_data_.wait(length, [&]() {
+      return (captured_frames_.load(std::memory_order_acquire) >= length) ||
+             stop_requested();
+    });
+  }
+
+  /**
+   * @brief Get how far into the capture the probe was found
+   * @return std::optional<LatencyEstimate> Round trip, empty if nothing
+   *  was captured
+   */
+  std::optional<LatencyEstimate> estimate() const {
+    auto frames = captured_frames_.load(std::memory_order_acquire);
+    return estimate_latency(probe_, std::span(captured_).first(frames));
+  }
+
+  /**
+   * @brief Print xrun counters, an xrun shifts the capture against the
+   *  probe and spoils the measurement
+   */
+  void print_summary(int sample_rate) const {
+    print_stats_summary(stats_.snapshot(), sample_rate);
+  }
+
+  /**
+   * @brief Check whether the device reported an xrun
+   */
+  bool had_xrun() const {
+    auto stats = stats_.snapshot();
+    return (stats.device_underflows + stats.device_overflows) > 0U;
+  }
+
+  void process(float *output, float const *input, std::size_t frames,
+               RtAudioStreamStatus status) {
+    auto position = position_;
+    auto probe_end = lead_frames_ + probe_.size();
+
+    // Play the probe at its place in the stream, silence around it
+    for (std::size_t i = 0; i < frames; ++i) {
+      auto frame = position + i;
+      output[i] = ((frame >= lead_frames_) && (frame < probe_end))
+                      ? probe_[frame - lead_frames_]
+                      : 0.0F;
+    }
+
+    // Keep what came in from the first frame of the probe on
+    auto captured = captured_frames_.load(std::memory_order_relaxed);
+
+    for (std::size_t i = 0; i < frames; ++i) {
+      auto frame = position + i;
+      if ((frame >= lead_frames_) && (captured < captured_.size())) {
+        captured_[captured++] = input[i];
+      }
+    }
+
+    position_ = position + frames;
+    stats_.on_device_status(status);
+    captured_frames_.store(captured, std::memory_order_release);
+    request_data_.notify(captured);
+  }
+
+  static int audio_callback(void *output_buffer, void *input_buffer,
+                            unsigned int n_frame, double /* stream_time */,
+                            RtAudioStreamStatus status, void *user_data) {
+    auto *proc = static_cast<LatencyProbeProcess *>(user_data);
+    proc->callback_pin_.apply();
+    proc->process(static_cast<float *>(output_buffer),
+                  static_cast<float const *>(input_buffer), n_frame, status);
+
+    if (stop_requested()) {
+      proc->request_data_.wake();
+      return 1;
+    }
+
+    return 0;
+  }
+
+ private:
+  std::vector<float> probe_{};
+  std::size_t lead_frames_{};
+  std::vector<float> captured_{};
+  std::size_t position_{0};  // Only touched by the callback
+  std::atomic<std::size_t> captured_frames_{0};
+  EventSignal request_data_{};
+  CallbackThreadPin callback_pin_{};
+  StreamStats stats_{};
+};
+
+/**
+ * @brief Output and input device of a duplex stream
+ */
+struct DuplexDevices {
+  unsigned int output{};
+  unsigned int input{};
+};
+
+static DuplexDevices select_duplex_devices(AudioStream &stream, int output_id,
+                                           int input_id) {
+  DuplexDevices devices{};
+
+  // Use default devices if the ids are less than zero
+  devices.output = (output_id < 0) ? stream.default_output_device()
+                                   : static_cast<unsigned int>(output_id);
+  devices.input = (input_id < 0) ? stream.default_input_device()
+                                 : static_cast<unsigned int>(input_id);
+  return devices;
+}
+
+void duplex_audio_file(int api_id, int output_id, int input_id,
+                       int start_channel, int num_channels, int sample_rate,
+                       const std::string &play_filename,
+                       const std::string &record_filename,
+                       const StreamConfig &config) {
+  auto stream = make_audio_stream(api_id, config);
+  auto devices = select_duplex_devices(*stream, output_id, input_id);
+
+  // Open the input file
+  auto file = SndfileHandle(play_filename, SFM_READ);
+
+  if (file.frames() == 0) {
+    std::cerr << "Error opening file \"" << play_filename
+              << "\" for reading" << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+
+  // The stream runs at the play file's rate when the device allows, and
+  // the recording is made at the stream rate unless asked otherwise
+  auto file_rate = file.samplerate();
+  auto device_info = stream->device_info(devices.output);
+  auto stream_rate = static_cast<int>(
+      (config.device_rate > 0)
+          ? config.device_rate
+          : nearest_sample_rate(device_info,
+                                static_cast<unsigned int>(file_rate)));
+  auto record_rate = (sample_rate > 0) ? sample_rate : stream_rate;
+
+  RtAudio::StreamParameters out_parameters{
+      .deviceId = devices.output,
+      .nChannels = static_cast<unsigned int>(file.channels()),
+      .firstChannel = static_cast<unsigned int>(start_channel),
+  };
+
+  RtAudio::StreamParameters in_parameters{
+      .deviceId = devices.input,
+      .nChannels = static_cast<unsigned int>(num_channels),
+      .firstChannel = static_cast<unsigned int>(start_channel),
+  };
+
+  // Both rings carry float32, so that either side can be resampled
+  auto file_format = file_format_from_name(record_filename);
+  auto subformat = sf_subformat(config.sample_format, file_format);
+  std::unique_ptr<DuplexProcess> process{};
+
+  try {
+    auto writer =
+        make_audio_file_writer(record_filename, file_format | subformat,
+                               num_channels, record_rate, config.writer);
+    auto record = std::make_unique<RecordProcess<float>>(
+        std::move(writer), config, stream_rate);
+    auto playback = std::make_unique<PlaybackProcess<float>>(
+        std::move(file), config, stream_rate);
+    process = std::make_unique<DuplexProcess>(std::move(playback),
+                                              std::move(record), config);
+  } catch (std::exception const &e) {
+    std::cerr << e.what() << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+
+  auto &duplex = *process;
+  unsigned int frame_size = config.frames;
+  auto stream_options = make_stream_options(config);
+
+  try {
+    stream->open(&out_parameters, &in_parameters, RTAUDIO_FLOAT32,
+                 stream_rate, &frame_size, &duplex.audio_callback,
+                 static_cast<void *>(&duplex), &stream_options);
+  } catch (std::exception const &e) {
+    std::cerr << "Error opening audio stream: " << e.what() << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+
+  // The device may have granted longer periods than asked for
+  duplex.set_frame_size(frame_size);
+
+  if (config.realtime) {
+    duplex.prefault();
+  }
+
+  std::cout << "Play audio file: " << play_filename << std::endl
+            << "Record audio file: " << record_filename << std::endl
+            << "Start channel: " << start_channel << std::endl
+            << "API: " << stream->api_name() << std::endl
+            << "output_device: " << devices.output << std::endl
+            << "input_device: " << devices.input << std::endl
+            << "file_sample_rate: " << file_rate << std::endl
+            << "record_sample_rate: " << record_rate << std::endl
+            << "sample_rate: " << stream_rate << std::endl
+            << "stream_format: " << rt_sample_formats_str(RTAUDIO_FLOAT32)
+            << std::endl
+            << "frame_size: " << frame_size << std::endl
+            << "periods: " << stream_options.numberOfBuffers << std::endl
+            << "queue_ms: " << config.queue_ms << std::endl
+            << "stream_latency: " << stream->latency()
+            << " frame(s)" << std::endl;
+
+  install_stop_handler();
+
+  // Lock memory and raise this thread before the callback runs
+  setup_io_thread(config);
+
+  std::cout << "Prefilling queue...\n";
+  duplex.prefill();
+
+  std::cout << "Starting stream...\n";
+  stream->start();
+
+  std::cout << "Starting io task, press Ctrl-C to stop...\n";
+  duplex.start();
+
+  std::cout << "\nClosing stream...\n";
+  stream->close();
+  duplex.print_summary();
+}
+
+void measure_latency(int api_id, int output_id, int input_id,
+                     int start_channel, ProbeSignal signal,
+                     const StreamConfig &config) {
+  // Correlation peaks below this are likely noise or crosstalk
+  constexpr double MIN_PEAK_RATIO = 10.0;
+
+  auto stream = make_audio_stream(api_id, config);
+  auto devices = select_duplex_devices(*stream, output_id, input_id);
+
+  auto device_info = stream->device_info(devices.output);
+  auto stream_rate = static_cast<int>(
+      (config.device_rate > 0)
+          ? config.device_rate
+          : preferred_sample_rate(device_info, 48000U));
+
+  // One channel each way, the loopback goes from the first output
+  // channel to the first input channel
+  RtAudio::StreamParameters out_parameters{
+      .deviceId = devices.output,
+      .nChannels = 1U,
+      .firstChannel = static_cast<unsigned int>(start_channel),
+  };
+
+  RtAudio::StreamParameters in_parameters{
+      .deviceId = devices.input,
+      .nChannels = 1U,
+      .firstChannel = static_cast<unsigned int>(start_channel),
+  };
+
+  auto probe = std::make_unique<LatencyProbeProcess>(
+      make_probe_signal(signal, stream_rate), stream_rate, config);
+  unsigned int frame_size = config.frames;
+  auto stream_options = make_stream_options(config);
+
+  probe->prefault();
+
+  try {
+    stream->open(&out_parameters, &in_parameters, RTAUDIO_FLOAT32,
+                 stream_rate, &frame_size, &probe->audio_callback,
+                 static_cast<void *>(probe.get()), &stream_options);
+  } catch (std::exception const &e) {
+    std::cerr << "Error opening audio stream: " << e.what() << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+
+  std::cout << "Measure round-trip latency" << std::endl
+            << "API: " << stream->api_name() << std::endl
+            << "output_device: " << devices.output << std::endl
+            << "input_device: " << devices.input << std::endl
+            << "Start channel: " << start_channel << std::endl
+            << "probe: "
+            << ((signal == ProbeSignal::MLS) ? "mls" : "chirp") << std::endl
+            << "sample_rate: " << stream_rate << std::endl
+            << "frame_size: " << frame_size << std::endl
+            << "periods: " << stream_options.numberOfBuffers << std::endl;
+
+  install_stop_handler();
+
+  std::cout << "Starting stream...\n";
+  stream->start();
+  probe->start();
+
+  // RtAudio's own figure, from what the API reports about its buffers
+  auto reported = stream->latency();
+  stream->close();
+  probe->print_summary(stream_rate);
+
+  auto estimate = probe->estimate();
+
+  if (!estimate) {
+    std::cerr << "Nothing was captured" << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+
+  auto rate = static_cast<double>(stream_rate);
+  std::cout << "Round-trip latency: " << estimate->frames << " frame(s), "
+            << std::fixed << std::setprecision(2)
+            << (static_cast<double>(estimate->frames) * 1000.0 / rate)
+            << " ms" << std::endl
+            << "Latency reported by the API: " << reported << " frame(s), "
+            << (static_cast<double>(reported) * 1000.0 / rate) << " ms"
+            << std::endl
+            << "Correlation peak ratio: " << std::setprecision(1)
+            << estimate->peak_ratio << std::endl;
+
+  if (estimate->peak_ratio < MIN_PEAK_RATIO) {
+    std::cerr << "Weak correlation peak, check the loopback connection "
+                 "and levels"
+              << std::endl;
+  }
+
+  if (probe->had_xrun()) {
+    std::cerr << "The device reported an xrun during the measurement, "
+                 "the result may be off"
+              << std::endl;
+  }
+}
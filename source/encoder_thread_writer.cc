@@ -0,0 +1,291 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <type_traits>
+
+#include "cpu_meter.hh"
+#include "encoder_thread_writer.hh"
+
+EncoderThreadWriter::EncoderThreadWriter(
+    std::unique_ptr<AudioFileWriter> file, std::size_t block_frames,
+    std::size_t block_count)
+    : AudioFileWriter(file->format(), file->channels(), file->samplerate()),
+      file_(std::move(file)),
+      block_frames_(block_frames),
+      blocks_(std::max<std::size_t>(block_count, 2U)) {
+  free_.reserve(blocks_.size());
+  for (auto &block : blocks_) {
+    free_.push_back(&block);
+  }
+
+  encoder_ = std::thread(&EncoderThreadWriter::encode_loop, this);
+}
+
+template <typename SampleType>
+constexpr EncoderThreadWriter::SampleKind EncoderThreadWriter::kind_of() {
+  if constexpr (std::is_same_v<SampleType, short>) {
+    return SampleKind::SHORT;
+  } else if constexpr (std::is_same_v<SampleType, int>) {
+    return SampleKind::INT;
+  } else if constexpr (std::is_same_v<SampleType, float>) {
+    return SampleKind::FLOAT;
+  } else {
+    static_assert(std::is_same_v<SampleType, double>);
+    return SampleKind::DOUBLE;
+  }
+}
+
+template <typename SampleType>
+sf_count_t EncoderThreadWriter::write_frames(SampleType const *ptr,
+                                             sf_count_t frames) {
+  if (failed_.load(std::memory_order_relaxed) || (frames <= 0)) {
+    return 0;
+  }
+
+  constexpr auto kind = kind_of<SampleType>();
+  auto channels = static_cast<std::size_t>(this->channels());
+  auto remaining = static_cast<std::size_t>(frames);
+
+  // A block holds samples of a single type
+  if ((current_ != nullptr) && (current_->kind != kind)) {
+    submit_current();
+  }
+
+  while (remaining > 0) {
+    if (current_ == nullptr) {
+      current_ = acquire_block();
+      current_->kind = kind;
+      current_->frames = 0;
+
+      // Sized on first use, once the sample type is known
+      auto block_bytes = block_frames_ * channels * sizeof(SampleType);
+      if (current_->data.size() < block_bytes) {
+        current_->data.resize(block_bytes);
+      }
+    }
+
+    auto n = std::min(remaining, block_frames_ - current_->frames);
+    auto offset = current_->frames * channels * sizeof(SampleType);
+    std::memcpy(current_->data.data() + offset, ptr,
+                n * channels * sizeof(SampleType));
+
+    ptr += n * channels;
+    remaining -= n;
+    current_->frames += n;
+
+    if (current_->frames == block_frames_) {
+      submit_current();
+    }
+  }
+
+  return failed_.load(std::memory_order_relaxed) ? 0 : frames;
+}
+
+sf_count_t EncoderThreadWriter::writef(short const *ptr, sf_count_t frames) {
+  return write_frames(ptr, frames);
+}
+
+sf_count_t EncoderThreadWriter::writef(int const *ptr, sf_count_t frames) {
+  return write_frames(ptr, frames);
+}
+
+sf_count_t EncoderThreadWriter::writef(float const *ptr, sf_count_t frames) {
+  return write_frames(ptr, frames);
+}
+
+sf_count_t EncoderThreadWriter::writef(double const *ptr,
+                                       sf_count_t frames) {
+  return write_frames(ptr, frames);
+}
+
+bool EncoderThreadWriter::flush() {
+  return !failed_.load(std::memory_order_relaxed);
+}
+
+bool EncoderThreadWriter::close() {
+  if (closed_) {
+    return true;
+  }
+
+  closed_ = true;
+  submit_current();
+
+  {
+    std::lock_guard lock{mutex_};
+    done_ = true;
+  }
+
+  queued_.notify_one();
+  encoder_.join();
+
+  auto ok = file_->close();
+  return ok && !failed_.load(std::memory_order_relaxed);
+}
+
+EncoderThreadWriter::Block *EncoderThreadWriter::acquire_block() {
+  std::unique_lock lock{mutex_};
+
+  if (free_.empty()) {
+    // Every block is queued, the encoder is behind
+    auto start = std::chrono::steady_clock::now();
+    freed_.wait(lock, [this]() { return !free_.empty(); });
+
+    auto waited = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+    stats_.producer_waits++;
+    stats_.wait_seconds += waited;
+    stats_.max_wait_seconds = std::max(stats_.max_wait_seconds, waited);
+  }
+
+  auto *block = free_.back();
+  free_.pop_back();
+  return block;
+}
+
+void EncoderThreadWriter::submit_current() {
+  if ((current_ == nullptr) || (current_->frames == 0)) {
+    return;
+  }
+
+  {
+    std::lock_guard lock{mutex_};
+    queue_.push_back(current_);
+    stats_.queue_depth = queue_.size();
+    stats_.high_water = std::max(stats_.high_water, queue_.size());
+  }
+
+  queued_.notify_one();
+  current_ = nullptr;
+}
+
+void EncoderThreadWriter::encode_loop() {
+  ThreadCpuMeter cpu_meter{};
+
+  for (;;) {
+    Block *block = nullptr;
+
+    {
+      std::unique_lock lock{mutex_};
+      queued_.wait(lock, [this]() { return !queue_.empty() || done_; });
+
+      if (queue_.empty()) {
+        break;
+      }
+
+      block = queue_.front();
+      queue_.pop_front();
+    }
+
+    // After a failure blocks are still taken off the queue, so that the
+    // caller never waits on an encoder that has given up
+    if (!failed_.load(std::memory_order_relaxed) && !encode_block(*block)) {
+      failed_.store(true, std::memory_order_relaxed);
+    }
+
+    {
+      std::lock_guard lock{mutex_};
+      free_.push_back(block);
+      stats_.blocks_written++;
+      stats_.queue_depth = queue_.size();
+    }
+
+    freed_.notify_one();
+  }
+
+  std::lock_guard lock{mutex_};
+  encoder_cpu_seconds_ = cpu_meter.cpu_seconds();
+  encoder_wall_seconds_ = cpu_meter.wall_seconds();
+}
+
+bool EncoderThreadWriter::encode_block(Block const &block) {
+  auto frames = static_cast<sf_count_t>(block.frames);
+  auto const *data = block.data.data();
+  sf_count_t written = 0;
+
+  switch (block.kind) {
+    case SampleKind::SHORT:
+      written = file_->writef(reinterpret_cast<short const *>(data), frames);
+      break;
+    case SampleKind::INT:
+      written = file_->writef(reinterpret_cast<int const *>(data), frames);
+      break;
+    case SampleKind::FLOAT:
+      written = file_->writef(reinterpret_cast<float const *>(data), frames);
+      break;
+    case SampleKind::DOUBLE:
+      written =
+          file_->writef(reinterpret_cast<double const *>(data), frames);
+      break;
+  }
+
+  return (written == frames) && file_->flush();
+}
+
+EncoderThreadWriter::Stats EncoderThreadWriter::stats() const {
+  std::lock_guard lock{mutex_};
+  return stats_;
+}
+
+std::string EncoderThreadWriter::status_str() const {
+  auto stats = this->stats();
+  std::ostringstream status{};
+  status << "encoder queue " << stats.queue_depth << "/" << blocks_.size();
+
+  if (stats.producer_waits > 0) {
+    status << ", " << stats.producer_waits << " wait(s)";
+  }
+
+  return status.str();
+}
+
+void EncoderThreadWriter::print_summary() const {
+  auto stats = this->stats();
+  double cpu_seconds{};
+  double wall_seconds{};
+
+  {
+    std::lock_guard lock{mutex_};
+    cpu_seconds = encoder_cpu_seconds_;
+    wall_seconds = encoder_wall_seconds_;
+  }
+
+  auto block_ms = static_cast<double>(block_frames_) * 1000.0 /
+                  static_cast<double>(samplerate());
+  auto percent = (wall_seconds > 0.0) ? 100.0 * cpu_seconds / wall_seconds
+                                      : 0.0;
+
+  std::cout << std::fixed << std::setprecision(1)
+            << "Encoder queue: " << blocks_.size() << " block(s) of "
+            << block_ms << " ms, high-water " << stats.high_water
+            << ", " << stats.blocks_written << " block(s) written"
+            << std::endl
+            << "Encoder backpressure: " << stats.producer_waits
+            << " wait(s), " << 1000.0 * stats.wait_seconds
+            << " ms total, longest " << 1000.0 * stats.max_wait_seconds
+            << " ms" << std::endl
+            << "Encoder thread cpu: " << std::setprecision(3)
+            << cpu_seconds << " s over " << wall_seconds << " s ("
+            << std::setprecision(2) << percent << "%)" << std::endl;
+}
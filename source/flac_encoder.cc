@@ -0,0 +1,541 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdlib>
+
+#include "flac_encoder.hh"
+
+namespace {
+
+constexpr std::uint64_t PLACEHOLDER_SEEK_POINT = ~std::uint64_t(0);
+
+// Rice parameters above this need the 5-bit parameter coding method
+constexpr unsigned int MAX_RICE4_PARAM = 14U;
+constexpr unsigned int MAX_RICE5_PARAM = 30U;
+
+constexpr std::array<std::uint8_t, 256> make_crc8_table() {
+  std::array<std::uint8_t, 256> table{};
+
+  for (unsigned int i = 0; i < 256U; ++i) {
+    auto crc = static_cast<std::uint8_t>(i);
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = static_cast<std::uint8_t>((crc & 0x80U) ? ((crc << 1U) ^ 0x07U)
+                                                    : (crc << 1U));
+    }
+    table[i] = crc;
+  }
+
+  return table;
+}
+
+constexpr std::array<std::uint16_t, 256> make_crc16_table() {
+  std::array<std::uint16_t, 256> table{};
+
+  for (unsigned int i = 0; i < 256U; ++i) {
+    auto crc = static_cast<std::uint16_t>(i << 8U);
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = static_cast<std::uint16_t>(
+          (crc & 0x8000U) ? ((crc << 1U) ^ 0x8005U) : (crc << 1U));
+    }
+    table[i] = crc;
+  }
+
+  return table;
+}
+
+constexpr auto CRC8_TABLE = make_crc8_table();
+constexpr auto CRC16_TABLE = make_crc16_table();
+
+/**
+ * @brief CRC-8 of the frame header, polynomial x^8 + x^2 + x + 1
+ */
+std::uint8_t crc8(std::span<std::uint8_t const> bytes) {
+  std::uint8_t crc = 0;
+  for (auto byte : bytes) {
+    crc = CRC8_TABLE[crc ^ byte];
+  }
+  return crc;
+}
+
+/**
+ * @brief CRC-16 of the whole frame, polynomial x^16 + x^15 + x^2 + 1
+ */
+std::uint16_t crc16(std::span<std::uint8_t const> bytes) {
+  std::uint16_t crc = 0;
+  for (auto byte : bytes) {
+    crc = static_cast<std::uint16_t>((crc << 8U) ^
+                                     CRC16_TABLE[(crc >> 8U) ^ byte]);
+  }
+  return crc;
+}
+
+/**
+ * @brief Get the frame header code for a block size
+ * @return unsigned int 4-bit code, 6 and 7 mean the size follows the
+ *  header in 8 and 16 bits
+ */
+unsigned int block_size_code(std::size_t n) {
+  if (n == 192U) {
+    return 1U;
+  }
+
+  for (unsigned int k = 0; k < 4U; ++k) {
+    if (n == (std::size_t(576) << k)) {
+      return 2U + k;
+    }
+  }
+
+  for (unsigned int k = 0; k < 8U; ++k) {
+    if (n == (std::size_t(256) << k)) {
+      return 8U + k;
+    }
+  }
+
+  return (n <= 256U) ? 6U : 7U;
+}
+
+/**
+ * @brief Get the frame header code for a sample size
+ */
+unsigned int sample_size_code(unsigned int bits) {
+  switch (bits) {
+    case 8:
+      return 1U;
+    case 12:
+      return 2U;
+    case 16:
+      return 4U;
+    case 20:
+      return 5U;
+    case 24:
+      return 6U;
+    default:
+      return 0U;
+  }
+}
+
+/**
+ * @brief Cheapest Rice parameter for a partition
+ * @param sum Sum of the zigzag coded residual
+ * @param count Number of residual values
+ * @param param Chosen parameter
+ * @return std::uint64_t Estimated size in bits, without the parameter
+ */
+std::uint64_t best_rice_param(std::uint64_t sum, std::size_t count,
+                              unsigned int &param) {
+  param = 0;
+
+  if (count == 0) {
+    return 0;
+  }
+
+  // The optimum is just below log2 of the mean, check around it
+  auto mean = sum / count;
+  auto hi = std::min(static_cast<unsigned int>(std::bit_width(mean)),
+                     MAX_RICE5_PARAM);
+  auto lo = (hi >= 2U) ? (hi - 2U) : 0U;
+  auto best = ~std::uint64_t(0);
+
+  for (auto k = lo; k <= hi; ++k) {
+    auto bits = static_cast<std::uint64_t>(count) * (k + 1U) + (sum >> k);
+    if (bits < best) {
+      best = bits;
+      param = k;
+    }
+  }
+
+  return best;
+}
+
+}  // namespace
+
+/**
+ * @brief MSB first bit packer appending to a byte vector
+ */
+class FlacBitWriter {
+ public:
+  explicit FlacBitWriter(std::vector<std::uint8_t> &out) : out_(out) {}
+
+  /**
+   * @brief Append the low bits of a value
+   * @param value Value
+   * @param bits Number of bits, at most 32
+   */
+  void put(std::uint32_t value, unsigned int bits) {
+    auto mask = (std::uint64_t(1) << bits) - 1U;
+    acc_ = (acc_ << bits) | (value & mask);
+    pending_ += bits;
+
+    while (pending_ >= 8U) {
+      pending_ -= 8U;
+      out_.push_back(static_cast<std::uint8_t>(acc_ >> pending_));
+    }
+  }
+
+  void put64(std::uint64_t value) {
+    put(static_cast<std::uint32_t>(value >> 32U), 32);
+    put(static_cast<std::uint32_t>(value), 32);
+  }
+
+  /**
+   * @brief Append a two's complement value
+   */
+  void put_signed(std::int32_t value, unsigned int bits) {
+    put(static_cast<std::uint32_t>(value), bits);
+  }
+
+  void put_zeros(std::uint32_t count) {
+    for (; count >= 32U; count -= 32U) {
+      put(0, 32);
+    }
+    put(0, count);
+  }
+
+  /**
+   * @brief Append a zigzag coded value as a Rice code
+   * @param u Zigzag coded value
+   * @param k Rice parameter
+   */
+  void put_rice(std::uint32_t u, unsigned int k) {
+    auto q = u >> k;
+    auto low = (std::uint32_t(1) << k) | (u & ((std::uint32_t(1) << k) - 1U));
+
+    // Quotient in unary, stop bit and remainder in one go when they fit
+    if ((q + 1U + k) <= 32U) {
+      put(low, q + 1U + k);
+    } else {
+      put_zeros(q);
+      put(low, k + 1U);
+    }
+  }
+
+  /**
+   * @brief Append the frame number in FLAC's extended UTF-8 coding
+   */
+  void put_utf8(std::uint64_t value) {
+    if (value < 0x80U) {
+      put(static_cast<std::uint32_t>(value), 8);
+      return;
+    }
+
+    // Each continuation byte carries 6 bits
+    unsigned int extra = 1U;
+    while ((extra < 6U) && (value >= (std::uint64_t(1) << (5U * extra + 6U)))) {
+      ++extra;
+    }
+
+    auto lead_bits = 6U - extra;
+    auto prefix = (0xFF00U >> (extra + 1U)) & 0xFFU;
+    auto lead = static_cast<std::uint32_t>(value >> (6U * extra));
+    put(prefix | (lead & ((1U << lead_bits) - 1U)), 8);
+
+    for (auto i = extra; i-- > 0;) {
+      put(0x80U | (static_cast<std::uint32_t>(value >> (6U * i)) & 0x3FU), 8);
+    }
+  }
+
+  /**
+   * @brief Pad with zero bits to a byte boundary
+   */
+  void align() {
+    if (pending_ > 0) {
+      put(0, 8U - pending_);
+    }
+  }
+
+ private:
+  std::vector<std::uint8_t> &out_;
+  std::uint64_t acc_{};
+  unsigned int pending_{};
+};
+
+std::vector<std::uint8_t> flac_stream_header(
+    FlacStreamInfo const &info, std::span<FlacSeekPoint const> points,
+    std::size_t seek_slots) {
+  constexpr std::uint32_t STREAMINFO_BYTES = 34U;
+  constexpr std::uint32_t SEEK_POINT_BYTES = 18U;
+  constexpr std::uint32_t STREAMINFO = 0U;
+  constexpr std::uint32_t SEEKTABLE = 3U;
+
+  std::vector<std::uint8_t> out{'f', 'L', 'a', 'C'};
+  FlacBitWriter bits{out};
+
+  // Sample count is 36 bits, 0 for unknown
+  auto total = (info.total_frames >> 36U) ? 0U : info.total_frames;
+
+  bits.put(0, 1);
+  bits.put(STREAMINFO, 7);
+  bits.put(STREAMINFO_BYTES, 24);
+  bits.put(info.min_block_size, 16);
+  bits.put(info.max_block_size, 16);
+  bits.put(info.min_frame_bytes, 24);
+  bits.put(info.max_frame_bytes, 24);
+  bits.put(info.sample_rate, 20);
+  bits.put(info.channels - 1U, 3);
+  bits.put(info.bits - 1U, 5);
+  bits.put(static_cast<std::uint32_t>(total >> 32U), 4);
+  bits.put(static_cast<std::uint32_t>(total), 32);
+
+  // No MD5 of the audio, all zero means unknown
+  for (int i = 0; i < 4; ++i) {
+    bits.put(0, 32);
+  }
+
+  bits.put(1, 1);
+  bits.put(SEEKTABLE, 7);
+  bits.put(static_cast<std::uint32_t>(seek_slots) * SEEK_POINT_BYTES, 24);
+
+  auto used = std::min(points.size(), seek_slots);
+
+  for (auto const &point : points.first(used)) {
+    bits.put64(point.frame);
+    bits.put64(point.offset);
+    bits.put(point.frames, 16);
+  }
+
+  for (auto i = used; i < seek_slots; ++i) {
+    bits.put64(PLACEHOLDER_SEEK_POINT);
+    bits.put64(0);
+    bits.put(0, 16);
+  }
+
+  return out;
+}
+
+FlacFrameEncoder::FlacFrameEncoder(unsigned int channels, unsigned int bits,
+                                   std::size_t max_block_size)
+    : channels_(channels),
+      bits_(bits),
+      max_block_size_(max_block_size),
+      channel_(max_block_size),
+      residual_(max_block_size),
+      partition_sums_(std::size_t(1) << MAX_PARTITION_ORDER),
+      rice_params_(std::size_t(1) << MAX_PARTITION_ORDER) {}
+
+std::size_t FlacFrameEncoder::encode(std::span<std::int32_t const> samples,
+                                     std::uint64_t frame_number,
+                                     std::vector<std::uint8_t> &out) {
+  auto channels = static_cast<std::size_t>(channels_);
+  auto n = std::min(samples.size() / channels, max_block_size_);
+  auto start = out.size();
+  FlacBitWriter bits{out};
+
+  // Fixed block size stream, sample rate taken from STREAMINFO
+  auto size_code = block_size_code(n);
+  bits.put(0xFFF8U, 16);
+  bits.put(size_code, 4);
+  bits.put(0, 4);
+  bits.put(channels_ - 1U, 4);
+  bits.put(sample_size_code(bits_), 3);
+  bits.put(0, 1);
+  bits.put_utf8(frame_number);
+
+  if (size_code == 6U) {
+    bits.put(static_cast<std::uint32_t>(n - 1U), 8);
+  } else if (size_code == 7U) {
+    bits.put(static_cast<std::uint32_t>(n - 1U), 16);
+  }
+
+  bits.put(crc8(std::span(out).subspan(start)), 8);
+
+  for (std::size_t c = 0; c < channels; ++c) {
+    for (std::size_t i = 0; i < n; ++i) {
+      channel_[i] = samples[i * channels + c];
+    }
+
+    encode_subframe(bits, std::span<std::int32_t const>(channel_).first(n));
+  }
+
+  bits.align();
+  bits.put(crc16(std::span(out).subspan(start)), 16);
+  return out.size() - start;
+}
+
+void FlacFrameEncoder::encode_subframe(FlacBitWriter &bits,
+                                       std::span<std::int32_t const> x) {
+  constexpr std::uint32_t CONSTANT = 0U;
+  constexpr std::uint32_t VERBATIM = 1U;
+  constexpr std::uint32_t FIXED = 8U;
+
+  auto n = x.size();
+
+  if (std::all_of(x.begin(), x.end(), [&](auto v) { return v == x[0]; })) {
+    bits.put(CONSTANT << 1U, 8);
+    bits.put_signed(x[0], bits_);
+    return;
+  }
+
+  auto verbatim_bits = static_cast<std::uint64_t>(n) * bits_;
+
+  if (n > MAX_FIXED_ORDER) {
+    // Pick the order with the smallest residual magnitude
+    std::array<std::uint64_t, MAX_FIXED_ORDER + 1U> error{};
+
+    for (std::size_t i = MAX_FIXED_ORDER; i < n; ++i) {
+      std::int64_t e0 = x[i];
+      std::int64_t e1 = e0 - x[i - 1];
+      std::int64_t e2 = e1 - (std::int64_t{x[i - 1]} - x[i - 2]);
+      std::int64_t e3 =
+          e2 - (std::int64_t{x[i - 1]} - 2 * std::int64_t{x[i - 2]} +
+                x[i - 3]);
+      std::int64_t e4 =
+          e3 - (std::int64_t{x[i - 1]} - 3 * std::int64_t{x[i - 2]} +
+                3 * std::int64_t{x[i - 3]} - x[i - 4]);
+
+      error[0] += static_cast<std::uint64_t>(std::llabs(e0));
+      error[1] += static_cast<std::uint64_t>(std::llabs(e1));
+      error[2] += static_cast<std::uint64_t>(std::llabs(e2));
+      error[3] += static_cast<std::uint64_t>(std::llabs(e3));
+      error[4] += static_cast<std::uint64_t>(std::llabs(e4));
+    }
+
+    auto order = static_cast<unsigned int>(
+        std::min_element(error.begin(), error.end()) - error.begin());
+
+    for (auto i = std::size_t{order}; i < n; ++i) {
+      std::int64_t r = x[i];
+
+      switch (order) {
+        case 1:
+          r -= x[i - 1];
+          break;
+        case 2:
+          r -= 2 * std::int64_t{x[i - 1]} - x[i - 2];
+          break;
+        case 3:
+          r -= 3 * std::int64_t{x[i - 1]} - 3 * std::int64_t{x[i - 2]} +
+               x[i - 3];
+          break;
+        case 4:
+          r -= 4 * std::int64_t{x[i - 1]} - 6 * std::int64_t{x[i - 2]} +
+               4 * std::int64_t{x[i - 3]} - x[i - 4];
+          break;
+        default:
+          break;
+      }
+
+      // Zigzag: 0, -1, 1, -2, ... to 0, 1, 2, 3, ...
+      auto v = static_cast<std::int32_t>(r);
+      residual_[i - order] = (static_cast<std::uint32_t>(v) << 1U) ^
+                             static_cast<std::uint32_t>(v >> 31);
+    }
+
+    auto residual_bits = choose_partitions(n, order);
+    auto fixed_bits = order * bits_ + 6U + residual_bits;
+
+    if (fixed_bits < verbatim_bits) {
+      auto partitions = std::size_t(1) << partition_order_;
+      auto max_param = *std::max_element(rice_params_.begin(),
+                                         rice_params_.begin() + partitions);
+      auto param_bits = (max_param > MAX_RICE4_PARAM) ? 5U : 4U;
+
+      bits.put((FIXED | order) << 1U, 8);
+      for (std::size_t i = 0; i < order; ++i) {
+        bits.put_signed(x[i], bits_);
+      }
+
+      bits.put((param_bits == 5U) ? 1U : 0U, 2);
+      bits.put(partition_order_, 4);
+
+      auto partition_len = n >> partition_order_;
+      auto *u = residual_.data();
+
+      for (std::size_t p = 0; p < partitions; ++p) {
+        auto k = rice_params_[p];
+        auto count = partition_len - ((p == 0) ? order : 0U);
+        bits.put(k, param_bits);
+
+        for (std::size_t i = 0; i < count; ++i) {
+          bits.put_rice(u[i], k);
+        }
+        u += count;
+      }
+      return;
+    }
+  }
+
+  bits.put(VERBATIM << 1U, 8);
+  for (auto v : x) {
+    bits.put_signed(v, bits_);
+  }
+}
+
+std::uint64_t FlacFrameEncoder::choose_partitions(std::size_t n,
+                                                  unsigned int order) {
+  // Finest order that splits the block evenly and leaves every partition
+  // longer than the warm-up
+  unsigned int max_order = 0;
+  while ((max_order < MAX_PARTITION_ORDER) &&
+         ((n % (std::size_t(2) << max_order)) == 0) &&
+         ((n >> (max_order + 1U)) > order)) {
+    ++max_order;
+  }
+
+  // Partition sums at the finest order, coarser ones are merged from them
+  auto partition_len = n >> max_order;
+  auto const *u = residual_.data();
+
+  for (std::size_t p = 0; p < (std::size_t(1) << max_order); ++p) {
+    auto count = partition_len - ((p == 0) ? order : 0U);
+    std::uint64_t sum = 0;
+
+    for (std::size_t i = 0; i < count; ++i) {
+      sum += u[i];
+    }
+
+    partition_sums_[p] = sum;
+    u += count;
+  }
+
+  std::array<std::uint8_t, std::size_t(1) << MAX_PARTITION_ORDER> params{};
+  auto best_bits = ~std::uint64_t(0);
+
+  for (auto porder = max_order + 1U; porder-- > 0;) {
+    auto partitions = std::size_t(1) << porder;
+    auto len = n >> porder;
+    std::uint64_t total = 0;
+    unsigned int max_param = 0;
+
+    for (std::size_t p = 0; p < partitions; ++p) {
+      unsigned int k = 0;
+      auto count = len - ((p == 0) ? order : 0U);
+      total += best_rice_param(partition_sums_[p], count, k);
+      params[p] = static_cast<std::uint8_t>(k);
+      max_param = std::max(max_param, k);
+    }
+
+    total += partitions * ((max_param > MAX_RICE4_PARAM) ? 5U : 4U);
+
+    if (total < best_bits) {
+      best_bits = total;
+      partition_order_ = porder;
+      std::copy_n(params.begin(), partitions, rice_params_.begin());
+    }
+
+    // Merge pairs for the next coarser order
+    for (std::size_t p = 0; p < (partitions / 2U); ++p) {
+      partition_sums_[p] = partition_sums_[2 * p] + partition_sums_[2 * p + 1];
+    }
+  }
+
+  return best_bits;
+}
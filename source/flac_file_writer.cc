@@ -0,0 +1,433 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <type_traits>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+#include "cpu_meter.hh"
+#include "flac_file_writer.hh"
+
+namespace {
+
+/**
+ * @brief Convert a sample as handed to writef() to a right justified
+ *  FLAC sample
+ * @note int samples are left justified, as everywhere else in rtutil
+ */
+template <typename SampleType>
+std::int32_t to_flac_sample(SampleType v, unsigned int bits) {
+  if constexpr (std::is_same_v<SampleType, short>) {
+    return static_cast<std::int32_t>(v) * (1 << (bits - 16U));
+  } else if constexpr (std::is_same_v<SampleType, int>) {
+    return v >> (32U - bits);
+  } else {
+    auto scale = static_cast<double>(1U << (bits - 1U));
+    auto scaled = std::clamp(static_cast<double>(v) * scale, -scale,
+                             scale - 1.0);
+    return static_cast<std::int32_t>(std::lrint(scaled));
+  }
+}
+
+}  // namespace
+
+FlacFileWriter::FlacFileWriter(std::string const &filename, int format,
+                               int channels, int samplerate,
+                               WriterConfig const &config)
+    : AudioFileWriter(format, channels, samplerate), schedule_(config.sync) {
+  if (!supports(format, channels)) {
+    throw std::runtime_error(
+        "The flac writer needs pcm16 or pcm24 and at most " +
+        std::to_string(MAX_CHANNELS) + " channels");
+  }
+
+  bits_ = ((format & SF_FORMAT_SUBMASK) == SF_FORMAT_PCM_24) ? 24U : 16U;
+  info_ = FlacStreamInfo{
+      .min_block_size = BLOCK_SIZE,
+      .max_block_size = BLOCK_SIZE,
+      .sample_rate = static_cast<std::uint32_t>(samplerate),
+      .channels = static_cast<std::uint32_t>(channels),
+      .bits = bits_,
+  };
+
+  file_ = std::fopen(filename.c_str(), "wb");
+  if (file_ == nullptr) {
+    throw std::runtime_error("Error opening file \"" + filename +
+                             "\" for writing: " + std::strerror(errno));
+  }
+
+  // Header with unknown length and empty seek table, patched on close
+  auto header = flac_stream_header(info_, {}, SEEK_POINTS);
+  if (std::fwrite(header.data(), 1, header.size(), file_) != header.size()) {
+    std::fclose(file_);
+    throw std::runtime_error("Error writing header of \"" + filename + "\"");
+  }
+
+  auto threads = (config.encoder_threads > 0)
+                     ? config.encoder_threads
+                     : std::max(std::thread::hardware_concurrency(), 1U);
+
+  // Enough jobs to keep every worker busy while finished ones wait for
+  // the oldest to be written
+  auto job_samples =
+      FRAMES_PER_JOB * BLOCK_SIZE * static_cast<std::size_t>(channels);
+  jobs_.resize(2U * threads + 2U);
+  free_.reserve(jobs_.size());
+
+  for (auto &job : jobs_) {
+    job.pcm.resize(job_samples);
+    job.encoded.reserve(job_samples * sizeof(std::int32_t));
+    job.frame_bytes.reserve(FRAMES_PER_JOB);
+    free_.push_back(&job);
+  }
+
+  workers_.reserve(threads);
+  for (unsigned int i = 0; i < threads; ++i) {
+    workers_.emplace_back(&FlacFileWriter::worker_loop, this);
+  }
+}
+
+FlacFileWriter::~FlacFileWriter() { FlacFileWriter::close(); }
+
+bool FlacFileWriter::supports(int format, int channels) {
+  auto subformat = format & SF_FORMAT_SUBMASK;
+
+  return ((format & SF_FORMAT_TYPEMASK) == SF_FORMAT_FLAC) &&
+         ((subformat == SF_FORMAT_PCM_16) ||
+          (subformat == SF_FORMAT_PCM_24)) &&
+         (channels > 0) && (channels <= MAX_CHANNELS);
+}
+
+template <typename SampleType>
+sf_count_t FlacFileWriter::write_frames(SampleType const *ptr,
+                                        sf_count_t frames) {
+  if (failed_.load(std::memory_order_relaxed) || (frames <= 0)) {
+    return 0;
+  }
+
+  constexpr auto job_frames = FRAMES_PER_JOB * BLOCK_SIZE;
+  auto channels = static_cast<std::size_t>(this->channels());
+  auto remaining = static_cast<std::size_t>(frames);
+
+  while (remaining > 0) {
+    if (current_ == nullptr) {
+      current_ = acquire_job();
+      current_->frames = 0;
+    }
+
+    auto n = std::min(remaining, job_frames - current_->frames);
+    auto *out = current_->pcm.data() + current_->frames * channels;
+
+    for (std::size_t i = 0; i < n * channels; ++i) {
+      out[i] = to_flac_sample(ptr[i], bits_);
+    }
+
+    ptr += n * channels;
+    remaining -= n;
+    current_->frames += n;
+
+    if (current_->frames == job_frames) {
+      submit_current();
+    }
+  }
+
+  return failed_.load(std::memory_order_relaxed) ? 0 : frames;
+}
+
+sf_count_t FlacFileWriter::writef(short const *ptr, sf_count_t frames) {
+  return write_frames(ptr, frames);
+}
+
+sf_count_t FlacFileWriter::writef(int const *ptr, sf_count_t frames) {
+  return write_frames(ptr, frames);
+}
+
+sf_count_t FlacFileWriter::writef(float const *ptr, sf_count_t frames) {
+  return write_frames(ptr, frames);
+}
+
+sf_count_t FlacFileWriter::writef(double const *ptr, sf_count_t frames) {
+  return write_frames(ptr, frames);
+}
+
+bool FlacFileWriter::flush() {
+  return !failed_.load(std::memory_order_relaxed);
+}
+
+bool FlacFileWriter::close() {
+  if (closed_) {
+    return true;
+  }
+
+  closed_ = true;
+  submit_current();
+
+  {
+    std::lock_guard lock{mutex_};
+    done_ = true;
+  }
+
+  queued_.notify_all();
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+
+  // Every job has been written by now, fill in the header
+  auto ok = !failed_.load(std::memory_order_relaxed);
+
+  if (ok) {
+    auto header = flac_stream_header(info_, seek_points_, SEEK_POINTS);
+    ok = (std::fseek(file_, 0, SEEK_SET) == 0) &&
+         (std::fwrite(header.data(), 1, header.size(), file_) ==
+          header.size());
+  }
+
+  if (ok && schedule_.sync_on_close()) {
+    ok = sync_file();
+  }
+
+  ok = (std::fclose(file_) == 0) && ok;
+  file_ = nullptr;
+  return ok;
+}
+
+FlacFileWriter::Job *FlacFileWriter::acquire_job() {
+  std::unique_lock lock{mutex_};
+
+  if (free_.empty()) {
+    // Every job is queued or waiting to be written, the workers are
+    // behind
+    auto start = std::chrono::steady_clock::now();
+    freed_.wait(lock, [this]() { return !free_.empty(); });
+
+    auto waited = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+    producer_waits_++;
+    wait_seconds_ += waited;
+    max_wait_seconds_ = std::max(max_wait_seconds_, waited);
+  }
+
+  auto *job = free_.back();
+  free_.pop_back();
+  return job;
+}
+
+void FlacFileWriter::submit_current() {
+  if ((current_ == nullptr) || (current_->frames == 0)) {
+    return;
+  }
+
+  current_->first_frame = next_frame_;
+  current_->done = false;
+  next_frame_ += (current_->frames + BLOCK_SIZE - 1U) / BLOCK_SIZE;
+
+  {
+    std::lock_guard lock{mutex_};
+    pending_.push_back(current_);
+    in_flight_.push_back(current_);
+    high_water_ = std::max(high_water_, in_flight_.size());
+  }
+
+  queued_.notify_one();
+  current_ = nullptr;
+}
+
+void FlacFileWriter::worker_loop() {
+  auto channels = static_cast<std::size_t>(this->channels());
+  FlacFrameEncoder encoder{static_cast<unsigned int>(channels), bits_,
+                           BLOCK_SIZE};
+  ThreadCpuMeter cpu_meter{};
+  std::unique_lock lock{mutex_};
+
+  for (;;) {
+    queued_.wait(lock, [this]() { return !pending_.empty() || done_; });
+
+    if (pending_.empty()) {
+      break;
+    }
+
+    auto *job = pending_.front();
+    pending_.pop_front();
+    lock.unlock();
+
+    job->encoded.clear();
+    job->frame_bytes.clear();
+
+    // After a failure jobs are still passed along, so that the caller
+    // never waits on workers that have given up
+    if (!failed_.load(std::memory_order_relaxed)) {
+      auto pcm = std::span<std::int32_t const>(job->pcm);
+
+      for (std::size_t pos = 0; pos < job->frames; pos += BLOCK_SIZE) {
+        auto n = std::min(BLOCK_SIZE, job->frames - pos);
+        auto frame = job->first_frame + pos / BLOCK_SIZE;
+        auto bytes = encoder.encode(pcm.subspan(pos * channels, n * channels),
+                                    frame, job->encoded);
+        job->frame_bytes.push_back(static_cast<std::uint32_t>(bytes));
+      }
+    }
+
+    lock.lock();
+    job->done = true;
+    write_finished(lock);
+  }
+
+  worker_cpu_seconds_ += cpu_meter.cpu_seconds();
+}
+
+void FlacFileWriter::write_finished(std::unique_lock<std::mutex> &lock) {
+  // The worker already writing picks up this job when it gets to it
+  if (writing_) {
+    return;
+  }
+
+  writing_ = true;
+
+  while (!in_flight_.empty() && in_flight_.front()->done) {
+    auto *job = in_flight_.front();
+    in_flight_.pop_front();
+
+    lock.unlock();
+    auto ok = failed_.load(std::memory_order_relaxed) || write_job(*job);
+    lock.lock();
+
+    if (!ok) {
+      failed_.store(true, std::memory_order_relaxed);
+    }
+
+    free_.push_back(job);
+    freed_.notify_one();
+  }
+
+  writing_ = false;
+}
+
+bool FlacFileWriter::write_job(Job const &job) {
+  auto frame = job.first_frame;
+  auto remaining = job.frames;
+
+  for (auto bytes : job.frame_bytes) {
+    auto n = std::min(BLOCK_SIZE, remaining);
+
+    // Keep at most SEEK_POINTS evenly spaced points, thinning them out
+    // as the recording grows
+    if ((frame % seek_spacing_) == 0) {
+      if (seek_points_.size() == SEEK_POINTS) {
+        std::size_t kept = 0;
+        for (std::size_t i = 0; i < seek_points_.size(); i += 2U) {
+          seek_points_[kept++] = seek_points_[i];
+        }
+        seek_points_.resize(kept);
+        seek_spacing_ *= 2U;
+      }
+
+      if ((frame % seek_spacing_) == 0) {
+        seek_points_.push_back({.frame = frame * BLOCK_SIZE,
+                                .offset = stream_bytes_,
+                                .frames = static_cast<std::uint32_t>(n)});
+      }
+    }
+
+    if ((info_.min_frame_bytes == 0) || (bytes < info_.min_frame_bytes)) {
+      info_.min_frame_bytes = bytes;
+    }
+
+    info_.max_frame_bytes = std::max(info_.max_frame_bytes, bytes);
+    stream_bytes_ += bytes;
+    remaining -= n;
+    ++frame;
+  }
+
+  info_.total_frames += job.frames;
+
+  auto size = job.encoded.size();
+  if (std::fwrite(job.encoded.data(), 1, size, file_) != size) {
+    return false;
+  }
+
+  schedule_.on_write(size);
+
+  if (schedule_.due()) {
+    if (!sync_file()) {
+      return false;
+    }
+    schedule_.on_sync();
+  }
+
+  return true;
+}
+
+bool FlacFileWriter::sync_file() {
+  if (std::fflush(file_) != 0) {
+    return false;
+  }
+
+#if defined(__unix__) || defined(__APPLE__)
+  return fsync(fileno(file_)) == 0;
+#else
+  return true;
+#endif
+}
+
+std::string FlacFileWriter::status_str() const {
+  std::lock_guard lock{mutex_};
+  std::ostringstream status{};
+  status << "flac queue " << in_flight_.size() << "/" << jobs_.size();
+
+  if (producer_waits_ > 0) {
+    status << ", " << producer_waits_ << " wait(s)";
+  }
+
+  return status.str();
+}
+
+void FlacFileWriter::print_summary() const {
+  std::lock_guard lock{mutex_};
+
+  auto pcm_bytes = static_cast<double>(info_.total_frames) *
+                   static_cast<double>(channels()) * bits_ / 8.0;
+  auto ratio = (pcm_bytes > 0.0)
+                   ? 100.0 * static_cast<double>(stream_bytes_) / pcm_bytes
+                   : 0.0;
+
+  std::cout << std::fixed << std::setprecision(1)
+            << "FLAC encoder: " << workers_.size() << " thread(s), "
+            << jobs_.size() << " job(s) of " << FRAMES_PER_JOB
+            << " frame(s), high-water " << high_water_ << std::endl
+            << "FLAC stream: " << stream_bytes_ << " byte(s), " << ratio
+            << "% of pcm, " << seek_points_.size() << " seek point(s)"
+            << std::endl
+            << "Encoder backpressure: " << producer_waits_ << " wait(s), "
+            << 1000.0 * wait_seconds_ << " ms total, longest "
+            << 1000.0 * max_wait_seconds_ << " ms" << std::endl
+            << "Encoder threads cpu: " << std::setprecision(3)
+            << worker_cpu_seconds_ << " s" << std::endl;
+}
@@ -0,0 +1,209 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <numbers>
+
+#include "latency_probe.hh"
+
+namespace {
+
+constexpr float PROBE_LEVEL = 0.5F;
+constexpr double CHIRP_SECONDS = 0.7;
+constexpr double CHIRP_FADE_SECONDS = 0.01;
+constexpr double CHIRP_LOW_HZ = 20.0;
+constexpr double CHIRP_HIGH_HZ = 20000.0;
+
+// Feedback taps of maximum length LFSRs, from Xilinx XAPP052
+constexpr unsigned int MLS_MIN_ORDER = 12U;
+constexpr unsigned int MLS_MAX_ORDER = 18U;
+constexpr std::array<std::uint32_t, 7> MLS_TAPS{
+    (1U << 11) | (1U << 5) | (1U << 3) | (1U << 0),    // 12
+    (1U << 12) | (1U << 3) | (1U << 2) | (1U << 0),    // 13
+    (1U << 13) | (1U << 4) | (1U << 2) | (1U << 0),    // 14
+    (1U << 14) | (1U << 13),                           // 15
+    (1U << 15) | (1U << 14) | (1U << 12) | (1U << 3),  // 16
+    (1U << 16) | (1U << 13),                           // 17
+    (1U << 17) | (1U << 10),                           // 18
+};
+
+/**
+ * @brief Generate a maximum length sequence, long enough to cover half a
+ *  second
+ */
+std::vector<float> make_mls(int sample_rate) {
+  auto half_second = static_cast<std::uint32_t>(sample_rate / 2);
+  auto order = std::clamp<unsigned int>(
+      static_cast<unsigned int>(std::bit_width(half_second)), MLS_MIN_ORDER,
+      MLS_MAX_ORDER);
+  auto taps = MLS_TAPS[order - MLS_MIN_ORDER];
+  auto mask = (1U << order) - 1U;
+  std::uint32_t state = 1U;
+
+  std::vector<float> mls((std::size_t{1} << order) - 1U);
+
+  for (auto &sample : mls) {
+    auto bit = static_cast<std::uint32_t>(std::popcount(state & taps) & 1);
+    state = ((state << 1) | bit) & mask;
+    sample = (bit != 0U) ? PROBE_LEVEL : -PROBE_LEVEL;
+  }
+
+  return mls;
+}
+
+/**
+ * @brief Generate a logarithmic sine sweep with short fades at both ends
+ */
+std::vector<float> make_chirp(int sample_rate) {
+  auto rate = static_cast<double>(sample_rate);
+  auto length = static_cast<std::size_t>(CHIRP_SECONDS * rate);
+  auto fade = static_cast<std::size_t>(CHIRP_FADE_SECONDS * rate);
+  auto high = std::min(CHIRP_HIGH_HZ, 0.45 * rate);
+  auto k = std::log(high / CHIRP_LOW_HZ);
+
+  std::vector<float> chirp(length);
+
+  for (std::size_t i = 0; i < length; ++i) {
+    auto t = static_cast<double>(i) / rate;
+    auto phase = 2.0 * std::numbers::pi * CHIRP_LOW_HZ * CHIRP_SECONDS / k *
+                 (std::exp(k * t / CHIRP_SECONDS) - 1.0);
+    auto edge = static_cast<double>(std::min(i, length - 1U - i));
+    auto gain = (edge < static_cast<double>(fade))
+                    ? 0.5 - 0.5 * std::cos(std::numbers::pi * edge /
+                                           static_cast<double>(fade))
+                    : 1.0;
+    chirp[i] = static_cast<float>(PROBE_LEVEL * gain * std::sin(phase));
+  }
+
+  return chirp;
+}
+
+/**
+ * @brief In-place radix-2 FFT
+ * @param data Power of two number of points
+ * @param inverse True for the unscaled inverse transform
+ */
+void fft(std::vector<std::complex<double>> &data, bool inverse) {
+  auto n = data.size();
+
+  for (std::size_t i = 1, j = 0; i < n; ++i) {
+    auto bit = n >> 1;
+    for (; (j & bit) != 0U; bit >>= 1) {
+      j ^= bit;
+    }
+    j ^= bit;
+
+    if (i < j) {
+      std::swap(data[i], data[j]);
+    }
+  }
+
+  auto sign = inverse ? 1.0 : -1.0;
+
+  for (std::size_t len = 2; len <= n; len <<= 1) {
+    auto angle = sign * 2.0 * std::numbers::pi / static_cast<double>(len);
+    auto step = std::polar(1.0, angle);
+
+    for (std::size_t i = 0; i < n; i += len) {
+      std::complex<double> w{1.0, 0.0};
+
+      for (std::size_t j = 0; j < len / 2U; ++j) {
+        auto u = data[i + j];
+        auto v = data[i + j + len / 2U] * w;
+        data[i + j] = u + v;
+        data[i + j + len / 2U] = u - v;
+        w *= step;
+      }
+    }
+  }
+}
+
+}  // namespace
+
+std::optional<ProbeSignal> parse_probe_signal(std::string_view name) {
+  if (name == "mls") {
+    return ProbeSignal::MLS;
+  } else if (name == "chirp") {
+    return ProbeSignal::CHIRP;
+  } else {
+    return std::nullopt;
+  }
+}
+
+std::vector<float> make_probe_signal(ProbeSignal signal, int sample_rate) {
+  switch (signal) {
+    case ProbeSignal::CHIRP:
+      return make_chirp(sample_rate);
+    case ProbeSignal::MLS:
+    default:
+      return make_mls(sample_rate);
+  }
+}
+
+std::optional<LatencyEstimate> estimate_latency(
+    std::span<float const> probe, std::span<float const> captured) {
+  if (probe.empty() || captured.empty()) {
+    return std::nullopt;
+  }
+
+  // Zero padded so that the circular correlation does not wrap
+  auto size = std::bit_ceil(probe.size() + captured.size());
+  std::vector<std::complex<double>> p(size);
+  std::vector<std::complex<double>> c(size);
+  std::copy(probe.begin(), probe.end(), p.begin());
+  std::copy(captured.begin(), captured.end(), c.begin());
+
+  fft(p, false);
+  fft(c, false);
+
+  for (std::size_t i = 0; i < size; ++i) {
+    c[i] *= std::conj(p[i]);
+  }
+
+  fft(c, true);
+
+  // Lag k of the correlation is the probe starting at capture frame k,
+  // a polarity inverting path gives a negative peak
+  LatencyEstimate estimate{};
+  double peak = 0.0;
+  double energy = 0.0;
+
+  for (std::size_t k = 0; k < captured.size(); ++k) {
+    auto value = std::abs(c[k].real());
+    energy += value * value;
+
+    if (value > peak) {
+      peak = value;
+      estimate.frames = k;
+    }
+  }
+
+  if (peak <= 0.0) {
+    return std::nullopt;
+  }
+
+  auto rms = std::sqrt(energy / static_cast<double>(captured.size()));
+  estimate.peak_ratio = peak / rms;
+  return estimate;
+}
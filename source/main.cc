@@ -18,20 +18,46 @@
  **/
 
 #include <iostream>
+#include <optional>
 #include <string>
+#include <vector>
 
 // Third party
 #include "RtAudio.h"
 #include "cxxopts.hpp"
 #include "sndfile.hh"
 
-void list_audio_api();
-void list_audio_device(RtAudio::Api);
+#include "audio_device.hh"
+#include "latency_probe.hh"
+#include "multi_record.hh"
+#include "playlist.hh"
+#include "stream_config.hh"
+
 void play_audio_file(int api_id, int device_id, int start_channel,
-                     const std::string &filename);
+                     const std::vector<std::string> &filenames,
+                     const StreamConfig &config);
 void record_audio_file(int api_id, int device_id, int start_channel,
                        int num_channels, int sample_rate,
-                       const std::string &filename);
+                       const std::string &filename,
+                       const StreamConfig &config);
+void duplex_audio_file(int api_id, int output_id, int input_id,
+                       int start_channel, int num_channels, int sample_rate,
+                       const std::string &play_filename,
+                       const std::string &record_filename,
+                       const StreamConfig &config);
+void multi_record_audio_file(int api_id, std::vector<CaptureDevice> devices,
+                             int start_channel, int num_channels,
+                             int sample_rate, const std::string &filename,
+                             bool split, const StreamConfig &config);
+void offline_play_file(const std::string &filename,
+                       const StreamConfig &config);
+void offline_record_file(int sample_rate, const std::string &filename,
+                         const StreamConfig &config);
+void attach_shared_ring(int api_id, int device_id, int start_channel,
+                        const std::string &name, const StreamConfig &config);
+void measure_latency(int api_id, int output_id, int input_id,
+                     int start_channel, ProbeSignal signal,
+                     const StreamConfig &config);
 
 constexpr std::string_view RTUTIL_VERSION = "1.0.0";
 
@@ -41,6 +67,201 @@ static std::string cxxopt_version_string() {
          std::to_string(CXXOPTS__VERSION_PATCH);
 }
 
+static std::optional<TimePosition> time_position_from_options(
+    cxxopts::ParseResult const &result, std::string const &name) {
+  if (!result.count(name)) {
+    return std::nullopt;
+  }
+
+  auto spec = result[name].as<std::string>();
+  auto position = parse_time_position(spec);
+
+  if (!position) {
+    std::cerr << "Invalid --" << name << " position: " << spec << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+
+  return position;
+}
+
+static PlayRegion play_region_from_options(
+    cxxopts::ParseResult const &result) {
+  PlayRegion region{};
+  region.start = time_position_from_options(result, "start");
+  region.end = time_position_from_options(result, "end");
+  region.crossfade_ms = result["crossfade-ms"].as<unsigned int>();
+
+  if (result.count("loop")) {
+    region.passes = result["loop"].as<unsigned int>();
+  }
+
+  return region;
+}
+
+static StreamConfig stream_config_from_options(
+    cxxopts::ParseResult const &result) {
+  auto profile_name = result["latency"].as<std::string>();
+  auto profile = parse_latency_profile(profile_name);
+
+  if (!profile) {
+    std::cerr << "Unknown latency profile: " << profile_name << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+
+  // Explicit options override the profile
+  auto config = make_stream_config(*profile);
+
+  if (result.count("frames")) {
+    config.frames = result["frames"].as<unsigned int>();
+  }
+
+  if (result.count("periods")) {
+    config.periods = result["periods"].as<unsigned int>();
+  }
+
+  if (result.count("queue-ms")) {
+    config.queue_ms = result["queue-ms"].as<unsigned int>();
+  }
+
+  if ((config.frames == 0U) || (config.queue_ms == 0U)) {
+    std::cerr << "--frames and --queue-ms must be at least 1" << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+
+  config.realtime = result.count("realtime") > 0;
+  config.rt_priority = result["rt-priority"].as<int>();
+  config.io_cpu = result["io-cpu"].as<int>();
+  config.callback_cpu = result["callback-cpu"].as<int>();
+
+  auto quality_name = result["resample-quality"].as<std::string>();
+  auto quality = parse_resample_quality(quality_name);
+
+  if (!quality) {
+    std::cerr << "Unknown resampler quality: " << quality_name << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+
+  config.resample_quality = *quality;
+  config.device_rate = result["device-rate"].as<unsigned int>();
+
+  auto format_name = result["sample-format"].as<std::string>();
+  auto sample_format = parse_sample_format(format_name);
+
+  if (!sample_format) {
+    std::cerr << "Unknown sample format: " << format_name << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+
+  config.sample_format = *sample_format;
+
+  // Fields left out of the raw layout come from the recording options
+  if (result.count("raw")) {
+    auto raw_spec = result["raw"].as<std::string>();
+    auto raw = parse_raw_format(
+        raw_spec, RawFormat{.sample_rate = result["rate"].as<int>(),
+                            .channels = result["channels"].as<int>(),
+                            .sample_format = *sample_format});
+
+    if (!raw) {
+      std::cerr << "Invalid --raw layout: " << raw_spec << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+
+    config.raw = raw;
+    config.sample_format = raw->sample_format;
+  }
+
+  config.dither = result.count("no-dither") == 0;
+  config.mmap = result.count("mmap") > 0;
+
+  auto backend_name = result["writer"].as<std::string>();
+  auto backend = parse_writer_backend(backend_name);
+
+  if (!backend) {
+    std::cerr << "Unknown writer: " << backend_name << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+
+  auto sync_spec = result["sync"].as<std::string>();
+  auto sync = parse_sync_policy(sync_spec);
+
+  if (!sync) {
+    std::cerr << "Unknown sync policy: " << sync_spec << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+
+  config.writer.backend = *backend;
+  config.writer.direct_io = result.count("direct-io") > 0;
+  config.writer.sync = *sync;
+  config.writer.encoder_queue_ms =
+      result["encoder-queue-ms"].as<unsigned int>();
+
+  config.writer.encoder_threads =
+      result["encoder-threads"].as<unsigned int>();
+
+  if (result.count("compression")) {
+    config.writer.compression = result["compression"].as<double>();
+  }
+
+  config.region = play_region_from_options(result);
+
+  if (result.count("drift-lock")) {
+    config.drift_lock_ms = result["drift-lock"].as<unsigned int>();
+  }
+
+  if (result.count("publish")) {
+    config.publish = result["publish"].as<std::string>();
+  }
+
+  config.virtual_device.enabled = result.count("virtual") > 0;
+  config.virtual_device.speed = result["virtual-speed"].as<double>();
+  config.virtual_device.source = result["virtual-source"].as<std::string>();
+
+  if (result.count("virtual-sink")) {
+    config.virtual_device.sink = result["virtual-sink"].as<std::string>();
+  }
+
+  if (!(config.virtual_device.speed >= 0.0)) {
+    std::cerr << "Invalid --virtual-speed" << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+
+  return config;
+}
+
+static std::vector<std::string> play_list_from_options(
+    cxxopts::ParseResult const &result) {
+  std::vector<std::string> filenames{};
+
+  if (result.count("play")) {
+    filenames.push_back(result["play"].as<std::string>());
+  }
+
+  if (result.count("files")) {
+    auto const &files = result["files"].as<std::vector<std::string>>();
+    filenames.insert(filenames.end(), files.begin(), files.end());
+  }
+
+  if (result.count("playlist")) {
+    auto playlist_name = result["playlist"].as<std::string>();
+    auto playlist = read_m3u_playlist(playlist_name);
+
+    if (!playlist) {
+      std::cerr << "Error reading playlist: " << playlist_name << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+
+    filenames.insert(filenames.end(), playlist->begin(), playlist->end());
+  }
+
+  if (filenames.empty()) {
+    std::cerr << "Nothing to play" << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+
+  return filenames;
+}
+
 int main(int argc, char **argv) {
   cxxopts::Options options("rtutil", "Utility to record/play audio file");
   cxxopts::ParseResult result{};
@@ -48,6 +269,8 @@ int main(int argc, char **argv) {
   options.add_options()  // List options
       ("d,device", "Device ID to play or record",
        cxxopts::value<int>()->default_value("-1"))           //
+      ("input-device", "Device ID to record from when also playing",
+       cxxopts::value<int>()->default_value("-1"))           //
       ("l,list-device", "List enumerated device list")       //
       ("L,list-device-api", "List compiled supported APIs")  //
       ("A,select-api", "Select audio API",
@@ -58,13 +281,111 @@ int main(int argc, char **argv) {
        cxxopts::value<int>()->default_value("1"))  //
       ("R,rate", "Sample rate [for-recording]",
        cxxopts::value<int>()->default_value("16000"))  //
-      ("r,record", "Record an audio file",
+      ("r,record", "Record an audio file, while playing with -p",
+       cxxopts::value<std::string>())  //
+      ("devices",
+       "Record from several devices at once, locked to the first one's "
+       "clock: <id>[:<channels>],...",
+       cxxopts::value<std::string>())  //
+      ("split-files",
+       "Record one file per device, numbered, instead of one file of all "
+       "channels [with --devices]")  //
+      ("measure-latency",
+       "Measure round-trip latency through a loopback with a probe "
+       "signal: mls or chirp",
+       cxxopts::value<std::string>()->implicit_value("mls"))  //
+      ("p,play", "Play audio files, gapless when there is more than one",
+       cxxopts::value<std::string>())  //
+      ("playlist", "Play the files of an M3U playlist",
+       cxxopts::value<std::string>())  //
+      ("files", "More files to play",
+       cxxopts::value<std::vector<std::string>>())  //
+      ("latency", "Latency profile: low, balanced or safe",
+       cxxopts::value<std::string>()->default_value("balanced"))  //
+      ("frames", "Frames per period [overrides latency profile]",
+       cxxopts::value<unsigned int>())  //
+      ("periods", "Number of device periods [overrides latency profile]",
+       cxxopts::value<unsigned int>())  //
+      ("queue-ms", "File IO queue depth in ms [overrides latency profile]",
+       cxxopts::value<unsigned int>())  //
+      ("realtime", "Real-time priority stream threads and locked memory")  //
+      ("rt-priority", "Real-time priority of the audio callback",
+       cxxopts::value<int>()->default_value("70"))  //
+      ("io-cpu", "Pin file IO thread to a CPU",
+       cxxopts::value<int>()->default_value("-1"))  //
+      ("callback-cpu", "Pin audio callback thread to a CPU",
+       cxxopts::value<int>()->default_value("-1"))  //
+      ("resample-quality", "Resampler quality: best, medium, fastest or linear",
+       cxxopts::value<std::string>()->default_value("medium"))  //
+      ("device-rate",
+       "Device sample rate, 0 to use the file rate for playback and the "
+       "device's preferred rate for recording",
+       cxxopts::value<unsigned int>()->default_value("0"))  //
+      ("sample-format",
+       "Recorded sample format: pcm16, pcm24, pcm32, float or double",
+       cxxopts::value<std::string>()->default_value("pcm16"))  //
+      ("no-dither", "Do not dither when recording to pcm16 or pcm24")  //
+      ("mmap", "Play uncompressed WAV and AIFF files from a file mapping")  //
+      ("raw",
+       "Header-less PCM to play or record, e.g. on a pipe given as \"-\": "
+       "<rate>:<channels>:<format>, empty fields come from -R, -c and "
+       "--sample-format",
+       cxxopts::value<std::string>()->implicit_value(""))  //
+      ("start",
+       "Start playing at a position: seconds, <n>ms or <n>f for frames",
+       cxxopts::value<std::string>())  //
+      ("end", "Stop playing at a position, same units as --start",
+       cxxopts::value<std::string>())  //
+      ("loop", "Play the file or region N times, forever without N",
+       cxxopts::value<unsigned int>()->implicit_value("0"))  //
+      ("crossfade-ms", "Crossfade the end of a loop into its start",
+       cxxopts::value<unsigned int>()->default_value("0"))  //
+      ("drift-lock",
+       "Playback source runs on its own clock, e.g. a live feed: resample "
+       "within 500 ppm to hold the queue at this many ms",
+       cxxopts::value<unsigned int>()->implicit_value("200"))  //
+      ("publish",
+       "Publish the capture to a shared-memory ring other processes can "
+       "--attach to",
+       cxxopts::value<std::string>())  //
+      ("attach", "Play from a ring another rtutil process --publish-es",
        cxxopts::value<std::string>())  //
-      ("p,play", "Play an audio file",
-       cxxopts::value<std::string>())         //
-      ("v,version", "Print program version")  //
+      ("writer",
+       "Recording writer: sndfile, aio for RAW and WAV, or flac for "
+       "FLAC on all cores",
+       cxxopts::value<std::string>()->default_value("sndfile"))  //
+      ("direct-io", "Bypass the page cache when recording [aio writer]")  //
+      ("sync",
+       "Flush recording to disk: none, interval:<ms>, bytes:<n> or close",
+       cxxopts::value<std::string>()->default_value("interval:1000"))  //
+      ("encoder-queue-ms",
+       "Encoder queue depth in ms for FLAC and Ogg, 0 to encode on the "
+       "file IO thread",
+       cxxopts::value<unsigned int>()->default_value("2000"))  //
+      ("compression", "FLAC and Ogg compression level, 0 to 1",
+       cxxopts::value<double>())  //
+      ("encoder-threads", "Worker threads, 0 for one per core [flac writer]",
+       cxxopts::value<unsigned int>()->default_value("0"))  //
+      ("virtual", "Use a virtual device, no sound card needed")  //
+      ("offline",
+       "Render from file to file as fast as possible: play into "
+       "--virtual-sink, record from a --virtual-source file")  //
+      ("virtual-speed",
+       "Virtual device speed, a multiple of real time, 0 for as fast as "
+       "possible",
+       cxxopts::value<double>()->default_value("1"))  //
+      ("virtual-source",
+       "Virtual device input: silence, noise, sine:<hz>, loopback, or a "
+       "file to loop",
+       cxxopts::value<std::string>()->default_value("sine:440"))  //
+      ("virtual-sink", "WAV file the virtual device's output is written to",
+       cxxopts::value<std::string>())                    //
+      ("v,version", "Print program version")                //
       ("h,help", "Print usage and exit");
 
+  options.parse_positional({"files"});
+  options.positional_help("[file...]");
+
   try {
     result = options.parse(argc, argv);
   } catch (...) {
@@ -86,12 +407,75 @@ int main(int argc, char **argv) {
   } else if (result.count("list-device")) {
     auto api = RtAudio::Api(result["select-api"].as<int>());
     list_audio_device(api);
-  } else if (result.count("play")) {
+  } else if (result.count("measure-latency")) {
+    auto api = RtAudio::Api(result["select-api"].as<int>());
+    auto dev = result["device"].as<int>();
+    auto input_dev = result["input-device"].as<int>();
+    auto start_channel = result["start-channel"].as<int>();
+    auto signal_name = result["measure-latency"].as<std::string>();
+    auto signal = parse_probe_signal(signal_name);
+
+    if (!signal) {
+      std::cerr << "Unknown probe signal: " << signal_name << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+
+    auto config = stream_config_from_options(result);
+    measure_latency(api, dev, input_dev, start_channel, *signal, config);
+  } else if (result.count("attach")) {
+    auto api = RtAudio::Api(result["select-api"].as<int>());
+    auto dev = result["device"].as<int>();
+    auto start_channel = result["start-channel"].as<int>();
+    auto name = result["attach"].as<std::string>();
+    auto config = stream_config_from_options(result);
+    attach_shared_ring(api, dev, start_channel, name, config);
+  } else if (result.count("record") &&
+             (result.count("play") || result.count("playlist"))) {
+    auto api = RtAudio::Api(result["select-api"].as<int>());
+    auto dev = result["device"].as<int>();
+    auto input_dev = result["input-device"].as<int>();
+    auto start_channel = result["start-channel"].as<int>();
+    auto num_channels = result["channels"].as<int>();
+    auto filenames = play_list_from_options(result);
+    auto filename = result["record"].as<std::string>();
+    auto config = stream_config_from_options(result);
+
+    // The recording runs at the stream rate unless a rate is given
+    auto sample_rate = result.count("rate") ? result["rate"].as<int>() : 0;
+
+    if (filenames.size() > 1U) {
+      std::cerr << "Playing only the first file while recording"
+                << std::endl;
+    }
+
+    if (result.count("offline")) {
+      std::cerr << "--offline plays or records, not both" << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+
+    if (!config.publish.empty()) {
+      std::cerr << "Ignoring --publish while playing" << std::endl;
+    }
+
+    duplex_audio_file(api, dev, input_dev, start_channel, num_channels,
+                      sample_rate, filenames.front(), filename, config);
+  } else if (result.count("play") || result.count("playlist")) {
     auto api = RtAudio::Api(result["select-api"].as<int>());
     auto dev = result["device"].as<int>();
     auto start_channel = result["start-channel"].as<int>();
-    auto filename = result["play"].as<std::string>();
-    play_audio_file(api, dev, start_channel, filename);
+    auto filenames = play_list_from_options(result);
+    auto config = stream_config_from_options(result);
+
+    if (result.count("offline")) {
+      if (filenames.size() > 1U) {
+        std::cerr << "Rendering only the first file offline" << std::endl;
+      }
+
+      offline_play_file(filenames.front(), config);
+      return EXIT_SUCCESS;
+    }
+
+    play_audio_file(api, dev, start_channel, filenames, config);
   } else if (result.count("record")) {
     auto api = RtAudio::Api(result["select-api"].as<int>());
     auto dev = result["device"].as<int>();
@@ -99,8 +483,47 @@ int main(int argc, char **argv) {
     auto num_channels = result["channels"].as<int>();
     auto sample_rate = result["rate"].as<int>();
     auto filename = result["record"].as<std::string>();
+    auto config = stream_config_from_options(result);
+
+    // The raw layout describes what is recorded
+    if (config.raw) {
+      num_channels = config.raw->channels;
+      sample_rate = config.raw->sample_rate;
+    }
+
+    if (!config.publish.empty() &&
+        (result.count("devices") || result.count("offline"))) {
+      std::cerr << "--publish records from one device" << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+
+    if (result.count("devices")) {
+      auto spec = result["devices"].as<std::string>();
+      auto devices = parse_capture_devices(spec);
+
+      if (!devices) {
+        std::cerr << "Invalid device list: " << spec << std::endl;
+        std::exit(EXIT_FAILURE);
+      }
+
+      if (result.count("offline")) {
+        std::cerr << "--offline records from one device" << std::endl;
+        std::exit(EXIT_FAILURE);
+      }
+
+      multi_record_audio_file(api, *devices, start_channel, num_channels,
+                              sample_rate, filename,
+                              result.count("split-files") > 0, config);
+      return EXIT_SUCCESS;
+    }
+
+    if (result.count("offline")) {
+      offline_record_file(sample_rate, filename, config);
+      return EXIT_SUCCESS;
+    }
+
     record_audio_file(api, dev, start_channel, num_channels, sample_rate,
-                      filename);
+                      filename, config);
   } else {
     std::cout << "Invalid option\n" << options.help() << std::endl;
     std::exit(EXIT_FAILURE);
@@ -0,0 +1,341 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mapped_audio_file.hh"
+#include "sndfile.h"
+
+namespace {
+
+/**
+ * @brief Size of a memory page, ranges passed to madvise() and munlock()
+ *  have to start on one. Kernels on arm64 may use 16K or 64K pages.
+ */
+std::size_t page_size() {
+#if defined(__linux__)
+  static auto const size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+  return size;
+#else
+  return 4096U;
+#endif
+}
+
+std::uint32_t load_le(unsigned char const *p, std::size_t n) {
+  std::uint32_t v = 0;
+  for (std::size_t i = 0; i < n; ++i) {
+    v |= static_cast<std::uint32_t>(p[i]) << (8U * i);
+  }
+  return v;
+}
+
+std::uint32_t load_be(unsigned char const *p, std::size_t n) {
+  std::uint32_t v = 0;
+  for (std::size_t i = 0; i < n; ++i) {
+    v = (v << 8U) | p[i];
+  }
+  return v;
+}
+
+bool has_id(unsigned char const *p, std::string_view id) {
+  return std::memcmp(p, id.data(), 4) == 0;
+}
+
+/**
+ * @brief Decode an 80-bit IEEE 754 extended float, as used for the AIFF
+ *  sample rate
+ */
+double load_extended(unsigned char const *p) {
+  auto exponent = static_cast<int>(load_be(p, 2) & 0x7FFFU);
+  auto mantissa = (static_cast<std::uint64_t>(load_be(p + 2, 4)) << 32U) |
+                  load_be(p + 6, 4);
+  auto value = std::ldexp(static_cast<double>(mantissa), exponent - 16383 - 63);
+  return (p[0] & 0x80U) ? -value : value;
+}
+
+}  // namespace
+
+MappedAudioFile::MappedAudioFile(std::string const &filename) {
+#if defined(__linux__)
+  int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw std::runtime_error("Can not open \"" + filename +
+                             "\": " + std::strerror(errno));
+  }
+
+  struct stat st {};
+  if ((fstat(fd, &st) != 0) || (st.st_size < 12)) {
+    ::close(fd);
+    throw std::runtime_error("\"" + filename + "\" is not a sound file");
+  }
+
+  map_size_ = static_cast<std::size_t>(st.st_size);
+  auto *map = mmap(nullptr, map_size_, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+
+  if (map == MAP_FAILED) {
+    throw std::runtime_error("Can not map \"" + filename +
+                             "\": " + std::strerror(errno));
+  }
+
+  map_ = static_cast<unsigned char *>(map);
+
+  try {
+    if (has_id(map_, "RIFF") && has_id(map_ + 8, "WAVE")) {
+      parse_wav();
+    } else if (has_id(map_, "FORM") &&
+               (has_id(map_ + 8, "AIFF") || has_id(map_ + 8, "AIFC"))) {
+      parse_aiff();
+    } else {
+      throw std::runtime_error("not a WAV or AIFF file");
+    }
+  } catch (std::exception const &e) {
+    munmap(map_, map_size_);
+    throw std::runtime_error("Can not map \"" + filename + "\": " + e.what());
+  }
+
+  // Played front to back, read ahead aggressively and drop behind
+  auto [begin, size] = page_range(0, frames_);
+  if (size > 0) {
+    madvise(begin, size, MADV_SEQUENTIAL);
+  }
+#else
+  throw std::runtime_error("Can not map \"" + filename +
+                           "\": not supported on this platform");
+#endif
+}
+
+MappedAudioFile::~MappedAudioFile() {
+#if defined(__linux__)
+  if (map_ != nullptr) {
+    munmap(map_, map_size_);
+  }
+#endif
+}
+
+int MappedAudioFile::sf_subformat() const {
+  switch (encoding_) {
+    case SampleEncoding::S8:
+      return SF_FORMAT_PCM_S8;
+    case SampleEncoding::U8:
+      return SF_FORMAT_PCM_U8;
+    case SampleEncoding::PCM24:
+      return SF_FORMAT_PCM_24;
+    case SampleEncoding::PCM32:
+      return SF_FORMAT_PCM_32;
+    case SampleEncoding::FLOAT32:
+      return SF_FORMAT_FLOAT;
+    case SampleEncoding::FLOAT64:
+      return SF_FORMAT_DOUBLE;
+    case SampleEncoding::PCM16:
+    default:
+      return SF_FORMAT_PCM_16;
+  }
+}
+
+void MappedAudioFile::parse_wav() {
+  std::size_t pos = 12;
+  bool have_fmt = false;
+
+  while ((pos + 8) <= map_size_) {
+    auto const *chunk = map_ + pos;
+    auto size = static_cast<std::size_t>(load_le(chunk + 4, 4));
+    auto const *body = chunk + 8;
+    auto body_size = std::min(size, map_size_ - (pos + 8));
+
+    if (has_id(chunk, "fmt ") && (body_size >= 16)) {
+      auto tag = load_le(body, 2);
+      channels_ = static_cast<int>(load_le(body + 2, 2));
+      samplerate_ = static_cast<int>(load_le(body + 4, 4));
+      frame_bytes_ = load_le(body + 12, 2);
+
+      // WAVE_FORMAT_EXTENSIBLE carries the real tag in its sub format
+      if ((tag == 0xFFFEU) && (body_size >= 26)) {
+        tag = load_le(body + 24, 2);
+      }
+
+      if (channels_ <= 0 || (frame_bytes_ % channels_) != 0) {
+        throw std::runtime_error("bad fmt chunk");
+      }
+
+      auto container = frame_bytes_ / static_cast<std::size_t>(channels_);
+
+      if ((tag == 1U) && (container == 1)) {
+        encoding_ = SampleEncoding::U8;
+      } else if ((tag == 1U) && (container == 2)) {
+        encoding_ = SampleEncoding::PCM16;
+      } else if ((tag == 1U) && (container == 3)) {
+        encoding_ = SampleEncoding::PCM24;
+      } else if ((tag == 1U) && (container == 4)) {
+        encoding_ = SampleEncoding::PCM32;
+      } else if ((tag == 3U) && (container == 4)) {
+        encoding_ = SampleEncoding::FLOAT32;
+      } else if ((tag == 3U) && (container == 8)) {
+        encoding_ = SampleEncoding::FLOAT64;
+      } else {
+        throw std::runtime_error("unsupported WAV encoding");
+      }
+
+      have_fmt = true;
+    } else if (has_id(chunk, "data") && have_fmt) {
+      // Streamed files may leave the size at 0 or 0xFFFFFFFF
+      data_ = body;
+      data_size_ = (size == 0) ? (map_size_ - (pos + 8)) : body_size;
+      frames_ = data_size_ / frame_bytes_;
+      big_endian_ = false;
+      return;
+    }
+
+    pos += 8 + size + (size & 1U);
+  }
+
+  throw std::runtime_error("no fmt and data chunks");
+}
+
+void MappedAudioFile::parse_aiff() {
+  std::size_t pos = 12;
+  bool is_aifc = has_id(map_ + 8, "AIFC");
+  bool have_comm = false;
+  std::size_t comm_frames = 0;
+
+  while ((pos + 8) <= map_size_) {
+    auto const *chunk = map_ + pos;
+    auto size = static_cast<std::size_t>(load_be(chunk + 4, 4));
+    auto const *body = chunk + 8;
+    auto body_size = std::min(size, map_size_ - (pos + 8));
+
+    if (has_id(chunk, "COMM") && (body_size >= 18)) {
+      channels_ = static_cast<int>(load_be(body, 2));
+      comm_frames = load_be(body + 2, 4);
+      auto bits = load_be(body + 6, 2);
+      samplerate_ = static_cast<int>(std::lround(load_extended(body + 8)));
+      big_endian_ = true;
+
+      if (channels_ <= 0) {
+        throw std::runtime_error("bad COMM chunk");
+      }
+
+      auto container = (bits + 7U) / 8U;
+      std::string_view compression = "NONE";
+
+      if (is_aifc && (body_size >= 22)) {
+        compression = std::string_view(
+            reinterpret_cast<char const *>(body + 18), 4);
+      }
+
+      if ((compression == "NONE") || (compression == "twos") ||
+          (compression == "sowt")) {
+        big_endian_ = (compression != "sowt");
+
+        switch (container) {
+          case 1:
+            encoding_ = SampleEncoding::S8;
+            break;
+          case 2:
+            encoding_ = SampleEncoding::PCM16;
+            break;
+          case 3:
+            encoding_ = SampleEncoding::PCM24;
+            break;
+          case 4:
+            encoding_ = SampleEncoding::PCM32;
+            break;
+          default:
+            throw std::runtime_error("unsupported AIFF sample size");
+        }
+      } else if ((compression == "fl32") || (compression == "FL32")) {
+        encoding_ = SampleEncoding::FLOAT32;
+      } else if ((compression == "fl64") || (compression == "FL64")) {
+        encoding_ = SampleEncoding::FLOAT64;
+      } else {
+        throw std::runtime_error("compressed AIFC is not supported");
+      }
+
+      frame_bytes_ =
+          sample_bytes(encoding_) * static_cast<std::size_t>(channels_);
+      have_comm = true;
+    } else if (has_id(chunk, "SSND") && have_comm && (body_size >= 8)) {
+      auto offset = static_cast<std::size_t>(load_be(body, 4));
+      if ((8 + offset) > body_size) {
+        throw std::runtime_error("bad SSND chunk");
+      }
+
+      data_ = body + 8 + offset;
+      data_size_ = body_size - 8 - offset;
+      frames_ = std::min(comm_frames, data_size_ / frame_bytes_);
+      return;
+    }
+
+    pos += 8 + size + (size & 1U);
+  }
+
+  throw std::runtime_error("no COMM and SSND chunks");
+}
+
+std::pair<unsigned char *, std::size_t> MappedAudioFile::page_range(
+    std::size_t frame, std::size_t frames) const {
+  frame = std::min(frame, frames_);
+  frames = std::min(frames, frames_ - frame);
+
+  auto begin = reinterpret_cast<std::uintptr_t>(data_ + frame * frame_bytes_);
+  auto end = begin + frames * frame_bytes_;
+  begin -= begin % page_size();
+
+  return {reinterpret_cast<unsigned char *>(begin), end - begin};
+}
+
+void MappedAudioFile::will_need(std::size_t frame, std::size_t frames) const {
+#if defined(__linux__)
+  auto [begin, size] = page_range(frame, frames);
+  if (size > 0) {
+    madvise(begin, size, MADV_WILLNEED);
+  }
+#endif
+}
+
+void MappedAudioFile::prefault(std::size_t frame, std::size_t frames) const {
+  auto [begin, size] = page_range(frame, frames);
+  auto const *bytes = static_cast<volatile unsigned char const *>(begin);
+
+  for (std::size_t i = 0; i < size; i += page_size()) {
+    static_cast<void>(bytes[i]);
+  }
+}
+
+void MappedAudioFile::release(std::size_t frame, std::size_t frames) const {
+#if defined(__linux__)
+  auto [begin, size] = page_range(frame, frames);
+
+  // Keep the page shared with the next frame, it is still being played
+  size -= size % page_size();
+  if (size > 0) {
+    munlock(begin, size);
+  }
+#endif
+}
@@ -0,0 +1,870 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/**
+ * Record from several devices at once, locked to the first one's clock
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "RtAudio.h"
+#include "audio_device.hh"
+#include "audio_file_writer.hh"
+#include "audio_stream.hh"
+#include "circular_buffer.hh"
+#include "cpu_meter.hh"
+#include "drift_controller.hh"
+#include "event_signal.hh"
+#include "multi_record.hh"
+#include "realtime.hh"
+#include "record_process.hh"
+#include "resampler.hh"
+#include "sample_format.hh"
+#include "stop_signal.hh"
+#include "stream_config.hh"
+#include "stream_stats.hh"
+
+/**
+ * @brief Capture ring of one device
+ */
+class DeviceCapture {
+ public:
+  /**
+   * @brief Construct a new device capture
+   * @param device Device ID
+   * @param channels Number of channels
+   * @param queue_size Ring size in frames
+   * @param callback_cpu CPU to pin the audio callback to, or negative
+   * @param data_ready Signal to notify as audio is queued, or nullptr
+   */
+  DeviceCapture(unsigned int device, std::size_t channels,
+                std::size_t queue_size, int callback_cpu,
+                EventSignal *data_ready)
+      : device_(device),
+        channels_(channels),
+        data_ready_(data_ready),
+        callback_pin_(callback_cpu) {
+    ring_.resize(queue_size * channels);
+  }
+
+  /**
+   * @brief Grow the ring to hold the periods the device granted
+   * @note Call after the stream is opened, before anything is queued
+   * @param frame_size Frames per callback of the opened stream
+   */
+  void set_frame_size(unsigned int frame_size) {
+    auto queue_size = min_queue_frames(frame_size) * channels_;
+    if (ring_.capacity() < queue_size) {
+      ring_.resize(queue_size);
+    }
+  }
+
+  /**
+   * @brief Fault in the ring used by the audio callback
+   */
+  void prefault() { ring_.prefault(); }
+
+  unsigned int device() const { return device_; }
+  std::size_t channels() const { return channels_; }
+  StreamStats const &stats() const { return stats_; }
+
+  /**
+   * @brief Get the number of whole frames queued
+   */
+  std::size_t frames_available() const {
+    return ring_.get_read_available() / channels_;
+  }
+
+  /**
+   * @brief Check whether the device has delivered the two periods
+   *  fill_estimate() needs to know its callback interval
+   */
+  bool is_timed() const {
+    return interval_ns_.load(std::memory_order_relaxed) > 0;
+  }
+
+  /**
+   * @brief Estimate the frames queued at this instant, counting the part
+   *  of the next period the device has captured but not delivered yet
+   *
+   * Whole periods arrive at once, so the ring fill alone jumps by a
+   * period depending on when it is looked at. Interpolating from the
+   * last callback time takes that jitter out of the drift measurement.
+   *
+   * @return double Frames, fractional
+   */
+  double fill_estimate() const {
+    std::uint32_t sequence{};
+    std::size_t frames{};
+    std::int64_t stamp{};
+
+    // Retry when a callback was queueing in between. The fence keeps the
+    // loads above from moving past the second look at the sequence
+    do {
+      sequence = sequence_.load(std::memory_order_acquire);
+      frames = frames_available();
+      stamp = callback_ns_.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+    } while (((sequence & 1U) != 0U) ||
+             (sequence != sequence_.load(std::memory_order_relaxed)));
+
+    auto interval = interval_ns_.load(std::memory_order_relaxed);
+
+    if (interval <= 0) {
+      return static_cast<double>(frames);
+    }
+
+    auto elapsed = static_cast<double>(now_ns() - stamp);
+    auto fraction = std::clamp(elapsed / static_cast<double>(interval),
+                               0.0, 1.0);
+    return static_cast<double>(frames) +
+           fraction *
+               static_cast<double>(
+                   period_frames_.load(std::memory_order_relaxed));
+  }
+
+  /**
+   * @brief Dequeue frames
+   * @param output Interleaved output of at least frames frames
+   * @param frames Number of frames wanted
+   * @return std::size_t Number of frames dequeued
+   */
+  std::size_t read(float *output, std::size_t frames) {
+    frames = std::min(frames, frames_available());
+    return ring_.dequeue(output, frames * channels_) / channels_;
+  }
+
+  /**
+   * @brief Drop queued frames
+   * @param frames Number of frames to drop, at most frames_available()
+   */
+  void discard(std::size_t frames) { ring_.consume(frames * channels_); }
+
+  /**
+   * @brief Report the callback pinning
+   */
+  void report_pin() const { callback_pin_.report("Callback"); }
+
+  static int audio_callback(void * /*output_buffer*/, void *input_buffer,
+                            unsigned int n_frame, double /* stream_time */,
+                            RtAudioStreamStatus status, void *user_data) {
+    auto *input = static_cast<float *>(input_buffer);
+    auto *capture = static_cast<DeviceCapture *>(user_data);
+    capture->callback_pin_.apply();
+    capture->write_frames(input, n_frame, status);
+
+    // Returning 1 stops the stream
+    return stop_requested() ? 1 : 0;
+  }
+
+ private:
+  // Smoothing of the callback interval, as a power of two
+  static constexpr int INTERVAL_SHIFT = 4;
+
+  static std::int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  void write_frames(float const *input, std::size_t frames,
+                    RtAudioStreamStatus status) {
+    auto data_len = frames * channels_;
+    auto now = now_ns();
+
+    // An odd sequence tells fill_estimate() the ring and the time stamp
+    // do not match yet
+    sequence_.fetch_add(1U, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    auto data_written = ring_.enqueue(input, data_len);
+    auto last = callback_ns_.load(std::memory_order_relaxed);
+    auto interval = interval_ns_.load(std::memory_order_relaxed);
+
+    if (last > 0) {
+      auto measured = now - last;
+      interval = (interval > 0)
+                     ? interval + ((measured - interval) >> INTERVAL_SHIFT)
+                     : measured;
+    }
+
+    callback_ns_.store(now, std::memory_order_relaxed);
+    interval_ns_.store(interval, std::memory_order_relaxed);
+    period_frames_.store(frames, std::memory_order_relaxed);
+    sequence_.fetch_add(1U, std::memory_order_release);
+
+    auto data_dropped = data_len - data_written;
+
+    stats_.on_device_status(status);
+    if (data_dropped > 0) {
+      stats_.on_ring_overrun(data_dropped, data_dropped / channels_);
+    } else {
+      stats_.on_ring_ok();
+    }
+
+    if (data_ready_ == nullptr) {
+      return;
+    }
+
+    if (stop_requested()) {
+      data_ready_->wake();
+    } else {
+      data_ready_->notify(ring_.get_read_available());
+    }
+  }
+
+  unsigned int device_{};
+  std::size_t channels_{};
+  CircularBuffer<float> ring_{};
+  StreamStats stats_{};
+  EventSignal *data_ready_{nullptr};
+  CallbackThreadPin callback_pin_{};
+
+  // Time stamp of the last callback, written by the callback only
+  std::atomic<std::uint32_t> sequence_{0};
+  std::atomic<std::int64_t> callback_ns_{0};
+  std::atomic<std::int64_t> interval_ns_{0};
+  std::atomic<std::size_t> period_frames_{0};
+};
+
+/**
+ * @brief Merge the captures of several devices onto the timeline of the
+ *  first one
+ *
+ * The first device is the clock master, its audio is taken as it is.
+ * Every other device runs through a converter whose ratio a
+ * DriftController steers, so that its ring holds a fixed margin more
+ * than the master's. Equal fill levels mean equal capture times, so the
+ * master is delayed by the same margin and the devices line up, to
+ * within the jitter of their periods.
+ */
+class MultiRecordProcess {
+ public:
+  static constexpr std::size_t BUFFER_FACTOR = 4U;
+
+  // Converter input read ahead, for its rounding
+  static constexpr std::size_t RESAMPLE_SLACK_FRAMES = 64U;
+
+  // Longest wait for every device to deliver its first periods
+  static constexpr auto FIRST_PERIOD_TIMEOUT = std::chrono::seconds(2);
+
+  /**
+   * @brief Construct a new multi-device recording
+   * @throw std::runtime_error if a converter can not be created
+   * @param devices Devices with their channel counts resolved, the first
+   *  is the clock master
+   * @param outputs One recording of all channels, or one per device
+   * @param config Stream configuration
+   * @param stream_rate Sample rate all devices run at
+   */
+  MultiRecordProcess(std::vector<CaptureDevice> const &devices,
+                     std::vector<std::unique_ptr<RecordProcess<float>>>
+                         outputs,
+                     StreamConfig const &config, int stream_rate)
+      : outputs_(std::move(outputs)), stream_rate_(stream_rate) {
+    auto queue_size = queue_frames(config, stream_rate);
+    block_frames_ = std::max<std::size_t>(
+        1U, std::min(BUFFER_FACTOR * config.frames, queue_size / 4U));
+
+    for (auto const &device : devices) {
+      auto channels = static_cast<std::size_t>(device.channels);
+      auto *signal = lanes_.empty() ? &data_ready_ : nullptr;
+      Lane lane{};
+
+      lane.capture = std::make_unique<DeviceCapture>(
+          device.id, channels, queue_size, config.callback_cpu, signal);
+
+      if (!lanes_.empty()) {
+        lane.controller.emplace(stream_rate, 0.0);
+        lane.resampler = std::make_unique<Resampler>(
+            config.resample_quality, device.channels, 1.0);
+        lane.in.resize((queue_size + RESAMPLE_SLACK_FRAMES) * channels);
+      }
+
+      // The master also holds the alignment margin, up to a ring's worth
+      lane.out.resize((block_frames_ + queue_size) * channels);
+      total_channels_ += channels;
+      lanes_.push_back(std::move(lane));
+    }
+
+    for (auto &output : outputs_) {
+      output->show_status(false);
+    }
+
+    merged_.resize(block_frames_ * total_channels_);
+  }
+
+  /**
+   * @brief Fault in the rings used by the audio callbacks
+   */
+  void prefault() {
+    for (auto &lane : lanes_) {
+      lane.capture->prefault();
+    }
+  }
+
+  /**
+   * @brief Get the capture of a device, the user data of its callback
+   * @param index Position in the device list
+   */
+  DeviceCapture &capture(std::size_t index) {
+    return *lanes_[index].capture;
+  }
+
+  /**
+   * @brief Merge and write, returns after a stop has been requested and
+   *  everything captured has been written
+   * @param period_frames Largest period of the devices, sets the margin
+   *  the other devices are kept ahead of the master by
+   */
+  void start(std::size_t period_frames) {
+    auto &master = *lanes_.front().capture;
+    auto watermark = block_frames_ * master.channels();
+    cpu_meter_ = ThreadCpuMeter{};
+
+    // Nothing is merged unless the devices could be lined up
+    bool stopping = !align(2U * period_frames);
+
+    if (stopping) {
+      request_stop();
+    }
+
+    while (!stopping) {
+      data_ready_.wait(watermark, [&]() {
+        return (master.frames_available() >= block_frames_) ||
+               stop_requested();
+      });
+
+      // Audio captured before the stop request still gets written
+      stopping = stop_requested();
+      auto low_water = stopping ? 1U : block_frames_;
+
+      while (master.frames_available() >= low_water) {
+        auto frames = std::min(master.frames_available(), block_frames_);
+
+        if (!merge(frames)) {
+          stopping = true;
+          break;
+        }
+      }
+
+      print_status();
+    }
+
+    for (auto &output : outputs_) {
+      output->write_queued(true);
+      output->close();
+    }
+  }
+
+  /**
+   * @brief Print a summary of the recording, with the drift of every
+   *  device against the master
+   */
+  void print_summary() const {
+    std::cout << "Merge thread cpu: " << std::setprecision(3)
+              << cpu_meter_.cpu_seconds() << " s over "
+              << cpu_meter_.wall_seconds() << " s (" << std::setprecision(2)
+              << cpu_meter_.percent() << "%)" << std::endl;
+
+    for (std::size_t i = 0; i < lanes_.size(); ++i) {
+      auto const &lane = lanes_[i];
+      std::cout << "Device " << lane.capture->device() << ": "
+                << lane.capture->channels() << " channel(s), ";
+
+      if (lane.controller) {
+        std::cout << std::showpos << std::fixed << std::setprecision(1)
+                  << "drift " << lane.controller->drift_ppm()
+                  << " ppm, correction " << lane.min_ppm << " to "
+                  << lane.max_ppm << " ppm" << std::noshowpos << ", "
+                  << lane.frames_short << " frame(s) short" << std::endl;
+      } else {
+        std::cout << "clock master" << std::endl;
+      }
+
+      lane.capture->report_pin();
+      print_stats_summary(lane.capture->stats().snapshot(), stream_rate_);
+    }
+
+    for (auto const &output : outputs_) {
+      output->print_summary();
+    }
+  }
+
+ private:
+  /**
+   * @brief Capture state of one device on the merge thread
+   */
+  struct Lane {
+    std::unique_ptr<DeviceCapture> capture{};
+    std::optional<DriftController> controller{};  // All but the master
+    std::unique_ptr<Resampler> resampler{};       // All but the master
+    std::vector<float> in{};   // Converter input carried over
+    std::size_t in_frames{};
+    std::vector<float> out{};  // Aligned frames not merged yet
+    std::size_t out_frames{};
+    std::size_t frames_short{};
+    double min_ppm{};
+    double max_ppm{};
+  };
+
+  /**
+   * @brief Line the devices up once they all deliver audio
+   * @param margin Frames the other devices are kept ahead of the master
+   * @return false if a device delivered nothing, reported on stderr
+   */
+  bool align(std::size_t margin) {
+    auto deadline = std::chrono::steady_clock::now() + FIRST_PERIOD_TIMEOUT;
+
+    for (auto &lane : lanes_) {
+      while (!lane.capture->is_timed()) {
+        if (stop_requested()) {
+          return true;
+        }
+
+        if (std::chrono::steady_clock::now() > deadline) {
+          std::cerr << "Device " << lane.capture->device()
+                    << " delivers no audio" << std::endl;
+          return false;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
+
+    // A device that is ahead drops its surplus, one that started late
+    // gets the missing time as silence
+    auto &master_lane = lanes_.front();
+    auto master_fill = master_lane.capture->fill_estimate();
+
+    for (auto &lane : lanes_) {
+      if (!lane.controller) {
+        continue;
+      }
+
+      auto channels = lane.capture->channels();
+      auto excess = std::llround(lane.capture->fill_estimate() -
+                                 master_fill -
+                                 static_cast<double>(margin));
+
+      if (excess > 0) {
+        lane.capture->discard(std::min(static_cast<std::size_t>(excess),
+                                       lane.capture->frames_available()));
+      } else {
+        auto room = lane.in.size() / channels - RESAMPLE_SLACK_FRAMES;
+        lane.in_frames = std::min(static_cast<std::size_t>(-excess), room);
+        std::fill_n(lane.in.begin(), lane.in_frames * channels, 0.0F);
+      }
+
+      lane.controller.emplace(stream_rate_, static_cast<double>(margin));
+    }
+
+    margin = std::min(margin, master_lane.out.size() /
+                                      master_lane.capture->channels() -
+                                  block_frames_);
+    std::fill_n(master_lane.out.begin(),
+                margin * master_lane.capture->channels(), 0.0F);
+    master_lane.out_frames = margin;
+    return true;
+  }
+
+  /**
+   * @brief Merge and write a block of frames
+   * @param frames Number of master frames to take, at most what is queued
+   * @return false on write error, reported on stderr
+   */
+  bool merge(std::size_t frames) {
+    auto dt = static_cast<double>(frames) / stream_rate_;
+    auto master_fill = lanes_.front().capture->fill_estimate();
+
+    for (auto &lane : lanes_) {
+      auto channels = lane.capture->channels();
+
+      if (!lane.controller) {
+        auto *out = lane.out.data() + lane.out_frames * channels;
+        lane.out_frames += lane.capture->read(out, frames);
+        continue;
+      }
+
+      // Measure against the master before anything is taken
+      auto fill = lane.capture->fill_estimate() +
+                  static_cast<double>(lane.in_frames);
+      auto ratio = lane.controller->update(fill - master_fill, dt);
+      auto ppm = lane.controller->correction_ppm();
+
+      lane.min_ppm = std::min(lane.min_ppm, ppm);
+      lane.max_ppm = std::max(lane.max_ppm, ppm);
+      lane.resampler->set_ratio(ratio);
+      convert(lane, frames);
+    }
+
+    if (!write(frames)) {
+      std::cerr << "\nFailed to write data..." << std::endl;
+      return false;
+    }
+
+    // Keep what is left, the master's alignment margin
+    for (auto &lane : lanes_) {
+      auto channels = lane.capture->channels();
+      auto left = lane.out_frames - frames;
+      auto head = lane.out.begin() + static_cast<std::ptrdiff_t>(
+                                         frames * channels);
+
+      std::copy(head, head + static_cast<std::ptrdiff_t>(left * channels),
+                lane.out.begin());
+      lane.out_frames = left;
+    }
+
+    write_counter_ += frames;
+    return true;
+  }
+
+  /**
+   * @brief Convert a device's audio until it has frames aligned frames,
+   *  the rest is zero-filled when it runs short
+   */
+  void convert(Lane &lane, std::size_t frames) {
+    auto channels = lane.capture->channels();
+
+    while (lane.out_frames < frames) {
+      auto wanted = frames - lane.out_frames;
+      auto needed = static_cast<std::size_t>(std::ceil(
+                        static_cast<double>(wanted) /
+                        lane.resampler->ratio())) +
+                    RESAMPLE_SLACK_FRAMES;
+
+      if (lane.in_frames < needed) {
+        auto room = lane.in.size() / channels - lane.in_frames;
+        auto *in = lane.in.data() + lane.in_frames * channels;
+        lane.in_frames += lane.capture->read(
+            in, std::min(room, needed - lane.in_frames));
+      }
+
+      if (lane.in_frames == 0) {
+        break;
+      }
+
+      auto result = lane.resampler->process(
+          std::span<float const>(lane.in.data(), lane.in_frames * channels),
+          std::span<float>(lane.out.data() + lane.out_frames * channels,
+                           wanted * channels),
+          false);
+
+      auto used = result.frames_used * channels;
+      std::copy(lane.in.begin() + static_cast<std::ptrdiff_t>(used),
+                lane.in.begin() +
+                    static_cast<std::ptrdiff_t>(lane.in_frames * channels),
+                lane.in.begin());
+      lane.in_frames -= result.frames_used;
+      lane.out_frames += result.frames_generated;
+
+      if ((result.frames_used == 0) && (result.frames_generated == 0)) {
+        break;
+      }
+    }
+
+    if (lane.out_frames < frames) {
+      auto *out = lane.out.data() + lane.out_frames * channels;
+      std::fill_n(out, (frames - lane.out_frames) * channels, 0.0F);
+      lane.frames_short += frames - lane.out_frames;
+      lane.out_frames = frames;
+    }
+  }
+
+  /**
+   * @brief Hand the first frames aligned frames of every device to the
+   *  recording, interleaved into one or one per device
+   * @return false on write error
+   */
+  bool write(std::size_t frames) {
+    if (outputs_.size() == lanes_.size()) {
+      for (std::size_t i = 0; i < lanes_.size(); ++i) {
+        outputs_[i]->write_frames(lanes_[i].out.data(), frames, 0);
+
+        if (!outputs_[i]->write_queued(false)) {
+          return false;
+        }
+      }
+
+      return true;
+    }
+
+    std::size_t offset = 0;
+
+    for (auto const &lane : lanes_) {
+      auto channels = lane.capture->channels();
+
+      for (std::size_t f = 0; f < frames; ++f) {
+        auto const *src = lane.out.data() + f * channels;
+        std::copy(src, src + channels,
+                  merged_.data() + f * total_channels_ + offset);
+      }
+
+      offset += channels;
+    }
+
+    outputs_.front()->write_frames(merged_.data(), frames, 0);
+    return outputs_.front()->write_queued(false);
+  }
+
+  void print_status() {
+    std::cout << "[ Recording " << (write_counter_ / stream_rate_)
+              << " second(s), merge cpu " << std::fixed
+              << std::setprecision(1) << cpu_meter_.percent() << "%";
+
+    for (auto const &lane : lanes_) {
+      auto stats = stats_status_str(lane.capture->stats().snapshot());
+      std::cout << ", dev " << lane.capture->device() << " ";
+
+      if (lane.controller) {
+        std::cout << std::showpos << lane.controller->drift_ppm()
+                  << std::noshowpos << " ppm ";
+      }
+
+      std::cout << stats;
+    }
+
+    std::cout << " ]\r" << std::flush;
+  }
+
+  std::vector<Lane> lanes_{};
+  std::vector<std::unique_ptr<RecordProcess<float>>> outputs_{};
+  std::vector<float> merged_{};
+  std::size_t total_channels_{0};
+  std::size_t block_frames_{};
+  std::size_t write_counter_{0};
+  int stream_rate_{};
+  EventSignal data_ready_{};
+  ThreadCpuMeter cpu_meter_{};
+};
+
+std::optional<std::vector<CaptureDevice>> parse_capture_devices(
+    std::string_view spec) {
+  std::vector<CaptureDevice> devices{};
+
+  while (!spec.empty()) {
+    auto comma = spec.find(',');
+    auto item = spec.substr(0, comma);
+    spec = (comma == std::string_view::npos) ? std::string_view{}
+                                             : spec.substr(comma + 1);
+
+    CaptureDevice device{};
+    auto colon = item.find(':');
+    auto id = item.substr(0, colon);
+    auto [id_end, id_ec] =
+        std::from_chars(id.data(), id.data() + id.size(), device.id);
+
+    if (id.empty() || (id_ec != std::errc{}) ||
+        (id_end != id.data() + id.size())) {
+      return std::nullopt;
+    }
+
+    if (colon != std::string_view::npos) {
+      auto channels = item.substr(colon + 1);
+      auto [ch_end, ch_ec] = std::from_chars(
+          channels.data(), channels.data() + channels.size(),
+          device.channels);
+
+      if (channels.empty() || (ch_ec != std::errc{}) ||
+          (ch_end != channels.data() + channels.size()) ||
+          (device.channels < 1)) {
+        return std::nullopt;
+      }
+    }
+
+    devices.push_back(device);
+  }
+
+  if (devices.empty()) {
+    return std::nullopt;
+  }
+
+  return devices;
+}
+
+/**
+ * @brief Insert a device number before a file name's extension
+ * @param filename File name, e.g. "take.wav"
+ * @param number Device number, e.g. 2 for "take-2.wav"
+ */
+static std::string numbered_file_name(std::string const &filename,
+                                      std::size_t number) {
+  auto dot = filename.find_last_of('.');
+  auto slash = filename.find_last_of("/\\");
+
+  if ((dot == std::string::npos) ||
+      ((slash != std::string::npos) && (dot < slash))) {
+    dot = filename.size();
+  }
+
+  return filename.substr(0, dot) + "-" + std::to_string(number) +
+         filename.substr(dot);
+}
+
+void multi_record_audio_file(int api_id, std::vector<CaptureDevice> devices,
+                             int start_channel, int num_channels,
+                             int sample_rate, const std::string &filename,
+                             bool split, const StreamConfig &config) {
+  std::vector<std::unique_ptr<AudioStream>> streams{};
+  int total_channels = 0;
+
+  for (auto &device : devices) {
+    if (device.channels == 0) {
+      device.channels = num_channels;
+    }
+
+    total_channels += device.channels;
+    streams.push_back(make_audio_stream(api_id, config));
+  }
+
+  // Every device runs at the master's rate
+  auto stream_rate = static_cast<int>(
+      (config.device_rate > 0)
+          ? config.device_rate
+          : preferred_sample_rate(
+                streams.front()->device_info(devices.front().id),
+                static_cast<unsigned int>(sample_rate)));
+
+  // One file of all channels, or one file per device
+  std::vector<std::string> filenames{};
+
+  if (split) {
+    for (std::size_t i = 0; i < devices.size(); ++i) {
+      filenames.push_back(numbered_file_name(filename, i + 1U));
+    }
+  } else {
+    filenames.push_back(filename);
+  }
+
+  std::vector<std::unique_ptr<RecordProcess<float>>> outputs{};
+
+  try {
+    for (std::size_t i = 0; i < filenames.size(); ++i) {
+      auto channels = split ? devices[i].channels : total_channels;
+      auto file_format = file_format_from_name(filenames[i]);
+      auto subformat = sf_subformat(config.sample_format, file_format);
+      auto file = make_audio_file_writer(filenames[i],
+                                         file_format | subformat, channels,
+                                         sample_rate, config.writer);
+      outputs.push_back(std::make_unique<RecordProcess<float>>(
+          std::move(file), config, stream_rate));
+    }
+  } catch (std::exception const &e) {
+    std::cerr << e.what() << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+
+  std::unique_ptr<MultiRecordProcess> process{};
+
+  try {
+    process = std::make_unique<MultiRecordProcess>(
+        devices, std::move(outputs), config, stream_rate);
+  } catch (std::exception const &e) {
+    std::cerr << e.what() << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+
+  auto &record = *process;
+  auto stream_options = make_stream_options(config);
+  unsigned int period_frames = 0;
+
+  for (std::size_t i = 0; i < devices.size(); ++i) {
+    unsigned int frame_size = config.frames;
+    RtAudio::StreamParameters in_parameters{
+        .deviceId = devices[i].id,
+        .nChannels = static_cast<unsigned int>(devices[i].channels),
+        .firstChannel = static_cast<unsigned int>(start_channel),
+    };
+
+    try {
+      streams[i]->open(nullptr, &in_parameters, RTAUDIO_FLOAT32,
+                       stream_rate, &frame_size,
+                       &DeviceCapture::audio_callback,
+                       static_cast<void *>(&record.capture(i)),
+                       &stream_options);
+    } catch (std::exception const &e) {
+      std::cerr << "Error opening audio stream on device " << devices[i].id
+                << ": " << e.what() << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+
+    // The device may have granted longer periods than asked for
+    record.capture(i).set_frame_size(frame_size);
+    period_frames = std::max(period_frames, frame_size);
+  }
+
+  if (config.realtime) {
+    record.prefault();
+  }
+
+  std::cout << "Record audio file(s): ";
+  for (auto const &name : filenames) {
+    std::cout << name << " ";
+  }
+
+  std::cout << std::endl
+            << "Devices:";
+  for (auto const &device : devices) {
+    std::cout << " " << device.id << " (" << device.channels << " ch)";
+  }
+
+  std::cout << std::endl
+            << "Clock master: device " << devices.front().id << std::endl
+            << "Start channel: " << start_channel << std::endl
+            << "API: " << streams.front()->api_name() << std::endl
+            << "file_sample_rate: " << sample_rate << std::endl
+            << "sample_rate: " << stream_rate << std::endl
+            << "frame_size: " << period_frames << std::endl
+            << "periods: " << stream_options.numberOfBuffers << std::endl
+            << "queue_ms: " << config.queue_ms << std::endl
+            << "num_channels: " << total_channels << std::endl;
+
+  install_stop_handler();
+
+  // Lock memory and raise this thread before the callbacks run
+  setup_io_thread(config);
+
+  std::cout << "Starting streams...\n";
+  for (auto &stream : streams) {
+    stream->start();
+  }
+
+  std::cout << "Starting merge task, press Ctrl-C to stop...\n";
+  record.start(period_frames);
+
+  std::cout << "\nClosing streams...\n";
+  for (auto &stream : streams) {
+    stream->close();
+  }
+
+  record.print_summary();
+}
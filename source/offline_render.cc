@@ -0,0 +1,254 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/**
+ * Run the playback and record chains from file to file, without a device
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "audio_device.hh"
+#include "audio_file_writer.hh"
+#include "playback_process.hh"
+#include "record_process.hh"
+#include "sample_format.hh"
+#include "sndfile.hh"
+#include "stop_signal.hh"
+#include "stream_config.hh"
+
+namespace {
+
+// Frames handed over per step, many device periods at once
+constexpr std::size_t BATCH_FRAMES = 16384U;
+
+// Every format a file can be read or written in without conversion
+constexpr RtAudioFormat ALL_FORMATS =
+    RTAUDIO_SINT16 | RTAUDIO_SINT32 | RTAUDIO_FLOAT32 | RTAUDIO_FLOAT64;
+
+using Clock = std::chrono::steady_clock;
+
+void print_throughput(std::size_t frames, int sample_rate,
+                      Clock::time_point start) {
+  std::chrono::duration<double> wall = Clock::now() - start;
+  auto audio = static_cast<double>(frames) / sample_rate;
+
+  std::cout << "Rendered " << frames << " frame(s), " << std::fixed
+            << std::setprecision(2) << audio << " s of audio in "
+            << wall.count() << " s, " << std::setprecision(1)
+            << (audio / std::max(wall.count(), 1e-9)) << "x real time"
+            << std::endl;
+}
+
+/**
+ * @brief Batch size that leaves the ring room for a block more
+ */
+std::size_t batch_frames(StreamConfig const &config, int sample_rate) {
+  return std::max<std::size_t>(
+      1U, std::min(BATCH_FRAMES, queue_frames(config, sample_rate) / 2U));
+}
+
+}  // namespace
+
+void offline_play_file(const std::string &filename,
+                       const StreamConfig &config) {
+  auto file = SndfileHandle(filename, SFM_READ);
+
+  if (file.frames() == 0) {
+    std::cerr << "Error opening file \"" << filename << "\" for reading"
+              << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+
+  if (config.region.passes == 0U) {
+    std::cerr << "An endless --loop can not be rendered offline"
+              << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+
+  // The "device" runs at the file rate unless a device rate is given
+  auto file_rate = file.samplerate();
+  auto stream_rate = (config.device_rate > 0)
+                         ? static_cast<int>(config.device_rate)
+                         : file_rate;
+  auto stream_format = (stream_rate == file_rate)
+                           ? native_stream_format(file.format(), ALL_FORMATS)
+                           : RtAudioFormat{RTAUDIO_FLOAT32};
+  auto channels = static_cast<std::size_t>(file.channels());
+  auto const &sink_name = config.virtual_device.sink;
+  SndfileHandle sink{};
+
+  if (!sink_name.empty()) {
+    sink = SndfileHandle(sink_name, SFM_WRITE,
+                         SF_FORMAT_WAV | sf_subformat_of(stream_format),
+                         file.channels(), stream_rate);
+
+    if (sink.error() != 0) {
+      std::cerr << "Error opening file \"" << sink_name << "\" for writing"
+                << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+  }
+
+  std::cout << "Render audio file: " << filename << std::endl
+            << "Sink: " << (sink_name.empty() ? "(discarded)" : sink_name)
+            << std::endl
+            << "file_sample_rate: " << file_rate << std::endl
+            << "sample_rate: " << stream_rate << std::endl
+            << "stream_format: " << rt_sample_formats_str(stream_format)
+            << std::endl;
+
+  install_stop_handler();
+
+  visit_sample_type(stream_format, [&](auto sample_type) {
+    using SampleType = typename decltype(sample_type)::type;
+    std::unique_ptr<PlaybackProcess<SampleType>> process{};
+
+    try {
+      process = std::make_unique<PlaybackProcess<SampleType>>(
+          std::move(file), config, stream_rate);
+    } catch (std::exception const &e) {
+      std::cerr << e.what() << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+
+    // Decode a ring's worth, then hand it to the callback in one go
+    auto &playback = *process;
+    auto batch = batch_frames(config, stream_rate);
+    std::vector<SampleType> buffer(batch * channels);
+    std::size_t rendered = 0;
+    auto start = Clock::now();
+
+    while (!stop_requested()) {
+      playback.prefill();
+      auto frames = std::min(batch, playback.frames_queued());
+
+      if ((frames == 0U) && playback.finished()) {
+        break;
+      }
+
+      playback.read_frames(buffer.data(), frames, 0);
+
+      if (sink && (sink.writef(buffer.data(), static_cast<sf_count_t>(
+                                                  frames)) <
+                   static_cast<sf_count_t>(frames))) {
+        std::cerr << "Failed to write data..." << std::endl;
+        break;
+      }
+
+      rendered += frames;
+    }
+
+    print_throughput(rendered, stream_rate, start);
+    playback.print_summary();
+  });
+}
+
+void offline_record_file(int sample_rate, const std::string &filename,
+                         const StreamConfig &config) {
+  // The virtual device's source file stands in for the device input
+  auto const &source_name = config.virtual_device.source;
+  auto source = SndfileHandle(source_name, SFM_READ);
+
+  if ((source.error() != 0) || (source.frames() == 0)) {
+    std::cerr << "Offline recording needs a --virtual-source file, "
+                 "error opening \""
+              << source_name << "\"" << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+
+  auto num_channels = source.channels();
+  auto stream_rate = source.samplerate();
+  auto file_format = file_format_from_name(filename);
+  auto subformat = sf_subformat(config.sample_format, file_format);
+  std::unique_ptr<AudioFileWriter> file{};
+
+  try {
+    file = make_audio_file_writer(filename, file_format | subformat,
+                                  num_channels, sample_rate, config.writer);
+  } catch (std::exception const &e) {
+    std::cerr << e.what() << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+
+  // Same choice of stream format as a live recording
+  auto stream_format = (stream_rate == sample_rate)
+                           ? native_stream_format(file->format(), ALL_FORMATS)
+                           : RtAudioFormat{RTAUDIO_FLOAT32};
+
+  std::cout << "Render audio file: " << filename << std::endl
+            << "Source: " << source_name << std::endl
+            << "file_sample_rate: " << sample_rate << std::endl
+            << "sample_rate: " << stream_rate << std::endl
+            << "stream_format: " << rt_sample_formats_str(stream_format)
+            << std::endl
+            << "num_channels: " << num_channels << std::endl;
+
+  install_stop_handler();
+
+  visit_sample_type(stream_format, [&](auto sample_type) {
+    using SampleType = typename decltype(sample_type)::type;
+    std::unique_ptr<RecordProcess<SampleType>> process{};
+
+    try {
+      process = std::make_unique<RecordProcess<SampleType>>(
+          std::move(file), config, stream_rate);
+    } catch (std::exception const &e) {
+      std::cerr << e.what() << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+
+    // Hand the callback a batch, then write it out right away
+    auto &record = *process;
+    auto channels = static_cast<std::size_t>(num_channels);
+    auto batch = batch_frames(config, stream_rate);
+    std::vector<SampleType> buffer(batch * channels);
+    std::size_t rendered = 0;
+    bool ok = true;
+    auto start = Clock::now();
+
+    while (ok && !stop_requested()) {
+      auto frames = static_cast<std::size_t>(
+          source.readf(buffer.data(), static_cast<sf_count_t>(batch)));
+
+      record.write_frames(buffer.data(), frames, 0);
+      rendered += frames;
+      ok = record.write_queued(frames < batch);
+
+      if (frames < batch) {
+        break;
+      }
+    }
+
+    if (ok && stop_requested()) {
+      record.write_queued(true);
+    }
+
+    record.close();
+    print_throughput(rendered, stream_rate, start);
+    std::cout << "Recorded " << record.frames_written() << " frame(s) at "
+              << sample_rate << " Hz" << std::endl;
+  });
+}
@@ -0,0 +1,677 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "pipe_io.hh"
+#include "stop_signal.hh"
+
+#if defined(__linux__)
+
+namespace {
+
+std::uint32_t load_le(unsigned char const *src, std::size_t size) {
+  std::uint32_t word = 0;
+  for (std::size_t i = 0; i < size; ++i) {
+    word |= static_cast<std::uint32_t>(src[i]) << (8U * i);
+  }
+  return word;
+}
+
+unsigned char *store_le(unsigned char *dst, std::uint32_t word,
+                        std::size_t size) {
+  for (std::size_t i = 0; i < size; ++i) {
+    dst[i] = static_cast<unsigned char>(word >> (8U * i));
+  }
+  return dst + size;
+}
+
+/**
+ * @brief Get the libsndfile subformat of a WAV format tag and sample size
+ * @return int Subformat, 0 if not supported
+ */
+int wav_subformat(std::uint32_t tag, std::uint32_t bits) {
+  constexpr std::uint32_t WAVE_FORMAT_PCM = 1U;
+  constexpr std::uint32_t WAVE_FORMAT_IEEE_FLOAT = 3U;
+
+  if (tag == WAVE_FORMAT_PCM) {
+    switch (bits) {
+      case 8:
+        return SF_FORMAT_PCM_U8;
+      case 16:
+        return SF_FORMAT_PCM_16;
+      case 24:
+        return SF_FORMAT_PCM_24;
+      case 32:
+        return SF_FORMAT_PCM_32;
+      default:
+        return 0;
+    }
+  }
+
+  if (tag == WAVE_FORMAT_IEEE_FLOAT) {
+    switch (bits) {
+      case 32:
+        return SF_FORMAT_FLOAT;
+      case 64:
+        return SF_FORMAT_DOUBLE;
+      default:
+        return 0;
+    }
+  }
+
+  return 0;
+}
+
+std::size_t subformat_bytes(int subformat) {
+  switch (subformat) {
+    case SF_FORMAT_PCM_24:
+      return 3;
+    case SF_FORMAT_PCM_32:
+    case SF_FORMAT_FLOAT:
+      return 4;
+    case SF_FORMAT_DOUBLE:
+      return 8;
+    case SF_FORMAT_PCM_16:
+    default:
+      return 2;
+  }
+}
+
+/**
+ * @brief Where a seek would land, only seeking forward from the current
+ *  position can be done on a stream
+ * @return sf_count_t Target position, negative if it can not be reached
+ */
+sf_count_t seek_target(sf_count_t offset, int whence, std::uint64_t position) {
+  auto current = static_cast<sf_count_t>(position);
+
+  switch (whence) {
+    case SEEK_SET:
+      return (offset >= current) ? offset : -1;
+    case SEEK_CUR:
+      return (offset >= 0) ? (current + offset) : -1;
+    default:
+      return -1;
+  }
+}
+
+}  // namespace
+
+bool is_pipe_path(std::string const &path) {
+  if (path == "-") {
+    return true;
+  }
+
+  struct stat info {};
+  return (stat(path.c_str(), &info) == 0) && S_ISFIFO(info.st_mode);
+}
+
+PipeReader::PipeReader(std::string const &path) : path_(path) {
+  // Opening a named pipe waits for the writer to open it too
+  fd_ = (path == "-") ? STDIN_FILENO : ::open(path.c_str(), O_RDONLY);
+
+  if (fd_ < 0) {
+    throw std::runtime_error("Error opening \"" + path +
+                             "\" for reading: " + std::strerror(errno));
+  }
+
+  saved_flags_ = fcntl(fd_, F_GETFL);
+
+  if ((saved_flags_ < 0) ||
+      (fcntl(fd_, F_SETFL, saved_flags_ | O_NONBLOCK) != 0)) {
+    auto error = std::string(std::strerror(errno));
+    if (fd_ != STDIN_FILENO) {
+      ::close(fd_);
+    }
+    throw std::runtime_error("Error setting up \"" + path + "\": " + error);
+  }
+
+  ring_.resize(BUFFER_BYTES);
+  thread_ = std::thread(&PipeReader::drain, this);
+}
+
+PipeReader::~PipeReader() {
+  closing_.store(true, std::memory_order_seq_cst);
+  space_ready_.wake();
+  thread_.join();
+
+  // stdin is shared with whoever started us, leave it as it was
+  fcntl(fd_, F_SETFL, saved_flags_);
+
+  if (fd_ != STDIN_FILENO) {
+    ::close(fd_);
+  }
+}
+
+void PipeReader::drain() {
+  pollfd poll_fd{.fd = fd_, .events = POLLIN, .revents = 0};
+
+  while (!closing_.load(std::memory_order_seq_cst)) {
+    auto space = ring_.get_write_available();
+
+    if (space == 0) {
+      space_ready_.wait(1U, [&]() {
+        return (ring_.get_write_available() > 0) ||
+               closing_.load(std::memory_order_seq_cst);
+      });
+      continue;
+    }
+
+    auto segments = ring_.prepare_write(space);
+    auto n = ::read(fd_, segments.first.data(), segments.first.size());
+
+    if (n > 0) {
+      ring_.commit_write(static_cast<std::size_t>(n));
+
+      auto fill = ring_.get_read_available();
+      if (fill > peak_bytes_.load(std::memory_order_relaxed)) {
+        peak_bytes_.store(fill, std::memory_order_relaxed);
+      }
+
+      auto total = total_bytes_.load(std::memory_order_relaxed);
+      total_bytes_.store(total + static_cast<std::uint64_t>(n),
+                         std::memory_order_relaxed);
+      data_ready_.notify(fill);
+      continue;
+    }
+
+    if (n == 0) {
+      break;
+    }
+
+    if (errno == EINTR) {
+      continue;
+    }
+
+    if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+      std::cerr << "\nError reading \"" << path_
+                << "\": " << std::strerror(errno) << std::endl;
+      failed_.store(true, std::memory_order_relaxed);
+      break;
+    }
+
+    // The producer is idle, let a reader waiting on it see a stop
+    if (stop_requested()) {
+      data_ready_.wake();
+    }
+
+    poll(&poll_fd, 1, POLL_MS);
+  }
+
+  eof_.store(true, std::memory_order_seq_cst);
+  data_ready_.wake();
+}
+
+std::size_t PipeReader::read(void *dst, std::size_t size) {
+  auto *out = static_cast<unsigned char *>(dst);
+  std::size_t done = 0;
+
+  while (done < size) {
+    data_ready_.wait(1U, [&]() {
+      return (ring_.get_read_available() > 0) ||
+             eof_.load(std::memory_order_seq_cst) || stop_requested();
+    });
+
+    auto n = ring_.dequeue(out + done, size - done);
+    if (n == 0) {
+      break;
+    }
+
+    done += n;
+    space_ready_.notify(ring_.get_write_available());
+  }
+
+  return done;
+}
+
+void PipeReader::read_exact(void *dst, std::size_t size) {
+  if (read(dst, size) < size) {
+    throw std::runtime_error("\"" + path_ + "\" ended in its header");
+  }
+}
+
+SF_INFO PipeReader::read_wav_header() {
+  std::array<unsigned char, 12> riff{};
+  read_exact(riff.data(), riff.size());
+
+  bool is_rf64 = (std::memcmp(riff.data(), "RF64", 4) == 0);
+
+  if (((std::memcmp(riff.data(), "RIFF", 4) != 0) && !is_rf64) ||
+      (std::memcmp(riff.data() + 8, "WAVE", 4) != 0)) {
+    throw std::runtime_error("\"" + path_ +
+                             "\" is not a WAV stream, use --raw to "
+                             "describe header-less PCM");
+  }
+
+  // Chunks before the sample data, fmt is the only one needed
+  constexpr std::size_t MAX_FMT_BYTES = 64U;
+  std::array<unsigned char, MAX_FMT_BYTES> chunk{};
+  SF_INFO info{};
+
+  for (;;) {
+    std::array<unsigned char, 8> chunk_header{};
+    read_exact(chunk_header.data(), chunk_header.size());
+
+    auto size = load_le(chunk_header.data() + 4, 4);
+    auto padded = static_cast<std::size_t>(size) + (size & 1U);
+
+    if (std::memcmp(chunk_header.data(), "data", 4) == 0) {
+      if (info.format == 0) {
+        throw std::runtime_error("\"" + path_ +
+                                 "\" has no fmt chunk before its data");
+      }
+
+      // Streams write 0 or the maximum when the length is not known
+      if (!is_rf64 && (size != 0U) &&
+          (size != std::numeric_limits<std::uint32_t>::max())) {
+        data_bytes_ = size;
+      }
+
+      return info;
+    }
+
+    if (std::memcmp(chunk_header.data(), "fmt ", 4) == 0) {
+      if ((size < 16U) || (padded > chunk.size())) {
+        throw std::runtime_error("\"" + path_ + "\" has a bad fmt chunk");
+      }
+
+      read_exact(chunk.data(), padded);
+
+      // WAVE_FORMAT_EXTENSIBLE carries the tag in its sub-format GUID
+      auto tag = load_le(chunk.data(), 2);
+      if ((tag == 0xFFFEU) && (size >= 40U)) {
+        tag = load_le(chunk.data() + 24, 2);
+      }
+
+      auto subformat = wav_subformat(tag, load_le(chunk.data() + 14, 2));
+      info.channels = static_cast<int>(load_le(chunk.data() + 2, 2));
+      info.samplerate = static_cast<int>(load_le(chunk.data() + 4, 4));
+
+      if ((subformat == 0) || (info.channels < 1) || (info.samplerate < 1)) {
+        throw std::runtime_error("\"" + path_ +
+                                 "\" is not PCM or float, or has no "
+                                 "channels");
+      }
+
+      info.format = SF_FORMAT_RAW | subformat | SF_ENDIAN_LITTLE;
+      continue;
+    }
+
+    // Skip anything else
+    while (padded > 0) {
+      auto n = std::min(padded, chunk.size());
+      read_exact(chunk.data(), n);
+      padded -= n;
+    }
+  }
+}
+
+SndfileHandle PipeReader::open(std::optional<RawFormat> const &raw) {
+  SF_INFO info{};
+
+  if (raw) {
+    info.format = sf_raw_format(*raw);
+    info.channels = raw->channels;
+    info.samplerate = raw->sample_rate;
+  } else {
+    info = read_wav_header();
+  }
+
+  vio_ = SF_VIRTUAL_IO{
+      .get_filelen = &PipeReader::vio_get_filelen,
+      .seek = &PipeReader::vio_seek,
+      .read = &PipeReader::vio_read,
+      .write = &PipeReader::vio_write,
+      .tell = &PipeReader::vio_tell,
+  };
+  position_ = 0;
+
+  auto file = SndfileHandle(vio_, this, SFM_READ, info.format, info.channels,
+                            info.samplerate);
+
+  if (file.error() != 0) {
+    throw std::runtime_error("Error opening \"" + path_ +
+                             "\": " + file.strError());
+  }
+
+  return file;
+}
+
+void PipeReader::print_summary() const {
+  auto peak = peak_bytes_.load(std::memory_order_relaxed);
+
+  std::cout << "Pipe: read " << total_bytes_.load(std::memory_order_relaxed)
+            << " byte(s), buffer peaked at " << (peak * 100U) / ring_.capacity()
+            << "% of " << (ring_.capacity() >> 10U) << " KiB";
+
+  if (failed_.load(std::memory_order_relaxed)) {
+    std::cout << ", read error";
+  }
+
+  std::cout << std::endl;
+}
+
+sf_count_t PipeReader::vio_get_filelen(void *user_data) {
+  auto *self = static_cast<PipeReader *>(user_data);
+
+  // libsndfile reads up to the length, so a stream is as long as it gets
+  return self->data_bytes_ ? static_cast<sf_count_t>(*self->data_bytes_)
+                           : SF_COUNT_MAX;
+}
+
+sf_count_t PipeReader::vio_seek(sf_count_t offset, int whence,
+                                void *user_data) {
+  auto *self = static_cast<PipeReader *>(user_data);
+  auto target = seek_target(offset, whence, self->position_);
+
+  if (target < 0) {
+    return -1;
+  }
+
+  // Skip forward by reading
+  std::array<unsigned char, 4096> scratch{};
+
+  while (static_cast<sf_count_t>(self->position_) < target) {
+    auto gap = static_cast<std::uint64_t>(target) - self->position_;
+    auto n = static_cast<sf_count_t>(
+        std::min<std::uint64_t>(gap, scratch.size()));
+
+    if (vio_read(scratch.data(), n, user_data) < n) {
+      return -1;
+    }
+  }
+
+  return static_cast<sf_count_t>(self->position_);
+}
+
+sf_count_t PipeReader::vio_read(void *ptr, sf_count_t count,
+                                void *user_data) {
+  auto *self = static_cast<PipeReader *>(user_data);
+  auto size = static_cast<std::uint64_t>(std::max<sf_count_t>(count, 0));
+
+  // Stop at the end of the data chunk, when the header gave its size
+  if (self->data_bytes_) {
+    size = std::min(size, *self->data_bytes_ - self->position_);
+  }
+
+  auto n = self->read(ptr, static_cast<std::size_t>(size));
+  self->position_ += n;
+  return static_cast<sf_count_t>(n);
+}
+
+sf_count_t PipeReader::vio_write(void const * /* ptr */,
+                                 sf_count_t /* count */,
+                                 void * /* user_data */) {
+  return 0;
+}
+
+sf_count_t PipeReader::vio_tell(void *user_data) {
+  return static_cast<sf_count_t>(
+      static_cast<PipeReader *>(user_data)->position_);
+}
+
+PipeWriter::PipeWriter(std::string const &path, int format, int channels,
+                       int samplerate)
+    : AudioFileWriter(format, channels, samplerate) {
+  if (!supports(format)) {
+    throw std::runtime_error("Only RAW and WAV with pcm16, pcm24, pcm32, "
+                             "float or double can be written to a pipe");
+  }
+
+  if (path == "-") {
+    // Keep stdout for the audio, status output goes to stderr from here
+    std::cout.flush();
+    fd_ = dup(STDOUT_FILENO);
+
+    if ((fd_ >= 0) && (dup2(STDERR_FILENO, STDOUT_FILENO) < 0)) {
+      ::close(fd_);
+      fd_ = -1;
+    }
+  } else {
+    // Opening a named pipe waits for the reader to open it too
+    fd_ = ::open(path.c_str(), O_WRONLY);
+  }
+
+  if (fd_ < 0) {
+    throw std::runtime_error("Error opening \"" + path +
+                             "\" for writing: " + std::strerror(errno));
+  }
+
+  // A reader going away is a write error, not a signal
+  std::signal(SIGPIPE, SIG_IGN);
+
+  if (((format & SF_FORMAT_TYPEMASK) == SF_FORMAT_WAV) &&
+      !write_wav_header()) {
+    ::close(fd_);
+    throw std::runtime_error("Error writing WAV header to \"" + path + "\"");
+  }
+
+  vio_ = SF_VIRTUAL_IO{
+      .get_filelen = &PipeWriter::vio_get_filelen,
+      .seek = &PipeWriter::vio_seek,
+      .read = &PipeWriter::vio_read,
+      .write = &PipeWriter::vio_write,
+      .tell = &PipeWriter::vio_tell,
+  };
+
+  auto raw = SF_FORMAT_RAW | (format & SF_FORMAT_SUBMASK) | SF_ENDIAN_LITTLE;
+  file_ = SndfileHandle(vio_, this, SFM_WRITE, raw, channels, samplerate);
+
+  if (file_.error() != 0) {
+    auto error = std::string(file_.strError());
+    file_ = SndfileHandle{};
+    ::close(fd_);
+    throw std::runtime_error("Error opening \"" + path +
+                             "\" for writing: " + error);
+  }
+}
+
+PipeWriter::~PipeWriter() { PipeWriter::close(); }
+
+bool PipeWriter::supports(int format) {
+  auto major = format & SF_FORMAT_TYPEMASK;
+  auto subformat = format & SF_FORMAT_SUBMASK;
+
+  return ((major == SF_FORMAT_RAW) || (major == SF_FORMAT_WAV)) &&
+         ((subformat == SF_FORMAT_PCM_16) || (subformat == SF_FORMAT_PCM_24) ||
+          (subformat == SF_FORMAT_PCM_32) || (subformat == SF_FORMAT_FLOAT) ||
+          (subformat == SF_FORMAT_DOUBLE));
+}
+
+template <typename SampleType>
+sf_count_t PipeWriter::write_frames(SampleType const *ptr,
+                                    sf_count_t frames) {
+  if (failed_ || closed_) {
+    return 0;
+  }
+
+  return file_.writef(ptr, frames);
+}
+
+sf_count_t PipeWriter::writef(short const *ptr, sf_count_t frames) {
+  return write_frames(ptr, frames);
+}
+
+sf_count_t PipeWriter::writef(int const *ptr, sf_count_t frames) {
+  return write_frames(ptr, frames);
+}
+
+sf_count_t PipeWriter::writef(float const *ptr, sf_count_t frames) {
+  return write_frames(ptr, frames);
+}
+
+sf_count_t PipeWriter::writef(double const *ptr, sf_count_t frames) {
+  return write_frames(ptr, frames);
+}
+
+bool PipeWriter::close() {
+  if (closed_) {
+    return !failed_;
+  }
+
+  // libsndfile has nothing to finish for RAW, this only drops the handle
+  file_ = SndfileHandle{};
+  ::close(fd_);
+  fd_ = -1;
+  closed_ = true;
+  return !failed_;
+}
+
+bool PipeWriter::write_bytes(void const *src, std::size_t size) {
+  auto const *bytes = static_cast<unsigned char const *>(src);
+
+  while ((size > 0) && !failed_) {
+    auto n = ::write(fd_, bytes, size);
+
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      std::cerr << "\nError writing to pipe: " << std::strerror(errno)
+                << std::endl;
+      failed_ = true;
+      break;
+    }
+
+    bytes += n;
+    size -= static_cast<std::size_t>(n);
+  }
+
+  return !failed_;
+}
+
+bool PipeWriter::write_wav_header() {
+  constexpr auto unknown = std::numeric_limits<std::uint32_t>::max();
+  auto subformat = format() & SF_FORMAT_SUBMASK;
+  auto sample_bytes = static_cast<std::uint32_t>(subformat_bytes(subformat));
+  auto channels = static_cast<std::uint32_t>(this->channels());
+  auto rate = static_cast<std::uint32_t>(samplerate());
+  auto block_align = channels * sample_bytes;
+  bool is_float =
+      (subformat == SF_FORMAT_FLOAT) || (subformat == SF_FORMAT_DOUBLE);
+
+  std::array<unsigned char, 44> header{};
+  auto *p = header.data();
+  std::memcpy(p, "RIFF", 4);
+  p = store_le(p + 4, unknown, 4);
+  std::memcpy(p, "WAVEfmt ", 8);
+  p = store_le(p + 8, 16U, 4);
+  p = store_le(p, is_float ? 3U : 1U, 2);
+  p = store_le(p, channels, 2);
+  p = store_le(p, rate, 4);
+  p = store_le(p, rate * block_align, 4);
+  p = store_le(p, block_align, 2);
+  p = store_le(p, sample_bytes * 8U, 2);
+  std::memcpy(p, "data", 4);
+  store_le(p + 4, unknown, 4);
+
+  return write_bytes(header.data(), header.size());
+}
+
+sf_count_t PipeWriter::vio_get_filelen(void *user_data) {
+  return vio_tell(user_data);
+}
+
+sf_count_t PipeWriter::vio_seek(sf_count_t offset, int whence,
+                                void *user_data) {
+  auto *self = static_cast<PipeWriter *>(user_data);
+  auto target = seek_target(offset, whence, self->position_);
+
+  // Only a seek to where the stream already is can be done
+  if (target != static_cast<sf_count_t>(self->position_)) {
+    return -1;
+  }
+
+  return target;
+}
+
+sf_count_t PipeWriter::vio_read(void * /* ptr */, sf_count_t /* count */,
+                                void * /* user_data */) {
+  return 0;
+}
+
+sf_count_t PipeWriter::vio_write(void const *ptr, sf_count_t count,
+                                 void *user_data) {
+  auto *self = static_cast<PipeWriter *>(user_data);
+  auto size = static_cast<std::size_t>(std::max<sf_count_t>(count, 0));
+
+  if (!self->write_bytes(ptr, size)) {
+    return 0;
+  }
+
+  self->position_ += size;
+  return count;
+}
+
+sf_count_t PipeWriter::vio_tell(void *user_data) {
+  return static_cast<sf_count_t>(
+      static_cast<PipeWriter *>(user_data)->position_);
+}
+
+#else
+
+bool is_pipe_path(std::string const &path) { return path == "-"; }
+
+PipeReader::PipeReader(std::string const &path) : path_(path) {
+  throw std::runtime_error("Reading from a pipe is not supported on this "
+                           "platform");
+}
+
+PipeReader::~PipeReader() = default;
+
+SndfileHandle PipeReader::open(std::optional<RawFormat> const &) {
+  return {};
+}
+
+void PipeReader::print_summary() const {}
+
+PipeWriter::PipeWriter(std::string const & /* path */, int format,
+                       int channels, int samplerate)
+    : AudioFileWriter(format, channels, samplerate) {
+  throw std::runtime_error("Writing to a pipe is not supported on this "
+                           "platform");
+}
+
+PipeWriter::~PipeWriter() = default;
+
+bool PipeWriter::supports(int) { return false; }
+sf_count_t PipeWriter::writef(short const *, sf_count_t) { return 0; }
+sf_count_t PipeWriter::writef(int const *, sf_count_t) { return 0; }
+sf_count_t PipeWriter::writef(float const *, sf_count_t) { return 0; }
+sf_count_t PipeWriter::writef(double const *, sf_count_t) { return 0; }
+bool PipeWriter::close() { return false; }
+
+#endif
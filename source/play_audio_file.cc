@@ -22,131 +22,547 @@
  */
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cmath>
-#include <condition_variable>
+#include <future>
 #include <iostream>
-#include <mutex>
+#include <memory>
+#include <optional>
 #include <span>
+#include <stdexcept>
 #include <string>
 #include <thread>
+#include <type_traits>
+#include <vector>
 
 #include "RtAudio.h"
+#include "audio_device.hh"
+#include "audio_stream.hh"
 #include "circular_buffer.hh"
+#include "event_signal.hh"
+#include "mapped_audio_file.hh"
+#include "packed24_stream.hh"
+#include "pipe_io.hh"
+#include "playback_process.hh"
+#include "realtime.hh"
+#include "resampler.hh"
+#include "sample_format.hh"
 #include "sndfile.hh"
+#include "stream_config.hh"
+#include "stop_signal.hh"
+#include "stream_stats.hh"
+#include "track_reader.hh"
 
-class PlaybackProcess {
+/**
+ * @brief Play a memory mapped file, decoding it inside the audio callback
+ *
+ * There is no ring: the file IO thread only keeps the pages ahead of the
+ * play position resident, so it is idle most of the time.
+ *
+ * @tparam SampleType Sample type of the stream
+ */
+template <typename SampleType>
+class MappedPlaybackProcess {
+ public:
+  /**
+   * @brief Construct a new mapped playback process
+   * @param file Mapped file to play
+   * @param config Stream configuration
+   */
+  MappedPlaybackProcess(std::unique_ptr<MappedAudioFile> file,
+                        StreamConfig const &config)
+      : file_(std::move(file)),
+        channels_(static_cast<std::size_t>(file_->channels())),
+        total_frames_(file_->frames()),
+        lead_frames_(queue_frames(config, file_->samplerate())),
+        callback_pin_(config.callback_cpu) {}
+
+  /**
+   * @brief Keep at least as much of the file resident ahead of the play
+   *  position as a ring would hold for the periods the device granted
+   * @param frame_size Frames per callback of the opened stream
+   */
+  void set_frame_size(unsigned int frame_size) {
+    lead_frames_ = std::max(lead_frames_, min_queue_frames(frame_size));
+  }
+
+  /**
+   * @brief Nothing to fault in besides the mapping, see prefill()
+   */
+  void prefault() {}
+
+  /**
+   * @brief Report how the audio callback thread was set up
+   */
+  void report_callback_thread() const { callback_pin_.report("Callback"); }
+
+  /**
+   * @brief Fault in the start of the file before the stream starts
+   */
+  void prefill() { prefetch(0); }
+
+  void start() {
+    std::size_t animation_counter = 0U;
+
+    // Keep the lead resident until the whole file has been prefetched
+    while (prefetched_.load(std::memory_order_relaxed) < total_frames_) {
+      // Top up once half the lead has been played
+      auto checkpoint =
+          prefetched_.load(std::memory_order_relaxed) - (lead_frames_ / 2U);
+
+      request_data_.wait(checkpoint, [&]() {
+        return (position_.load(std::memory_order_acquire) >= checkpoint) ||
+               stop_requested();
+      });
+
+      if (stop_requested()) {
+        return;
+      }
+
+      // Unlock what has been played, then keep the lead resident
+      auto position = position_.load(std::memory_order_acquire);
+      file_->release(released_, position - released_);
+      released_ = position;
+      prefetch(position);
+      ++animation_counter;
+
+      // Display timeline info
+      std::cout << "[ " << ("\\|/-"[animation_counter % 4]) << " Playing "
+                << (position * 100) / total_frames_ << "%, "
+                << stats_status_str(stats_.snapshot()) << " ]\r"
+                << std::flush;
+    }
+
+    // Let the audio process play out the rest of the file
+    request_data_.wait(total_frames_, [&]() {
+      return (position_.load(std::memory_order_acquire) >= total_frames_) ||
+             stop_requested();
+    });
+  }
+
+  /**
+   * @brief Print xrun counters, and how often the callback got ahead of
+   *  the prefetched range
+   */
+  void print_summary() const {
+    std::cout << "Callbacks ahead of prefetch: "
+              << late_callbacks_.load(std::memory_order_relaxed) << std::endl;
+    print_stats_summary(stats_.snapshot(), file_->samplerate());
+  }
+
+  void read_frames(SampleType *output, std::size_t frames,
+                   RtAudioStreamStatus status) {
+    auto position = position_.load(std::memory_order_relaxed);
+    auto play_frames = std::min(frames, total_frames_ - position);
+
+    file_->decode(position, play_frames, output);
+
+    // Zero the tail after the end of file
+    auto out = std::span(output + play_frames * channels_,
+                         (frames - play_frames) * channels_);
+    std::fill(std::begin(out), std::end(out), SampleType{});
+
+    // Decoding past the prefetched range may have page faulted
+    auto end = position + play_frames;
+    if (end > prefetched_.load(std::memory_order_acquire)) {
+      auto late = late_callbacks_.load(std::memory_order_relaxed);
+      late_callbacks_.store(late + 1U, std::memory_order_relaxed);
+    }
+
+    stats_.on_device_status(status);
+    stats_.on_ring_ok();
+
+    position_.store(end, std::memory_order_release);
+
+    if (stop_requested()) {
+      request_data_.wake();
+    } else {
+      request_data_.notify(end);
+    }
+  }
+
+  static int audio_callback(void *output_buffer, void * /* input_buffer */,
+                            unsigned int n_frame, double /* stream_time */,
+                            RtAudioStreamStatus status, void *user_data) {
+    auto *output = static_cast<SampleType *>(output_buffer);
+    auto *proc = static_cast<MappedPlaybackProcess *>(user_data);
+    proc->callback_pin_.apply();
+    proc->read_frames(output, n_frame, status);
+    return 0;
+  }
+
+ private:
+  /**
+   * @brief Fault in the lead ahead of a position, and start readahead of
+   *  the lead after that
+   * @param position Play position in frames
+   */
+  void prefetch(std::size_t position) {
+    auto target = std::min(position + lead_frames_, total_frames_);
+    auto from = prefetched_.load(std::memory_order_relaxed);
+
+    if (target > from) {
+      file_->prefault(from, target - from);
+      file_->will_need(target, lead_frames_);
+      prefetched_.store(target, std::memory_order_release);
+    }
+  }
+
+ private:
+  std::unique_ptr<MappedAudioFile> file_{};
+  std::size_t channels_{};
+  std::size_t total_frames_{};
+  std::size_t lead_frames_{};
+  std::size_t released_{};
+  EventSignal request_data_{};
+  CallbackThreadPin callback_pin_{};
+  StreamStats stats_{};
+  std::atomic<std::size_t> position_{0};
+  std::atomic<std::size_t> prefetched_{0};
+  std::atomic<std::size_t> late_callbacks_{0};
+};
+
+/**
+ * @brief Play a list of files back to back through one stream
+ *
+ * The file IO thread decodes the tracks into the ring one after the
+ * other, so the first frame of a track directly follows the last frame
+ * of the one before. The next track is opened, and its first block
+ * decoded, on a helper thread while the current one plays. Every track
+ * is converted to the stream's channel count and sample rate.
+ */
+class PlaylistProcess {
  public:
   static constexpr std::size_t BUFFER_FACTOR = 4U;
-  static constexpr std::size_t QUEUE_FACTOR = 128U * BUFFER_FACTOR;
 
-  PlaybackProcess(SndfileHandle &&file, std::size_t frame_size)
-      : file_(std::move(file)),
-        circ_buffer_(QUEUE_FACTOR * file.channels() * frame_size),
-        file_io_buffer_(BUFFER_FACTOR * file.channels() * frame_size, 0.0F) {}
+  /**
+   * @brief Construct a new playlist process
+   * @param files Files to play, in order
+   * @param first Reader of the first file, already open
+   * @param config Stream configuration
+   * @param channels Number of stream channels
+   * @param stream_rate Sample rate of the audio stream
+   */
+  PlaylistProcess(std::vector<std::string> files,
+                  std::unique_ptr<TrackReader> first,
+                  StreamConfig const &config, int channels, int stream_rate)
+      : files_(std::move(files)),
+        channels_(static_cast<std::size_t>(channels)),
+        stream_rate_(stream_rate),
+        quality_(config.resample_quality),
+        current_(std::move(first)),
+        callback_pin_(config.callback_cpu) {
+    auto queue_size = queue_frames(config, stream_rate);
+    auto io_frames = std::max<std::size_t>(
+        1U, std::min(BUFFER_FACTOR * config.frames, queue_size / 4U));
+
+    circ_buffer_.resize(queue_size * channels_);
+    block_.resize(io_frames * channels_);
+
+    tracks_.push_back({0U, 0U, current_->stream_frames()});
+    prefetch_next();
+  }
+
+  /**
+   * @brief Grow the ring to hold the periods the device granted, which
+   *  can be longer than the ones asked for
+   * @note Call after the stream is opened, before anything is queued
+   * @param frame_size Frames per callback of the opened stream
+   */
+  void set_frame_size(unsigned int frame_size) {
+    auto queue_size = min_queue_frames(frame_size) * channels_;
+    if (circ_buffer_.capacity() < queue_size) {
+      circ_buffer_.resize(queue_size);
+    }
+  }
+
+  /**
+   * @brief Fault in the buffers used by the audio callback
+   */
+  void prefault() { circ_buffer_.prefault(); }
+
+  /**
+   * @brief Report how the audio callback thread was set up
+   */
+  void report_callback_thread() const { callback_pin_.report("Callback"); }
+
+  /**
+   * @brief Fill the ring before the stream starts, so that the first
+   *  callbacks do not run dry
+   */
+  void prefill() {
+    while (!eof_.load(std::memory_order_relaxed) &&
+           (circ_buffer_.get_write_available() >= block_.size())) {
+      fill_block();
+    }
+  }
 
   void start() {
-    auto *buffer = file_io_buffer_.data();
-    auto buffer_len = static_cast<sf_count_t>(file_io_buffer_.size());
-    auto channels = static_cast<sf_count_t>(file_.channels());
-    auto frames = buffer_len / channels;
-    auto total_frames = file_.frames();
+    auto block_space = block_.size();
     std::size_t animation_counter = 0U;
-    std::size_t read_counter = 0U;
-
-    std::unique_lock lock{file_io_lock_};
-    for (;;) {
-      auto write_available =
-          static_cast<sf_count_t>(circ_buffer_.get_write_available());
-
-      if (write_available > buffer_len) {
-        auto read_frames = file_.readf(buffer, frames);
-        auto read_len = read_frames * channels;
-        circ_buffer_.enqueue(buffer, read_len);
-        read_counter += read_frames;
-        ++animation_counter;
-
-        // Display timeline info
-        std::cout << "[ " << ("\\|/-"[animation_counter % 4]) << " Playing "
-                  << (read_counter * 100) / total_frames << "% ]\r"
-                  << std::flush;
-
-        if (read_frames < frames) {
-          break;
-        }
+
+    while (!eof_.load(std::memory_order_relaxed)) {
+      // Sleep until the audio process has made room for a whole block
+      request_data_.wait(block_space, [&]() {
+        return (circ_buffer_.get_write_available() >= block_space) ||
+               stop_requested();
+      });
+
+      if (stop_requested()) {
+        return;
       }
-      // Wait until there is notification from audio process
-      request_data_.wait(lock);
+
+      fill_block();
+      ++animation_counter;
+
+      // Display the track being heard, which lags the one being decoded
+      // by up to the depth of the ring
+      auto played = played_frames_.load(std::memory_order_relaxed);
+      auto track = std::find_if(tracks_.rbegin(), tracks_.rend(),
+                                [&](auto const &t) {
+                                  return t.start_frame <= played;
+                                });
+      auto position = played - track->start_frame;
+      auto percent = std::min<std::size_t>(
+          100U, (position * 100U) / std::max<std::size_t>(track->frames, 1U));
+
+      if (track->index != shown_index_) {
+        shown_index_ = track->index;
+        std::cout << "\nPlaying " << (track->index + 1U) << "/"
+                  << files_.size() << ": " << files_[track->index]
+                  << std::endl;
+      }
+
+      std::cout << "[ " << ("\\|/-"[animation_counter % 4]) << " Track "
+                << (track->index + 1U) << "/" << files_.size() << " "
+                << percent << "%, " << stats_status_str(stats_.snapshot())
+                << " ]\r" << std::flush;
     }
+
+    // Let the audio process play out whatever is still queued
+    auto capacity = circ_buffer_.capacity();
+    request_data_.wait(capacity, [&]() {
+      return (circ_buffer_.get_write_available() >= capacity) ||
+             stop_requested();
+    });
   }
 
-  void read_frames(float *output, std::size_t frames) {
-    auto channels = static_cast<size_t>(file_.channels());
-    auto read_available = circ_buffer_.get_read_available();
+  /**
+   * @brief Print the number of tracks played and xrun counters
+   */
+  void print_summary() const {
+    std::cout << "Played " << tracks_.size() << " of " << files_.size()
+              << " track(s)";
+    if (skipped_ > 0) {
+      std::cout << ", skipped " << skipped_;
+    }
+    std::cout << std::endl;
+    print_stats_summary(stats_.snapshot(), stream_rate_);
+  }
+
+  void read_frames(float *output, std::size_t frames,
+                   RtAudioStreamStatus status) {
+    auto channels = channels_;
     auto data_needed = frames * channels;
+    auto data_read = circ_buffer_.dequeue(output, data_needed);
+    auto data_missing = data_needed - data_read;
+
+    // Fill the rest of the output buffer with zeros to prevent
+    // "raspberry" sound when queue runs short
+    auto out = std::span(output + data_read, data_missing);
+    std::fill(std::begin(out), std::end(out), 0.0F);
 
-    // Output only if there are enough data
-    if (read_available > data_needed) {
-      circ_buffer_.dequeue(output, data_needed);
+    // Running dry after the last track is not an underrun
+    stats_.on_device_status(status);
+    if ((data_missing > 0) && !eof_.load(std::memory_order_relaxed)) {
+      stats_.on_ring_underrun(data_missing, data_missing / channels);
     } else {
-      // Fill the output buffer with zeros to prevent "raspberry" sound
-      // when queue is empty
-      auto out = std::span(output, data_needed);
-      std::fill(std::begin(out), std::end(out), 0.0F);
+      stats_.on_ring_ok();
     }
 
-    // Send a notification to the file IO thread
-    if ((io_counter_ >= (BUFFER_FACTOR * 3 / 4)) && (file_io_lock_.try_lock())) {
-      io_counter_ = 0;
-      request_data_.notify_one();
-      file_io_lock_.unlock();
+    auto played = played_frames_.load(std::memory_order_relaxed);
+    played_frames_.store(played + data_read / channels,
+                         std::memory_order_relaxed);
+
+    // Wake up the file IO thread once there is room for a block, or
+    // right away when asked to stop
+    if (stop_requested()) {
+      request_data_.wake();
     } else {
-      ++io_counter_;
+      request_data_.notify(circ_buffer_.get_write_available());
     }
   }
 
   static int audio_callback(void *output_buffer, void * /* input_buffer */,
                             unsigned int n_frame, double /* stream_time */,
-                            RtAudioStreamStatus /* status */, void *user_data) {
+                            RtAudioStreamStatus status, void *user_data) {
     auto *output = static_cast<float *>(output_buffer);
-    auto *proc = static_cast<PlaybackProcess *>(user_data);
-    proc->read_frames(output, n_frame);
+    auto *proc = static_cast<PlaylistProcess *>(user_data);
+    proc->callback_pin_.apply();
+    proc->read_frames(output, n_frame, status);
     return 0;
   }
 
  private:
-  SndfileHandle file_{};
+  /**
+   * @brief Where a track starts in the stream
+   */
+  struct TrackStart {
+    std::size_t index{};        //!< Index in files_
+    std::size_t start_frame{};  //!< Frames queued before the track
+    std::size_t frames{};       //!< Length at the stream rate
+  };
+
+  /**
+   * @brief Decode one block into the ring, running into the next track
+   *  when the current one ends
+   */
+  void fill_block() {
+    auto channels = channels_;
+    auto wanted = block_.size() / channels;
+    std::size_t frames = 0;
+
+    while (current_ && (frames < wanted)) {
+      auto rest = std::span(block_).subspan(frames * channels,
+                                            (wanted - frames) * channels);
+      frames += current_->read(rest);
+
+      if (current_->done()) {
+        advance_track(queued_frames_ + frames);
+      }
+    }
+
+    circ_buffer_.enqueue(block_.data(), frames * channels);
+    queued_frames_ += frames;
+
+    if (!current_) {
+      eof_.store(true, std::memory_order_relaxed);
+    }
+  }
+
+  /**
+   * @brief Open the next file on a helper thread
+   */
+  void prefetch_next() {
+    if (next_index_ >= files_.size()) {
+      return;
+    }
+
+    next_ = std::async(std::launch::async,
+                       [filename = files_[next_index_],
+                        channels = static_cast<int>(channels_),
+                        rate = stream_rate_, quality = quality_]() {
+                         return std::make_unique<TrackReader>(
+                             filename, channels, rate, quality);
+                       });
+  }
+
+  /**
+   * @brief Switch to the prefetched track, skipping files that fail to
+   *  open, and start prefetching the one after it
+   * @param start_frame Frames queued before the new track
+   */
+  void advance_track(std::size_t start_frame) {
+    current_.reset();
+
+    while (next_.valid()) {
+      auto index = next_index_++;
+
+      try {
+        current_ = next_.get();
+      } catch (std::exception const &e) {
+        std::cerr << "\n" << e.what() << ", skipping" << std::endl;
+        ++skipped_;
+      }
+
+      prefetch_next();
+
+      if (current_) {
+        tracks_.push_back({index, start_frame, current_->stream_frames()});
+        return;
+      }
+    }
+  }
+
+ private:
+  std::vector<std::string> files_{};
+  std::size_t channels_{};
+  int stream_rate_{};
+  ResampleQuality quality_{};
+  std::unique_ptr<TrackReader> current_{};
+  std::future<std::unique_ptr<TrackReader>> next_{};
+  std::size_t next_index_{1};
+  std::vector<TrackStart> tracks_{};
+  std::size_t shown_index_{0};
+  std::size_t skipped_{};
+  std::size_t queued_frames_{};
   CircularBuffer<float> circ_buffer_{};
-  std::vector<float> file_io_buffer_{};
-  std::mutex file_io_lock_{};
-  std::condition_variable request_data_{};
-  std::size_t io_counter_{};
+  std::vector<float> block_{};
+  EventSignal request_data_{};
+  CallbackThreadPin callback_pin_{};
+  StreamStats stats_{};
+  std::atomic<std::size_t> played_frames_{0};
+  std::atomic<bool> eof_{false};
 };
 
 void play_audio_file(int api_id, int device_id, int start_channel,
-                     const std::string &filename) {
-  // Use default API if api_id is less than zero
-  auto rt_api = ([=]() {
-    if (api_id < 0) {
-      return RtAudio::Api::UNSPECIFIED;
-    } else {
-      return static_cast<RtAudio::Api>(api_id);
-    }
-  })();
-
-  RtAudio rt_audio{rt_api};
+                     const std::vector<std::string> &filenames,
+                     const StreamConfig &stream_config) {
+  auto config = stream_config;
+  auto stream = make_audio_stream(api_id, config);
 
   // Use default device if device_id is less than zero
   auto rt_device = ([&]() {
     if (device_id < 0) {
-      return rt_audio.getDefaultOutputDevice();
+      return stream->default_output_device();
     } else {
       return static_cast<unsigned int>(device_id);
     }
   })();
 
+  // More than one file plays as a gapless playlist, in the layout and
+  // sample rate of the first file
+  auto const &filename = filenames.front();
+  bool is_playlist = filenames.size() > 1U;
+
+  // A pipe is drained by a reader thread of its own, and can only be
+  // played from start to end
+  bool is_pipe = is_pipe_path(filename);
+  std::unique_ptr<PipeReader> pipe{};
+  SndfileHandle file{};
+
+  if (is_pipe && is_playlist) {
+    std::cerr << "A pipe can only be played on its own" << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+
+  if (is_pipe && config.region.is_set()) {
+    std::cerr << "--start, --end and --loop are ignored for pipes"
+              << std::endl;
+    config.region = PlayRegion{};
+  }
+
+  if (config.raw && is_playlist) {
+    std::cerr << "--raw is ignored for playlists" << std::endl;
+    config.raw.reset();
+  }
+
   // Open the input file
-  auto file = SndfileHandle(filename, SFM_READ);
+  try {
+    if (is_pipe) {
+      pipe = std::make_unique<PipeReader>(filename);
+      file = pipe->open(config.raw);
+    } else if (config.raw) {
+      file = SndfileHandle(filename, SFM_READ, sf_raw_format(*config.raw),
+                           config.raw->channels, config.raw->sample_rate);
+    } else {
+      file = SndfileHandle(filename, SFM_READ);
+    }
+  } catch (std::exception const &e) {
+    std::cerr << e.what() << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
 
   if (file.frames() == 0) {
     std::cerr << "Error opening file \"" << filename << "\" for reading"
@@ -161,36 +577,193 @@ void play_audio_file(int api_id, int device_id, int start_channel,
       .firstChannel = static_cast<unsigned int>(start_channel),
   };
 
-  auto sample_rate = file.samplerate();
-  constexpr std::size_t STREAM_FRAMESIZE = 512;
-  constexpr auto STREAM_FORMAT = RTAUDIO_FLOAT32;
-  unsigned int frame_size = STREAM_FRAMESIZE;
+  // Resample when the device does not support the file sample rate
+  auto file_rate = file.samplerate();
+  auto device_info = stream->device_info(rt_device);
+  auto sample_rate = static_cast<int>(
+      (config.device_rate > 0)
+          ? config.device_rate
+          : nearest_sample_rate(device_info,
+                                static_cast<unsigned int>(file_rate)));
+
+  // Uncompressed files can be played straight from a file mapping, as
+  // long as there is nothing to resample
+  std::unique_ptr<MappedAudioFile> mapped{};
+
+  if (is_playlist && config.region.is_set()) {
+    std::cerr << "--start, --end and --loop are ignored for playlists"
+              << std::endl;
+  }
+
+  if (is_playlist && (config.drift_lock_ms > 0)) {
+    std::cerr << "--drift-lock is ignored for playlists" << std::endl;
+  }
+
+  if (config.mmap && is_pipe) {
+    std::cerr << "Pipes are played with libsndfile, not mapping files"
+              << std::endl;
+  } else if (config.mmap && config.raw) {
+    std::cerr << "Header-less files are played with libsndfile, not "
+                 "mapping the file"
+              << std::endl;
+  } else if (config.mmap && is_playlist) {
+    std::cerr << "Playlists are played with libsndfile, not mapping files"
+              << std::endl;
+  } else if (config.mmap && (config.drift_lock_ms > 0)) {
+    std::cerr << "A drift lock plays with libsndfile, not mapping the file"
+              << std::endl;
+  } else if (config.mmap && config.region.is_set()) {
+    std::cerr << "Regions and loops are played with libsndfile, not "
+                 "mapping the file"
+              << std::endl;
+  } else if (config.mmap) {
+    try {
+      mapped = std::make_unique<MappedAudioFile>(filename);
+    } catch (std::exception const &e) {
+      std::cerr << e.what() << ", using libsndfile" << std::endl;
+    }
+
+    if (mapped && (sample_rate != file_rate)) {
+      std::cerr << "Resampling needs libsndfile, not mapping the file"
+                << std::endl;
+      mapped.reset();
+    }
+  }
+
+  // Play the file's own sample type when the device speaks it and no
+  // conversion is needed, float32 otherwise
+  auto file_format = mapped ? mapped->sf_subformat() : file.format();
+  auto stream_format =
+      ((sample_rate == file_rate) && !is_playlist &&
+       (config.drift_lock_ms == 0))
+          ? native_stream_format(file_format, device_info.nativeFormats)
+          : RtAudioFormat{RTAUDIO_FLOAT32};
+  unsigned int frame_size = config.frames;
   const auto num_channels = file.channels();
+  auto stream_options = make_stream_options(config);
+  bool is_mapped = (mapped != nullptr);
 
-  PlaybackProcess playback(std::move(file), frame_size);
+  // The mapping has its own view of the header, libsndfile is done
+  if (is_mapped) {
+    file = SndfileHandle{};
+  }
 
-  try {
-    rt_audio.openStream(&out_parameters, nullptr, STREAM_FORMAT, sample_rate,
-                        &frame_size, &playback.audio_callback,
-                        static_cast<void *>(&playback));
-  } catch (...) {
-    std::cerr << "Error opening rtaudio stream" << std::endl;
-    std::exit(EXIT_FAILURE);
+  auto run = [&](auto &playback) {
+    // Packed 24-bit output is packed from int32 after the process
+    bool is_packed = (stream_format == RTAUDIO_SINT24);
+    Packed24Stream packed(&playback.audio_callback,
+                          static_cast<void *>(&playback),
+                          static_cast<std::size_t>(num_channels));
+    auto *callback =
+        is_packed ? &Packed24Stream::audio_callback : &playback.audio_callback;
+    auto *user_data = is_packed ? static_cast<void *>(&packed)
+                                : static_cast<void *>(&playback);
+
+    try {
+      stream->open(&out_parameters, nullptr, stream_format, sample_rate,
+                   &frame_size, callback, user_data, &stream_options);
+    } catch (std::exception const &e) {
+      std::cerr << "Error opening audio stream: " << e.what() << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+
+    // The device may have granted longer periods than asked for
+    playback.set_frame_size(frame_size);
+
+    if (is_packed) {
+      packed.set_frame_size(frame_size);
+    }
+
+    if (config.realtime) {
+      playback.prefault();
+    }
+
+    if (is_playlist) {
+      std::cout << "Play playlist: " << filenames.size() << " file(s)"
+                << std::endl;
+    }
+
+    std::cout << "Play audio file: " << filename << std::endl
+              << "Start channel: " << start_channel << std::endl
+              << "API: " << stream->api_name() << std::endl
+              << "file_sample_rate: " << file_rate << std::endl
+              << "sample_rate: " << sample_rate << std::endl
+              << "stream_format: " << rt_sample_formats_str(stream_format)
+              << std::endl
+              << "file_io: "
+              << (is_mapped
+                      ? "mmap"
+                      : (is_playlist ? "libsndfile, gapless"
+                                     : (is_pipe ? "libsndfile, pipe"
+                                                : "libsndfile")))
+              << std::endl
+              << "frame_size: " << frame_size << std::endl
+              << "periods: " << stream_options.numberOfBuffers << std::endl
+              << "queue_ms: " << config.queue_ms << std::endl
+              << "num_channels: " << num_channels << std::endl;
+
+    install_stop_handler();
+
+    // Lock memory and raise this thread before the callback runs. Pages
+    // of a mapped file are only locked as they are prefetched
+    setup_io_thread(config, is_mapped);
+
+    std::cout << "Prefilling queue...\n";
+    playback.prefill();
+
+    std::cout << "Starting stream...\n";
+    stream->start();
+
+    std::cout << "Starting io task, press Ctrl-C to stop...\n";
+    playback.start();
+    playback.report_callback_thread();
+
+    std::cout << "\nClosing stream...\n";
+    stream->close();
+    playback.print_summary();
+
+    if (pipe) {
+      pipe->print_summary();
+    }
+  };
+
+  if (is_playlist) {
+    std::unique_ptr<PlaylistProcess> playlist{};
+
+    try {
+      auto first = std::make_unique<TrackReader>(
+          filename, num_channels, sample_rate, config.resample_quality);
+      playlist = std::make_unique<PlaylistProcess>(
+          filenames, std::move(first), config, num_channels, sample_rate);
+    } catch (std::exception const &e) {
+      std::cerr << e.what() << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+
+    run(*playlist);
+    return;
   }
 
-  std::cout << "Play audio file: " << filename << std::endl
-            << "Start channel: " << start_channel << std::endl
-            << "API: " << rt_api << std::endl
-            << "sample_rate: " << sample_rate << std::endl
-            << "frame_size: " << frame_size << std::endl
-            << "num_channels: " << num_channels << std::endl;
+  visit_sample_type(stream_format, [&](auto sample_type) {
+    using SampleType = typename decltype(sample_type)::type;
 
-  std::cout << "Starting stream...\n";
-  rt_audio.startStream();
+    if (mapped) {
+      auto playback = std::make_unique<MappedPlaybackProcess<SampleType>>(
+          std::move(mapped), config);
+      run(*playback);
+      return;
+    }
 
-  std::cout << "Starting io task...\n";
-  playback.start();
+    std::unique_ptr<PlaybackProcess<SampleType>> process{};
+
+    try {
+      process = std::make_unique<PlaybackProcess<SampleType>>(
+          std::move(file), config, sample_rate, is_pipe);
+    } catch (std::exception const &e) {
+      std::cerr << e.what() << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
 
-  std::cout << "\nClosing stream...\n";
-  rt_audio.closeStream();
+    run(*process);
+  });
 }
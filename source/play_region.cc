@@ -0,0 +1,64 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+
+#include "play_region.hh"
+
+std::size_t TimePosition::to_frames(int sample_rate) const {
+  auto frames = in_frames ? value : value * sample_rate;
+
+  // Positions past the end are clamped by the caller, only keep huge ones
+  // in range of llround()
+  return static_cast<std::size_t>(std::llround(std::min(frames, 0x1p62)));
+}
+
+std::optional<TimePosition> parse_time_position(std::string_view spec) {
+  TimePosition position{};
+  auto scale = 1.0;
+
+  if (spec.ends_with("ms")) {
+    spec.remove_suffix(2);
+    scale = 1e-3;
+  } else if (spec.ends_with("s")) {
+    spec.remove_suffix(1);
+  } else if (spec.ends_with("f")) {
+    spec.remove_suffix(1);
+    position.in_frames = true;
+  }
+
+  auto const *end = spec.data() + spec.size();
+  auto [ptr, ec] = std::from_chars(spec.data(), end, position.value);
+
+  // from_chars() also takes "inf" and "nan"
+  if (spec.empty() || (ec != std::errc{}) || (ptr != end) ||
+      !std::isfinite(position.value) || (position.value < 0.0)) {
+    return std::nullopt;
+  }
+
+  // A frame index is a whole number
+  if (position.in_frames && (position.value != std::floor(position.value))) {
+    return std::nullopt;
+  }
+
+  position.value *= scale;
+  return position;
+}
@@ -0,0 +1,60 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <filesystem>
+#include <fstream>
+
+#include "playlist.hh"
+
+std::optional<std::vector<std::string>> read_m3u_playlist(
+    std::string const &filename) {
+  std::ifstream playlist{filename};
+
+  if (!playlist) {
+    return std::nullopt;
+  }
+
+  namespace fs = std::filesystem;
+  auto base = fs::path(filename).parent_path();
+  std::vector<std::string> files{};
+  std::string line{};
+  bool first_line = true;
+
+  while (std::getline(playlist, line)) {
+    // Strip a UTF-8 byte order mark, as .m3u8 files may have one
+    if (first_line && (line.rfind("\xEF\xBB\xBF", 0) == 0)) {
+      line.erase(0, 3);
+    }
+    first_line = false;
+
+    // Playlists written on Windows end lines with CR LF
+    if (!line.empty() && (line.back() == '\r')) {
+      line.pop_back();
+    }
+
+    if (line.empty() || (line.front() == '#')) {
+      continue;
+    }
+
+    auto path = fs::path(line);
+    files.push_back(path.is_absolute() ? line : (base / path).string());
+  }
+
+  return files;
+}
@@ -0,0 +1,165 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#endif
+
+#include "realtime.hh"
+
+// Stack touched by prefault_stack()
+static constexpr std::size_t PREFAULT_STACK_SIZE = 256U * 1024U;
+
+// The file IO thread runs below the audio callback
+static constexpr int IO_PRIORITY_OFFSET = 10;
+
+#if defined(__linux__)
+static std::string rlimit_str(int resource) {
+  rlimit limit{};
+
+  if (getrlimit(resource, &limit) != 0) {
+    return "unknown";
+  } else if (limit.rlim_cur == RLIM_INFINITY) {
+    return "unlimited";
+  } else {
+    return std::to_string(limit.rlim_cur);
+  }
+}
+#endif
+
+bool lock_process_memory([[maybe_unused]] bool on_fault) {
+#if defined(__linux__)
+  int flags = MCL_CURRENT | MCL_FUTURE;
+#if defined(MCL_ONFAULT)
+  if (on_fault) {
+    flags |= MCL_ONFAULT;
+  }
+#endif
+
+  if (mlockall(flags) != 0) {
+    std::cerr << "Warning: mlockall failed: " << std::strerror(errno)
+              << " (RLIMIT_MEMLOCK " << rlimit_str(RLIMIT_MEMLOCK)
+              << " bytes), continuing without locked memory" << std::endl;
+    return false;
+  }
+  return true;
+#else
+  std::cerr << "Warning: memory locking is not supported on this platform"
+            << std::endl;
+  return false;
+#endif
+}
+
+bool set_thread_realtime([[maybe_unused]] int priority) {
+#if defined(__linux__)
+  sched_param param{};
+  param.sched_priority =
+      std::clamp(priority, sched_get_priority_min(SCHED_FIFO),
+                 sched_get_priority_max(SCHED_FIFO));
+
+  auto err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+  if (err != 0) {
+    std::cerr << "Warning: SCHED_FIFO priority " << param.sched_priority
+              << " denied: " << std::strerror(err) << " (RLIMIT_RTPRIO "
+              << rlimit_str(RLIMIT_RTPRIO)
+              << "), continuing at normal priority" << std::endl;
+    return false;
+  }
+  return true;
+#else
+  std::cerr << "Warning: real-time scheduling is not supported on this "
+               "platform"
+            << std::endl;
+  return false;
+#endif
+}
+
+bool pin_thread_to_cpu([[maybe_unused]] int cpu) noexcept {
+#if defined(__linux__)
+  // CPU_SET() does not check its argument
+  if ((cpu < 0) || (cpu >= CPU_SETSIZE)) {
+    return false;
+  }
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+  return false;
+#endif
+}
+
+void prefault_stack() {
+  volatile unsigned char stack[PREFAULT_STACK_SIZE];
+
+  for (std::size_t i = 0; i < PREFAULT_STACK_SIZE; i += 64U) {
+    stack[i] = 0;
+  }
+
+  // Volatile read so that the writes above cannot be elided
+  static_cast<void>(stack[0]);
+}
+
+void setup_io_thread(StreamConfig const &config, bool lock_on_fault) {
+  if (config.realtime) {
+    if (lock_process_memory(lock_on_fault)) {
+      std::cout << "Process memory locked" << std::endl;
+    }
+
+    prefault_stack();
+
+    auto io_priority = std::max(1, config.rt_priority - IO_PRIORITY_OFFSET);
+    if (set_thread_realtime(io_priority)) {
+      std::cout << "IO thread running SCHED_FIFO at priority " << io_priority
+                << std::endl;
+    }
+  }
+
+  if (config.io_cpu >= 0) {
+    if (pin_thread_to_cpu(config.io_cpu)) {
+      std::cout << "IO thread pinned to cpu " << config.io_cpu << std::endl;
+    } else {
+      std::cerr << "Warning: failed to pin IO thread to cpu " << config.io_cpu
+                << std::endl;
+    }
+  }
+}
+
+void CallbackThreadPin::report(std::string_view name) const {
+  switch (status_.load(std::memory_order_relaxed)) {
+    case PINNED:
+      std::cout << name << " thread pinned to cpu " << cpu_ << std::endl;
+      break;
+    case FAILED:
+      std::cerr << "Warning: failed to pin " << name << " thread to cpu "
+                << cpu_ << std::endl;
+      break;
+    default:
+      break;
+  }
+}
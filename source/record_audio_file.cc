@@ -21,186 +21,206 @@
  * Play an audio file to selected device
  */
 
-#include <algorithm>
-#include <chrono>
-#include <cmath>
-#include <condition_variable>
-#include <filesystem>
 #include <iostream>
-#include <unordered_map>
-#include <mutex>
-#include <span>
+#include <memory>
+#include <stdexcept>
 #include <string>
-#include <thread>
 
 #include "RtAudio.h"
-#include "circular_buffer.hh"
-#include "sndfile.hh"
+#include "audio_device.hh"
+#include "audio_stream.hh"
+#include "audio_file_writer.hh"
+#include "packed24_stream.hh"
+#include "realtime.hh"
+#include "record_process.hh"
+#include "sample_format.hh"
+#include "shared_ring.hh"
+#include "stop_signal.hh"
+#include "stream_config.hh"
+
+namespace {
 
 /**
- * @brief Record audio to file
+ * @brief Record process that also publishes what it captures to a
+ *  shared ring
  */
-class RecordProcess {
- public:
-  static constexpr std::size_t BUFFER_FACTOR = 4U;
-  static constexpr std::size_t QUEUE_FACTOR = 4 * BUFFER_FACTOR;
-
-  RecordProcess(SndfileHandle &&file, std::size_t frame_size)
-      : file_{std::move(file)},
-        circ_buffer_(QUEUE_FACTOR * file.channels() * frame_size),
-        file_io_buffer_(BUFFER_FACTOR * file.channels() * frame_size, 0.0F),
-        io_counter_{0} {}
-
-  /**
-   * @brief Start file io thread
-   */
-  void start() {
-    auto *buffer = file_io_buffer_.data();
-    auto buffer_len = static_cast<sf_count_t>(file_io_buffer_.size());
-    auto channels = static_cast<sf_count_t>(file_.channels());
-    auto frames = buffer_len / channels;
-    int write_counter = 0;
-    auto sample_rate = file_.samplerate();
-    std::unique_lock lock{file_io_lock_};
-
-    for (;;) {
-      auto read_available = circ_buffer_.get_read_available();
-
-      if (read_available > static_cast<std::size_t>(buffer_len)) {
-        circ_buffer_.dequeue(buffer, buffer_len);
-        auto write_frames = file_.writef(buffer, frames);
-        write_counter += static_cast<int>(write_frames);
-
-        // Display recording info info
-        std::cout << "[ Recording " << (write_counter / sample_rate)
-                  << " second(s) ]\r" << std::flush;
-
-        file_.writeSync();
-        if (write_frames < frames) {
-          std::cerr << "Failed to write data..." << std::endl;
-          break;
-        }
-      }
-    }
-
-    // Wait until there is notification from audio process
-    data_ready_.wait(lock);
-  }
-
-  void write_frames(float const *input, std::size_t frames) {
-    auto channels = static_cast<size_t>(file_.channels());
-    circ_buffer_.enqueue(input, frames * channels);
-
-    // Send a notification to the IO thread
-    if ((io_counter_ >= BUFFER_FACTOR) && (file_io_lock_.try_lock())) {
-      io_counter_ = 0;
-      file_io_lock_.unlock();
-      data_ready_.notify_one();
-    } else {
-      ++io_counter_;
-    }
-  }
-
-  static int audio_callback(void * /*output_buffer*/, void *input_buffer,
-                            unsigned int n_frame, double /* stream_time */,
-                            RtAudioStreamStatus /* status */, void *user_data) {
-    auto *input = static_cast<float *>(input_buffer);
-    auto *proc = static_cast<RecordProcess *>(user_data);
-    proc->write_frames(input, n_frame);
-    return 0;
+template <typename Process>
+struct PublishingRecord {
+  Process &record;
+  SharedRingWriter &ring;
+
+  static int audio_callback(void *output_buffer, void *input_buffer,
+                            unsigned int n_frame, double stream_time,
+                            RtAudioStreamStatus status, void *user_data) {
+    auto *self = static_cast<PublishingRecord *>(user_data);
+    auto result = Process::audio_callback(output_buffer, input_buffer,
+                                          n_frame, stream_time, status,
+                                          static_cast<void *>(&self->record));
+    self->ring.write(input_buffer, n_frame);
+    return result;
   }
-
- private:
-  SndfileHandle file_{};
-  CircularBuffer<float> circ_buffer_{};
-  std::vector<float> file_io_buffer_{};
-  std::mutex file_io_lock_{};
-  std::condition_variable data_ready_{};
-  std::size_t io_counter_{};
 };
 
-static int get_format_from_file_ext(std::string filename) {
-
-  // This is a subset of formats supported by libsndfile
-  static const std::unordered_map<std::string, int> fmt{
-      {".wav", SF_FORMAT_WAV},   {".aiff", SF_FORMAT_AIFF},
-      {".au", SF_FORMAT_AU},     {".raw", SF_FORMAT_RAW},
-      {".flac", SF_FORMAT_FLAC}, {".ogg", SF_FORMAT_OGG},
-  };
-
-  namespace fs = std::filesystem;
-  auto ext = fs::path(filename).extension().string();
-
-  if (fmt.count(ext)) {
-    return fmt.at(ext);
-  } else {
-    // Assume RAW file format
-    return SF_FORMAT_RAW;
-  }
-}
+}  // namespace
 
 void record_audio_file(int api_id, int device_id, int start_channel,
                        int num_channels, int sample_rate,
-                       const std::string &filename) {
-  // Use default API if api_id is less than zero
-  auto rt_api = ([=]() {
-    if (api_id < 0) {
-      return RtAudio::Api::UNSPECIFIED;
-    } else {
-      return static_cast<RtAudio::Api>(api_id);
-    }
-  })();
-
-  RtAudio rt_audio{rt_api};
+                       const std::string &filename,
+                       const StreamConfig &config) {
+  auto stream = make_audio_stream(api_id, config);
 
   // Use default device if device_id is less than zero
   auto rt_device = ([&]() {
     if (device_id < 0) {
-      return rt_audio.getDefaultOutputDevice();
+      return stream->default_input_device();
     } else {
       return static_cast<unsigned int>(device_id);
     }
   })();
 
   // Create stream parameters
-  constexpr std::size_t STREAM_FRAMESIZE = 512;
-  constexpr auto STREAM_FORMAT = RTAUDIO_FLOAT32;
-  unsigned int frame_size = STREAM_FRAMESIZE;
+  unsigned int frame_size = config.frames;
+  auto stream_options = make_stream_options(config);
   RtAudio::StreamParameters in_parameters{
       .deviceId = rt_device,
       .nChannels = static_cast<unsigned int>(num_channels),
       .firstChannel = static_cast<unsigned int>(start_channel),
   };
 
-  // Create a 16-bit PCM file
-  auto file_format = get_format_from_file_ext(filename);
-  auto file = SndfileHandle{filename, SFM_WRITE, file_format | SF_FORMAT_PCM_16,
-                            num_channels, sample_rate};
-
-  RecordProcess record{std::move(file), frame_size};
+  // Create the file in the requested sample format, header-less if asked
+  auto file_format =
+      config.raw ? SF_FORMAT_RAW : file_format_from_name(filename);
+  auto subformat = sf_subformat(config.sample_format, file_format);
+  std::unique_ptr<AudioFileWriter> file{};
 
   try {
-    rt_audio.openStream(nullptr, &in_parameters, STREAM_FORMAT, sample_rate,
-                        &frame_size, &record.audio_callback,
-                        static_cast<void *>(&record));
-  } catch (...) {
-    std::cerr << "Error opening rtaudio stream" << std::endl;
+    file = make_audio_file_writer(filename, file_format | subformat,
+                                  num_channels, sample_rate, config.writer);
+  } catch (std::exception const &e) {
+    std::cerr << e.what() << std::endl;
     std::exit(EXIT_FAILURE);
   }
 
-  std::cout << "Record audio file: " << filename << std::endl
-            << "Start channel: " << start_channel << std::endl
-            << "API: " << rt_api << std::endl
-            << "sample_rate: " << sample_rate << std::endl
-            << "frame_size: " << frame_size << std::endl
-            << "num_channels: " << num_channels << std::endl;
+  // Run the device at its own rate and resample to the file rate
+  auto device_info = stream->device_info(rt_device);
+  auto stream_rate = static_cast<int>(
+      (config.device_rate > 0)
+          ? config.device_rate
+          : preferred_sample_rate(device_info,
+                                  static_cast<unsigned int>(sample_rate)));
+
+  // Capture in the file's own sample type when the device speaks it and
+  // no resampling is needed, float32 otherwise
+  auto stream_format =
+      (stream_rate == sample_rate)
+          ? native_stream_format(file->format(), device_info.nativeFormats)
+          : RtAudioFormat{RTAUDIO_FLOAT32};
+
+  visit_sample_type(stream_format, [&](auto sample_type) {
+    using SampleType = typename decltype(sample_type)::type;
+    using Process = RecordProcess<SampleType>;
+    std::unique_ptr<Process> process{};
+
+    try {
+      process = std::make_unique<Process>(std::move(file), config, stream_rate);
+    } catch (std::exception const &e) {
+      std::cerr << e.what() << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
 
-  std::cout << "Starting stream...\n";
-  rt_audio.startStream();
+    auto &record = *process;
+
+    // Publish the stream as captured, before resampling
+    std::unique_ptr<SharedRingWriter> ring{};
+    std::unique_ptr<PublishingRecord<Process>> publisher{};
+
+    if (!config.publish.empty()) {
+      try {
+        ring = std::make_unique<SharedRingWriter>(
+            config.publish, rt_format_of<SampleType>(), num_channels,
+            stream_rate,
+            queue_frames(config, stream_rate));
+      } catch (std::exception const &e) {
+        std::cerr << e.what() << std::endl;
+        std::exit(EXIT_FAILURE);
+      }
+
+      publisher = std::unique_ptr<PublishingRecord<Process>>(
+          new PublishingRecord<Process>{record, *ring});
+    }
+
+    auto *callback = publisher ? &PublishingRecord<Process>::audio_callback
+                               : &Process::audio_callback;
+    auto *user_data = publisher ? static_cast<void *>(publisher.get())
+                                : static_cast<void *>(&record);
+
+    // Packed 24-bit input is unpacked to int32 ahead of the process
+    bool is_packed = (stream_format == RTAUDIO_SINT24);
+    Packed24Stream packed(callback, user_data,
+                          static_cast<std::size_t>(num_channels));
+
+    if (is_packed) {
+      callback = &Packed24Stream::audio_callback;
+      user_data = static_cast<void *>(&packed);
+    }
+
+    try {
+      stream->open(nullptr, &in_parameters, stream_format, stream_rate,
+                   &frame_size, callback, user_data, &stream_options);
+    } catch (std::exception const &e) {
+      std::cerr << "Error opening audio stream: " << e.what() << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+
+    // The device may have granted longer periods than asked for
+    record.set_frame_size(frame_size);
+
+    if (is_packed) {
+      packed.set_frame_size(frame_size);
+    }
+
+    if (config.realtime) {
+      record.prefault();
+      if (ring) {
+        ring->prefault();
+      }
+    }
+
+    std::cout << "Record audio file: " << filename << std::endl
+              << "Start channel: " << start_channel << std::endl
+              << "API: " << stream->api_name() << std::endl
+              << "file_sample_rate: " << sample_rate << std::endl
+              << "sample_rate: " << stream_rate << std::endl
+              << "stream_format: " << rt_sample_formats_str(stream_format)
+              << std::endl
+              << "frame_size: " << frame_size << std::endl
+              << "periods: " << stream_options.numberOfBuffers << std::endl
+              << "queue_ms: " << config.queue_ms << std::endl
+              << "num_channels: " << num_channels << std::endl;
+
+    if (ring) {
+      ring->set_period(frame_size);
+      std::cout << "publish: " << config.publish << " ("
+                << ring->capacity() << " frames)" << std::endl;
+    }
 
-  std::cout << "Starting io task...\n";
-  record.start();
+    install_stop_handler();
 
-  std::cout << "\nClosing stream...\n";
-  rt_audio.closeStream();
+    // Lock memory and raise this thread before the callback runs
+    setup_io_thread(config);
+
+    std::cout << "Starting stream...\n";
+    stream->start();
+
+    std::cout << "Starting io task, press Ctrl-C to stop...\n";
+    record.start();
+
+    std::cout << "\nClosing stream...\n";
+    stream->close();
+    record.print_summary();
+
+    if (ring) {
+      ring->print_summary();
+    }
+  });
 }
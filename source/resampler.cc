@@ -0,0 +1,94 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <stdexcept>
+#include <string>
+
+#include "resampler.hh"
+#include "samplerate.h"
+
+std::optional<ResampleQuality> parse_resample_quality(std::string_view name) {
+  if (name == "best") {
+    return ResampleQuality::BEST;
+  } else if (name == "medium") {
+    return ResampleQuality::MEDIUM;
+  } else if (name == "fastest") {
+    return ResampleQuality::FASTEST;
+  } else if (name == "linear") {
+    return ResampleQuality::LINEAR;
+  } else {
+    return std::nullopt;
+  }
+}
+
+static int src_converter_type(ResampleQuality quality) {
+  switch (quality) {
+    case ResampleQuality::BEST:
+      return SRC_SINC_BEST_QUALITY;
+    case ResampleQuality::FASTEST:
+      return SRC_SINC_FASTEST;
+    case ResampleQuality::LINEAR:
+      return SRC_LINEAR;
+    case ResampleQuality::MEDIUM:
+    default:
+      return SRC_SINC_MEDIUM_QUALITY;
+  }
+}
+
+Resampler::Resampler(ResampleQuality quality, int channels, double ratio)
+    : channels_(channels), ratio_(ratio) {
+  if (src_is_valid_ratio(ratio) == 0) {
+    throw std::runtime_error("Invalid resampling ratio " +
+                             std::to_string(ratio));
+  }
+
+  int error = 0;
+  state_ = src_new(src_converter_type(quality), channels, &error);
+
+  if (state_ == nullptr) {
+    throw std::runtime_error(std::string("Failed to create resampler: ") +
+                             src_strerror(error));
+  }
+}
+
+Resampler::~Resampler() { src_delete(state_); }
+
+Resampler::Result Resampler::process(std::span<float const> input,
+                                     std::span<float> output,
+                                     bool end_of_input) {
+  auto channels = static_cast<std::size_t>(channels_);
+  SRC_DATA data{};
+  data.data_in = input.data();
+  data.data_out = output.data();
+  data.input_frames = static_cast<long>(input.size() / channels);
+  data.output_frames = static_cast<long>(output.size() / channels);
+  data.end_of_input = end_of_input ? 1 : 0;
+  data.src_ratio = ratio_;
+
+  auto error = src_process(state_, &data);
+  if (error != 0) {
+    throw std::runtime_error(std::string("Resampling failed: ") +
+                             src_strerror(error));
+  }
+
+  return {.frames_used = static_cast<std::size_t>(data.input_frames_used),
+          .frames_generated = static_cast<std::size_t>(data.output_frames_gen)};
+}
+
+void Resampler::reset() { src_reset(state_); }
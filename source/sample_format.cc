@@ -0,0 +1,167 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <charconv>
+
+#include "sample_format.hh"
+#include "sndfile.h"
+
+std::optional<SampleFormat> parse_sample_format(std::string_view name) {
+  if (name == "pcm16") {
+    return SampleFormat::PCM16;
+  } else if (name == "pcm24") {
+    return SampleFormat::PCM24;
+  } else if (name == "pcm32") {
+    return SampleFormat::PCM32;
+  } else if (name == "float") {
+    return SampleFormat::FLOAT;
+  } else if (name == "double") {
+    return SampleFormat::DOUBLE;
+  } else {
+    return std::nullopt;
+  }
+}
+
+std::optional<RawFormat> parse_raw_format(std::string_view spec,
+                                          RawFormat const &defaults) {
+  auto raw = defaults;
+  auto first = spec.find(':');
+  auto second = (first == std::string_view::npos)
+                    ? std::string_view::npos
+                    : spec.find(':', first + 1);
+
+  // At most three fields
+  if ((second != std::string_view::npos) &&
+      (spec.find(':', second + 1) != std::string_view::npos)) {
+    return std::nullopt;
+  }
+
+  auto field = [&](std::size_t begin, std::size_t end) {
+    if (begin == std::string_view::npos) {
+      return std::string_view{};
+    }
+    return spec.substr(begin, end - begin);
+  };
+
+  auto parse_int = [](std::string_view text, int &value) {
+    auto [end, ec] =
+        std::from_chars(text.data(), text.data() + text.size(), value);
+    return (ec == std::errc{}) && (end == text.data() + text.size()) &&
+           (value > 0);
+  };
+
+  auto rate = field(0, first);
+  auto channels =
+      field((first == std::string_view::npos) ? first : first + 1, second);
+  auto format =
+      field((second == std::string_view::npos) ? second : second + 1,
+            std::string_view::npos);
+
+  if (!rate.empty() && !parse_int(rate, raw.sample_rate)) {
+    return std::nullopt;
+  }
+
+  if (!channels.empty() && !parse_int(channels, raw.channels)) {
+    return std::nullopt;
+  }
+
+  if (!format.empty()) {
+    auto sample_format = parse_sample_format(format);
+    if (!sample_format) {
+      return std::nullopt;
+    }
+    raw.sample_format = *sample_format;
+  }
+
+  return raw;
+}
+
+int sf_raw_format(RawFormat const &raw) {
+  return SF_FORMAT_RAW | sf_subformat(raw.sample_format, SF_FORMAT_RAW) |
+         SF_ENDIAN_LITTLE;
+}
+
+int sf_subformat(SampleFormat format, int major_format) {
+  if (major_format == SF_FORMAT_OGG) {
+    return SF_FORMAT_VORBIS;
+  }
+
+  switch (format) {
+    case SampleFormat::PCM24:
+      return SF_FORMAT_PCM_24;
+    case SampleFormat::PCM32:
+      return SF_FORMAT_PCM_32;
+    case SampleFormat::FLOAT:
+      return SF_FORMAT_FLOAT;
+    case SampleFormat::DOUBLE:
+      return SF_FORMAT_DOUBLE;
+    case SampleFormat::PCM16:
+    default:
+      return SF_FORMAT_PCM_16;
+  }
+}
+
+RtAudioFormat native_stream_format(int sf_format,
+                                   RtAudioFormat native_formats) {
+  auto format = RtAudioFormat{RTAUDIO_FLOAT32};
+  auto accepted = RtAudioFormat{0};
+
+  switch (sf_format & SF_FORMAT_SUBMASK) {
+    case SF_FORMAT_PCM_16:
+      format = RTAUDIO_SINT16;
+      accepted = RTAUDIO_SINT16;
+      break;
+    case SF_FORMAT_PCM_24:
+      // int32 carries 24-bit samples left justified on both sides. A
+      // device that only speaks packed 24-bit gets that, rather than
+      // having RtAudio convert every buffer
+      format = (native_formats & RTAUDIO_SINT32) ? RTAUDIO_SINT32
+                                                  : RTAUDIO_SINT24;
+      accepted = RTAUDIO_SINT24 | RTAUDIO_SINT32;
+      break;
+    case SF_FORMAT_PCM_32:
+      format = RTAUDIO_SINT32;
+      accepted = RTAUDIO_SINT32;
+      break;
+    case SF_FORMAT_DOUBLE:
+      format = RTAUDIO_FLOAT64;
+      accepted = RTAUDIO_FLOAT64;
+      break;
+    default:
+      break;
+  }
+
+  return (native_formats & accepted) ? format : RtAudioFormat{RTAUDIO_FLOAT32};
+}
+
+int sf_subformat_of(RtAudioFormat format) {
+  switch (format) {
+    case RTAUDIO_SINT16:
+      return SF_FORMAT_PCM_16;
+    case RTAUDIO_SINT24:
+      return SF_FORMAT_PCM_24;
+    case RTAUDIO_SINT32:
+      return SF_FORMAT_PCM_32;
+    case RTAUDIO_FLOAT64:
+      return SF_FORMAT_DOUBLE;
+    case RTAUDIO_FLOAT32:
+    default:
+      return SF_FORMAT_FLOAT;
+  }
+}
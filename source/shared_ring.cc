@@ -0,0 +1,477 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <stdexcept>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include "sample_format.hh"
+#include "shared_ring.hh"
+
+#if defined(__linux__)
+
+namespace {
+
+std::string shm_name(std::string const &name) { return "/rtutil-" + name; }
+
+std::size_t page_size() {
+  return static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+}
+
+std::size_t round_up(std::size_t size, std::size_t alignment) {
+  return ((size + alignment - 1) / alignment) * alignment;
+}
+
+std::size_t format_bytes(RtAudioFormat format) {
+  switch (format) {
+    case RTAUDIO_SINT16:
+      return 2;
+    case RTAUDIO_SINT32:
+    case RTAUDIO_FLOAT32:
+      return 4;
+    case RTAUDIO_FLOAT64:
+      return 8;
+    default:
+      return 0;
+  }
+}
+
+bool process_alive(std::int32_t pid) {
+  return (pid > 0) && ((kill(pid, 0) == 0) || (errno == EPERM));
+}
+
+// Shared, not FUTEX_PRIVATE_FLAG, the waiter is in another process
+void futex_wake(std::atomic<std::uint32_t> *word) {
+  syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(word), FUTEX_WAKE,
+          INT_MAX, nullptr, nullptr, 0);
+}
+
+void futex_wait(std::atomic<std::uint32_t> *word, std::uint32_t expected,
+                int timeout_ms) {
+  timespec timeout{.tv_sec = timeout_ms / 1000,
+                   .tv_nsec = (timeout_ms % 1000) * 1000000L};
+  syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(word), FUTEX_WAIT,
+          expected, &timeout, nullptr, 0);
+}
+
+/**
+ * @brief Map part of a file twice back to back, as RingStorage does
+ * @return Start of the first mapping, nullptr on failure
+ */
+void *map_mirrored(int fd, std::size_t offset, std::size_t bytes,
+                   int protection) {
+  auto *base = static_cast<std::byte *>(mmap(
+      nullptr, 2 * bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+
+  if (base == MAP_FAILED) {
+    return nullptr;
+  }
+
+  auto file_offset = static_cast<off_t>(offset);
+  auto *lo = mmap(base, bytes, protection, MAP_SHARED | MAP_FIXED, fd,
+                  file_offset);
+  auto *hi = mmap(base + bytes, bytes, protection, MAP_SHARED | MAP_FIXED,
+                  fd, file_offset);
+
+  if ((lo == MAP_FAILED) || (hi == MAP_FAILED)) {
+    munmap(base, 2 * bytes);
+    return nullptr;
+  }
+
+  return base;
+}
+
+/**
+ * @brief Check whether a ring is left over from a writer that is gone
+ */
+bool is_stale(std::string const &shm) {
+  int fd = shm_open(shm.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    return true;
+  }
+
+  struct stat info {};
+  bool stale = true;
+
+  if ((fstat(fd, &info) == 0) &&
+      (static_cast<std::size_t>(info.st_size) >= sizeof(SharedRingHeader))) {
+    auto *map = mmap(nullptr, sizeof(SharedRingHeader), PROT_READ,
+                     MAP_SHARED, fd, 0);
+
+    if (map != MAP_FAILED) {
+      auto const *header = static_cast<SharedRingHeader const *>(map);
+      stale = (header->closed.load(std::memory_order_acquire) != 0U) ||
+              !process_alive(header->writer_pid);
+      munmap(map, sizeof(SharedRingHeader));
+    }
+  }
+
+  close(fd);
+  return stale;
+}
+
+}  // namespace
+
+SharedRingWriter::SharedRingWriter(std::string const &name,
+                                   RtAudioFormat format, int channels,
+                                   int sample_rate, std::size_t frames)
+    : name_(name) {
+  auto sample_bytes = format_bytes(format);
+  auto page = page_size();
+
+  if ((sample_bytes == 0) || (channels < 1)) {
+    throw std::runtime_error("Can not publish this stream format");
+  }
+
+  // A power of two of at least a page of frames is a whole number of
+  // pages, as the mirror mapping needs
+  auto capacity = next_pow2(std::max(frames, page));
+  frame_bytes_ = sample_bytes * static_cast<std::size_t>(channels);
+  header_bytes_ = round_up(sizeof(SharedRingHeader), page);
+  data_bytes_ = capacity * frame_bytes_;
+  mask_ = capacity - 1U;
+
+  auto shm = shm_name(name);
+  int fd = shm_open(shm.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+
+  if ((fd < 0) && (errno == EEXIST) && is_stale(shm)) {
+    shm_unlink(shm.c_str());
+    fd = shm_open(shm.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  }
+
+  if (fd < 0) {
+    throw std::runtime_error(
+        (errno == EEXIST)
+            ? "Shared ring \"" + name + "\" is already being published"
+            : "Error creating shared ring \"" + name +
+                  "\": " + std::strerror(errno));
+  }
+
+  auto fail = [&](char const *what) {
+    auto error = std::string(std::strerror(errno));
+    if (data_ != nullptr) {
+      munmap(data_, 2 * data_bytes_);
+    }
+    if (header_ != nullptr) {
+      munmap(header_, header_bytes_);
+    }
+    close(fd);
+    shm_unlink(shm.c_str());
+    return std::runtime_error("Error setting up shared ring \"" + name +
+                              "\": " + what + ": " + error);
+  };
+
+  if (ftruncate(fd, static_cast<off_t>(header_bytes_ + data_bytes_)) != 0) {
+    throw fail("ftruncate");
+  }
+
+  auto *map = mmap(nullptr, header_bytes_, PROT_READ | PROT_WRITE,
+                   MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    throw fail("mmap");
+  }
+
+  header_ = new (map) SharedRingHeader{};
+  data_ = static_cast<unsigned char *>(
+      map_mirrored(fd, header_bytes_, data_bytes_, PROT_READ | PROT_WRITE));
+
+  if (data_ == nullptr) {
+    throw fail("mmap");
+  }
+
+  close(fd);
+
+  header_->version = SharedRingHeader::VERSION;
+  header_->format = static_cast<std::uint32_t>(format);
+  header_->sample_bytes = static_cast<std::uint32_t>(sample_bytes);
+  header_->channels = static_cast<std::uint32_t>(channels);
+  header_->sample_rate = static_cast<std::uint32_t>(sample_rate);
+  header_->writer_pid = static_cast<std::int32_t>(getpid());
+  header_->capacity_frames = capacity;
+  header_->data_offset = header_bytes_;
+
+  // Readers only trust the header once the magic is there
+  std::atomic_thread_fence(std::memory_order_release);
+  header_->magic = SharedRingHeader::MAGIC;
+}
+
+SharedRingWriter::~SharedRingWriter() {
+  header_->closed.store(1U, std::memory_order_seq_cst);
+  header_->sequence.fetch_add(1U, std::memory_order_seq_cst);
+  futex_wake(&header_->sequence);
+
+  // Attached readers keep their mappings, only the name goes
+  shm_unlink(shm_name(name_).c_str());
+  munmap(data_, 2 * data_bytes_);
+  munmap(header_, header_bytes_);
+}
+
+void SharedRingWriter::set_period(unsigned int frames) {
+  header_->period_frames = frames;
+}
+
+void SharedRingWriter::prefault() {
+  auto *bytes = static_cast<volatile unsigned char *>(data_);
+
+  for (std::size_t i = 0; i < 2 * data_bytes_; i += page_size()) {
+    bytes[i] = bytes[i];
+  }
+}
+
+void SharedRingWriter::write(void const *frames, std::size_t count) noexcept {
+  auto capacity = mask_ + 1U;
+  auto const *src = static_cast<unsigned char const *>(frames);
+
+  // Only the newest frames fit
+  if (count > capacity) {
+    src += (count - capacity) * frame_bytes_;
+    header_->write_head.fetch_add(count - capacity,
+                                  std::memory_order_relaxed);
+    count = capacity;
+  }
+
+  auto head = header_->write_head.load(std::memory_order_relaxed);
+
+  // Claim the frames about to be overwritten before touching them
+  header_->write_claim.store(head + count, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  std::memcpy(data_ + (head & mask_) * frame_bytes_, src,
+              count * frame_bytes_);
+  header_->write_head.store(head + count, std::memory_order_release);
+
+  // Wake readers only when one is asleep
+  header_->sequence.fetch_add(1U, std::memory_order_seq_cst);
+  if (header_->waiters.load(std::memory_order_seq_cst) > 0U) {
+    futex_wake(&header_->sequence);
+  }
+}
+
+std::size_t SharedRingWriter::readers() const {
+  std::size_t count = 0;
+
+  for (auto const &cursor : header_->readers) {
+    if (process_alive(cursor.pid.load(std::memory_order_relaxed))) {
+      ++count;
+    }
+  }
+
+  return count;
+}
+
+void SharedRingWriter::print_summary() const {
+  auto head = header_->write_head.load(std::memory_order_relaxed);
+  std::size_t count = 0;
+  std::uint64_t slowest = 0;
+
+  for (auto const &cursor : header_->readers) {
+    if (process_alive(cursor.pid.load(std::memory_order_relaxed))) {
+      auto lag = head - cursor.read_head.load(std::memory_order_relaxed);
+      slowest = std::max(slowest, lag);
+      ++count;
+    }
+  }
+
+  std::cout << "Shared ring \"" << name_ << "\": published " << head
+            << " frame(s), " << count << " reader(s) attached";
+
+  if (count > 0) {
+    std::cout << ", slowest " << slowest << " frame(s) behind";
+  }
+
+  std::cout << std::endl;
+}
+
+SharedRingReader::SharedRingReader(std::string const &name) : name_(name) {
+  auto shm = shm_name(name);
+  int fd = shm_open(shm.c_str(), O_RDWR, 0);
+
+  if (fd < 0) {
+    throw std::runtime_error("No shared ring \"" + name +
+                             "\": " + std::strerror(errno));
+  }
+
+  auto page = page_size();
+  struct stat info {};
+  auto size = (fstat(fd, &info) == 0) ? static_cast<std::size_t>(info.st_size)
+                                      : 0U;
+  header_bytes_ = round_up(sizeof(SharedRingHeader), page);
+
+  auto *map = (size >= header_bytes_)
+                  ? mmap(nullptr, header_bytes_, PROT_READ | PROT_WRITE,
+                         MAP_SHARED, fd, 0)
+                  : MAP_FAILED;
+
+  if (map == MAP_FAILED) {
+    close(fd);
+    throw std::runtime_error("Shared ring \"" + name + "\" is not set up");
+  }
+
+  header_ = static_cast<SharedRingHeader *>(map);
+  std::atomic_thread_fence(std::memory_order_acquire);
+
+  auto capacity = header_->capacity_frames;
+  auto frame_bytes =
+      std::size_t(header_->sample_bytes) * std::size_t(header_->channels);
+  data_bytes_ = capacity * frame_bytes;
+
+  if ((header_->magic != SharedRingHeader::MAGIC) ||
+      (header_->version != SharedRingHeader::VERSION) ||
+      (header_->data_offset != header_bytes_) || !is_pow2(capacity) ||
+      (format_bytes(header_->format) != header_->sample_bytes) ||
+      (size != header_bytes_ + data_bytes_)) {
+    munmap(map, header_bytes_);
+    close(fd);
+    throw std::runtime_error("Shared ring \"" + name +
+                             "\" is not set up or not compatible");
+  }
+
+  data_ = static_cast<unsigned char const *>(
+      map_mirrored(fd, header_bytes_, data_bytes_, PROT_READ));
+  close(fd);
+
+  if (data_ == nullptr) {
+    munmap(map, header_bytes_);
+    throw std::runtime_error("Error mapping shared ring \"" + name + "\"");
+  }
+
+  mask_ = capacity - 1U;
+
+  // Take a free cursor, or one left behind by a reader that is gone
+  auto pid = static_cast<std::int32_t>(getpid());
+
+  for (int pass = 0; (pass < 2) && (cursor_slot_ == nullptr); ++pass) {
+    for (auto &cursor : header_->readers) {
+      auto owner = cursor.pid.load(std::memory_order_relaxed);
+      bool free = (pass == 0) ? (owner == 0) : !process_alive(owner);
+
+      if (free && cursor.pid.compare_exchange_strong(owner, pid)) {
+        cursor_slot_ = &cursor;
+        break;
+      }
+    }
+  }
+
+  if (cursor_slot_ == nullptr) {
+    munmap(const_cast<unsigned char *>(data_), 2 * data_bytes_);
+    munmap(map, header_bytes_);
+    throw std::runtime_error("Every reader of shared ring \"" + name +
+                             "\" is taken");
+  }
+
+  cursor_ = header_->write_head.load(std::memory_order_acquire);
+  cursor_slot_->overruns.store(0U, std::memory_order_relaxed);
+  cursor_slot_->read_head.store(cursor_, std::memory_order_release);
+}
+
+SharedRingReader::~SharedRingReader() {
+  cursor_slot_->pid.store(0, std::memory_order_release);
+  munmap(const_cast<unsigned char *>(data_), 2 * data_bytes_);
+  munmap(header_, header_bytes_);
+}
+
+std::size_t SharedRingReader::available() const noexcept {
+  return header_->write_head.load(std::memory_order_acquire) - cursor_;
+}
+
+bool SharedRingReader::consume(std::size_t frames) noexcept {
+  // Pairs with the fence in SharedRingWriter::write()
+  std::atomic_thread_fence(std::memory_order_acquire);
+  auto claim = header_->write_claim.load(std::memory_order_relaxed);
+  bool intact = (claim - cursor_) <= capacity();
+
+  if (!intact) {
+    auto overruns = cursor_slot_->overruns.load(std::memory_order_relaxed);
+    cursor_slot_->overruns.store(overruns + 1U, std::memory_order_relaxed);
+  }
+
+  cursor_ += frames;
+  cursor_slot_->read_head.store(cursor_, std::memory_order_release);
+  return intact;
+}
+
+void SharedRingReader::skip_to(std::size_t lag) noexcept {
+  auto head = header_->write_head.load(std::memory_order_acquire);
+  auto distance = std::min<std::uint64_t>({lag, head, capacity()});
+  cursor_ = head - distance;
+  cursor_slot_->read_head.store(cursor_, std::memory_order_release);
+}
+
+bool SharedRingReader::wait(std::size_t frames, int timeout_ms) {
+  auto ready = [&]() { return (available() >= frames) || closed(); };
+  auto sequence = header_->sequence.load(std::memory_order_seq_cst);
+
+  if (ready()) {
+    return available() >= frames;
+  }
+
+  // Count in waiters before the final check, so that the writer either
+  // sees it or has already bumped the sequence
+  header_->waiters.fetch_add(1U, std::memory_order_seq_cst);
+
+  if (!ready()) {
+    futex_wait(&header_->sequence, sequence, timeout_ms);
+  }
+
+  header_->waiters.fetch_sub(1U, std::memory_order_seq_cst);
+  return available() >= frames;
+}
+
+#else
+
+SharedRingWriter::SharedRingWriter(std::string const &name,
+                                   RtAudioFormat /* format */,
+                                   int /* channels */, int /* sample_rate */,
+                                   std::size_t /* frames */)
+    : name_(name) {
+  throw std::runtime_error("Shared rings are not supported on this platform");
+}
+
+SharedRingWriter::~SharedRingWriter() = default;
+void SharedRingWriter::set_period(unsigned int) {}
+void SharedRingWriter::prefault() {}
+void SharedRingWriter::write(void const *, std::size_t) noexcept {}
+std::size_t SharedRingWriter::readers() const { return 0; }
+void SharedRingWriter::print_summary() const {}
+
+SharedRingReader::SharedRingReader(std::string const &name) : name_(name) {
+  throw std::runtime_error("Shared rings are not supported on this platform");
+}
+
+SharedRingReader::~SharedRingReader() = default;
+std::size_t SharedRingReader::available() const noexcept { return 0; }
+bool SharedRingReader::consume(std::size_t) noexcept { return false; }
+void SharedRingReader::skip_to(std::size_t) noexcept {}
+bool SharedRingReader::wait(std::size_t, int) { return false; }
+
+#endif
@@ -0,0 +1,286 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/**
+ * Play what another process publishes to a shared ring
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "RtAudio.h"
+#include "audio_device.hh"
+#include "audio_stream.hh"
+#include "realtime.hh"
+#include "sample_format.hh"
+#include "shared_ring.hh"
+#include "stop_signal.hh"
+#include "stream_config.hh"
+#include "stream_stats.hh"
+
+/**
+ * @brief Play frames straight out of a shared ring
+ *
+ * There is no file IO thread and no queue of its own: the audio callback
+ * copies from the ring, holding itself a target distance behind the
+ * writer. It falls back to that distance when it drifts far behind or
+ * is lapped, and waits for it again after running dry.
+ */
+template <typename SampleType>
+class SharedRingPlayback {
+ public:
+  /**
+   * @brief Construct a new player of a ring
+   * @param ring Attached ring, in SampleType's format
+   * @param config Stream configuration
+   */
+  SharedRingPlayback(SharedRingReader &ring, StreamConfig const &config)
+      : ring_(ring),
+        channels_(static_cast<std::size_t>(ring.channels())),
+        writer_period_(config.frames),
+        callback_pin_(config.callback_cpu) {
+    set_frame_size(config.frames);
+  }
+
+  /**
+   * @brief Set the lag to hold from the frames per callback the device
+   *  settled on, before the stream is started
+   * @param frame_size Frames per callback
+   */
+  void set_frame_size(unsigned int frame_size) {
+    // The writer's period is only known once its stream is open
+    auto period = ring_.period_frames();
+    if (period == 0U) {
+      period = writer_period_;
+    }
+
+    target_ = std::min(period + 2U * std::size_t{frame_size},
+                       ring_.capacity() / 4U);
+    resync_frames_ = 4U * target_;
+  }
+
+  /**
+   * @brief Wait for the writer to get a target's worth of frames ahead,
+   *  so that the stream starts without a gap
+   */
+  void prefill() {
+    while (!ring_.wait(target_, 100) && !stop_requested() &&
+           !ring_.closed()) {
+    }
+  }
+
+  /**
+   * @brief Show the status line until stopped, or the writer stops and
+   *  the ring is played out
+   */
+  void start() {
+    std::size_t animation_counter = 0U;
+    auto rate = static_cast<std::size_t>(ring_.sample_rate());
+
+    while (!stop_requested() && !drained_.load(std::memory_order_relaxed)) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      ++animation_counter;
+
+      std::cout << "[ " << ("\\|/-"[animation_counter % 4])
+                << " Attached, lag "
+                << lag_.load(std::memory_order_relaxed) * 1000U / rate
+                << " ms, resyncs " << resyncs_.load(std::memory_order_relaxed)
+                << ", " << stats_status_str(stats_.snapshot()) << " ]\r"
+                << std::flush;
+    }
+  }
+
+  void report_callback_thread() const { callback_pin_.report("Callback"); }
+
+  /**
+   * @brief Print resyncs, overruns and xrun counters
+   */
+  void print_summary() const {
+    std::cout << "Shared ring: " << target_ << " frame(s) target lag, "
+              << resyncs_.load(std::memory_order_relaxed)
+              << " resync(s), lapped " << ring_.overruns() << " time(s)"
+              << std::endl;
+    print_stats_summary(stats_.snapshot(), ring_.sample_rate());
+  }
+
+  static int audio_callback(void *output_buffer, void * /*input_buffer*/,
+                            unsigned int n_frame, double /* stream_time */,
+                            RtAudioStreamStatus status, void *user_data) {
+    auto *output = static_cast<SampleType *>(output_buffer);
+    auto *proc = static_cast<SharedRingPlayback *>(user_data);
+    proc->callback_pin_.apply();
+    proc->read_frames(output, n_frame, status);
+    return 0;
+  }
+
+ private:
+  void resync() noexcept {
+    ring_.skip_to(target_);
+    resyncs_.store(resyncs_.load(std::memory_order_relaxed) + 1U,
+                   std::memory_order_relaxed);
+  }
+
+  void read_frames(SampleType *output, std::size_t frames,
+                   RtAudioStreamStatus status) {
+    auto out = std::span(output, frames * channels_);
+    stats_.on_device_status(status);
+
+    // Far behind, or lapped: drop back to the target lag
+    if (ring_.available() > resync_frames_) {
+      resync();
+    }
+
+    // After running dry, play silence until there is a target's worth
+    // again instead of playing every period as it trickles in
+    if (priming_ && (ring_.available() < target_) && !ring_.closed()) {
+      std::fill(std::begin(out), std::end(out), SampleType{});
+      lag_.store(ring_.available(), std::memory_order_relaxed);
+      return;
+    }
+
+    priming_ = false;
+
+    auto in = ring_.template peek<SampleType>(frames);
+    std::copy(std::begin(in), std::end(in), std::begin(out));
+    auto frames_read = in.size() / channels_;
+
+    // Frames overwritten while they were copied are not played
+    if (!ring_.consume(frames_read)) {
+      std::fill(std::begin(out), std::end(out), SampleType{});
+      stats_.on_ring_underrun(out.size(), frames);
+      resync();
+      lag_.store(ring_.available(), std::memory_order_relaxed);
+      return;
+    }
+
+    auto missing = out.subspan(in.size());
+    std::fill(std::begin(missing), std::end(missing), SampleType{});
+
+    if (ring_.closed() && (frames_read < frames)) {
+      drained_.store(true, std::memory_order_relaxed);
+    } else if (frames_read < frames) {
+      stats_.on_ring_underrun(missing.size(), frames - frames_read);
+      priming_ = true;
+    } else {
+      stats_.on_ring_ok();
+    }
+
+    lag_.store(ring_.available(), std::memory_order_relaxed);
+  }
+
+  SharedRingReader &ring_;
+  std::size_t channels_{};
+  std::size_t writer_period_{};
+  std::size_t target_{};
+  std::size_t resync_frames_{};
+  bool priming_{true};  // Only touched by the callback
+  CallbackThreadPin callback_pin_{};
+  StreamStats stats_{};
+  std::atomic<std::size_t> lag_{0};
+  std::atomic<std::uint64_t> resyncs_{0};
+  std::atomic<bool> drained_{false};
+};
+
+void attach_shared_ring(int api_id, int device_id, int start_channel,
+                        const std::string &name, const StreamConfig &config) {
+  std::unique_ptr<SharedRingReader> ring{};
+
+  try {
+    ring = std::make_unique<SharedRingReader>(name);
+  } catch (std::exception const &e) {
+    std::cerr << e.what() << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+
+  if (config.device_rate > 0) {
+    std::cerr << "--device-rate is ignored, a ring plays at its own rate"
+              << std::endl;
+  }
+
+  auto stream = make_audio_stream(api_id, config);
+
+  // Use default device if device_id is less than zero
+  auto rt_device = ([&]() {
+    if (device_id < 0) {
+      return stream->default_output_device();
+    } else {
+      return static_cast<unsigned int>(device_id);
+    }
+  })();
+
+  // The device plays the ring's own format and rate, without conversion
+  RtAudio::StreamParameters out_parameters{
+      .deviceId = rt_device,
+      .nChannels = static_cast<unsigned int>(ring->channels()),
+      .firstChannel = static_cast<unsigned int>(start_channel),
+  };
+  auto stream_format = ring->format();
+  auto sample_rate = static_cast<unsigned int>(ring->sample_rate());
+  unsigned int frame_size = config.frames;
+  auto stream_options = make_stream_options(config);
+
+  visit_sample_type(stream_format, [&](auto sample_type) {
+    using Process = SharedRingPlayback<typename decltype(sample_type)::type>;
+    auto process = std::make_unique<Process>(*ring, config);
+    auto &playback = *process;
+
+    try {
+      stream->open(&out_parameters, nullptr, stream_format, sample_rate,
+                   &frame_size, &playback.audio_callback,
+                   static_cast<void *>(&playback), &stream_options);
+    } catch (std::exception const &e) {
+      std::cerr << "Error opening audio stream: " << e.what() << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+
+    playback.set_frame_size(frame_size);
+
+    std::cout << "Attach to shared ring: " << name << std::endl
+              << "Start channel: " << start_channel << std::endl
+              << "API: " << stream->api_name() << std::endl
+              << "sample_rate: " << sample_rate << std::endl
+              << "stream_format: " << rt_sample_formats_str(stream_format)
+              << std::endl
+              << "frame_size: " << frame_size << std::endl
+              << "periods: " << stream_options.numberOfBuffers << std::endl
+              << "ring_frames: " << ring->capacity() << std::endl
+              << "num_channels: " << ring->channels() << std::endl;
+
+    install_stop_handler();
+
+    std::cout << "Waiting for the writer...\n";
+    playback.prefill();
+
+    std::cout << "Starting stream, press Ctrl-C to stop...\n";
+    stream->start();
+    playback.report_callback_thread();
+    playback.start();
+
+    std::cout << "\nClosing stream...\n";
+    stream->close();
+    playback.print_summary();
+  });
+}
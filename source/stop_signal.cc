@@ -0,0 +1,45 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <atomic>
+#include <csignal>
+
+#include "stop_signal.hh"
+
+static std::atomic<bool> stop_flag{false};
+static_assert(std::atomic<bool>::is_always_lock_free);
+
+extern "C" void stop_signal_handler(int sig) {
+  // Let a second signal kill the process if the clean stop hangs
+  std::signal(sig, SIG_DFL);
+  stop_flag.store(true, std::memory_order_relaxed);
+}
+
+void install_stop_handler() {
+  std::signal(SIGINT, stop_signal_handler);
+  std::signal(SIGTERM, stop_signal_handler);
+}
+
+void request_stop() noexcept {
+  stop_flag.store(true, std::memory_order_relaxed);
+}
+
+bool stop_requested() noexcept {
+  return stop_flag.load(std::memory_order_relaxed);
+}
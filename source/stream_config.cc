@@ -0,0 +1,85 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <algorithm>
+
+#include "stream_config.hh"
+
+// The ring always holds at least this many periods, whatever queue_ms says
+static constexpr std::size_t MIN_QUEUE_PERIODS = 16U;
+
+std::optional<LatencyProfile> parse_latency_profile(std::string_view name) {
+  if (name == "low") {
+    return LatencyProfile::LOW;
+  } else if (name == "balanced") {
+    return LatencyProfile::BALANCED;
+  } else if (name == "safe") {
+    return LatencyProfile::SAFE;
+  } else {
+    return std::nullopt;
+  }
+}
+
+StreamConfig make_stream_config(LatencyProfile profile) {
+  switch (profile) {
+    case LatencyProfile::LOW:
+      return {.frames = 128,
+              .periods = 2,
+              .queue_ms = 100,
+              .minimize_latency = true};
+    case LatencyProfile::SAFE:
+      return {.frames = 2048,
+              .periods = 8,
+              .queue_ms = 5000,
+              .minimize_latency = false};
+    case LatencyProfile::BALANCED:
+    default:
+      return {.frames = 512,
+              .periods = 4,
+              .queue_ms = 1000,
+              .minimize_latency = false};
+  }
+}
+
+RtAudio::StreamOptions make_stream_options(StreamConfig const &config) {
+  RtAudio::StreamOptions options{};
+  options.numberOfBuffers = config.periods;
+  options.streamName = "rtutil";
+
+  if (config.minimize_latency) {
+    options.flags |= RTAUDIO_MINIMIZE_LATENCY;
+  }
+
+  if (config.realtime) {
+    options.flags |= RTAUDIO_SCHEDULE_REALTIME;
+    options.priority = config.rt_priority;
+  }
+
+  return options;
+}
+
+std::size_t queue_frames(StreamConfig const &config, int sample_rate) {
+  auto queue_ms = static_cast<std::size_t>(config.queue_ms);
+  auto rate = static_cast<std::size_t>(sample_rate);
+  return std::max((queue_ms * rate) / 1000U, min_queue_frames(config.frames));
+}
+
+std::size_t min_queue_frames(unsigned int frame_size) {
+  return MIN_QUEUE_PERIODS * frame_size;
+}
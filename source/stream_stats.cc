@@ -0,0 +1,46 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <iomanip>
+#include <iostream>
+
+#include "stream_stats.hh"
+
+std::string stats_status_str(StreamStats::Snapshot const &stats) {
+  auto device = stats.device_underflows + stats.device_overflows;
+  auto ring = stats.ring_underruns + stats.ring_overruns;
+  return "xruns " + std::to_string(stats.xruns()) + " (dev " +
+         std::to_string(device) + ", ring " + std::to_string(ring) + ")";
+}
+
+void print_stats_summary(StreamStats::Snapshot const &stats, int sample_rate) {
+  auto gap_ms = (1000.0 * static_cast<double>(stats.worst_gap_frames)) /
+                static_cast<double>(sample_rate);
+
+  std::cout << "Device underflows: " << stats.device_underflows << std::endl
+            << "Device overflows: " << stats.device_overflows << std::endl
+            << "Ring underruns: " << stats.ring_underruns << std::endl
+            << "Ring overruns: " << stats.ring_overruns << std::endl
+            << "Samples zero-filled: " << stats.samples_zero_filled
+            << std::endl
+            << "Samples dropped: " << stats.samples_dropped << std::endl
+            << "Worst gap: " << stats.worst_gap_frames << " frame(s), "
+            << std::fixed << std::setprecision(2) << gap_ms << " ms"
+            << std::endl;
+}
@@ -0,0 +1,58 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <charconv>
+
+#include "sync_policy.hh"
+
+/**
+ * @brief Parse the number after a "name:" prefix
+ * @return true if spec starts with prefix and the rest is a number
+ */
+template <typename Number>
+static bool parse_suffix(std::string_view spec, std::string_view prefix,
+                         Number &value) {
+  if (!spec.starts_with(prefix)) {
+    return false;
+  }
+
+  auto digits = spec.substr(prefix.size());
+  auto const *end = digits.data() + digits.size();
+  auto [ptr, ec] = std::from_chars(digits.data(), end, value);
+  return !digits.empty() && (ec == std::errc{}) && (ptr == end);
+}
+
+std::optional<SyncPolicy> parse_sync_policy(std::string_view spec) {
+  SyncPolicy policy{};
+
+  if (spec == "none") {
+    policy.mode = SyncPolicy::Mode::NONE;
+  } else if (spec == "close") {
+    policy.mode = SyncPolicy::Mode::CLOSE;
+  } else if (parse_suffix(spec, "interval:", policy.interval_ms)) {
+    policy.mode = SyncPolicy::Mode::INTERVAL;
+  } else if (parse_suffix(spec, "bytes:", policy.bytes) &&
+             (policy.bytes > 0)) {
+    policy.mode = SyncPolicy::Mode::BYTES;
+  } else {
+    return std::nullopt;
+  }
+
+  return policy;
+}
@@ -0,0 +1,164 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "track_reader.hh"
+
+TrackReader::TrackReader(std::string const &filename, int channels,
+                         int sample_rate, ResampleQuality quality)
+    : filename_(filename),
+      file_(filename, SFM_READ),
+      channels_(static_cast<std::size_t>(channels)) {
+  if ((file_.error() != 0) || (file_.channels() <= 0) ||
+      (file_.samplerate() <= 0)) {
+    throw std::runtime_error("Error opening file \"" + filename +
+                             "\" for reading");
+  }
+
+  auto file_channels = static_cast<std::size_t>(file_.channels());
+  auto file_rate = file_.samplerate();
+  auto ratio = static_cast<double>(sample_rate) / file_rate;
+
+  stream_frames_ = static_cast<std::size_t>(
+      std::llround(static_cast<double>(file_.frames()) * ratio));
+
+  if (file_channels != channels_) {
+    decode_.resize(BLOCK_FRAMES * file_channels);
+  }
+
+  if (file_rate != sample_rate) {
+    resampler_ = std::make_unique<Resampler>(quality, channels, ratio);
+    resample_in_.resize(BLOCK_FRAMES * channels_);
+  }
+
+  // Have the start of the track ready before it is needed
+  primed_.resize(BLOCK_FRAMES * channels_);
+  primed_frames_ = resampler_ ? read_resampled(primed_) : read_mapped(primed_);
+}
+
+std::size_t TrackReader::read(std::span<float> out) {
+  auto channels = channels_;
+  auto wanted = out.size() / channels;
+  std::size_t frames = 0;
+
+  if (primed_frames_ > 0) {
+    frames = std::min(wanted, primed_frames_);
+    auto primed = std::span<float const>(primed_).subspan(
+        primed_offset_ * channels, frames * channels);
+    std::copy(primed.begin(), primed.end(), out.begin());
+    primed_offset_ += frames;
+    primed_frames_ -= frames;
+  }
+
+  if (frames < wanted) {
+    auto rest = out.subspan(frames * channels, (wanted - frames) * channels);
+    frames += resampler_ ? read_resampled(rest) : read_mapped(rest);
+  }
+
+  return frames;
+}
+
+std::size_t TrackReader::read_mapped(std::span<float> out) {
+  auto channels = channels_;
+  auto file_channels = static_cast<std::size_t>(file_.channels());
+  auto wanted = out.size() / channels;
+  std::size_t frames = 0;
+
+  while ((frames < wanted) && !file_eof_) {
+    auto chunk = std::min(wanted - frames, BLOCK_FRAMES);
+    auto *dst = out.data() + frames * channels;
+    std::size_t got = 0;
+
+    if (decode_.empty()) {
+      got = static_cast<std::size_t>(
+          file_.readf(dst, static_cast<sf_count_t>(chunk)));
+    } else {
+      got = static_cast<std::size_t>(
+          file_.readf(decode_.data(), static_cast<sf_count_t>(chunk)));
+      auto const *src = decode_.data();
+
+      for (std::size_t i = 0; i < got; ++i) {
+        auto const *in = src + i * file_channels;
+        auto *frame = dst + i * channels;
+
+        if (file_channels == 1U) {
+          std::fill_n(frame, channels, in[0]);
+        } else if (channels == 1U) {
+          float sum = 0.0F;
+          for (std::size_t c = 0; c < file_channels; ++c) {
+            sum += in[c];
+          }
+          frame[0] = sum / static_cast<float>(file_channels);
+        } else {
+          for (std::size_t c = 0; c < channels; ++c) {
+            frame[c] = (c < file_channels) ? in[c] : 0.0F;
+          }
+        }
+      }
+    }
+
+    frames += got;
+    file_eof_ = (got < chunk);
+  }
+
+  if (!resampler_) {
+    done_ = file_eof_;
+  }
+
+  return frames;
+}
+
+std::size_t TrackReader::read_resampled(std::span<float> out) {
+  auto channels = channels_;
+  auto wanted = out.size() / channels;
+  std::size_t frames = 0;
+
+  while ((frames < wanted) && !done_) {
+    // Top up the converter input from the file
+    if (!file_eof_ && (resample_in_frames_ < BLOCK_FRAMES)) {
+      auto space = std::span(resample_in_).subspan(
+          resample_in_frames_ * channels,
+          (BLOCK_FRAMES - resample_in_frames_) * channels);
+      resample_in_frames_ += read_mapped(space);
+    }
+
+    auto input = std::span<float const>(resample_in_.data(),
+                                        resample_in_frames_ * channels);
+    auto result = resampler_->process(input, out.subspan(frames * channels),
+                                      file_eof_);
+
+    // Keep unconsumed input at the front of the block
+    auto used = result.frames_used * channels;
+    std::copy(input.begin() + static_cast<std::ptrdiff_t>(used), input.end(),
+              resample_in_.begin());
+    resample_in_frames_ -= result.frames_used;
+    frames += result.frames_generated;
+
+    // The converter is flushed once it stops producing at end of file
+    if (file_eof_ && (resample_in_frames_ == 0) &&
+        (result.frames_generated == 0)) {
+      done_ = true;
+    }
+  }
+
+  return frames;
+}
@@ -0,0 +1,398 @@
+/**
+ * This file is part of rtutils distribution
+ *
+ * Copyright (C) 2022 Ayan Shafqat <ayan.x.shafqat@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <numbers>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#include "realtime.hh"
+#include "sample_convert.hh"
+#include "sample_format.hh"
+#include "virtual_device.hh"
+
+namespace {
+
+constexpr float NOISE_LEVEL = 0.25F;
+constexpr double SINE_LEVEL = 0.5;
+constexpr std::size_t DEFAULT_PERIODS = 2U;
+constexpr unsigned int DEFAULT_FRAMES = 512U;
+constexpr unsigned int PREFERRED_RATE = 48000U;
+
+std::size_t sample_size_of(RtAudioFormat format) {
+  switch (format) {
+    case RTAUDIO_SINT16:
+      return sizeof(short);
+    case RTAUDIO_SINT32:
+      return sizeof(int);
+    case RTAUDIO_FLOAT32:
+      return sizeof(float);
+    case RTAUDIO_FLOAT64:
+      return sizeof(double);
+    default:
+      return 0U;
+  }
+}
+
+}  // namespace
+
+VirtualAudioStream::VirtualAudioStream(VirtualDeviceConfig config)
+    : config_(std::move(config)) {}
+
+VirtualAudioStream::~VirtualAudioStream() { close(); }
+
+std::string VirtualAudioStream::api_name() { return "virtual"; }
+
+RtAudio::DeviceInfo VirtualAudioStream::device_info(
+    unsigned int /* device */) {
+  RtAudio::DeviceInfo info{};
+  info.probed = true;
+  info.name = "rtutil virtual device";
+  info.outputChannels = MAX_CHANNELS;
+  info.inputChannels = MAX_CHANNELS;
+  info.duplexChannels = MAX_CHANNELS;
+  info.isDefaultOutput = true;
+  info.isDefaultInput = true;
+  info.sampleRates = {8000U,  16000U, 22050U, 44100U,
+                      48000U, 88200U, 96000U, 192000U};
+  info.preferredSampleRate = PREFERRED_RATE;
+  info.nativeFormats =
+      RTAUDIO_SINT16 | RTAUDIO_SINT32 | RTAUDIO_FLOAT32 | RTAUDIO_FLOAT64;
+  return info;
+}
+
+void VirtualAudioStream::open(RtAudio::StreamParameters *output,
+                              RtAudio::StreamParameters *input,
+                              RtAudioFormat format, unsigned int sample_rate,
+                              unsigned int *frames, RtAudioCallback callback,
+                              void *user_data,
+                              RtAudio::StreamOptions *options) {
+  close();
+
+  auto channels_of = [](RtAudio::StreamParameters const *parameters) {
+    if (parameters == nullptr) {
+      return 0U;
+    }
+
+    if (parameters->firstChannel + parameters->nChannels > MAX_CHANNELS) {
+      throw std::runtime_error("The virtual device has " +
+                               std::to_string(MAX_CHANNELS) + " channels");
+    }
+
+    return parameters->nChannels;
+  };
+
+  out_channels_ = channels_of(output);
+  in_channels_ = channels_of(input);
+  sample_size_ = sample_size_of(format);
+
+  if ((out_channels_ + in_channels_) == 0U) {
+    throw std::runtime_error("Virtual stream has no channels");
+  }
+
+  if ((sample_size_ == 0U) || (sample_rate == 0U)) {
+    throw std::runtime_error("Virtual stream format not supported");
+  }
+
+  if (*frames == 0U) {
+    *frames = DEFAULT_FRAMES;
+  }
+
+  callback_ = callback;
+  user_data_ = user_data;
+  format_ = format;
+  frames_ = *frames;
+  sample_rate_ = sample_rate;
+  periods_ = ((options != nullptr) && (options->numberOfBuffers > 0U))
+                 ? options->numberOfBuffers
+                 : DEFAULT_PERIODS;
+  rt_priority_ = ((options != nullptr) &&
+                  ((options->flags & RTAUDIO_SCHEDULE_REALTIME) != 0U))
+                     ? options->priority
+                     : -1;
+
+  // Input signal
+  auto const &source = config_.source;
+  sine_phase_ = 0.0;
+
+  if (source == "silence") {
+    source_ = Source::SILENCE;
+  } else if (source == "noise") {
+    source_ = Source::NOISE;
+  } else if (source == "loopback") {
+    source_ = Source::LOOPBACK;
+  } else if (source.starts_with("sine:")) {
+    auto const *first = source.data() + 5;
+    auto const *last = source.data() + source.size();
+    auto [ptr, ec] = std::from_chars(first, last, sine_hz_);
+
+    if ((ec != std::errc{}) || (ptr != last) || !(sine_hz_ > 0.0) ||
+        (sine_hz_ >= sample_rate / 2.0)) {
+      throw std::runtime_error("Invalid virtual source: " + source);
+    }
+
+    source_ = Source::SINE;
+  } else {
+    source_file_ = SndfileHandle(source, SFM_READ);
+
+    if ((source_file_.error() != 0) || (source_file_.frames() == 0)) {
+      throw std::runtime_error("Error opening virtual source \"" + source +
+                               "\"");
+    }
+
+    source_ = Source::FILE;
+    file_scratch_.resize(frames_ *
+                         static_cast<std::size_t>(source_file_.channels()));
+  }
+
+  // Output sink
+  if (!config_.sink.empty() && (out_channels_ > 0U)) {
+    sink_file_ = SndfileHandle(config_.sink, SFM_WRITE,
+                               SF_FORMAT_WAV | sf_subformat_of(format),
+                               static_cast<int>(out_channels_),
+                               static_cast<int>(sample_rate));
+
+    if (sink_file_.error() != 0) {
+      throw std::runtime_error("Error opening virtual sink \"" +
+                               config_.sink + "\"");
+    }
+  }
+
+  output_.assign(frames_ * out_channels_ * sample_size_, std::byte{});
+  input_.assign(frames_ * in_channels_ * sample_size_, std::byte{});
+  input_float_.assign(frames_ * in_channels_, 0.0F);
+
+  if (source_ == Source::LOOPBACK) {
+    loop_periods_.assign(periods_, output_);
+    loop_index_ = 0U;
+  }
+}
+
+void VirtualAudioStream::start() {
+  if (!thread_.joinable() && (callback_ != nullptr)) {
+    running_.store(true, std::memory_order_relaxed);
+    thread_ = std::thread(&VirtualAudioStream::run, this);
+  }
+}
+
+void VirtualAudioStream::close() {
+  running_.store(false, std::memory_order_relaxed);
+
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+
+  // Closing the sink finishes its header
+  sink_file_ = SndfileHandle{};
+  source_file_ = SndfileHandle{};
+  callback_ = nullptr;
+}
+
+long VirtualAudioStream::latency() {
+  return static_cast<long>(frames_ * periods_);
+}
+
+void VirtualAudioStream::run() {
+  using clock = std::chrono::steady_clock;
+
+  if (rt_priority_ >= 0) {
+    set_thread_realtime(rt_priority_);
+  }
+
+  auto speed = config_.speed;
+  auto period = std::chrono::duration_cast<clock::duration>(
+      std::chrono::duration<double>(
+          (speed > 0.0) ? static_cast<double>(frames_) /
+                              (static_cast<double>(sample_rate_) * speed)
+                        : 0.0));
+  auto lost = static_cast<RtAudioStreamStatus>(
+      ((out_channels_ > 0U) ? RTAUDIO_OUTPUT_UNDERFLOW : 0U) |
+      ((in_channels_ > 0U) ? RTAUDIO_INPUT_OVERFLOW : 0U));
+  auto period_time = static_cast<double>(frames_) / sample_rate_;
+  auto deadline = clock::now();
+  RtAudioStreamStatus status = 0;
+  double stream_time = 0.0;
+
+  while (running_.load(std::memory_order_relaxed)) {
+    make_input();
+    auto result = callback_(output_.data(), input_.data(),
+                            static_cast<unsigned int>(frames_), stream_time,
+                            status, user_data_);
+    write_output();
+    stream_time += period_time;
+    status = 0;
+
+    // Nothing is buffered past the callback, stopping drains nothing
+    if (result != 0) {
+      break;
+    }
+
+    if (speed <= 0.0) {
+      continue;
+    }
+
+    // A device would have lost a period by now
+    deadline += period;
+    auto now = clock::now();
+
+    if (now > deadline + period) {
+      status = lost;
+      deadline = now;
+    } else {
+      std::this_thread::sleep_until(deadline);
+    }
+  }
+}
+
+void VirtualAudioStream::make_input() {
+  auto channels = in_channels_;
+
+  if (channels == 0U) {
+    return;
+  }
+
+  // The oldest period of output comes back, channel for channel
+  if (source_ == Source::LOOPBACK) {
+    auto const &period = loop_periods_[loop_index_];
+    auto size = sample_size_;
+
+    if (out_channels_ == 0U) {
+      std::fill(input_.begin(), input_.end(), std::byte{});
+      return;
+    }
+
+    for (std::size_t i = 0; i < frames_; ++i) {
+      for (std::size_t c = 0; c < channels; ++c) {
+        auto from = (i * out_channels_ + c % out_channels_) * size;
+        std::memcpy(input_.data() + (i * channels + c) * size,
+                    period.data() + from, size);
+      }
+    }
+    return;
+  }
+
+  auto &samples = input_float_;
+
+  switch (source_) {
+    case Source::NOISE:
+      for (auto &sample : samples) {
+        noise_state_ ^= noise_state_ << 13U;
+        noise_state_ ^= noise_state_ >> 17U;
+        noise_state_ ^= noise_state_ << 5U;
+        auto uniform = static_cast<float>(noise_state_ >> 8U) / 8388608.0F;
+        sample = NOISE_LEVEL * (uniform - 1.0F);
+      }
+      break;
+
+    case Source::SINE: {
+      auto step = 2.0 * std::numbers::pi * sine_hz_ / sample_rate_;
+
+      for (std::size_t i = 0; i < frames_; ++i) {
+        auto value = static_cast<float>(SINE_LEVEL * std::sin(sine_phase_));
+        std::fill_n(samples.begin() + static_cast<std::ptrdiff_t>(i * channels),
+                    channels, value);
+        sine_phase_ = std::fmod(sine_phase_ + step, 2.0 * std::numbers::pi);
+      }
+      break;
+    }
+
+    case Source::FILE: {
+      // Loop the file, taking channel c from file channel c modulo its
+      // channel count
+      auto file_channels = static_cast<std::size_t>(source_file_.channels());
+      std::size_t got = 0;
+      bool rewound = false;
+
+      while (got < frames_) {
+        auto read = source_file_.readf(
+            file_scratch_.data() + got * file_channels,
+            static_cast<sf_count_t>(frames_ - got));
+
+        if (read > 0) {
+          got += static_cast<std::size_t>(read);
+          rewound = false;
+          continue;
+        }
+
+        // Start over at the end, a file that gives nothing gives silence
+        if (rewound || (source_file_.seek(0, SEEK_SET) < 0)) {
+          break;
+        }
+        rewound = true;
+      }
+
+      std::fill(samples.begin(), samples.end(), 0.0F);
+
+      for (std::size_t i = 0; i < got; ++i) {
+        for (std::size_t c = 0; c < channels; ++c) {
+          samples[i * channels + c] =
+              file_scratch_[i * file_channels + c % file_channels];
+        }
+      }
+      break;
+    }
+
+    case Source::SILENCE:
+    default:
+      std::fill(samples.begin(), samples.end(), 0.0F);
+      break;
+  }
+
+  // Convert to the stream's sample type
+  visit_sample_type(format_, [&](auto sample_type) {
+    using SampleType = typename decltype(sample_type)::type;
+    auto *dst = reinterpret_cast<SampleType *>(input_.data());
+    auto out = std::span<SampleType>(dst, samples.size());
+
+    if constexpr (std::is_same_v<SampleType, short>) {
+      quantize<short, 16>(samples, out, nullptr);
+    } else if constexpr (std::is_same_v<SampleType, int>) {
+      quantize<int, 32>(samples, out, nullptr);
+    } else {
+      std::copy(samples.begin(), samples.end(), out.begin());
+    }
+  });
+}
+
+void VirtualAudioStream::write_output() {
+  if (out_channels_ == 0U) {
+    return;
+  }
+
+  if (sink_file_) {
+    visit_sample_type(format_, [&](auto sample_type) {
+      using SampleType = typename decltype(sample_type)::type;
+      sink_file_.writef(
+          reinterpret_cast<SampleType const *>(output_.data()),
+          static_cast<sf_count_t>(frames_));
+    });
+  }
+
+  if (source_ == Source::LOOPBACK) {
+    std::copy(output_.begin(), output_.end(),
+              loop_periods_[loop_index_].begin());
+    loop_index_ = (loop_index_ + 1U) % loop_periods_.size();
+  }
+}